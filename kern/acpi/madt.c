@@ -0,0 +1,126 @@
+#include <types.h>
+#include "madt.h"
+
+#include <acpi.h>
+
+static madt_info_t madt_info;
+static bool madt_parsed;
+static bool madt_found;
+
+/*
+ * Loads the ACPI tables if that hasn't happened yet. This is safe to do
+ * before the ACPICA subsystem is initialised, and lets us get at the MADT
+ * early in boot.
+ */
+static bool acpi_madt_load_tables(void) {
+	ACPI_STATUS status = AcpiInitializeTables(NULL, 16, FALSE);
+
+	if(ACPI_FAILURE(status) && status != AE_ALREADY_EXISTS) {
+		kprintf("madt: table manager initialisation failed (%i)\n", status);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Walks the MADT's subtables, and records processors, IO APICs and interrupt
+ * source overrides.
+ */
+static void acpi_madt_parse(ACPI_TABLE_MADT *madt) {
+	uint8_t *ptr = (uint8_t *) (madt + 1);
+	uint8_t *end = ((uint8_t *) madt) + madt->Header.Length;
+
+	madt_info.lapic_address = madt->Address;
+	madt_info.has_8259 = (madt->Flags & ACPI_MADT_PCAT_COMPAT);
+
+	while(ptr < end) {
+		ACPI_SUBTABLE_HEADER *header = (ACPI_SUBTABLE_HEADER *) ptr;
+
+		// Guard against a corrupt table sending us into an infinite loop
+		if(header->Length == 0) break;
+
+		switch(header->Type) {
+			case ACPI_MADT_TYPE_LOCAL_APIC: {
+				ACPI_MADT_LOCAL_APIC *lapic = (ACPI_MADT_LOCAL_APIC *) header;
+
+				if((lapic->LapicFlags & ACPI_MADT_ENABLED) && madt_info.num_cpus < MADT_MAX_CPUS) {
+					madt_cpu_t *cpu = &madt_info.cpus[madt_info.num_cpus++];
+					cpu->acpi_id = lapic->ProcessorId;
+					cpu->apic_id = lapic->Id;
+				}
+
+				break;
+			}
+
+			case ACPI_MADT_TYPE_IO_APIC: {
+				ACPI_MADT_IO_APIC *ioapic = (ACPI_MADT_IO_APIC *) header;
+
+				if(madt_info.num_ioapics < MADT_MAX_IOAPICS) {
+					madt_ioapic_t *info = &madt_info.ioapics[madt_info.num_ioapics++];
+					info->id = ioapic->Id;
+					info->address = ioapic->Address;
+					info->gsi_base = ioapic->GlobalIrqBase;
+				}
+
+				break;
+			}
+
+			case ACPI_MADT_TYPE_INTERRUPT_OVERRIDE: {
+				ACPI_MADT_INTERRUPT_OVERRIDE *override = (ACPI_MADT_INTERRUPT_OVERRIDE *) header;
+
+				if(madt_info.num_overrides < MADT_MAX_OVERRIDES) {
+					madt_override_t *info = &madt_info.overrides[madt_info.num_overrides++];
+					info->source_irq = override->SourceIrq;
+					info->gsi = override->GlobalIrq;
+					info->flags = override->IntiFlags;
+				}
+
+				break;
+			}
+
+			case ACPI_MADT_TYPE_LOCAL_APIC_OVERRIDE: {
+				ACPI_MADT_LOCAL_APIC_OVERRIDE *override = (ACPI_MADT_LOCAL_APIC_OVERRIDE *) header;
+
+				// We can't address the local APIC above 4G
+				if(!(override->Address >> 32)) {
+					madt_info.lapic_address = override->Address;
+				}
+
+				break;
+			}
+
+			default:
+				break;
+		}
+
+		ptr += header->Length;
+	}
+}
+
+/*
+ * Returns information from the MADT. The table is parsed on the first call.
+ */
+madt_info_t *acpi_madt_get(void) {
+	if(!madt_parsed) {
+		madt_parsed = true;
+
+		ACPI_TABLE_HEADER *table;
+
+		if(!acpi_madt_load_tables()) {
+			return NULL;
+		}
+
+		if(ACPI_FAILURE(AcpiGetTable(ACPI_SIG_MADT, 1, &table))) {
+			kprintf("madt: no MADT found\n");
+			return NULL;
+		}
+
+		acpi_madt_parse((ACPI_TABLE_MADT *) table);
+		madt_found = true;
+
+		kprintf("madt: %u CPUs, %u IO APICs, %u overrides\n", madt_info.num_cpus, madt_info.num_ioapics, madt_info.num_overrides);
+	}
+
+	return madt_found ? &madt_info : NULL;
+}
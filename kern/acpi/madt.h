@@ -0,0 +1,59 @@
+#ifndef ACPI_MADT_H
+#define ACPI_MADT_H
+
+#include <types.h>
+
+/*
+ * Interrupt controller topology from the ACPI MADT, in a form that can be
+ * used without pulling in the ACPICA headers.
+ */
+
+#define MADT_MAX_CPUS 16
+#define MADT_MAX_IOAPICS 4
+#define MADT_MAX_OVERRIDES 16
+
+// Polarity and trigger mode flags of interrupt source overrides
+#define MADT_POLARITY_MASK 0x03
+#define MADT_POLARITY_HIGH 0x01
+#define MADT_POLARITY_LOW 0x03
+#define MADT_TRIGGER_MASK 0x0C
+#define MADT_TRIGGER_EDGE 0x04
+#define MADT_TRIGGER_LEVEL 0x0C
+
+typedef struct madt_cpu {
+	uint8_t acpi_id;
+	uint8_t apic_id;
+} madt_cpu_t;
+
+typedef struct madt_ioapic {
+	uint8_t id;
+	uint32_t address;
+	uint32_t gsi_base;
+} madt_ioapic_t;
+
+typedef struct madt_override {
+	uint8_t source_irq;
+	uint32_t gsi;
+	uint16_t flags;
+} madt_override_t;
+
+typedef struct madt_info {
+	uint32_t lapic_address;
+	// Set if the system also has 8259 PICs that must be masked
+	bool has_8259;
+
+	// Only processors marked as enabled are listed
+	unsigned int num_cpus;
+	madt_cpu_t cpus[MADT_MAX_CPUS];
+
+	unsigned int num_ioapics;
+	madt_ioapic_t ioapics[MADT_MAX_IOAPICS];
+
+	unsigned int num_overrides;
+	madt_override_t overrides[MADT_MAX_OVERRIDES];
+} madt_info_t;
+
+// Returns the parsed MADT, or NULL if there is none
+madt_info_t *acpi_madt_get(void);
+
+#endif
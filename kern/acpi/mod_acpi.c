@@ -4,6 +4,9 @@
 #include "sys/sched.h"
 #include "sys/task.h"
 #include "sys/irq.h"
+#include "sys/clock.h"
+#include "sys/spinlock.h"
+#include "sys/sync.h"
 
 #include <acpi.h>
 
@@ -12,10 +15,30 @@ void console_putc(char c);
 extern char* printf_buffer;
 extern page_directory_t *kernel_directory;
 
+// Set once loading the namespace was attempted, and the result of that
+static bool acpi_namespace_tried;
+static int acpi_namespace_status;
+
+static int acpi_do_load_namespace(void);
+
 /*
- * Initialises ACPI.
+ * Initialises the ACPICA subsystem, and builds the namespace from the tables,
+ * unless that was tried before. This is enough to evaluate objects, such as
+ * _PRT, without enabling ACPI mode.
  */
-static int acpi_init(void) {
+int acpi_load_namespace(void) {
+	if(!acpi_namespace_tried) {
+		acpi_namespace_tried = true;
+		acpi_namespace_status = acpi_do_load_namespace();
+	}
+
+	return acpi_namespace_status;
+}
+
+/*
+ * The table manager may already have been set up to get at the MADT.
+ */
+static int acpi_do_load_namespace(void) {
 	ACPI_STATUS status;
 
 	// ACPICA subsystem
@@ -27,7 +50,7 @@ static int acpi_init(void) {
 
 	// ACPICA table manager and get all tables
 	status = AcpiInitializeTables(NULL, 16, FALSE);
-	if (ACPI_FAILURE(status)) {
+	if (ACPI_FAILURE(status) && status != AE_ALREADY_EXISTS) {
 		kprintf("Table manager initialisation failed (%i)\n", status);
 		return status;
 	}
@@ -39,6 +62,20 @@ static int acpi_init(void) {
 		return status;
 	}
 
+	return 0;
+}
+
+/*
+ * Initialises ACPI.
+ */
+static int acpi_init(void) {
+	ACPI_STATUS status;
+
+	status = acpi_load_namespace();
+	if (status) {
+		return status;
+	}
+
 	// If we had local handlers, we would install them here.
 
 	// Initialise the ACPI subsystem
@@ -217,7 +254,11 @@ void AcpiOsSleep(UINT64 Milliseconds) {
  * until either the time expires or the OS pre-empts it.
  */
 void AcpiOsStall(UINT32 Microseconds) {
+	uint64_t end = ktime_get_ns() + ((uint64_t) Microseconds * NSEC_PER_USEC);
 
+	while(ktime_get_ns() < end) {
+		__asm__ volatile("pause");
+	}
 }
 
 /*
@@ -232,6 +273,19 @@ void AcpiOsWaitEventsComplete(void) {
  * whose address is put into OutHandle. MaxUnits is ignored.
  */
 ACPI_STATUS AcpiOsCreateSemaphore(UINT32 MaxUnits, UINT32 InitialUnits, ACPI_SEMAPHORE *OutHandle) {
+	if(!OutHandle) {
+		return AE_BAD_PARAMETER;
+	}
+
+	semaphore_t *sem = (semaphore_t *) kmalloc(sizeof(semaphore_t));
+
+	if(!sem) {
+		return AE_NO_MEMORY;
+	}
+
+	semaphore_init(sem, InitialUnits);
+	*OutHandle = sem;
+
 	return AE_OK;
 }
 
@@ -239,6 +293,11 @@ ACPI_STATUS AcpiOsCreateSemaphore(UINT32 MaxUnits, UINT32 InitialUnits, ACPI_SEM
  * Deletes a previously created semaphore.
  */
 ACPI_STATUS AcpiOsDeleteSemaphore(ACPI_SEMAPHORE Handle) {
+	if(!Handle) {
+		return AE_BAD_PARAMETER;
+	}
+
+	kfree(Handle);
 	return AE_OK;
 }
 
@@ -247,13 +306,31 @@ ACPI_STATUS AcpiOsDeleteSemaphore(ACPI_SEMAPHORE Handle) {
  * AcpiOsAcquireMutex.
  */
 ACPI_STATUS AcpiOsWaitSemaphore(ACPI_SEMAPHORE Handle, UINT32 Units, UINT16 Timeout) {
-	return AE_OK;
+	semaphore_t *sem = Handle;
+
+	if(!sem) {
+		return AE_BAD_PARAMETER;
+	}
+
+	if(Timeout == ACPI_WAIT_FOREVER) {
+		semaphore_down(sem, Units);
+		return AE_OK;
+	} else if(Timeout == 0) {
+		return semaphore_trydown(sem, Units) ? AE_OK : AE_TIME;
+	}
+
+	return semaphore_down_timeout(sem, Units, (uint64_t) Timeout * NSEC_PER_MSEC) ? AE_OK : AE_TIME;
 }
 
 /*
  * Signals Units number of units on the specified semaphore.
  */
 ACPI_STATUS AcpiOsSignalSemaphore(ACPI_SEMAPHORE Handle, UINT32 Units) {
+	if(!Handle) {
+		return AE_BAD_PARAMETER;
+	}
+
+	semaphore_up(Handle, Units);
 	return AE_OK;
 }
 
@@ -262,6 +339,19 @@ ACPI_STATUS AcpiOsSignalSemaphore(ACPI_SEMAPHORE Handle, UINT32 Units) {
  * spinlock disables scheduling and interrupts on the current CPU.
  */
 ACPI_STATUS AcpiOsCreateLock(ACPI_SPINLOCK *OutHandle) {
+	if(!OutHandle) {
+		return AE_BAD_PARAMETER;
+	}
+
+	spinlock_t *lock = (spinlock_t *) kmalloc(sizeof(spinlock_t));
+
+	if(!lock) {
+		return AE_NO_MEMORY;
+	}
+
+	spin_lock_init(lock);
+	*OutHandle = lock;
+
 	return AE_OK;
 }
 
@@ -269,7 +359,7 @@ ACPI_STATUS AcpiOsCreateLock(ACPI_SPINLOCK *OutHandle) {
  * Deletes a spinlock.
  */
 void AcpiOsDeleteLock(ACPI_HANDLE Handle) {
-
+	kfree(Handle);
 }
 
 /*
@@ -277,14 +367,14 @@ void AcpiOsDeleteLock(ACPI_HANDLE Handle) {
  * machine state in AcpiOsReleaseLock.
  */
 ACPI_CPU_FLAGS AcpiOsAcquireLock(ACPI_SPINLOCK Handle) {
-	return -1;
+	return spin_lock_irqsave(Handle);
 }
 
 /*
  * Releases a spinlock. Flags is the value returned by AcpiOsAcquireLock.
  */
 void AcpiOsReleaseLock(ACPI_SPINLOCK Handle, ACPI_CPU_FLAGS Flags) {
-	
+	spin_unlock_irqrestore(Handle, Flags);
 }
 
 /*
@@ -293,6 +383,7 @@ void AcpiOsReleaseLock(ACPI_SPINLOCK Handle, ACPI_CPU_FLAGS Flags) {
  */
 ACPI_STATUS AcpiOsInstallInterruptHandler(UINT32 InterruptLevel, ACPI_OSD_HANDLER Handler, void *Context) {
 	kprintf("ACPI: Register IRQ handler for level %i at 0x%X\n", InterruptLevel, Handler);
+	// ACPI_INTERRUPT_HANDLED and _NOT_HANDLED are IRQ_HANDLED and IRQ_NONE
 	irq_register(InterruptLevel, (irq_t) Handler, Context);
 
 	return AE_OK;
@@ -475,7 +566,7 @@ ACPI_STATUS AcpiOsWritePciConfiguration(ACPI_PCI_ID *PciId, UINT32 Reg, UINT64 V
  * Returns the current system timer, in 100ns granularity.
  */
 UINT64 AcpiOsGetTimer(void) {
-	return 0;
+	return mstd_div_u64(ktime_get_ns(), 100, NULL);
 }
 
 /*
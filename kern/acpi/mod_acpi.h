@@ -3,4 +3,7 @@
 
 #include <types.h>
 
+// Builds the ACPI namespace, if needed; returns 0, or an ACPICA status
+int acpi_load_namespace(void);
+
 #endif
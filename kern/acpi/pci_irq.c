@@ -0,0 +1,162 @@
+#include <types.h>
+#include "pci_irq.h"
+#include "madt.h"
+#include "mod_acpi.h"
+
+#include <acpi.h>
+
+static bool pci_irq_loaded;
+
+// Root bridge, and its routing table; NULL if either wasn't found
+static ACPI_HANDLE pci_irq_bridge;
+static ACPI_BUFFER pci_irq_prt;
+
+/*
+ * Device walk callback: records the first root bridge found.
+ */
+static ACPI_STATUS acpi_pci_find_bridge(ACPI_HANDLE object, UINT32 level, void *context, void **ret) {
+	*((ACPI_HANDLE *) context) = object;
+	return AE_CTRL_TERMINATE;
+}
+
+/*
+ * Tells the firmware that interrupts are routed through the I/O APIC, which
+ * may change what _PRT returns, and gets the routing table of the root
+ * bridge.
+ */
+static void acpi_pci_load_prt(void) {
+	if(acpi_load_namespace()) {
+		return;
+	}
+
+	ACPI_OBJECT arg;
+	arg.Integer.Type = ACPI_TYPE_INTEGER;
+	arg.Integer.Value = 1;
+
+	ACPI_OBJECT_LIST args = {
+		.Count = 1,
+		.Pointer = &arg
+	};
+
+	ACPI_STATUS status = AcpiEvaluateObject(NULL, "\\_PIC", &args, NULL);
+
+	if(ACPI_FAILURE(status) && status != AE_NOT_FOUND) {
+		kprintf("acpi: _PIC failed (%i)\n", status);
+	}
+
+	AcpiGetDevices("PNP0A03", acpi_pci_find_bridge, &pci_irq_bridge, NULL);
+
+	if(!pci_irq_bridge) {
+		kprintf("acpi: no PCI root bridge found\n");
+		return;
+	}
+
+	pci_irq_prt.Length = ACPI_ALLOCATE_BUFFER;
+	pci_irq_prt.Pointer = NULL;
+
+	status = AcpiGetIrqRoutingTable(pci_irq_bridge, &pci_irq_prt);
+
+	if(ACPI_FAILURE(status)) {
+		kprintf("acpi: no _PRT on the PCI root bridge (%i)\n", status);
+		pci_irq_prt.Pointer = NULL;
+	}
+}
+
+/*
+ * Converts ACPI resource triggering and polarity to MADT flags.
+ */
+static uint16_t acpi_pci_irq_flags(uint8_t triggering, uint8_t polarity) {
+	uint16_t flags = (triggering == ACPI_LEVEL_SENSITIVE) ? MADT_TRIGGER_LEVEL : MADT_TRIGGER_EDGE;
+	flags |= (polarity == ACPI_ACTIVE_LOW) ? MADT_POLARITY_LOW : MADT_POLARITY_HIGH;
+
+	return flags;
+}
+
+/*
+ * Gets the interrupt an interrupt link device is currently set to, from its
+ * _CRS.
+ */
+static bool acpi_pci_link_irq(char *source, uint32_t *gsi, uint16_t *flags) {
+	ACPI_HANDLE link;
+
+	if(ACPI_FAILURE(AcpiGetHandle(pci_irq_bridge, source, &link))) {
+		return false;
+	}
+
+	ACPI_BUFFER buffer = {
+		.Length = ACPI_ALLOCATE_BUFFER,
+		.Pointer = NULL
+	};
+
+	if(ACPI_FAILURE(AcpiGetCurrentResources(link, &buffer))) {
+		return false;
+	}
+
+	ACPI_RESOURCE *res = buffer.Pointer;
+	bool found = false;
+
+	while(res->Type != ACPI_RESOURCE_TYPE_END_TAG && res->Length) {
+		if(res->Type == ACPI_RESOURCE_TYPE_IRQ && res->Data.Irq.InterruptCount) {
+			*gsi = res->Data.Irq.Interrupts[0];
+			*flags = acpi_pci_irq_flags(res->Data.Irq.Triggering, res->Data.Irq.Polarity);
+
+			found = true;
+			break;
+		} else if(res->Type == ACPI_RESOURCE_TYPE_EXTENDED_IRQ && res->Data.ExtendedIrq.InterruptCount) {
+			*gsi = res->Data.ExtendedIrq.Interrupts[0];
+			*flags = acpi_pci_irq_flags(res->Data.ExtendedIrq.Triggering, res->Data.ExtendedIrq.Polarity);
+
+			found = true;
+			break;
+		}
+
+		res = ACPI_NEXT_RESOURCE(res);
+	}
+
+	AcpiOsFree(buffer.Pointer);
+
+	return found;
+}
+
+/*
+ * Looks up the routing of a device's interrupt pin in the root bridge's _PRT,
+ * which is loaded on the first call. Entries either name a GSI, which is
+ * active low and level triggered like all PCI interrupts, or an interrupt
+ * link device that it's taken from.
+ */
+bool acpi_pci_route_irq(uint8_t device, uint8_t pin, uint32_t *gsi, uint16_t *flags) {
+	if(!pci_irq_loaded) {
+		pci_irq_loaded = true;
+		acpi_pci_load_prt();
+	}
+
+	if(!pci_irq_prt.Pointer || pin < 1 || pin > 4) {
+		return false;
+	}
+
+	uint8_t *ptr = pci_irq_prt.Pointer;
+
+	while(1) {
+		ACPI_PCI_ROUTING_TABLE *entry = (ACPI_PCI_ROUTING_TABLE *) ptr;
+
+		if(!entry->Length) {
+			break;
+		}
+
+		// The device is in the high word of the address; pins count from 0
+		if((((uint32_t) entry->Address) >> 16) == device && entry->Pin == (uint32_t) (pin - 1)) {
+			if(!entry->Source[0]) {
+				*gsi = entry->SourceIndex;
+				*flags = MADT_POLARITY_LOW | MADT_TRIGGER_LEVEL;
+
+				return true;
+			}
+
+			return acpi_pci_link_irq(entry->Source, gsi, flags);
+		}
+
+		ptr += entry->Length;
+	}
+
+	return false;
+}
@@ -0,0 +1,16 @@
+#ifndef ACPI_PCI_IRQ_H
+#define ACPI_PCI_IRQ_H
+
+#include <types.h>
+
+/*
+ * PCI interrupt routing from the _PRT of the PCI root bridge, in a form that
+ * can be used without pulling in the ACPICA headers. The firmware is told
+ * interrupts go through the I/O APIC, so this must only be used if they do.
+ */
+
+// Finds the GSI pin (1-4 for INTA#-INTD#) of a device on the root bus is
+// routed to, and its polarity and trigger mode (MADT_POLARITY_*, _TRIGGER_*)
+bool acpi_pci_route_irq(uint8_t device, uint8_t pin, uint32_t *gsi, uint16_t *flags);
+
+#endif
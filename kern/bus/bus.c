@@ -108,24 +108,30 @@ bus_t *bus_get_by_name(char *name) {
 
 /*
  * Enumerates all drivers registered for the specified bus to find one that can
- * support the device.
+ * support the device. Drivers are never unregistered, so the one returned
+ * stays valid after the read section.
  */
 driver_t *bus_find_driver(device_t *device, bus_t *bus) {
-	driver_t *driver;
+	driver_t *found = NULL;
 
 //	kprintf("finding driver on bus 0x%X device 0x%X\n", bus, device);
 
 	// Loop through all drivers for the bus
-	for(int i = 0; i < bus->drivers->num_entries; i++) {
-		driver = list_get(bus->drivers, i);
+	rcu_read_lock();
+
+	list_for_each_rcu(entry, bus->drivers) {
+		driver_t *driver = (driver_t *) entry->data;
 
 		if(bus->match(device, driver)) {
-			return driver;
+			found = driver;
+			break;
 		}
 	}
 
-	// We haven't found a driver that supports it.
-	return NULL;
+	rcu_read_unlock();
+
+	// NULL if we haven't found a driver that supports it
+	return found;
 }
 
 /*
@@ -3,6 +3,10 @@
 #include "bus.h"
 #include "pci.h"
 #include "pci_tables.h"
+#include "sys/irq.h"
+#include "device/ioapic.h"
+#include "acpi/madt.h"
+#include "acpi/pci_irq.h"
 
 #include <acpi.h>
 
@@ -16,7 +20,7 @@ static void pci_set_function_info(uint8_t bus, uint8_t device, uint8_t function,
 static void pci_probe_bus(pci_bus_t *bus);
 static void pci_enumerate_busses(void);
 
-static void pci_initialise_irq(uint8_t bus);
+static void pci_initialise_irq(pci_bus_t *bus, uint8_t bus_number);
 
 static pci_str_vendor_t* pci_info_get_vendor(uint16_t vendor);
 static pci_str_device_t* pci_info_get_device(uint16_t vendor, uint16_t device);
@@ -217,6 +221,7 @@ static void pci_probe_bus(pci_bus_t *bus) {
 
 		if(vendor_id != 0xFFFF) { // Does the device exist?
 			pci_device_t *device = (pci_device_t *) kmalloc(sizeof(pci_device_t));
+			memclr(device, sizeof(pci_device_t));
 
 			device->ident.vendor = vendor_id;
 			device->ident.device = device_id;
@@ -256,6 +261,7 @@ static void pci_probe_bus(pci_bus_t *bus) {
 			}
 
 			// Add "device" to the bus' node.children, and set the bus' node.parent.
+			// Readers walk the list under RCU, so it must be complete by now.
 			device->d.node.name = "PCI Device";
 			device->d.node.parent = &bus->d.node;
 
@@ -264,7 +270,7 @@ static void pci_probe_bus(pci_bus_t *bus) {
 	}	
 
 	// Set up IRQs for this bus
-	pci_initialise_irq(bus_number);
+	pci_initialise_irq(bus, bus_number);
 }
 
 /*
@@ -335,10 +341,67 @@ static void pci_enumerate_busses(void) {
 }
 
 /*
- * Initialises IRQ routing
+ * Returns the IRQ an interrupt pin of a device is routed to, or -1. With an
+ * I/O APIC, devices on the root bus are looked up in the ACPI _PRT, and their
+ * line gets the polarity and trigger mode it says. Otherwise, or if that
+ * fails, the interrupt line register the firmware set up for the 8259s is
+ * used; under an I/O APIC, that line is active low and level triggered,
+ * unless the MADT overrides it.
  */
-static void pci_initialise_irq(uint8_t bus) {
+static int pci_route_irq(uint8_t bus, uint8_t device, uint8_t pin, uint8_t line) {
+	if(ioapic_available()) {
+		uint32_t gsi;
+		uint16_t flags;
 
+		if(bus == 0 && acpi_pci_route_irq(device, pin, &gsi, &flags)) {
+			int irq = ioapic_gsi_to_irq(gsi);
+
+			if(irq >= 0) {
+				ioapic_set_flags(irq, flags);
+				return irq;
+			}
+
+			kprintf("pci: %u:%u INT%c# routed to unusable GSI %u\n", bus, device, 'A' + pin - 1, gsi);
+		}
+
+		if(line < 16 && !ioapic_irq_overridden(line)) {
+			ioapic_set_flags(line, MADT_POLARITY_LOW | MADT_TRIGGER_LEVEL);
+		}
+	}
+
+	// 0xFF means the pin isn't connected
+	return (line < MAX_IRQ) ? line : -1;
+}
+
+/*
+ * Reads the interrupt pins of the functions of every device on a bus, and
+ * finds the IRQs they're routed to. Drivers then register handlers for those.
+ */
+static void pci_initialise_irq(pci_bus_t *bus, uint8_t bus_number) {
+	rcu_read_lock();
+
+	list_for_each_rcu(entry, bus->d.node.children) {
+		pci_device_t *device = (pci_device_t *) entry->data;
+		int functions = device->multifunction ? 7 : 1;
+
+		for(int f = 0; f < functions; f++) {
+			pci_function_t *function = &device->function[f];
+			function->irq = -1;
+
+			if(function->ident.vendor == 0xFFFF) {
+				continue;
+			}
+
+			uint32_t temp = pci_config_read(bus_number, device->location.device, f, 0x3C);
+			function->irq_pin = (temp >> 0x08) & 0xFF;
+
+			if(function->irq_pin >= 1 && function->irq_pin <= 4) {
+				function->irq = pci_route_irq(bus_number, device->location.device, function->irq_pin, temp & 0xFF);
+			}
+		}
+	}
+
+	rcu_read_unlock();
 }
 
 /*
@@ -373,18 +436,23 @@ static pci_str_device_t* pci_info_get_device(uint16_t vendor, uint16_t device) {
 static void pci_print_tree(void) {
 	kprintf("==================== PCI Bus Device Listing ====================\n");
 
+	rcu_read_lock();
+
 	// Check all possible busses
-	for(int i = 0; i < pci_bus.node.children->num_entries; i++) {
-		pci_bus_t *bus = (pci_bus_t *) list_get(pci_bus.node.children, i);
+	list_for_each_rcu(bus_entry, pci_bus.node.children) {
+		pci_bus_t *bus = (pci_bus_t *) bus_entry->data;
 
 		// Is bus defined?
 		if(bus) {
 			kprintf("Bus %u:\n", bus->bus_number);
 
 			// Search through all devices
-			for(int d = 0; d < bus->d.node.children->num_entries; d++) {
+			int d = -1;
+
+			list_for_each_rcu(entry, bus->d.node.children) {
 				// Process multifunction device
-				pci_device_t *device = (pci_device_t *) list_get(bus->d.node.children, d);
+				pci_device_t *device = (pci_device_t *) entry->data;
+				d++;
 
 				if(device) {
 					if(device->ident.vendor != 0xFFFF) {
@@ -422,6 +490,8 @@ static void pci_print_tree(void) {
 		}
 	}
 
+	rcu_read_unlock();
+
 	kprintf("\n");
 }
 
@@ -442,16 +512,18 @@ static bool pci_match(device_t* dev, driver_t* driver) {
  * for them.
  */
 static int pci_load_drivers(void) {
+	rcu_read_lock();
+
 	// Check all possible busses
-	for(int i = 0; i < pci_bus.node.children->num_entries; i++) {
-		pci_bus_t *bus = (pci_bus_t *) list_get(pci_bus.node.children, i);
+	list_for_each_rcu(bus_entry, pci_bus.node.children) {
+		pci_bus_t *bus = (pci_bus_t *) bus_entry->data;
 
 		// Is bus defined?
 		if(bus) {
 			// Search through all devices
-			for(int d = 0; d < bus->d.node.children->num_entries; d++) {
+			list_for_each_rcu(entry, bus->d.node.children) {
 				// Process multifunction device
-				pci_device_t *device = (pci_device_t *) list_get(bus->d.node.children, d);
+				pci_device_t *device = (pci_device_t *) entry->data;
 
 				if(device) {
 					if(device->ident.vendor != 0xFFFF) {
@@ -465,6 +537,8 @@ static int pci_load_drivers(void) {
 		}
 	}
 
+	rcu_read_unlock();
+
 	return 0;
 }
 
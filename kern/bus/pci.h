@@ -38,6 +38,11 @@ typedef struct {
 
 	uint32_t class;
 	pci_bar_t bar[6];
+
+	// Interrupt pin (1-4 for INTA#-INTD#, 0 for none), and the IRQ it's routed
+	// to, or -1 if it isn't
+	uint8_t irq_pin;
+	int irq;
 } pci_function_t;
 
 typedef struct {
@@ -1,17 +1,74 @@
 #include <types.h>
 #include "apic.h"
+#include "ioapic.h"
 #include "sys/cpuid.h"
+#include "sys/system.h"
+#include "sys/paging.h"
+#include "sys/clock.h"
+#include "sys/timer.h"
+#include "sys/sched.h"
+#include "sys/irq.h"
 #include "modules/module.h"
 
+extern page_directory_t *kernel_directory;
+
+// Assembly wrappers for the timer, reschedule and TLB shootdown interrupts
+extern void apic_timer_irq(void);
+extern void apic_resched_irq(void);
+extern void apic_tlb_irq(void);
+
+// Virtual address the local APIC's registers are mapped at
+static volatile uint32_t *apic_base;
+
+// Timer frequency (after the divider) in kHz
+static uint32_t apic_timer_khz;
+
+void apic_timer_handler(void);
+void apic_resched_handler(void);
+void apic_tlb_handler(void);
+
+/*
+ * Reads and writes local APIC registers.
+ */
+static inline uint32_t apic_read(uint32_t reg) {
+	return apic_base[reg >> 2];
+}
+
+static inline void apic_write(uint32_t reg, uint32_t value) {
+	apic_base[reg >> 2] = value;
+}
+
 /*
  * Returns true if the CPU supports the APIC.
  */
-static bool apic_supported() {
+bool apic_supported(void) {
 	uint32_t eax, ebx, ecx, edx;
 	cpuid(1, eax, ebx, ecx, edx);
 	return edx & CPUID_FEAT_EDX_APIC;
 }
 
+/*
+ * Measures the frequency of the APIC timer against the system clock.
+ */
+static uint32_t apic_timer_calibrate(void) {
+	apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIV_16);
+	apic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+
+	uint64_t start = ktime_get_ns();
+	apic_write(APIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+
+	while(ktime_get_ns() - start < APIC_CALIBRATE_NS) {
+		__asm__ volatile("pause");
+	}
+
+	uint32_t elapsed = 0xFFFFFFFF - apic_read(APIC_REG_TIMER_CURRENT);
+	uint64_t ns = ktime_get_ns() - start;
+
+	apic_write(APIC_REG_TIMER_INITIAL, 0);
+
+	return (uint32_t) mstd_div_u64((uint64_t) elapsed * NSEC_PER_MSEC, (uint32_t) ns, NULL);
+}
+
 /*
  * Module initialisation/exit functions.
  */
@@ -21,11 +78,163 @@ static int apic_init(void) {
 		return -1;
 	}
 
-	// Initialise APIC timer and IRQ routing based on ACPI
+	// Find and map the local APIC
+	uint32_t lo, hi;
+	sys_read_MSR(APIC_MSR_BASE, &lo, &hi);
+	sys_write_MSR(APIC_MSR_BASE, lo | APIC_MSR_BASE_ENABLE, hi);
 
-	// Override IRQ handler hooks, disable PIT
+	apic_base = (volatile uint32_t *) paging_map_section(lo & 0xFFFFF000, 0x1000, kernel_directory, kMemorySectionHardware);
+	ASSERT(apic_base != NULL);
+	paging_flush_tlb((uint32_t) apic_base);
+
+	// Enable the APIC with its spurious vector, and accept all priorities
+	sys_set_idt_gate(APIC_TIMER_VECTOR, (uint32_t) apic_timer_irq, 0x08, 0x8E);
+	sys_set_idt_gate(APIC_RESCHED_VECTOR, (uint32_t) apic_resched_irq, 0x08, 0x8E);
+	sys_set_idt_gate(APIC_TLB_VECTOR, (uint32_t) apic_tlb_irq, 0x08, 0x8E);
+	apic_write(APIC_REG_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+	apic_write(APIC_REG_TPR, 0);
+
+	/*
+	 * PCI interrupts were routed assuming the I/O APICs get used whenever
+	 * they're there, so they must be enabled before anything can fail. The
+	 * 8259s' output reaches us through LINT0, which isn't needed anymore.
+	 */
+	if(ioapic_enable()) {
+		apic_write(APIC_REG_LVT_LINT0, APIC_LVT_MASKED);
+	}
+
+	// Initialise APIC timer; all processors' timers run at the same rate
+	apic_timer_khz = apic_timer_calibrate();
+
+	if(apic_timer_khz == 0) {
+		kprintf("apic: timer calibration failed\n");
+		return -1;
+	}
+
+	kprintf("apic: local APIC %u, timer at %u kHz\n", apic_get_id(), apic_timer_khz);
+
+	// One-shot mode, unmasked
+	apic_write(APIC_REG_LVT_TIMER, APIC_TIMER_VECTOR);
+
+	timer_register_oneshot(apic_timer_oneshot);
+
+	/*
+	 * The PIT clock needs the periodic tick to keep time, so it can only be
+	 * switched off if the TSC is used.
+	 */
+	if(clock_get_source()->is_tsc) {
+		irq_disable(0);
+	} else {
+		kprintf("apic: keeping periodic PIT tick for the PIT clocksource\n");
+	}
+
+	// Kick off the first timer interrupt
+	apic_timer_oneshot(APIC_TIMER_MIN_NS);
 
 	return 0;
 }
 
-module_init(apic_init);
\ No newline at end of file
+module_init(apic_init);
+
+/*
+ * Enables the local APIC of an application processor, using the bootstrap
+ * processor's mapping and timer calibration.
+ */
+void apic_init_ap(void) {
+	uint32_t lo, hi;
+	sys_read_MSR(APIC_MSR_BASE, &lo, &hi);
+	sys_write_MSR(APIC_MSR_BASE, lo | APIC_MSR_BASE_ENABLE, hi);
+
+	apic_write(APIC_REG_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+	apic_write(APIC_REG_TPR, 0);
+
+	apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIV_16);
+	apic_write(APIC_REG_LVT_TIMER, APIC_TIMER_VECTOR);
+}
+
+/*
+ * Sends an inter-processor interrupt to the local APIC with the given ID, and
+ * waits for it to be accepted.
+ */
+void apic_send_ipi(uint8_t apic_id, uint32_t command) {
+	apic_write(APIC_REG_ICR_HIGH, ((uint32_t) apic_id) << 24);
+	apic_write(APIC_REG_ICR_LOW, command);
+
+	while(apic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) {
+		__asm__ volatile("pause");
+	}
+}
+
+/*
+ * Returns true if the local APIC has been initialised.
+ */
+bool apic_available(void) {
+	return (apic_base != NULL);
+}
+
+/*
+ * Returns the ID of the current processor's local APIC.
+ */
+uint8_t apic_get_id(void) {
+	return apic_read(APIC_REG_ID) >> 24;
+}
+
+/*
+ * Signals the end of an interrupt to the local APIC.
+ */
+void apic_eoi(void) {
+	apic_write(APIC_REG_EOI, 0);
+}
+
+/*
+ * Programs the timer to fire once, ns nanoseconds from now.
+ */
+void apic_timer_oneshot(uint64_t ns) {
+	if(ns < APIC_TIMER_MIN_NS) {
+		ns = APIC_TIMER_MIN_NS;
+	}
+
+	uint64_t count = mstd_div_u64(ns * apic_timer_khz, NSEC_PER_MSEC, NULL);
+
+	if(count > 0xFFFFFFFF) {
+		count = 0xFFFFFFFF;
+	} else if(count == 0) {
+		count = 1;
+	}
+
+	apic_write(APIC_REG_TIMER_INITIAL, (uint32_t) count);
+}
+
+/*
+ * Timer interrupt handler, called by the assembly wrapper.
+ */
+void apic_timer_handler(void) {
+	irq_enter();
+	sched_timer_interrupt();
+	apic_eoi();
+
+	irq_exit();
+}
+
+/*
+ * Reschedule IPI handler: another processor queued work for this one, and set
+ * need_resched, which the IRQ wrapper checks on the way out.
+ */
+void apic_resched_handler(void) {
+	irq_enter();
+	apic_eoi();
+
+	irq_exit();
+}
+
+/*
+ * TLB shootdown IPI handler: another processor changed page table entries,
+ * and waits for this one to flush them.
+ */
+void apic_tlb_handler(void) {
+	irq_enter();
+	paging_shootdown_interrupt();
+	apic_eoi();
+
+	irq_exit();
+}
@@ -8,4 +8,56 @@
 
 #include <types.h>
 
-#endif
\ No newline at end of file
+#define APIC_MSR_BASE			0x1B
+#define APIC_MSR_BASE_ENABLE	(1 << 11)
+
+// Local APIC registers (offsets into the MMIO window)
+#define APIC_REG_ID				0x020
+#define APIC_REG_VERSION		0x030
+#define APIC_REG_TPR			0x080
+#define APIC_REG_EOI			0x0B0
+#define APIC_REG_SVR			0x0F0
+#define APIC_REG_ESR			0x280
+#define APIC_REG_ICR_LOW		0x300
+#define APIC_REG_ICR_HIGH		0x310
+#define APIC_REG_LVT_TIMER		0x320
+#define APIC_REG_LVT_LINT0		0x350
+#define APIC_REG_LVT_LINT1		0x360
+#define APIC_REG_LVT_ERROR		0x370
+#define APIC_REG_TIMER_INITIAL	0x380
+#define APIC_REG_TIMER_CURRENT	0x390
+#define APIC_REG_TIMER_DIV		0x3E0
+
+#define APIC_SVR_ENABLE			(1 << 8)
+#define APIC_LVT_MASKED			(1 << 16)
+#define APIC_TIMER_DIV_16		0x03
+
+// Interrupt command register fields
+#define APIC_ICR_INIT			0x00000500
+#define APIC_ICR_STARTUP		0x00000600
+#define APIC_ICR_PENDING		(1 << 12)
+#define APIC_ICR_ASSERT			(1 << 14)
+#define APIC_ICR_LEVEL			(1 << 15)
+
+// Interrupt vectors used by the local APIC
+#define APIC_TIMER_VECTOR		0x40
+#define APIC_RESCHED_VECTOR		0x41
+#define APIC_TLB_VECTOR			0x42
+#define APIC_SPURIOUS_VECTOR	0xFF
+
+// Length of the timer calibration window
+#define APIC_CALIBRATE_NS		10000000
+
+// Minimum interval the one-shot timer is programmed for
+#define APIC_TIMER_MIN_NS		2000
+
+bool apic_supported(void);
+bool apic_available(void);
+uint8_t apic_get_id(void);
+void apic_eoi(void);
+void apic_init_ap(void);
+void apic_send_ipi(uint8_t apic_id, uint32_t command);
+
+void apic_timer_oneshot(uint64_t ns);
+
+#endif
@@ -81,6 +81,11 @@ static int ata_drivers_loaded = 0;
 #define ATA_REG_CONTROL			0x0C
 #define ATA_REG_ALTSTATUS		0x0C
 #define ATA_REG_DEVADDRESS		0x0D
+#define ATA_REG_BMCOMMAND		0x0E
+#define ATA_REG_BMSTATUS		0x10
+
+// Bus master status: interrupt pending; cleared by writing a 1
+#define ATA_BMSR_IRQ			0x04
 
 // Private functions
 static uint8_t ata_reg_read(ata_driver_t *drv, uint8_t channel, uint8_t reg);
@@ -494,8 +499,8 @@ static int ata_post_driver_load(void) {
 		}
 
 		// Register IRQs 14 and 15 since parallel ATA
-		irq_register(14, (void (*)(void *)) ata_irq_callback, ata);
-		irq_register(15, (void (*)(void *)) ata_irq_callback, ata);
+		irq_register(14, (irq_t) ata_irq_callback, ata);
+		irq_register(15, (irq_t) ata_irq_callback, ata);
 	}
 
 	return 0;
@@ -713,8 +718,32 @@ static int ata_access_pio(ata_driver_t *drv, uint8_t rw, uint8_t drive, uint32_t
 
 // !Interrupt support
 /*
- * Called from the interrupt handler of an IDE driver to 
+ * Called from the interrupt handler of an IDE driver to acknowledge the
+ * interrupt of whichever channel raised it. With bus mastering, a channel's
+ * bus master status says whether it did; otherwise, a channel with interrupts
+ * enabled is assumed to have. Returns IRQ_NONE if no channel claims it.
  */
-void ata_irq_callback(ata_driver_t *drv) {
+int ata_irq_callback(ata_driver_t *drv) {
+	int ret = IRQ_NONE;
+
+	for(uint8_t channel = 0; channel < 2; channel++) {
+		if(drv->BAR4 & 0xFFFFFFFC) {
+			uint8_t bm_status = ata_reg_read(drv, channel, ATA_REG_BMSTATUS);
+
+			if(!(bm_status & ATA_BMSR_IRQ)) {
+				continue;
+			}
+
+			// Writing the status back keeps the DMA capable bits
+			ata_reg_write(drv, channel, ATA_REG_BMSTATUS, bm_status);
+		} else if(drv->channels[channel].nIEN) {
+			continue;
+		}
+
+		// Reading the status register deasserts the device's interrupt
+		ata_reg_read(drv, channel, ATA_REG_STATUS);
+		ret = IRQ_HANDLED;
+	}
 
+	return ret;
 }
\ No newline at end of file
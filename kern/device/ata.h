@@ -141,6 +141,6 @@ void ata_deinit(ata_driver_t *driver);
 int ata_read(ata_driver_t *drv, uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer);
 int ata_write(ata_driver_t *drv, uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer);
 
-void ata_irq_callback(ata_driver_t *drv);
+int ata_irq_callback(ata_driver_t *drv);
 
 #endif
\ No newline at end of file
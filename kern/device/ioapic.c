@@ -0,0 +1,297 @@
+#include <types.h>
+#include "ioapic.h"
+#include "apic.h"
+#include "pic.h"
+#include "acpi/madt.h"
+#include "sys/system.h"
+#include "sys/paging.h"
+#include "sys/spinlock.h"
+#include "sys/irq.h"
+#include "modules/module.h"
+
+extern page_directory_t *kernel_directory;
+
+typedef struct ioapic {
+	volatile uint32_t *base;
+
+	// First GSI, and the number of redirection entries
+	uint32_t gsi_base;
+	unsigned int entries;
+} ioapic_t;
+
+static ioapic_t ioapics[MADT_MAX_IOAPICS];
+static unsigned int ioapic_count;
+
+static madt_info_t *ioapic_madt;
+
+// Polarity and trigger mode bits of each line's redirection entry
+static uint32_t ioapic_line_flags[MAX_IRQ];
+
+// Local APIC ID of the processor interrupts are delivered to
+static uint8_t ioapic_dest;
+
+// Serialises accesses through the register windows
+static spinlock_t ioapic_lock = SPINLOCK_INIT;
+
+static void ioapic_mask(uint8_t irq);
+static void ioapic_unmask(uint8_t irq);
+static void ioapic_eoi(uint8_t irq);
+
+static const irq_chip_t ioapic_chip = {
+	.name = "I/O APIC",
+	.lines = MAX_IRQ,
+
+	.mask = ioapic_mask,
+	.unmask = ioapic_unmask,
+	.eoi = ioapic_eoi
+};
+
+/*
+ * Reads and writes registers of an I/O APIC. The lock must be held.
+ */
+static inline uint32_t ioapic_read(ioapic_t *ioapic, uint8_t reg) {
+	ioapic->base[IOAPIC_REG_SELECT >> 2] = reg;
+	return ioapic->base[IOAPIC_REG_WINDOW >> 2];
+}
+
+static inline void ioapic_write(ioapic_t *ioapic, uint8_t reg, uint32_t value) {
+	ioapic->base[IOAPIC_REG_SELECT >> 2] = reg;
+	ioapic->base[IOAPIC_REG_WINDOW >> 2] = value;
+}
+
+/*
+ * Returns the I/O APIC handling a GSI, or NULL if there is none.
+ */
+static ioapic_t *ioapic_find(uint32_t gsi) {
+	for(unsigned int i = 0; i < ioapic_count; i++) {
+		if(gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].entries) {
+			return &ioapics[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Converts MADT polarity and trigger flags to redirection entry bits. Flags
+ * that conform to the bus mean active high and edge triggered for ISA, and
+ * active low and level triggered for PCI.
+ */
+static uint32_t ioapic_convert_flags(uint16_t flags, bool isa) {
+	uint16_t polarity = flags & MADT_POLARITY_MASK;
+	uint16_t trigger = flags & MADT_TRIGGER_MASK;
+	uint32_t bits = 0;
+
+	if(polarity == MADT_POLARITY_LOW || (!polarity && !isa)) {
+		bits |= IOAPIC_REDIR_ACTIVE_LOW;
+	}
+
+	if(trigger == MADT_TRIGGER_LEVEL || (!trigger && !isa)) {
+		bits |= IOAPIC_REDIR_LEVEL;
+	}
+
+	return bits;
+}
+
+/*
+ * Returns the GSI an IRQ is connected to. ISA IRQs are identity mapped,
+ * unless an interrupt source override moves them, or moves another IRQ onto
+ * their GSI. Above those, IRQ numbers are GSIs.
+ */
+int ioapic_irq_to_gsi(uint8_t irq) {
+	if(!ioapic_available()) {
+		return -1;
+	} else if(irq >= 16) {
+		return (irq < MAX_IRQ) ? irq : -1;
+	}
+
+	for(unsigned int i = 0; i < ioapic_madt->num_overrides; i++) {
+		if(ioapic_madt->overrides[i].source_irq == irq) {
+			return ioapic_madt->overrides[i].gsi;
+		}
+	}
+
+	for(unsigned int i = 0; i < ioapic_madt->num_overrides; i++) {
+		if(ioapic_madt->overrides[i].gsi == irq) {
+			return -1;
+		}
+	}
+
+	return irq;
+}
+
+/*
+ * Returns the IRQ number a GSI is used through: the ISA IRQ overridden onto
+ * it, if any. GSIs that no IRQ number maps to give -1.
+ */
+int ioapic_gsi_to_irq(uint32_t gsi) {
+	if(!ioapic_available()) {
+		return -1;
+	}
+
+	for(unsigned int i = 0; i < ioapic_madt->num_overrides; i++) {
+		if(ioapic_madt->overrides[i].gsi == gsi) {
+			return ioapic_madt->overrides[i].source_irq;
+		}
+	}
+
+	if(gsi >= MAX_IRQ || ioapic_irq_to_gsi(gsi) != (int) gsi) {
+		return -1;
+	}
+
+	return gsi;
+}
+
+bool ioapic_irq_overridden(uint8_t irq) {
+	if(!ioapic_available()) {
+		return false;
+	}
+
+	for(unsigned int i = 0; i < ioapic_madt->num_overrides; i++) {
+		if(ioapic_madt->overrides[i].source_irq == irq) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Writes the redirection entry of a line, which delivers its vector to the
+ * destination processor with the line's polarity and trigger mode.
+ */
+static void ioapic_write_entry(uint8_t irq, bool masked) {
+	int gsi = ioapic_irq_to_gsi(irq);
+	ioapic_t *ioapic = (gsi < 0) ? NULL : ioapic_find(gsi);
+
+	if(!ioapic) {
+		return;
+	}
+
+	uint8_t reg = IOAPIC_REG_REDIR + ((gsi - ioapic->gsi_base) * 2);
+	uint32_t low = (IRQ_0 + irq) | ioapic_line_flags[irq];
+
+	if(masked) {
+		low |= IOAPIC_REDIR_MASKED;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&ioapic_lock);
+
+	// Masked while the destination changes
+	ioapic_write(ioapic, reg, IOAPIC_REDIR_MASKED);
+	ioapic_write(ioapic, reg + 1, ((uint32_t) ioapic_dest) << 24);
+	ioapic_write(ioapic, reg, low);
+
+	spin_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+static void ioapic_mask(uint8_t irq) {
+	ioapic_write_entry(irq, true);
+}
+
+static void ioapic_unmask(uint8_t irq) {
+	ioapic_write_entry(irq, false);
+}
+
+/*
+ * The local APIC's EOI also ends level triggered interrupts at the I/O APIC.
+ */
+static void ioapic_eoi(uint8_t irq) {
+	apic_eoi();
+}
+
+/*
+ * Sets the polarity and trigger mode of a line that isn't in use yet, such as
+ * the ones PCI interrupts are routed to.
+ */
+void ioapic_set_flags(uint8_t irq, uint16_t flags) {
+	ASSERT(irq < MAX_IRQ);
+	ioapic_line_flags[irq] = ioapic_convert_flags(flags, false);
+}
+
+/*
+ * Finds the I/O APICs in the MADT, maps them, and masks all of their inputs.
+ * They're only used once ioapic_enable is called, but from here on, they're
+ * known to be: interrupts are routed on that assumption, so without a local
+ * APIC to deliver to, the I/O APICs are ignored altogether.
+ */
+static int ioapic_init(void) {
+	if(!apic_supported()) {
+		kprintf("ioapic: no local APIC, using 8259 PICs\n");
+		return -1;
+	}
+
+	ioapic_madt = acpi_madt_get();
+
+	if(!ioapic_madt || !ioapic_madt->num_ioapics) {
+		kprintf("No I/O APIC found.\n");
+		return -1;
+	}
+
+	for(unsigned int i = 0; i < ioapic_madt->num_ioapics; i++) {
+		madt_ioapic_t *info = &ioapic_madt->ioapics[i];
+		ioapic_t *ioapic = &ioapics[ioapic_count];
+
+		uint32_t virt = paging_map_section(info->address & 0xFFFFF000, 0x1000, kernel_directory, kMemorySectionHardware);
+		ASSERT(virt != 0);
+		paging_flush_tlb(virt);
+
+		ioapic->base = (volatile uint32_t *) (virt + (info->address & 0xFFF));
+		ioapic->gsi_base = info->gsi_base;
+		ioapic->entries = ((ioapic_read(ioapic, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+		for(unsigned int j = 0; j < ioapic->entries; j++) {
+			ioapic_write(ioapic, IOAPIC_REG_REDIR + (j * 2), IOAPIC_REDIR_MASKED);
+		}
+
+		kprintf("ioapic: %u at 0x%X, GSIs %u-%u\n", info->id, info->address, ioapic->gsi_base, ioapic->gsi_base + ioapic->entries - 1);
+
+		ioapic_count++;
+	}
+
+	// ISA lines take the flags of their overrides; all others are PCI
+	for(int i = 0; i < MAX_IRQ; i++) {
+		ioapic_line_flags[i] = ioapic_convert_flags(0, i < 16);
+	}
+
+	for(unsigned int i = 0; i < ioapic_madt->num_overrides; i++) {
+		madt_override_t *override = &ioapic_madt->overrides[i];
+
+		if(override->source_irq < 16) {
+			ioapic_line_flags[override->source_irq] = ioapic_convert_flags(override->flags, true);
+		}
+	}
+
+	return 0;
+}
+
+module_early_init(ioapic_init);
+
+/*
+ * Returns true if an I/O APIC was found, and will be used to route interrupts
+ * once the local APIC is up.
+ */
+bool ioapic_available(void) {
+	return ioapic_count != 0;
+}
+
+/*
+ * Routes interrupts through the I/O APICs to this processor, which must be
+ * the bootstrap processor with its local APIC enabled, and masks the 8259s.
+ * Returns false if there are no I/O APICs.
+ */
+bool ioapic_enable(void) {
+	if(!ioapic_available()) {
+		return false;
+	}
+
+	ioapic_dest = apic_get_id();
+
+	if(ioapic_madt->has_8259) {
+		sys_pic_irq_disable();
+	}
+
+	irq_set_chip(&ioapic_chip);
+
+	return true;
+}
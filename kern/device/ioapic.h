@@ -0,0 +1,36 @@
+/*
+ * Support for I/O APICs, which take over interrupt routing from the 8259 PICs
+ * once the local APIC is up.
+ */
+
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+#include <types.h>
+
+// Registers are accessed indirectly, through a select and a data window
+#define IOAPIC_REG_SELECT		0x00
+#define IOAPIC_REG_WINDOW		0x10
+
+#define IOAPIC_REG_VERSION		0x01
+// Redirection table: two registers per entry
+#define IOAPIC_REG_REDIR		0x10
+
+// Redirection entry fields (low half; the high half holds the destination)
+#define IOAPIC_REDIR_ACTIVE_LOW	(1 << 13)
+#define IOAPIC_REDIR_LEVEL		(1 << 15)
+#define IOAPIC_REDIR_MASKED		(1 << 16)
+
+bool ioapic_available(void);
+bool ioapic_enable(void);
+
+// Mapping between IRQ numbers and GSIs; -1 if a number has no counterpart
+int ioapic_irq_to_gsi(uint8_t irq);
+int ioapic_gsi_to_irq(uint32_t gsi);
+// Whether the MADT has an interrupt source override for an ISA IRQ
+bool ioapic_irq_overridden(uint8_t irq);
+
+// Sets polarity and trigger mode of a line (MADT_POLARITY_*, MADT_TRIGGER_*)
+void ioapic_set_flags(uint8_t irq, uint16_t flags);
+
+#endif
@@ -7,6 +7,9 @@
 #define PIT_CH2		0x42
 #define PIT_CTRL	0x43
 
+// Port B of the keyboard controller controls the channel 2 gate
+#define PIT_CH2_GATE		0x61
+
 /*
  * Initialises a channel.
  */
@@ -23,6 +26,48 @@ void sys_pit_init(uint8_t channel, uint8_t mode) {
  * Sets the count for the specific channel.
  */
 void sys_pit_set_reload(uint8_t ch, uint16_t count) {
-	io_outb(PIT_CH0, (count & 0x00FF)); // write low byte
-	io_outb(PIT_CH0, (count & 0xFF) >> 0x08); // write high byte
+	uint16_t port = PIT_CH0 + (ch & 0x03);
+
+	io_outb(port, (count & 0x00FF)); // write low byte
+	io_outb(port, (count & 0xFF00) >> 0x08); // write high byte
+}
+
+/*
+ * Latches the current count of the specified channel and reads it back.
+ */
+uint16_t sys_pit_read_count(uint8_t ch) {
+	uint16_t port = PIT_CH0 + (ch & 0x03);
+
+	// Counter latch command for the channel
+	io_outb(PIT_CTRL, (ch & 0x03) << 0x06);
+
+	uint16_t count = io_inb(port);
+	count |= io_inb(port) << 0x08;
+
+	return count;
+}
+
+/*
+ * Starts channel 2 counting down from count in one-shot mode (mode 0), with
+ * the speaker output disconnected. The channel's output goes high once the
+ * count reaches zero, which can be polled with sys_pit_ch2_expired.
+ */
+void sys_pit_ch2_oneshot(uint16_t count) {
+	// Gate low, speaker off
+	uint8_t gate = io_inb(PIT_CH2_GATE);
+	io_outb(PIT_CH2_GATE, gate & ~0x03);
+
+	// Channel 2, lo/hi access, mode 0, binary
+	io_outb(PIT_CTRL, 0xB0);
+	sys_pit_set_reload(2, count);
+
+	// Raising the gate starts the count
+	io_outb(PIT_CH2_GATE, (gate & ~0x02) | 0x01);
+}
+
+/*
+ * Returns true once channel 2's one-shot count has expired.
+ */
+bool sys_pit_ch2_expired(void) {
+	return (io_inb(PIT_CH2_GATE) & 0x20) ? true : false;
 }
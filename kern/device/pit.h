@@ -1,4 +1,11 @@
 #include <types.h>
 
+// Frequency of the PIT's input clock (3579545 / 3 Hz)
+#define PIT_FREQUENCY 1193182
+
 void sys_pit_init(uint8_t channel, uint8_t mode);
-void sys_pit_set_reload(uint8_t ch, uint16_t count);
\ No newline at end of file
+void sys_pit_set_reload(uint8_t ch, uint16_t count);
+uint16_t sys_pit_read_count(uint8_t ch);
+
+void sys_pit_ch2_oneshot(uint16_t count);
+bool sys_pit_ch2_expired(void);
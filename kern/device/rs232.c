@@ -2,7 +2,9 @@
 
 #include <sys/system.h>
 #include <device/pic.h>
+#include <sys/irq.h>
 #include <io/io.h>
+#include <io/debug_console.h>
 #include "rs232.h"
 
 typedef struct {
@@ -19,6 +21,9 @@ typedef struct {
 static void rs232_wait_write_avail(rs232_port_t port);
 static void rs232_wait_read_avail(rs232_port_t port);
 static void rs232_shift_buffer(rs232_buffer_t* buffer, bool tx, size_t bytes);
+static void rs232_receive(uint16_t port, rs232_buffer_t* buffer);
+static int rs232_irq(void* ctx);
+bool rs232_irq_handler(uint32_t portSet);
 
 extern void sys_rs232_irq_handler1(void);
 extern void sys_rs232_irq_handler2(void);
@@ -64,6 +69,8 @@ static int rs232_init(void) {
 		}
 	}
 
+	rs232_set_up_irq();
+
 	return 0;
 }
 
@@ -78,7 +85,18 @@ module_exit(rs232_exit);
  * Sets up IRQs once IDT is set up
  */
 void rs232_set_up_irq() {
-	// Set up IRQs
+	// COM1 and COM3 share IRQ 4, COM2 and COM4 share IRQ 3
+	irq_register(4, rs232_irq, (void *) 0);
+	irq_register(3, rs232_irq, (void *) 1);
+}
+
+/*
+ * Glue between the generic IRQ handler and the port-set specific handler.
+ * The line is shared, so it's only claimed if one of the ports had an
+ * interrupt pending.
+ */
+static int rs232_irq(void* ctx) {
+	return rs232_irq_handler((uint32_t) ctx) ? IRQ_HANDLED : IRQ_NONE;
 }
 
 /*
@@ -218,9 +236,10 @@ uint16_t rs232_get_io_addr(rs232_port_t port) {
  * RS232 IRQ handler
  *
  * portSet is a parameter passed by the assembly ISR wrapper: It's set to 1 for ports
- * COM2 and 4, and set to 0 for COM1 and 3.
+ * COM2 and 4, and set to 0 for COM1 and 3. Returns whether either port had an
+ * interrupt pending.
  */
-void rs232_irq_handler(uint32_t portSet) {
+bool rs232_irq_handler(uint32_t portSet) {
 	uint16_t port_addr[2][2] = {
 		{rs232_to_io_map[0], rs232_to_io_map[2]},
 		{rs232_to_io_map[1], rs232_to_io_map[3]}
@@ -230,12 +249,16 @@ void rs232_irq_handler(uint32_t portSet) {
 	uint8_t irq_port1 = io_inb(port_addr[portSet & 0x01][0]+2);
 	uint8_t irq_port2 = io_inb(port_addr[portSet & 0x01][1]+2);
 
+	bool handled = false;
+
 process_irq: ; // gcc is stupid
-	// Determine which port triggered it
+	// Determine which port triggered it: bit 0 of its IIR is clear
 	uint8_t triggered_port = 0;
-	if((irq_port2 & 0x01)) triggered_port = 0;
-	else if((irq_port1 & 0x01)) triggered_port = 1;
-	else return; // none of the two ports wants to ack the interrupt
+	if(!(irq_port1 & 0x01)) triggered_port = 0;
+	else if(!(irq_port2 & 0x01)) triggered_port = 1;
+	else return handled; // none of the two ports wants to ack the interrupt
+
+	handled = true;
 
 	// Shift the entire value right one bit, and get low 3 bits only
 	uint8_t irq = ((triggered_port == 0) ? irq_port1 : irq_port2);
@@ -279,10 +302,7 @@ process_irq: ; // gcc is stupid
 		}
 		
 		case 2: { // RX FIFO threshold (14 bytes) reached (Read RBR to service)
-			// TODO: replace with real stuff
-			for(int i = 0; i < 16; i++) {
-				io_inb(port);
-			}
+			rs232_receive(port, port_info);
 			break;
 		}
 		
@@ -292,7 +312,7 @@ process_irq: ; // gcc is stupid
 		}
 		
 		case 6: { // No RX act for 4 words, but data avail (Read RBR to service)
-
+			rs232_receive(port, port_info);
 			break;
 		}
 
@@ -311,7 +331,26 @@ process_irq: ; // gcc is stupid
 	if(!(irq_port2 & 0x01)) goto process_irq;
 
 	done: ;
-	sys_pic_irq_eoi(3); // send int ack to PIC
+	// The interrupt is acknowledged by the generic IRQ handler
+	return handled;
+}
+
+/*
+ * Drains the receive FIFO of the specified port. Input on the kernel debug
+ * port is handed to the debug console, while everything else is buffered.
+ */
+static void rs232_receive(uint16_t port, rs232_buffer_t* buffer) {
+	uint16_t debug_port = rs232_to_io_map[KERN_DEBUG_SERIAL_PORT-1];
+
+	while(io_inb(port + 5) & 0x01) {
+		uint8_t c = io_inb(port);
+
+		if(port == debug_port) {
+			debugcon_input(c);
+		} else if(buffer->rx_buf_off < RS232_BUF_SIZE) {
+			buffer->rx_buf[buffer->rx_buf_off++] = c;
+		}
+	}
 }
 
 /*
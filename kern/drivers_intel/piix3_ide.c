@@ -5,6 +5,7 @@
 #include "io/io.h"
 #include "device/ata.h"
 #include "sys/irq.h"
+#include "sys/workqueue.h"
 #include "bus/bus.h"
 #include "bus/pci.h"
 
@@ -35,7 +36,8 @@ static bool piix3_ide_configure(uint16_t vendor, uint16_t device);
 static bool piix3_ide_using_80conductor(uint8_t channel, uint8_t device);
 static void piix3_setup_prd(void);
 static void piix3_setup_dma(int device);
-static void piix3_ide_irq(void *context);
+static int piix3_ide_irq(void *context);
+static void piix3_ide_irq_work(void *context);
 
 // Driver info
 static driver_t pci_driver = {
@@ -58,6 +60,9 @@ static pci_function_t *functionPtr;
 // Expansion memory address
 static void* piix3_expansion_memory;
 
+// Deferred part of the IRQ handler
+static work_t piix3_ide_work;
+
 // ATA driver associated with this hardware
 static ata_driver_t *ata;
 
@@ -182,6 +187,8 @@ static bool piix3_ide_configure(uint16_t bus, uint16_t device) {
 	 * The PIIX3 IDE controller will use IRQ 14 and 15, regardless of how it's
 	 * configured, as it is a parallel controller.
 	 */
+	work_init(&piix3_ide_work, piix3_ide_irq_work, NULL);
+
 	irq_register(14, piix3_ide_irq, ata);
 	irq_register(15, piix3_ide_irq, ata);
 
@@ -312,9 +319,21 @@ static void piix3_setup_dma(int device) {
 }
 
 /*
- * IRQ handler
+ * Bottom half of the IRQ handler, which runs from the work queue.
  */
-static void piix3_ide_irq(void *context) {
+static void piix3_ide_irq_work(void *context) {
 	kprintf("ATA IRQ!\n");
-	ata_irq_callback((ata_driver_t *) context);
+}
+
+/*
+ * IRQ handler: the controller is serviced right away, and the rest deferred.
+ */
+static int piix3_ide_irq(void *context) {
+	if(ata_irq_callback((ata_driver_t *) context) != IRQ_HANDLED) {
+		return IRQ_NONE;
+	}
+
+	work_queue(&piix3_ide_work);
+
+	return IRQ_HANDLED;
 }
\ No newline at end of file
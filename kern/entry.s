@@ -44,9 +44,10 @@ _osentry:
 	mov		$(boot_page_directory - 0xC0000000), %ecx
 	mov		%ecx, %cr3
 
-	# Enable paging
+	# Enable paging, with read-only pages enforced in ring 0 too (CR0.WP), so
+	# copies to user space can't write through read-only user mappings
 	mov		%cr0, %ecx
-	or		$0x80000000, %ecx
+	or		$0x80010000, %ecx
 	mov		%ecx, %cr0
 
 	# jump to the higher half kernel
@@ -1,11 +1,15 @@
 #include <types.h>
 #include "vfs.h"
 #include <runtime/hashmap.h>
+#include "sys/rcu.h"
+#include "sys/rusage.h"
 
 static fs_type_t* vfs_find_fs(uint16_t type);
 
+// Registered filesystems; lookups walk the list forwards under RCU
 static fs_type_t* fs_map;
 static fs_type_t* fs_last;
+static spinlock_t fs_lock = SPINLOCK_INIT;
 
 static hashmap_t* mountPointMap;
 
@@ -28,46 +32,49 @@ int vfs_register(fs_type_t* fs) {
 	fs->next = NULL;
 	fs->prev = NULL;
 
+	uint32_t flags = spin_lock_irqsave(&fs_lock);
+
 	// Check if there isn't any filesystems loaded
 	if(!fs_map) {
-		fs_map = fs;
+		rcu_assign_pointer(fs_map, fs);
 		fs_last = fs;
 	} else {
 		fs->prev = fs_last;
 
-		fs_last->next = fs;
+		rcu_assign_pointer(fs_last->next, fs);
 		fs_last = fs;
 	}
 
+	spin_unlock_irqrestore(&fs_lock, flags);
+
 	return 0;
 }
 
 /*
  * Unregisters a filesystem with the kernel. Note that this does not relinquish
- * memory allocated by the filesystem, nor the "type" structure.
+ * memory allocated by the filesystem, nor the "type" structure; once this
+ * returns, no lookup is using it anymore, so the caller may free it.
  */
 void vfs_deregister(fs_type_t* fs) {
-	fs_type_t *fs_list_ptr = fs_map;
-	ASSERT(fs_list_ptr != NULL);
+	uint32_t flags = spin_lock_irqsave(&fs_lock);
 
-	// Loop through all filesystems
-	while(true) {
-		if(fs_list_ptr == fs) {
-			// Remove from linked list
-			if(fs->prev) {
-				fs_type_t* prev = fs->prev;
-				prev->next = fs->next;
-			}
-
-			// Update pointer to last element in list
-			if(fs == fs_last) {
-				fs_last = fs_last->prev;
-			}
-		}
-
-		fs_list_ptr = fs_list_ptr->next;
-		if(!fs_list_ptr) break;
+	// Remove from linked list; fs keeps its next pointer for lookups on it
+	if(fs->prev) {
+		rcu_assign_pointer(fs->prev->next, fs->next);
+	} else {
+		rcu_assign_pointer(fs_map, fs->next);
 	}
+
+	// Update pointer to last element in list
+	if(fs->next) {
+		fs->next->prev = fs->prev;
+	} else {
+		fs_last = fs->prev;
+	}
+
+	spin_unlock_irqrestore(&fs_lock, flags);
+
+	synchronize_rcu();
 }
 
 /*
@@ -97,8 +104,10 @@ int vfs_mount_filesystem(ptable_entry_t* fs, char* mountPoint) {
 		return -1;
 	}
 
-	// Get the appropriate filesystem
+	// Get the appropriate filesystem; it can't be deregistered while mounted
+	rcu_read_lock();
 	fs_type_t* fdrv = vfs_find_fs(fs->type);
+	rcu_read_unlock();
 
 	// If we have one, mount it
 	if(likely(fdrv != NULL)) {
@@ -130,18 +139,17 @@ int vfs_mount_filesystem(ptable_entry_t* fs, char* mountPoint) {
 }
 
 /*
- * Locates the pointer to a filesystem to handle a certain type.
+ * Locates the pointer to a filesystem to handle a certain type. Must be called
+ * in an RCU read section.
  */
 static fs_type_t* vfs_find_fs(uint16_t type) {
-	fs_type_t *fs_list_ptr = fs_map;
-	ASSERT(fs_list_ptr != NULL);
+	fs_type_t *fs_list_ptr = rcu_dereference(fs_map);
 
 	// Loop through all filesystems
-	while(true) {
+	while(fs_list_ptr) {
 		if(fs_list_ptr->type == type) return fs_list_ptr;
 
-		fs_list_ptr = fs_list_ptr->next;
-		if(!fs_list_ptr) break;
+		fs_list_ptr = rcu_dereference(fs_list_ptr->next);
 	}
 
 	return NULL;
@@ -167,10 +175,55 @@ int vfs_unmount(char* mountPoint) {
 		goto done;
 	}
 
-	// Remove from hashmap anmd clean up
+	// Remove from hashmap, and clean up once no lookup can still return it
 	hashmap_delete(mountPointMap, mountPoint);
+	synchronize_rcu();
 	kfree(superblock);
 
 done:;
 	return errno;
-}
\ No newline at end of file
+}
+
+/*
+ * Reads the file at path, on the filesystem mounted at mountPoint, into
+ * buffer. The filesystem may modify path. Returns 0, or a negative error code.
+ */
+int vfs_read(char *mountPoint, char *path, void *buffer, uint32_t length) {
+	fs_superblock_t* superblock = hashmap_get(mountPointMap, mountPoint);
+
+	if(unlikely(!superblock)) {
+		return -ENOTFOUND;
+	}
+
+	if(!superblock->fp_read_file || !superblock->fp_read_file(superblock, path, buffer, length)) {
+		return -ENOTFOUND;
+	}
+
+	rusage_io(length, false);
+
+	return 0;
+}
+
+/*
+ * Writes buffer to the file at path, on the filesystem mounted at mountPoint.
+ * The filesystem may modify path. Returns 0, or a negative error code.
+ */
+int vfs_write(char *mountPoint, char *path, void *buffer, uint32_t length) {
+	fs_superblock_t* superblock = hashmap_get(mountPointMap, mountPoint);
+
+	if(unlikely(!superblock)) {
+		return -ENOTFOUND;
+	}
+
+	if(!superblock->fp_write_file || (superblock->flags & VFS_FLAG_READONLY)) {
+		return -EINVAL;
+	}
+
+	if(!superblock->fp_write_file(superblock, path, buffer, length)) {
+		return -ENOTFOUND;
+	}
+
+	rusage_io(length, true);
+
+	return 0;
+}
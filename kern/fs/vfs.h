@@ -49,4 +49,7 @@ int vfs_mount_filesystem(ptable_entry_t* fs, char* mountPoint);
 
 int vfs_unmount(char* mountPoint);
 
+int vfs_read(char *mountPoint, char *path, void *buffer, uint32_t length);
+int vfs_write(char *mountPoint, char *path, void *buffer, uint32_t length);
+
 #endif
\ No newline at end of file
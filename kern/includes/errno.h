@@ -14,6 +14,13 @@
 #define ENOTFOUND 2
 #define EBUSY 3
 #define EINVAL 4
+#define EAGAIN 5
+#define ETIMEDOUT 6
+#define EFAULT 7
+#define EBADF 8
+#define EMFILE 9
+#define EPIPE 10
+#define ENOMEM 11
 
 // Global symbol indicating last error
 static int errno;
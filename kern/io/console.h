@@ -9,6 +9,7 @@
 // Initialises the console.
 void console_init();
 void console_init_fb();
+void console_putc(char c);
 int kprintf(const char* format, ...);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <types.h>
+#include "debug_console.h"
+#include "runtime/hashmap.h"
+#include "runtime/list.h"
+#include "device/rs232.h"
+#include "sys/workqueue.h"
+#include "sys/sync.h"
+
+typedef struct {
+	char *name;
+	char *help;
+	debugcon_cmd_t function;
+} debugcon_command_t;
+
+// Commands, by name, and in the order they were registered (for help)
+static hashmap_t *debugcon_command_map;
+static list_t *debugcon_command_list;
+
+// Line currently being typed
+static char debugcon_line[DEBUGCON_LINE_MAX];
+static unsigned int debugcon_line_len;
+
+// Characters received by the serial IRQ, waiting to be processed
+static char debugcon_input_buf[DEBUGCON_INPUT_BUF];
+static volatile unsigned int debugcon_input_head, debugcon_input_tail;
+static work_t debugcon_input_work;
+
+// Workers may pick up the input work concurrently; only one may process it
+static mutex_t debugcon_input_lock;
+
+static void debugcon_execute(char *line);
+static void debugcon_process_input(void *context);
+static void debugcon_cmd_help(int argc, char **argv);
+
+/*
+ * Sets up the command table, and registers the built-in help command.
+ */
+static int debugcon_init(void) {
+	debugcon_command_map = hashmap_allocate();
+	debugcon_command_list = list_allocate();
+
+	work_init(&debugcon_input_work, debugcon_process_input, NULL);
+	mutex_init(&debugcon_input_lock);
+
+	debugcon_register("help", "Lists available commands", debugcon_cmd_help);
+
+	return 0;
+}
+
+module_early_init(debugcon_init);
+
+/*
+ * Registers a command. The name and help strings are not copied, so they
+ * must remain valid for as long as the kernel runs.
+ */
+void debugcon_register(char *name, char *help, debugcon_cmd_t function) {
+	ASSERT(debugcon_command_map != NULL);
+
+	if(hashmap_get(debugcon_command_map, name)) {
+		kprintf("debugcon: command '%s' already registered\n", name);
+		return;
+	}
+
+	debugcon_command_t *cmd = (debugcon_command_t *) kmalloc(sizeof(debugcon_command_t));
+	ASSERT(cmd != NULL);
+
+	cmd->name = name;
+	cmd->help = help;
+	cmd->function = function;
+
+	hashmap_insert(debugcon_command_map, name, cmd);
+	list_add(debugcon_command_list, cmd);
+}
+
+/*
+ * Called from the serial port's IRQ handler with a received character. It's
+ * buffered, and processed from a work queue, since running a command can take
+ * much longer than interrupts should be disabled for. Characters that don't
+ * fit in the buffer are dropped.
+ */
+void debugcon_input(char c) {
+	unsigned int next = (debugcon_input_head + 1) % DEBUGCON_INPUT_BUF;
+
+	if(next != debugcon_input_tail) {
+		debugcon_input_buf[debugcon_input_head] = c;
+		debugcon_input_head = next;
+	}
+
+	work_queue(&debugcon_input_work);
+}
+
+/*
+ * Handles a character from the serial port: lines are collected until a
+ * carriage return or newline, and then executed. Input is echoed only to the
+ * serial port, so it doesn't clutter the screen.
+ */
+static void debugcon_handle_char(char c) {
+	if(c == '\r' || c == '\n') {
+		kprintf("\n");
+
+		debugcon_line[debugcon_line_len] = 0x00;
+		debugcon_line_len = 0;
+
+		debugcon_execute(debugcon_line);
+		kprintf("> ");
+	} else if(c == 0x08 || c == 0x7F) { // backspace or delete
+		if(debugcon_line_len) {
+			debugcon_line_len--;
+			rs232_write(KERN_DEBUG_SERIAL_PORT, 3, "\b \b");
+		}
+	} else if(debugcon_line_len < (DEBUGCON_LINE_MAX - 1)) {
+		debugcon_line[debugcon_line_len++] = c;
+		rs232_putchar(KERN_DEBUG_SERIAL_PORT, c);
+	}
+}
+
+/*
+ * Work queue function that handles the buffered input.
+ */
+static void debugcon_process_input(void *context) {
+	mutex_lock(&debugcon_input_lock);
+
+	while(debugcon_input_tail != debugcon_input_head) {
+		char c = debugcon_input_buf[debugcon_input_tail];
+		debugcon_input_tail = (debugcon_input_tail + 1) % DEBUGCON_INPUT_BUF;
+
+		debugcon_handle_char(c);
+	}
+
+	mutex_unlock(&debugcon_input_lock);
+}
+
+/*
+ * Splits the line into arguments, and runs the command it names.
+ */
+static void debugcon_execute(char *line) {
+	char *argv[DEBUGCON_MAX_ARGS];
+	int argc = 0;
+
+	char *pch = strtok(line, " \t");
+	while(pch != NULL && argc < DEBUGCON_MAX_ARGS) {
+		argv[argc++] = pch;
+		pch = strtok(NULL, " \t");
+	}
+
+	if(!argc) return;
+
+	debugcon_command_t *cmd = hashmap_get(debugcon_command_map, argv[0]);
+
+	if(cmd) {
+		cmd->function(argc, argv);
+	} else {
+		kprintf("Unknown command '%s'; try 'help'\n", argv[0]);
+	}
+}
+
+/*
+ * Prints all registered commands.
+ */
+static void debugcon_cmd_help(int argc, char **argv) {
+	debugcon_command_t *cmd;
+
+	for(int i = 0; i < debugcon_command_list->num_entries; i++) {
+		cmd = (debugcon_command_t *) list_get(debugcon_command_list, i);
+		kprintf("%s\t%s\n", cmd->name, cmd->help);
+	}
+}
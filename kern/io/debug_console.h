@@ -0,0 +1,24 @@
+#ifndef DEBUG_CONSOLE_H
+#define DEBUG_CONSOLE_H
+
+#include <types.h>
+
+/*
+ * Minimal command interpreter on the kernel debug serial port, used to dump
+ * kernel statistics without a userspace.
+ */
+
+#define DEBUGCON_LINE_MAX 128
+#define DEBUGCON_MAX_ARGS 8
+
+// Received characters buffered until the work queue gets to them
+#define DEBUGCON_INPUT_BUF 256
+
+typedef void (*debugcon_cmd_t)(int argc, char **argv);
+
+// Registers a command with the debug console
+void debugcon_register(char *name, char *help, debugcon_cmd_t function);
+// Feeds a character received on the debug serial port into the console
+void debugcon_input(char c);
+
+#endif
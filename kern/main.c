@@ -5,6 +5,7 @@
 #include "sys/paging.h"
 #include "sys/binfmt_elf.h"
 #include "sys/task.h"
+#include "sys/sched.h"
 #include "sys/multiboot.h"
 #include "vga/svga.h"
  
@@ -80,6 +81,7 @@ void kernel_main(uint32_t magic, multiboot_info_t* multibootInfo) {
 		kprintf("\nParsed ELF to 0x%X\n", elf);
 
 		i386_task_t* task = task_allocate(elf);
+		sched_task_start(task);
 	}*/
 
 /*	
@@ -111,7 +113,8 @@ void kernel_main(uint32_t magic, multiboot_info_t* multibootInfo) {
 
 	// kprintf("0x%X\n", sys_get_ticks());
 
-	while(1);
+	// Nothing left to do, so become the idle task
+	sched_idle();
 }
 
 /*
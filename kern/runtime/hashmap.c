@@ -64,11 +64,13 @@ hashmap_t *hashmap_allocate() {
 
 /*
  * Releases the memory associated with a a hashmap, including all bucket and
- * data structures.
+ * data structures. Nothing may be looking up keys in it anymore.
  */
 void hashmap_release(hashmap_t* map) {
 	hashmap_bucket_t* bucket = map->buckets;
+	hashmap_bucket_t* nextBucket;
 	hashmap_data_t* data;
+	hashmap_data_t* nextData;
 
 	// Deallocate buckets
 	while(likely(bucket != NULL)) {
@@ -76,10 +78,17 @@ void hashmap_release(hashmap_t* map) {
 
 		// Deallocate the data in the bucket.
 		while(likely(data != NULL)) {
+			nextData = data->next;
+
 			kfree(data->key);
 			kfree(data);
-			data = data->next;
+
+			data = nextData;
 		}
+
+		nextBucket = bucket->next;
+		kfree(bucket);
+		bucket = nextBucket;
 	}
 
 	// Clear remaining memory
@@ -87,17 +96,25 @@ void hashmap_release(hashmap_t* map) {
 }
 
 /*
- * Inserts an item into the hashmap. If the key already exists, its data is
- * overwritten.
+ * Frees an entry that was replaced or deleted, once no lookup can still be
+ * looking at it.
  */
-void hashmap_insert(hashmap_t* hashmap, void* key, void* value) {
-	// Create a copy of the key.
-	size_t keyLength = strlen(key);
-	void* keyCopy = (void *) kmalloc(keyLength+1);
+static void hashmap_data_free(rcu_head_t *head) {
+	hashmap_data_t *data = rcu_entry(head, hashmap_data_t, rcu);
 
-	memclr(keyCopy, keyLength+1);
-	memcpy(keyCopy, key, keyLength);
+	if(data->free_data) {
+		kfree(data->data);
+	}
+
+	kfree(data->key);
+	kfree(data);
+}
 
+/*
+ * Inserts an item into the hashmap. If the key already exists, its entry is
+ * replaced, and the old data released.
+ */
+static void hashmap_insert_locked(hashmap_t* hashmap, void* keyCopy, size_t keyLength, void* value) {
 	// Calculate hash
 	uint32_t hash = default_hash(keyCopy, keyLength);
 	hash &= hashmap->mask;
@@ -112,67 +129,55 @@ void hashmap_insert(hashmap_t* hashmap, void* key, void* value) {
 		if(bucket == NULL) return;
 	}
 
-	// Search through all data in the bucket to see if the key exists
-	hashmap_data_t* data;
-	hashmap_data_t* emptyData;
+	// The entry is complete before lookups can see it
+	hashmap_data_t* newData = (hashmap_data_t *) kmalloc(sizeof(hashmap_data_t));
+	memclr(newData, sizeof(hashmap_data_t));
 
-	data = bucket->data;
+	newData->data = value;
+	newData->key = keyCopy;
 
-	// If there's no data structure in this bucket, create some.
-	if(unlikely(data == NULL)) {
-		hashmap_data_t* newData = (hashmap_data_t *) kmalloc(sizeof(hashmap_data_t));
-		memclr(newData, sizeof(hashmap_data_t));
+	// Search through all data in the bucket to see if the key exists
+	hashmap_data_t** link = &bucket->data;
 
-		newData->data = value;
-		newData->key = keyCopy;
+	while(likely(*link != NULL)) {
+		hashmap_data_t* data = *link;
 
-		// Set the bucket's data structure
-		bucket->data = newData;
+		if(unlikely(memcmp(keyCopy, data->key, keyLength + 1) == 0)) {
+			// The keys match; swap in the new entry, and release the old one
+			newData->next = data->next;
+			rcu_assign_pointer(*link, newData);
 
-		return;
-	} else {
-		// Search through the data structures instead.
-		while(likely(data != NULL)) {
-			if(data->key == NULL) {
-				emptyData = value;
-			}
+			data->free_data = true;
+			call_rcu(&data->rcu, hashmap_data_free);
 
-			// Do the keys match?
-			if(unlikely(memcmp(keyCopy, data->key, keyLength) == 0)) {
-				// Release old data.
-				kfree(data->data);
+			return;
+		}
 
-				// Set data.
-				data->data = value;
+		link = &data->next;
+	}
 
-				// We're done here.
-				return;
-			}
-		}
+	// Append it to the bucket
+	rcu_assign_pointer(*link, newData);
+}
 
-		// If we have an empty data structure, stuff our data into it.
-		if(emptyData) {
-			emptyData->key = keyCopy;
-			emptyData->data = value;
-			return;
-		} else { // We need to allocate a data structure
-			hashmap_data_t* newData = (hashmap_data_t *) kmalloc(sizeof(hashmap_data_t));
-			memclr(newData, sizeof(hashmap_data_t));
+void hashmap_insert(hashmap_t* hashmap, void* key, void* value) {
+	// Create a copy of the key.
+	size_t keyLength = strlen(key);
+	void* keyCopy = (void *) kmalloc(keyLength+1);
 
-			newData->data = value;
-			newData->key = keyCopy;
+	memclr(keyCopy, keyLength+1);
+	memcpy(keyCopy, key, keyLength);
 
-			// Set it as the next data structure.
-			data->next = newData;
-			return;
-		}
-	}
+	uint32_t flags = spin_lock_irqsave(&hashmap->lock);
+	hashmap_insert_locked(hashmap, keyCopy, keyLength, value);
+	spin_unlock_irqrestore(&hashmap->lock, flags);
 }
 
 /*
- * Retrieves an item from the hashmap, or returns NULL if not found.
+ * Retrieves an item from the hashmap, or returns NULL if not found. Must be
+ * called in an RCU read section.
  */
-void* hashmap_get(hashmap_t* hashmap, void* key) {
+static void* hashmap_get_rcu(hashmap_t* hashmap, void* key) {
 	// Calculate hash
 	size_t keyLength = strlen(key);
 	uint32_t hash = default_hash(key, keyLength);
@@ -187,26 +192,38 @@ void* hashmap_get(hashmap_t* hashmap, void* key) {
 	}
 
 	// Loop through the data structures in the bucket
-	hashmap_data_t* data = bucket->data;
+	hashmap_data_t* data = rcu_dereference(bucket->data);
 
 	while(likely(data != NULL)) {
 		// We've found the key.
-		if(unlikely(memcmp(key, data->key, keyLength) == 0)) {
+		if(unlikely(memcmp(key, data->key, keyLength + 1) == 0)) {
 			return data->data;
 		}
 
-		data = data->next;
+		data = rcu_dereference(data->next);
 	}
 
 	// We didn't find the key in the bucket.
 	return NULL;
 }
 
+/*
+ * Looks up a key without taking the lock. The data itself is not protected
+ * once this returns; its owner must keep it alive while it's in the hashmap.
+ */
+void* hashmap_get(hashmap_t* hashmap, void* key) {
+	rcu_read_lock();
+	void *value = hashmap_get_rcu(hashmap, key);
+	rcu_read_unlock();
+
+	return value;
+}
+
 /*
  * Removes an entry from the hashmap, releasing the memory associated with the
  * key as well.
  */
-int hashmap_delete(hashmap_t* hashmap, void* key) {
+static int hashmap_delete_locked(hashmap_t* hashmap, void* key) {
 	// Calculate hash
 	size_t keyLength = strlen(key);
 	uint32_t hash = default_hash(key, keyLength);
@@ -221,19 +238,29 @@ int hashmap_delete(hashmap_t* hashmap, void* key) {
 	}
 
 	// Loop through the data structures in the bucket
-	hashmap_data_t* data = bucket->data;
+	hashmap_data_t** link = &bucket->data;
 
-	while(likely(data != NULL)) {
-		// We've found the key, so delete it.
-		if(unlikely(memcmp(key, data->key, keyLength) == 0)) {
-			kfree(data->key);
-			data->data = NULL;
+	while(likely(*link != NULL)) {
+		hashmap_data_t* data = *link;
+
+		// We've found the key, so unlink it; lookups on it keep its next pointer
+		if(unlikely(memcmp(key, data->key, keyLength + 1) == 0)) {
+			rcu_assign_pointer(*link, data->next);
+			call_rcu(&data->rcu, hashmap_data_free);
 			return 0;
 		}
 
-		data = data->next;
+		link = &data->next;
 	}
 
 	// The key couldn't be found in the hashmap
 	return ENOTFOUND;
+}
+
+int hashmap_delete(hashmap_t* hashmap, void* key) {
+	uint32_t flags = spin_lock_irqsave(&hashmap->lock);
+	int err = hashmap_delete_locked(hashmap, key);
+	spin_unlock_irqrestore(&hashmap->lock, flags);
+
+	return err;
 }
\ No newline at end of file
@@ -2,20 +2,26 @@
 #define HASHMAP_H
 
 #include <types.h>
+#include "sys/spinlock.h"
+#include "sys/rcu.h"
 
 /*
  * This structure actually contains the key and data, and forms a linked list
  * of data in a certain bucket.
  *
- * If the key pointer is NULL, this is a structure that has been deleted, and
- * can thus be re-used if we need to insert more data whose hash would place
- * it in this bucket.
+ * Lookups walk the lists under RCU without taking the lock, so entries are
+ * never changed once linked in: overwriting or deleting a key replaces or
+ * unlinks its entry, which is freed after a grace period.
  */
 typedef struct hashmap_data {
 	void* key;
 	void* data;
 
 	struct hashmap_data *next;
+
+	// Whether the data is freed along with the entry, as it was overwritten
+	bool free_data;
+	rcu_head_t rcu;
 } hashmap_data_t;
 
 /*
@@ -42,6 +48,9 @@ typedef struct hashmap {
 	int num_buckets;
 
 	uint32_t mask;
+
+	// Serialises changes to the buckets; lookups don't take it
+	spinlock_t lock;
 } hashmap_t;
 
 // Initialisation and deallocation
@@ -2,20 +2,23 @@
 #include "list.h"
 
 /*
- * Traverses the list for the first free entry.
+ * Traverses the list for the first free entry, and stores data in it. The
+ * entry is complete before readers can see it.
  */
-static list_entry_t *find_first_free_entry(list_t *list, unsigned int* index) {
+static list_entry_t *find_first_free_entry(list_t *list, void *data, unsigned int* index) {
 	// Create a new entry and link it to the last entry in the list.
 	list_entry_t *newLast = (list_entry_t *) kmalloc(sizeof(list_entry_t));
 	memclr(newLast, sizeof(list_entry_t));
 
+	newLast->data = data;
+
 	// The list does not yet contain anything
 	if(!list->first && !list->last) {
-		list->first = newLast;
+		rcu_assign_pointer(list->first, newLast);
 		list->last = newLast;
 	} else { // There's other items in the chain
-		list->last->next = newLast;
 		newLast->prev = list->last;
+		rcu_assign_pointer(list->last->next, newLast);
 		list->last = newLast;
 	}
 
@@ -30,10 +33,11 @@ static list_entry_t *find_first_free_entry(list_t *list, unsigned int* index) {
 }
 
 /*
- * Gets the entry at the specified index from the list, if it exists.
+ * Gets the entry at the specified index from the list, if it exists. Must be
+ * called with the lock held, or in an RCU read section.
  */
 static list_entry_t *get_index(list_t *list, unsigned int index) {
-	list_entry_t *entry = list->first;
+	list_entry_t *entry = rcu_dereference(list->first);
 
 	// If it's not 0, we must traverse the list
 	for(int i = 0; i < index; i++) {
@@ -41,7 +45,7 @@ static list_entry_t *get_index(list_t *list, unsigned int index) {
 			break; // equivalent to "return NULL;" as entry == NULL
 		}
 
-		entry = entry->next;
+		entry = rcu_dereference(entry->next);
 	}
 
 	return entry;
@@ -58,7 +62,8 @@ list_t *list_allocate() {
 }
 
 /*
- * Releases all memory associated with a list.
+ * Releases all memory associated with a list. Nothing may be reading it
+ * anymore.
  */
 void list_destroy(list_t *list, bool freeData) {
 	// Delete all entries within the list.
@@ -81,10 +86,10 @@ void list_destroy(list_t *list, bool freeData) {
  */
 unsigned int list_add(list_t *list, void* data) {
 	unsigned int index;
-	list_entry_t *entry = find_first_free_entry(list, &index);
-	entry->data = data;
 
-	// kprintf("Entry for list 0x%X at 0x%X (index = %i, data = 0x%X 0x%X)\n", list, entry, index, data, entry->data);
+	uint32_t flags = spin_lock_irqsave(&list->lock);
+	find_first_free_entry(list, data, &index);
+	spin_unlock_irqrestore(&list->lock, flags);
 
 	return index;
 }
@@ -95,65 +100,96 @@ unsigned int list_add(list_t *list, void* data) {
  * or the original index if success.
  */
 unsigned int list_insert(list_t *list, void* data, unsigned int index) {
+	unsigned int ret = -1;
+
+	uint32_t flags = spin_lock_irqsave(&list->lock);
 	list_entry_t *entry = get_index(list, index);
 
 	if(entry) {
 		if(index | LIST_OVERWRITE) {
-			entry->data = data;
-			return index;
+			rcu_assign_pointer(entry->data, data);
+			ret = index;
 		}
-
-		return -1;
-	} else {
-		return -1;
 	}
+
+	spin_unlock_irqrestore(&list->lock, flags);
+
+	return ret;
 }
 
 /*
  * Tries to retrieve the item at index from the list. Returns a pointer to its
- * data, or NULL if not found.
+ * data, or NULL if not found. This doesn't take the lock, so if the list is
+ * changed concurrently, the index may refer to a neighbouring entry, and the
+ * data may be freed once this returns; and each call walks the list from the
+ * start. To go through all entries, use list_for_each_rcu instead.
  */
 void* list_get(list_t *list, unsigned int index) {
+	rcu_read_lock();
 	list_entry_t *entry = get_index(list, index);
-	// kprintf("Entry for list 0x%X at 0x%X (index = %i, data = 0x%X)\n", list, entry, index, entry->data);
-	return entry->data;
+	void *data = entry ? entry->data : NULL;
+	rcu_read_unlock();
+
+	// kprintf("Entry for list 0x%X at 0x%X (index = %i, data = 0x%X)\n", list, entry, index, data);
+	return data;
 }
 
 /*
  * Iterates through the list to see if it contains the value passed in.
  */
 bool list_contains(list_t *list, void *data) {
-	list_entry_t *entry = list->first;
+	bool found = false;
+
+	rcu_read_lock();
+	list_entry_t *entry = rcu_dereference(list->first);
 
 	while(entry != NULL) {
 		if(entry->data == data) {
-			return true;
+			found = true;
+			break;
 		}
 
-		entry = entry->next;
+		entry = rcu_dereference(entry->next);
 	}
 
-	return false;
+	rcu_read_unlock();
+
+	return found;
+}
+
+/*
+ * Frees a deleted entry once no reader can still be looking at it.
+ */
+static void list_entry_free(rcu_head_t *head) {
+	list_entry_t *entry = rcu_entry(head, list_entry_t, rcu);
+
+	if(entry->free_data) {
+		kfree(entry->data);
+	}
+
+	kfree(entry);
 }
 
 /*
  * Removes the item at index from the list, if it exists. In addition, if
  * free_ptr is true, the list will call kfree() with the list entry's data
  * pointer as the parameter in addition to freeing the list_entry_t structure.
+ * Both are freed after an RCU grace period, as readers may still see them.
  */
 void list_delete(list_t *list, unsigned int index, bool free_ptr) {
+	uint32_t flags = spin_lock_irqsave(&list->lock);
 	list_entry_t *entry = get_index(list, index);
 
-	// Free data if needed
-	if(free_ptr) {
-		kfree(entry->data);
+	if(!entry) {
+		spin_unlock_irqrestore(&list->lock, flags);
+		return;
 	}
 
-	// Update linkage
+	// Update linkage; the entry keeps its next pointer for readers on it
 	if(entry->prev) {
-		entry->prev->next = entry->next;
+		rcu_assign_pointer(entry->prev->next, entry->next);
 	} else { // Deleting first entry in chain
-		list->first = entry->next;
+		rcu_assign_pointer(list->first, entry->next);
 	}
 
 	if(entry->next) {
@@ -162,6 +198,11 @@ void list_delete(list_t *list, unsigned int index, bool free_ptr) {
 		list->last = entry->prev;
 	}
 
+	list->num_entries--;
+
+	spin_unlock_irqrestore(&list->lock, flags);
+
 	// Clear memory allocated to entry
-	kfree(entry);
+	entry->free_data = free_ptr;
+	call_rcu(&entry->rcu, list_entry_free);
 }
\ No newline at end of file
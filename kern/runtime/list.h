@@ -7,6 +7,8 @@
 #define LIST_H
 
 #include <types.h>
+#include "sys/spinlock.h"
+#include "sys/rcu.h"
 
 #define LIST_OVERWRITE 0x80000000
 
@@ -16,13 +18,32 @@ typedef struct list list_t;
 struct list_entry {
 	list_entry_t *next, *prev;
 	void *data;
+
+	// Deleted entries are freed after a grace period, along with the data
+	// if free_data is set
+	bool free_data;
+	rcu_head_t rcu;
 };
 
 struct list {
 	list_entry_t *first, *last;
 	unsigned int num_entries;
+
+	// Serialises changes to the entries; readers walk them under RCU, only
+	// following next pointers
+	spinlock_t lock;
 };
 
+/*
+ * Walks the entries of a list, from the first. This must be done inside
+ * rcu_read_lock(): entries deleted meanwhile stay readable until the read
+ * section ends, so entry, and the data it points to, are only valid within it.
+ * Anything the walk finds and keeps past rcu_read_unlock() must be kept alive
+ * some other way.
+ */
+#define list_for_each_rcu(entry, list) \
+	for(list_entry_t *entry = rcu_dereference((list)->first); entry; entry = rcu_dereference(entry->next))
+
 // Allocation/deallocation functions
 list_t* list_allocate();
 void list_destroy(list_t*, bool);
@@ -0,0 +1,290 @@
+#include <types.h>
+#include "rbtree.h"
+
+/*
+ * Initialises an empty tree, ordered by the compare function.
+ */
+void rb_tree_init(rb_tree_t *tree, rb_compare_t compare) {
+	tree->root = NULL;
+	tree->leftmost = NULL;
+	tree->compare = compare;
+}
+
+/*
+ * Replaces old with new in old's parent, or as the root.
+ */
+static void rb_replace_child(rb_tree_t *tree, rb_node_t *parent, rb_node_t *old, rb_node_t *new) {
+	if(!parent) {
+		tree->root = new;
+	} else if(parent->left == old) {
+		parent->left = new;
+	} else {
+		parent->right = new;
+	}
+}
+
+static void rb_rotate_left(rb_tree_t *tree, rb_node_t *node) {
+	rb_node_t *right = node->right;
+
+	node->right = right->left;
+
+	if(right->left) {
+		right->left->parent = node;
+	}
+
+	right->parent = node->parent;
+	rb_replace_child(tree, node->parent, node, right);
+
+	right->left = node;
+	node->parent = right;
+}
+
+static void rb_rotate_right(rb_tree_t *tree, rb_node_t *node) {
+	rb_node_t *left = node->left;
+
+	node->left = left->right;
+
+	if(left->right) {
+		left->right->parent = node;
+	}
+
+	left->parent = node->parent;
+	rb_replace_child(tree, node->parent, node, left);
+
+	left->right = node;
+	node->parent = left;
+}
+
+/*
+ * Inserts a node into the tree.
+ */
+void rb_insert(rb_tree_t *tree, rb_node_t *node) {
+	rb_node_t *parent = NULL;
+	rb_node_t **link = &tree->root;
+	bool leftmost = true;
+
+	// Find the leaf to attach to
+	while(*link) {
+		parent = *link;
+
+		if(tree->compare(node, parent) < 0) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = false;
+		}
+	}
+
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->colour = RB_RED;
+	*link = node;
+
+	if(leftmost) {
+		tree->leftmost = node;
+	}
+
+	// Restore the red-black properties
+	while((parent = node->parent) && parent->colour == RB_RED) {
+		rb_node_t *grandparent = parent->parent;
+
+		if(parent == grandparent->left) {
+			rb_node_t *uncle = grandparent->right;
+
+			if(uncle && uncle->colour == RB_RED) {
+				parent->colour = uncle->colour = RB_BLACK;
+				grandparent->colour = RB_RED;
+				node = grandparent;
+				continue;
+			}
+
+			if(node == parent->right) {
+				rb_rotate_left(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->colour = RB_BLACK;
+			grandparent->colour = RB_RED;
+			rb_rotate_right(tree, grandparent);
+		} else {
+			rb_node_t *uncle = grandparent->left;
+
+			if(uncle && uncle->colour == RB_RED) {
+				parent->colour = uncle->colour = RB_BLACK;
+				grandparent->colour = RB_RED;
+				node = grandparent;
+				continue;
+			}
+
+			if(node == parent->left) {
+				rb_rotate_right(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->colour = RB_BLACK;
+			grandparent->colour = RB_RED;
+			rb_rotate_left(tree, grandparent);
+		}
+	}
+
+	tree->root->colour = RB_BLACK;
+}
+
+/*
+ * Rebalances the tree after a black node was removed from below parent, with
+ * node (which may be NULL) taking its place.
+ */
+static void rb_erase_fixup(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent) {
+	while(node != tree->root && (!node || node->colour == RB_BLACK)) {
+		if(node == parent->left) {
+			rb_node_t *sibling = parent->right;
+
+			if(sibling->colour == RB_RED) {
+				sibling->colour = RB_BLACK;
+				parent->colour = RB_RED;
+				rb_rotate_left(tree, parent);
+				sibling = parent->right;
+			}
+
+			if((!sibling->left || sibling->left->colour == RB_BLACK) &&
+			   (!sibling->right || sibling->right->colour == RB_BLACK)) {
+				sibling->colour = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if(!sibling->right || sibling->right->colour == RB_BLACK) {
+				sibling->left->colour = RB_BLACK;
+				sibling->colour = RB_RED;
+				rb_rotate_right(tree, sibling);
+				sibling = parent->right;
+			}
+
+			sibling->colour = parent->colour;
+			parent->colour = RB_BLACK;
+			sibling->right->colour = RB_BLACK;
+			rb_rotate_left(tree, parent);
+		} else {
+			rb_node_t *sibling = parent->left;
+
+			if(sibling->colour == RB_RED) {
+				sibling->colour = RB_BLACK;
+				parent->colour = RB_RED;
+				rb_rotate_right(tree, parent);
+				sibling = parent->left;
+			}
+
+			if((!sibling->left || sibling->left->colour == RB_BLACK) &&
+			   (!sibling->right || sibling->right->colour == RB_BLACK)) {
+				sibling->colour = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if(!sibling->left || sibling->left->colour == RB_BLACK) {
+				sibling->right->colour = RB_BLACK;
+				sibling->colour = RB_RED;
+				rb_rotate_left(tree, sibling);
+				sibling = parent->left;
+			}
+
+			sibling->colour = parent->colour;
+			parent->colour = RB_BLACK;
+			sibling->left->colour = RB_BLACK;
+			rb_rotate_right(tree, parent);
+		}
+
+		node = tree->root;
+		break;
+	}
+
+	if(node) {
+		node->colour = RB_BLACK;
+	}
+}
+
+/*
+ * Removes a node from the tree.
+ */
+void rb_erase(rb_tree_t *tree, rb_node_t *node) {
+	rb_node_t *child, *parent;
+	int colour;
+
+	if(tree->leftmost == node) {
+		tree->leftmost = rb_next(node);
+	}
+
+	if(node->left && node->right) {
+		// Swap in the successor, which has no left child
+		rb_node_t *successor = node->right;
+
+		while(successor->left) {
+			successor = successor->left;
+		}
+
+		child = successor->right;
+		parent = successor->parent;
+		colour = successor->colour;
+
+		if(parent == node) {
+			parent = successor;
+		} else {
+			if(child) {
+				child->parent = parent;
+			}
+
+			parent->left = child;
+
+			successor->right = node->right;
+			node->right->parent = successor;
+		}
+
+		successor->parent = node->parent;
+		successor->left = node->left;
+		successor->colour = node->colour;
+		node->left->parent = successor;
+
+		rb_replace_child(tree, node->parent, node, successor);
+	} else {
+		child = node->left ? node->left : node->right;
+		parent = node->parent;
+		colour = node->colour;
+
+		if(child) {
+			child->parent = parent;
+		}
+
+		rb_replace_child(tree, parent, node, child);
+	}
+
+	if(colour == RB_BLACK) {
+		rb_erase_fixup(tree, child, parent);
+	}
+
+	node->parent = node->left = node->right = NULL;
+}
+
+/*
+ * Returns the node following this one in order, or NULL if it's the last.
+ */
+rb_node_t *rb_next(rb_node_t *node) {
+	if(node->right) {
+		node = node->right;
+
+		while(node->left) {
+			node = node->left;
+		}
+
+		return node;
+	}
+
+	while(node->parent && node == node->parent->right) {
+		node = node->parent;
+	}
+
+	return node->parent;
+}
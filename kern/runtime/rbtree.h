@@ -0,0 +1,49 @@
+/*
+ * Intrusive red-black tree: the nodes are embedded in the structures stored
+ * in the tree, so inserting and removing never allocates memory. The leftmost
+ * node is cached, so the smallest item can be found in constant time.
+ */
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <types.h>
+
+#define RB_RED		0
+#define RB_BLACK	1
+
+typedef struct rb_node rb_node_t;
+typedef struct rb_tree rb_tree_t;
+
+struct rb_node {
+	rb_node_t *parent, *left, *right;
+	int colour;
+};
+
+/*
+ * Returns a negative value if a sorts before b, and anything else otherwise;
+ * nodes comparing equal are inserted after existing ones.
+ */
+typedef int (*rb_compare_t)(rb_node_t *a, rb_node_t *b);
+
+struct rb_tree {
+	rb_node_t *root;
+	rb_node_t *leftmost;
+
+	rb_compare_t compare;
+};
+
+// Gets the structure containing the node
+#define rb_entry(node, type, member) ((type *) ((uint8_t *) (node) - offsetof(type, member)))
+
+void rb_tree_init(rb_tree_t *tree, rb_compare_t compare);
+
+void rb_insert(rb_tree_t *tree, rb_node_t *node);
+void rb_erase(rb_tree_t *tree, rb_node_t *node);
+
+rb_node_t *rb_next(rb_node_t *node);
+
+static inline rb_node_t *rb_first(rb_tree_t *tree) {
+	return tree->leftmost;
+}
+
+#endif
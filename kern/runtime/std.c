@@ -625,4 +625,29 @@ unsigned int mstd_popCnt(uint32_t x) {
 	// Get rid of garbage and make a final value
 	x &= 0xF0F0F0F;
 	return (x * 0x01010101) >> 24;
-}
\ No newline at end of file
+}
+
+/*
+ * Divides a 64-bit dividend by a 32-bit divisor, optionally storing the
+ * remainder. The kernel isn't linked against libgcc, so this avoids the calls
+ * to __udivdi3 that gcc would otherwise emit for 64-bit division on i386.
+ */
+uint64_t mstd_div_u64(uint64_t dividend, uint32_t divisor, uint32_t *remainder) {
+	uint32_t high = dividend >> 32;
+	uint32_t low = dividend & 0xFFFFFFFF;
+	uint32_t quot_high = 0, quot_low, rem;
+
+	// Divide the high word first, so the second DIVL cannot overflow
+	if(high >= divisor) {
+		quot_high = high / divisor;
+		high %= divisor;
+	}
+
+	__asm__("divl %4" : "=a"(quot_low), "=d"(rem) : "a"(low), "d"(high), "rm"(divisor));
+
+	if(remainder) {
+		*remainder = rem;
+	}
+
+	return ((uint64_t) quot_high << 32) | quot_low;
+}
@@ -72,5 +72,6 @@ int vsnprintf(char* str, size_t size, const char* format, va_list ap);
 
 // MosquitOS extensions
 unsigned int mstd_popCnt(uint32_t x);
+uint64_t mstd_div_u64(uint64_t dividend, uint32_t divisor, uint32_t *remainder);
 
 #endif
\ No newline at end of file
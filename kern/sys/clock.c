@@ -0,0 +1,225 @@
+#include <types.h>
+#include <device/pit.h>
+#include <device/pic.h>
+#include "clock.h"
+#include "system.h"
+#include "sched.h"
+#include "cpuid.h"
+
+static uint64_t clock_tsc_read(void);
+static uint64_t clock_pit_read(void);
+
+static uint32_t clock_calibrate_tsc(void);
+static void clock_calc_mult_shift(clock_source_t *cs, uint32_t freq, uint32_t scale);
+
+// The clock in use, and the last value the PIT clock returned
+static clock_source_t clock_source;
+static uint64_t clock_pit_last;
+
+/*
+ * Calibrates the TSC and selects the clock to use. The PIT must already be
+ * configured to generate the system tick when this is called.
+ *
+ * Passing clocksource=pit or clocksource=tsc on the kernel command line
+ * forces the respective clock.
+ */
+void clock_init(void) {
+	uint32_t eax, ebx, ecx, edx;
+	char *forced = sys_get_argument("clocksource");
+
+	uint32_t tsc_khz = 0;
+	bool invariant = false;
+
+	// Does the CPU have a TSC at all?
+	cpuid(1, eax, ebx, ecx, edx);
+
+	if(edx & CPUID_FEAT_EDX_TSC) {
+		// Check for an invariant TSC (CPUID 0x80000007, EDX bit 8)
+		cpuid(0x80000000, eax, ebx, ecx, edx);
+
+		if(eax >= 0x80000007) {
+			cpuid(0x80000007, eax, ebx, ecx, edx);
+			invariant = (edx & (1 << 8)) ? true : false;
+		}
+
+		if(!forced || strcmp(forced, "pit") != 0) {
+			tsc_khz = clock_calibrate_tsc();
+		}
+	}
+
+	if(tsc_khz == 0 && forced && strcmp(forced, "tsc") == 0) {
+		kprintf("clock: TSC requested, but it could not be calibrated\n");
+	}
+
+	memclr(&clock_source, sizeof(clock_source_t));
+
+	if(tsc_khz != 0) {
+		clock_source.name = "tsc";
+		clock_source.is_tsc = true;
+		clock_source.read = clock_tsc_read;
+		clock_source.freq_khz = tsc_khz;
+
+		clock_calc_mult_shift(&clock_source, tsc_khz, NSEC_PER_MSEC);
+
+		kprintf("clock: TSC at %u.%03u MHz%s\n", tsc_khz / 1000, tsc_khz % 1000, invariant ? " (invariant)" : "");
+	} else {
+		clock_source.name = "pit";
+		clock_source.is_tsc = false;
+		clock_source.read = clock_pit_read;
+		clock_source.freq_khz = PIT_FREQUENCY / 1000;
+
+		clock_calc_mult_shift(&clock_source, PIT_FREQUENCY, NSEC_PER_SEC);
+
+		kprintf("clock: TSC unusable, using PIT\n");
+	}
+
+	// Time starts now
+	clock_source.base_cycles = clock_source.read();
+	clock_source.base_ns = 0;
+}
+
+/*
+ * Returns the clock that's in use.
+ */
+clock_source_t* clock_get_source(void) {
+	return &clock_source;
+}
+
+/*
+ * Returns the number of nanoseconds since the clock was initialised. This is
+ * guaranteed to never go backwards.
+ */
+uint64_t ktime_get_ns(void) {
+	uint64_t cycles;
+
+	if(likely(clock_source.is_tsc)) {
+		cycles = sys_rdtsc();
+	} else if(clock_source.read) {
+		cycles = clock_source.read();
+	} else {
+		return 0;
+	}
+
+	return clock_source.base_ns + clock_mul_u64_u32_shr(cycles - clock_source.base_cycles, clock_source.mult, clock_source.shift);
+}
+
+/*
+ * Converts a number of cycles of the clock into nanoseconds.
+ */
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+	return clock_mul_u64_u32_shr(cycles, clock_source.mult, clock_source.shift);
+}
+
+/*
+ * Converts nanoseconds to cycles of the clock. This is intended for short
+ * intervals: ns * freq_khz must fit in 64 bits (roughly 30 minutes at 10GHz.)
+ */
+uint64_t clock_ns_to_cycles(uint64_t ns) {
+	return mstd_div_u64(ns * clock_source.freq_khz, NSEC_PER_MSEC, NULL);
+}
+
+/*
+ * Reads the TSC.
+ */
+static uint64_t clock_tsc_read(void) {
+	return sys_rdtsc();
+}
+
+/*
+ * Returns the number of PIT input clocks since boot, made up of the number of
+ * system ticks and the current count of channel 0.
+ */
+static uint64_t clock_pit_read(void) {
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	uint64_t ticks = sys_get_ticks();
+	uint16_t count = sys_pit_read_count(0);
+
+	// If the counter wrapped but the tick IRQ is still pending, account for it
+	if(sys_pic_irq_get_irr() & 0x0100) {
+		ticks++;
+		count = sys_pit_read_count(0);
+	}
+
+	uint64_t clocks = (ticks * SCHED_TIMESLICE) + (SCHED_TIMESLICE - count);
+
+	// Never go backwards, even if the latch was read across a reload
+	if(clocks < clock_pit_last) {
+		clocks = clock_pit_last;
+	}
+
+	clock_pit_last = clocks;
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+
+	return clocks;
+}
+
+/*
+ * Measures how many TSC cycles elapse during a fixed PIT channel 2 count,
+ * a few times over. Returns the TSC frequency in kHz, or 0 if the runs didn't
+ * agree with each other, which points at the TSC being unstable.
+ */
+static uint32_t clock_calibrate_tsc(void) {
+	uint64_t min = 0, max = 0;
+
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	for(int i = 0; i < CLOCK_CALIBRATE_RUNS; i++) {
+		sys_pit_ch2_oneshot(CLOCK_CALIBRATE_PIT_COUNT);
+
+		uint64_t start = sys_rdtsc();
+		uint32_t loops = 0;
+
+		while(!sys_pit_ch2_expired()) {
+			// The count should expire in ~10ms; give up if it doesn't
+			if(++loops > 0x1000000) {
+				min = 0;
+				goto done;
+			}
+		}
+
+		uint64_t delta = sys_rdtsc() - start;
+
+		if(i == 0 || delta < min) min = delta;
+		if(i == 0 || delta > max) max = delta;
+	}
+
+	// Do the runs agree closely enough?
+	if(min == 0 || (max - min) > mstd_div_u64(min * CLOCK_CALIBRATE_TOLERANCE, 1000, NULL)) {
+		min = 0;
+	}
+
+done: ;
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+
+	// Convert to kHz: cycles * PIT_FREQUENCY / (count * 1000)
+	return (uint32_t) mstd_div_u64(min * PIT_FREQUENCY, CLOCK_CALIBRATE_PIT_COUNT * 1000, NULL);
+}
+
+/*
+ * Calculates the largest shift (and corresponding multiplier) such that the
+ * multiplier still fits into 32 bits. A counter running at freq units per
+ * second converts to nanoseconds with scale = nanoseconds per unit.
+ */
+static void clock_calc_mult_shift(clock_source_t *cs, uint32_t freq, uint32_t scale) {
+	uint32_t shift;
+	uint64_t mult = 0;
+
+	for(shift = 32; shift > 0; shift--) {
+		mult = mstd_div_u64((uint64_t) scale << shift, freq, NULL);
+
+		if(!(mult >> 32)) {
+			break;
+		}
+	}
+
+	cs->mult = (uint32_t) mult;
+	cs->shift = shift;
+}
@@ -0,0 +1,68 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <types.h>
+
+/*
+ * The clocksource layer provides a cheap, monotonic nanosecond clock. At boot,
+ * the TSC is calibrated against channel 2 of the PIT; if the TSC is missing or
+ * does not calibrate consistently, the PIT tick count plus the latched channel
+ * 0 counter is used instead.
+ *
+ * Raw counter values are converted to nanoseconds with a fixed-point multiply
+ * and shift, i.e. ns = (cycles * mult) >> shift.
+ */
+#define NSEC_PER_SEC 1000000000
+#define NSEC_PER_MSEC 1000000
+#define NSEC_PER_USEC 1000
+
+// Number of PIT input clocks in a calibration window (~10ms)
+#define CLOCK_CALIBRATE_PIT_COUNT 11932
+// How many calibration runs are done, and how far they may differ (in 1/1000)
+#define CLOCK_CALIBRATE_RUNS 3
+#define CLOCK_CALIBRATE_TOLERANCE 10
+
+typedef struct clock_source {
+	const char *name;
+	bool is_tsc;
+
+	// Reads the raw counter
+	uint64_t (*read)(void);
+
+	// Fixed-point conversion from counter cycles to nanoseconds
+	uint32_t mult;
+	uint32_t shift;
+
+	// Counter frequency in kHz
+	uint32_t freq_khz;
+
+	// Counter value and nanosecond time at which the clock was started
+	uint64_t base_cycles;
+	uint64_t base_ns;
+} clock_source_t;
+
+void clock_init(void);
+clock_source_t* clock_get_source(void);
+
+uint64_t ktime_get_ns(void);
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+uint64_t clock_ns_to_cycles(uint64_t ns);
+
+/*
+ * Multiplies a 64-bit value by a 32-bit value and shifts the 96-bit result
+ * right, without needing a 64x64 bit multiply.
+ */
+static inline uint64_t clock_mul_u64_u32_shr(uint64_t a, uint32_t mul, uint32_t shift) {
+	uint32_t high = a >> 32;
+	uint32_t low = a & 0xFFFFFFFF;
+
+	uint64_t ret = ((uint64_t) low * mul) >> shift;
+
+	if(high) {
+		ret += ((uint64_t) high * mul) << (32 - shift);
+	}
+
+	return ret;
+}
+
+#endif
@@ -0,0 +1,506 @@
+#include <types.h>
+#include <errno.h>
+#include "epoll.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "timer.h"
+#include "clock.h"
+#include "system.h"
+#include "msg.h"
+#include "pipe.h"
+#include "uaccess.h"
+#include "io/debug_console.h"
+
+static void epoll_release(file_t *file);
+
+static const file_ops_t epoll_ops = {
+	.release = epoll_release
+};
+
+static void epoll_bench_cmd(int argc, char **argv);
+
+static int epoll_cmd_init(void) {
+	debugcon_register("epollbench", "Measures event delivery with 1000 idle files registered ('epollbench [count]')", epoll_bench_cmd);
+	return 0;
+}
+
+module_init(epoll_cmd_init);
+
+/*
+ * Creates an event poll object.
+ */
+int epoll_create(file_t **file) {
+	epoll_t *ep = (epoll_t *) kmalloc(sizeof(epoll_t));
+
+	if(!ep) {
+		return -ENOMEM;
+	}
+
+	memclr(ep, sizeof(epoll_t));
+	wait_queue_init(&ep->wq);
+	mutex_init(&ep->mutex);
+
+	*file = file_alloc(&epoll_ops, ep);
+
+	if(!*file) {
+		kfree(ep);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Puts an item on the ready list, unless it's on it already. The object must
+ * be locked.
+ */
+static void epoll_queue_locked(epoll_t *ep, epoll_item_t *item) {
+	if(item->ready) {
+		return;
+	}
+
+	item->ready = true;
+	item->ready_next = NULL;
+
+	if(ep->ready_last) {
+		ep->ready_last->ready_next = item;
+	} else {
+		ep->ready_first = item;
+	}
+
+	ep->ready_last = item;
+	ep->nr_ready++;
+}
+
+/*
+ * Takes the first item off the ready list; the object must be locked.
+ */
+static epoll_item_t *epoll_dequeue_locked(epoll_t *ep) {
+	epoll_item_t *item = ep->ready_first;
+
+	if(item) {
+		ep->ready_first = item->ready_next;
+
+		if(!ep->ready_first) {
+			ep->ready_last = NULL;
+		}
+
+		item->ready = false;
+		ep->nr_ready--;
+	}
+
+	return item;
+}
+
+/*
+ * Wait queue callback, with the file's wait queue locked: its readiness may
+ * have changed, so it's queued to be looked at by the next wait.
+ */
+static void epoll_notify(wait_queue_watch_t *watch) {
+	epoll_item_t *item = (epoll_item_t *) ((uint8_t *) watch - offsetof(epoll_item_t, watch));
+	epoll_t *ep = item->ep;
+
+	uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+
+	epoll_queue_locked(ep, item);
+	wait_queue_wake_all_locked(&ep->wq);
+
+	spin_unlock_irqrestore(&ep->wq.lock, irq);
+}
+
+/*
+ * Unregisters an item, and frees it. The mutex must be held, unless the
+ * object is going away.
+ */
+static void epoll_remove(epoll_t *ep, epoll_item_t *item) {
+	// After this, the callback can't queue the item again
+	wait_queue_remove_watch(item->wq, &item->watch);
+
+	uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+
+	if(item->ready) {
+		epoll_item_t **link = &ep->ready_first;
+		epoll_item_t *prev = NULL;
+
+		while(*link != item) {
+			prev = *link;
+			link = &(*link)->ready_next;
+		}
+
+		*link = item->ready_next;
+
+		if(ep->ready_last == item) {
+			ep->ready_last = prev;
+		}
+
+		ep->nr_ready--;
+	}
+
+	spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+	file_put(item->file);
+	kfree(item);
+}
+
+static void epoll_release(file_t *file) {
+	epoll_t *ep = file->data;
+
+	while(ep->items) {
+		epoll_item_t *item = ep->items;
+		ep->items = item->next;
+
+		epoll_remove(ep, item);
+	}
+
+	kfree(ep);
+}
+
+/*
+ * Adds, changes or removes the registration of target, under the descriptor
+ * fd. Files that can't be polled can't be registered.
+ */
+int epoll_ctl(file_t *file, int op, int fd, file_t *target, const epoll_event_t *event) {
+	if(file->ops != &epoll_ops) {
+		return -EBADF;
+	}
+
+	epoll_t *ep = file->data;
+	int ret = 0;
+
+	mutex_lock(&ep->mutex);
+
+	epoll_item_t **link = &ep->items;
+
+	while(*link && (*link)->fd != fd) {
+		link = &(*link)->next;
+	}
+
+	epoll_item_t *item = *link;
+
+	switch(op) {
+		case EPOLL_CTL_ADD: {
+			if(item) {
+				ret = -EBUSY;
+				break;
+			}
+
+			if(!target->ops->poll) {
+				ret = -EINVAL;
+				break;
+			}
+
+			item = (epoll_item_t *) kmalloc(sizeof(epoll_item_t));
+
+			if(!item) {
+				ret = -ENOMEM;
+				break;
+			}
+
+			memclr(item, sizeof(epoll_item_t));
+			item->ep = ep;
+			item->fd = fd;
+			item->file = target;
+			item->event = *event;
+			item->watch.notify = epoll_notify;
+
+			file_get(target);
+			target->ops->poll(target, &item->wq);
+			wait_queue_add_watch(item->wq, &item->watch);
+
+			item->next = ep->items;
+			ep->items = item;
+
+			// It may be ready already; the next wait finds out
+			uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+			epoll_queue_locked(ep, item);
+			wait_queue_wake_all_locked(&ep->wq);
+			spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+			break;
+		}
+
+		case EPOLL_CTL_MOD: {
+			if(!item) {
+				ret = -ENOTFOUND;
+				break;
+			}
+
+			uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+			item->event = *event;
+			epoll_queue_locked(ep, item);
+			wait_queue_wake_all_locked(&ep->wq);
+			spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+			break;
+		}
+
+		case EPOLL_CTL_DEL:
+			if(!item) {
+				ret = -ENOTFOUND;
+				break;
+			}
+
+			*link = item->next;
+			epoll_remove(ep, item);
+			break;
+
+		default:
+			ret = -EINVAL;
+			break;
+	}
+
+	mutex_unlock(&ep->mutex);
+
+	return ret;
+}
+
+/*
+ * Goes through the items that were on the ready list, and stores the events
+ * of those that are actually ready. Level triggered ones stay on the list.
+ */
+static int epoll_collect(epoll_t *ep, epoll_event_t *events, int max) {
+	int count = 0;
+
+	mutex_lock(&ep->mutex);
+
+	uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+
+	// Items queued again below, or by callbacks meanwhile, wait for next time
+	for(unsigned int n = ep->nr_ready; n && count < max; n--) {
+		epoll_item_t *item = epoll_dequeue_locked(ep);
+
+		if(!item) {
+			break;
+		}
+
+		spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+		wait_queue_t *wq;
+		uint32_t mask = item->file->ops->poll(item->file, &wq);
+		mask &= item->event.events | FILE_POLL_ERR | FILE_POLL_HUP;
+
+		irq = spin_lock_irqsave(&ep->wq.lock);
+
+		if(mask) {
+			events[count].events = mask;
+			events[count].data = item->event.data;
+			count++;
+
+			if(!(item->event.events & EPOLL_ET)) {
+				epoll_queue_locked(ep, item);
+			}
+		}
+	}
+
+	spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+	mutex_unlock(&ep->mutex);
+
+	return count;
+}
+
+// A waiter's timeout; lives on its stack
+typedef struct epoll_timeout {
+	epoll_t *ep;
+
+	volatile bool expired;
+	volatile bool done;
+} epoll_timeout_t;
+
+/*
+ * Timer callback: wakes up the waiters, so the one whose timeout this is sees
+ * that it expired.
+ */
+static void epoll_timeout(void *context) {
+	epoll_timeout_t *timeout = context;
+	epoll_t *ep = timeout->ep;
+
+	uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+
+	timeout->expired = true;
+	wait_queue_wake_all_locked(&ep->wq);
+
+	spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+	// Last access; the waiter may return as soon as it sees this
+	timeout->done = true;
+}
+
+/*
+ * Waits until at least one registered file is ready, or timeout_ms passed,
+ * and stores up to max events. A timeout of 0 doesn't wait at all; one of
+ * EPOLL_NO_TIMEOUT waits forever. Returns the number of events.
+ */
+int epoll_wait(file_t *file, epoll_event_t *events, int max, int timeout_ms, uint32_t flags) {
+	if(file->ops != &epoll_ops) {
+		return -EBADF;
+	}
+
+	if(max <= 0) {
+		return -EINVAL;
+	}
+
+	if(max > EPOLL_MAX_EVENTS) {
+		max = EPOLL_MAX_EVENTS;
+	}
+
+	if(!(flags & FILE_IO_KERNEL) && !access_ok(events, max * sizeof(epoll_event_t))) {
+		return -EFAULT;
+	}
+
+	if(timeout_ms != 0 && !sched_can_block()) {
+		return -EINVAL;
+	}
+
+	epoll_t *ep = file->data;
+	epoll_event_t ready[EPOLL_MAX_EVENTS];
+
+	epoll_timeout_t timeout;
+	ktimer_t timer;
+	bool timed = timeout_ms > 0;
+
+	timeout.ep = ep;
+	timeout.expired = timeout.done = false;
+
+	if(timed) {
+		memclr(&timer, sizeof(ktimer_t));
+		timer_add(&timer, ktime_get_ns() + ((uint64_t) timeout_ms * NSEC_PER_MSEC), epoll_timeout, &timeout);
+	}
+
+	int count;
+
+	while(!(count = epoll_collect(ep, ready, max)) && timeout_ms != 0) {
+		uint32_t irq = spin_lock_irqsave(&ep->wq.lock);
+
+		while(!ep->nr_ready && !timeout.expired) {
+			irq = wait_queue_sleep_locked(&ep->wq, irq);
+		}
+
+		bool expired = timeout.expired;
+		spin_unlock_irqrestore(&ep->wq.lock, irq);
+
+		if(expired) {
+			count = epoll_collect(ep, ready, max);
+			break;
+		}
+	}
+
+	// If the timer fired, its callback may still be using the timeout
+	if(timed && !timer_cancel(&timer)) {
+		while(!timeout.done) {
+			__asm__ volatile("pause" : : : "memory");
+		}
+	}
+
+	if(file_copy_out(events, ready, count * sizeof(epoll_event_t), flags)) {
+		return -EFAULT;
+	}
+
+	return count;
+}
+
+/*
+ * Debug console command: registers 1000 idle channel server ends and a pipe
+ * with an event poll object, and measures writing a byte to the pipe, waiting
+ * for it, and reading it back. For comparison, it then measures polling every
+ * file instead of waiting.
+ */
+#define EPOLL_BENCH_IDLE 1000
+
+static void epoll_bench_cmd(int argc, char **argv) {
+	unsigned int count = 10000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	file_t **idle = (file_t **) kmalloc(EPOLL_BENCH_IDLE * 2 * sizeof(file_t *));
+	file_t *ep, *read_end, *write_end;
+
+	if(!idle || epoll_create(&ep)) {
+		kprintf("epollbench: out of memory\n");
+		return;
+	}
+
+	epoll_event_t event = { FILE_POLL_IN, 0 };
+
+	// Clients are kept open, so the servers don't hang up
+	for(int i = 0; i < EPOLL_BENCH_IDLE; i++) {
+		if(channel_create(&idle[i * 2], &idle[(i * 2) + 1])) {
+			kprintf("epollbench: out of memory\n");
+			return;
+		}
+
+		event.data = i;
+		epoll_ctl(ep, EPOLL_CTL_ADD, i, idle[i * 2], &event);
+	}
+
+	if(pipe_create(&read_end, &write_end)) {
+		kprintf("epollbench: out of memory\n");
+		return;
+	}
+
+	event.data = EPOLL_BENCH_IDLE;
+	epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_BENCH_IDLE, read_end, &event);
+
+	epoll_event_t events[8];
+	uint8_t byte = 0;
+	unsigned int missed = 0;
+
+	// The first wait finds all files freshly registered
+	epoll_wait(ep, events, 8, 0, FILE_IO_KERNEL);
+
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		file_write(write_end, &byte, 1, FILE_IO_KERNEL);
+
+		if(epoll_wait(ep, events, 8, 0, FILE_IO_KERNEL) != 1 || events[0].data != EPOLL_BENCH_IDLE) {
+			missed++;
+		}
+
+		file_read(read_end, &byte, 1, FILE_IO_KERNEL);
+	}
+
+	uint64_t epoll_cycles = sys_rdtsc() - start;
+
+	start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		file_write(write_end, &byte, 1, FILE_IO_KERNEL);
+
+		for(int j = 0; j < EPOLL_BENCH_IDLE; j++) {
+			wait_queue_t *wq;
+			idle[j * 2]->ops->poll(idle[j * 2], &wq);
+		}
+
+		wait_queue_t *wq;
+		read_end->ops->poll(read_end, &wq);
+
+		file_read(read_end, &byte, 1, FILE_IO_KERNEL);
+	}
+
+	uint64_t scan_cycles = sys_rdtsc() - start;
+
+	file_put(ep);
+	file_put(read_end);
+	file_put(write_end);
+
+	for(int i = 0; i < EPOLL_BENCH_IDLE * 2; i++) {
+		file_put(idle[i]);
+	}
+
+	kfree(idle);
+
+	uint32_t epoll_each = (uint32_t) mstd_div_u64(epoll_cycles, count, NULL);
+	uint32_t scan_each = (uint32_t) mstd_div_u64(scan_cycles, count, NULL);
+
+	kprintf("epollbench: %u events, %u missed; wait %u cycles each, scan %u cycles each", count, missed, epoll_each, scan_each);
+
+	if(clock_get_source()->is_tsc) {
+		kprintf(" (%u ns, %u ns)", (uint32_t) clock_cycles_to_ns(epoll_each), (uint32_t) clock_cycles_to_ns(scan_each));
+	}
+
+	kprintf("\n");
+}
@@ -0,0 +1,76 @@
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include <types.h>
+#include "file.h"
+#include "sync.h"
+#include "waitqueue.h"
+
+/*
+ * Event poll objects: a task registers any number of files with one, and then
+ * waits for any of them to become ready. Each registered file has its wait
+ * queue watched, and the callback puts it on the ready list, so waiting only
+ * ever looks at files that changed, no matter how many are registered.
+ *
+ * Files are level triggered, and reported by every wait while they're ready,
+ * unless registered with EPOLL_ET; those are reported once per change.
+ * Registrations hold a reference to their file, so they stay until removed,
+ * even if the descriptor is closed.
+ */
+
+// Most events returned by a single wait
+#define EPOLL_MAX_EVENTS 64
+
+// Control operations
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+// Event bits, in addition to the FILE_POLL ones
+#define EPOLL_ET 0x80000000
+
+// Timeout waiting forever
+#define EPOLL_NO_TIMEOUT -1
+
+typedef struct epoll_event {
+	uint32_t events;
+	uint32_t data;
+} epoll_event_t;
+
+struct epoll;
+
+// A registered file
+typedef struct epoll_item {
+	struct epoll *ep;
+
+	int fd;
+	file_t *file;
+	epoll_event_t event;
+
+	wait_queue_watch_t watch;
+	struct wait_queue *wq;
+
+	// Ready list linkage
+	bool ready;
+	struct epoll_item *ready_next;
+
+	struct epoll_item *next;
+} epoll_item_t;
+
+typedef struct epoll {
+	// Waiters; its lock protects the ready list
+	wait_queue_t wq;
+
+	epoll_item_t *ready_first, *ready_last;
+	unsigned int nr_ready;
+
+	// Held while changing the registrations, or collecting events
+	mutex_t mutex;
+	epoll_item_t *items;
+} epoll_t;
+
+int epoll_create(file_t **file);
+int epoll_ctl(file_t *file, int op, int fd, file_t *target, const epoll_event_t *event);
+int epoll_wait(file_t *file, epoll_event_t *events, int max, int timeout_ms, uint32_t flags);
+
+#endif
@@ -0,0 +1,184 @@
+#include <types.h>
+#include <errno.h>
+#include "file.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "spinlock.h"
+#include "uaccess.h"
+
+/*
+ * Allocates a file with a single reference, which the caller owns.
+ */
+file_t *file_alloc(const file_ops_t *ops, void *data) {
+	file_t *file = (file_t *) kmalloc(sizeof(file_t));
+
+	if(!file) {
+		return NULL;
+	}
+
+	file->ops = ops;
+	file->data = data;
+	file->refs = 1;
+
+	return file;
+}
+
+void file_get(file_t *file) {
+	__sync_fetch_and_add(&file->refs, 1);
+}
+
+/*
+ * Drops a reference to a file, releasing it when it was the last.
+ */
+void file_put(file_t *file) {
+	if(__sync_sub_and_fetch(&file->refs, 1) != 0) {
+		return;
+	}
+
+	if(file->ops->release) {
+		file->ops->release(file);
+	}
+
+	kfree(file);
+}
+
+int file_read(file_t *file, void *buf, uint32_t len, uint32_t flags) {
+	if(!file->ops->read) {
+		return -EINVAL;
+	}
+
+	int ret = file->ops->read(file, buf, len, flags);
+
+	if(ret > 0) {
+		rusage_io(ret, false);
+	}
+
+	return ret;
+}
+
+int file_write(file_t *file, const void *buf, uint32_t len, uint32_t flags) {
+	if(!file->ops->write) {
+		return -EINVAL;
+	}
+
+	int ret = file->ops->write(file, buf, len, flags);
+
+	if(ret > 0) {
+		rusage_io(ret, true);
+	}
+
+	return ret;
+}
+
+/*
+ * Copies out to the buffer of a read, which is in user space unless the flags
+ * say otherwise. Returns 0, or -EFAULT.
+ */
+int file_copy_out(void *to, const void *from, uint32_t len, uint32_t flags) {
+	if(flags & FILE_IO_KERNEL) {
+		memcpy(to, (void *) from, len);
+		return 0;
+	}
+
+	return copy_to_user(to, from, len);
+}
+
+/*
+ * Copies in from the buffer of a write.
+ */
+int file_copy_in(void *to, const void *from, uint32_t len, uint32_t flags) {
+	if(flags & FILE_IO_KERNEL) {
+		memcpy(to, (void *) from, len);
+		return 0;
+	}
+
+	return copy_from_user(to, from, len);
+}
+
+/*
+ * Gives a file a descriptor in the calling process, taking over the caller's
+ * reference. Returns the descriptor, or -EMFILE if the table is full, in
+ * which case the caller still owns the reference.
+ */
+int file_install(file_t *file) {
+	i386_task_t *leader = ((i386_task_t *) sched_curr_task())->leader;
+	uint32_t flags = spin_lock_irqsave(&leader->files_lock);
+
+	for(int fd = 0; fd < TASK_MAX_FILES; fd++) {
+		if(!leader->files[fd]) {
+			leader->files[fd] = file;
+			spin_unlock_irqrestore(&leader->files_lock, flags);
+
+			return fd;
+		}
+	}
+
+	spin_unlock_irqrestore(&leader->files_lock, flags);
+	return -EMFILE;
+}
+
+/*
+ * Returns the file a descriptor of the calling process refers to, with a
+ * reference the caller must drop with file_put; or NULL if it's not open.
+ */
+file_t *file_lookup(int fd) {
+	return file_lookup_in(((i386_task_t *) sched_curr_task())->leader, fd);
+}
+
+/*
+ * Same, but for a descriptor of the given process, whose leader this is.
+ */
+file_t *file_lookup_in(struct task *leader, int fd) {
+	if(fd < 0 || fd >= TASK_MAX_FILES) {
+		return NULL;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&leader->files_lock);
+	file_t *file = leader->files[fd];
+
+	if(file) {
+		file_get(file);
+	}
+
+	spin_unlock_irqrestore(&leader->files_lock, flags);
+
+	return file;
+}
+
+/*
+ * Closes a descriptor of the calling process.
+ */
+int file_close(int fd) {
+	i386_task_t *leader = ((i386_task_t *) sched_curr_task())->leader;
+
+	if(fd < 0 || fd >= TASK_MAX_FILES) {
+		return -EBADF;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&leader->files_lock);
+	file_t *file = leader->files[fd];
+	leader->files[fd] = NULL;
+	spin_unlock_irqrestore(&leader->files_lock, flags);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	file_put(file);
+	return 0;
+}
+
+/*
+ * Closes all descriptors of a process that's going away.
+ */
+void file_close_all(i386_task_t *leader) {
+	for(int fd = 0; fd < TASK_MAX_FILES; fd++) {
+		file_t *file = leader->files[fd];
+
+		if(file) {
+			leader->files[fd] = NULL;
+			file_put(file);
+		}
+	}
+}
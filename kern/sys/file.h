@@ -0,0 +1,68 @@
+#ifndef FILE_H
+#define FILE_H
+
+#include <types.h>
+
+/*
+ * Open files: kernel objects (such as pipes and message channels) that a
+ * process refers to by descriptor, an index into its leader's file table.
+ * Threads share the table. Files are reference counted; each descriptor holds
+ * a reference, as does anyone using the file, so closing a descriptor while
+ * another thread is blocked on it is safe.
+ */
+
+// Flags for reads and writes: the buffer is in the kernel, not user space
+#define FILE_IO_KERNEL 0x01
+
+// Readiness reported by poll
+#define FILE_POLL_IN	0x001
+#define FILE_POLL_OUT	0x004
+#define FILE_POLL_ERR	0x008
+#define FILE_POLL_HUP	0x010
+
+struct file;
+struct wait_queue;
+
+typedef struct file_ops {
+	// Return the number of bytes transferred, or a negative error code
+	int (*read)(struct file *file, void *buf, uint32_t len, uint32_t flags);
+	int (*write)(struct file *file, const void *buf, uint32_t len, uint32_t flags);
+
+	/*
+	 * Returns which FILE_POLL bits apply right now, and stores the wait queue
+	 * that's woken up whenever they may have changed in wq.
+	 */
+	uint32_t (*poll)(struct file *file, struct wait_queue **wq);
+
+	// Called when the last reference goes away
+	void (*release)(struct file *file);
+} file_ops_t;
+
+typedef struct file {
+	const file_ops_t *ops;
+	void *data;
+
+	volatile uint32_t refs;
+} file_t;
+
+file_t *file_alloc(const file_ops_t *ops, void *data);
+void file_get(file_t *file);
+void file_put(file_t *file);
+
+int file_read(file_t *file, void *buf, uint32_t len, uint32_t flags);
+int file_write(file_t *file, const void *buf, uint32_t len, uint32_t flags);
+
+// Copy to or from a read or write buffer, depending on FILE_IO_KERNEL
+int file_copy_out(void *to, const void *from, uint32_t len, uint32_t flags);
+int file_copy_in(void *to, const void *from, uint32_t len, uint32_t flags);
+
+// Descriptors of the calling process
+int file_install(file_t *file);
+file_t *file_lookup(int fd);
+int file_close(int fd);
+
+struct task;
+file_t *file_lookup_in(struct task *leader, int fd);
+void file_close_all(struct task *leader);
+
+#endif
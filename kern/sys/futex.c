@@ -0,0 +1,257 @@
+#include <types.h>
+#include <errno.h>
+#include "futex.h"
+#include "task.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "clock.h"
+#include "paging.h"
+#include "uaccess.h"
+#include "io/debug_console.h"
+
+/*
+ * A task waiting on a futex. It lives on the waiting task's stack, so anyone
+ * touching it must do so with the bucket locked, or, for the timeout timer,
+ * before setting timer_done.
+ */
+typedef struct futex_waiter {
+	// Physical address of the word
+	uint32_t key;
+	void *task;
+
+	struct futex_waiter *prev, *next;
+	struct futex_bucket *bucket;
+
+	volatile bool queued;
+	volatile bool timed_out;
+	volatile bool timer_done;
+} futex_waiter_t;
+
+typedef struct futex_bucket {
+	spinlock_t lock;
+	futex_waiter_t *first, *last;
+} futex_bucket_t;
+
+static futex_bucket_t futex_buckets[FUTEX_HASH_SIZE];
+
+// Statistics
+static uint32_t futex_waits, futex_wakes, futex_timeouts, futex_mismatches;
+
+static void futex_cmd(int argc, char **argv);
+
+static int futex_init(void) {
+	for(int i = 0; i < FUTEX_HASH_SIZE; i++) {
+		spin_lock_init(&futex_buckets[i].lock);
+	}
+
+	debugcon_register("futex", "Futex statistics ('futex reset' clears them)", futex_cmd);
+	return 0;
+}
+
+module_init(futex_init);
+
+/*
+ * Translates the address of a futex word in the current task's address space
+ * to its physical address. Returns 0 if it isn't aligned, or not mapped.
+ */
+static uint32_t futex_key(uint32_t *addr) {
+	uint32_t virt = (uint32_t) addr;
+
+	if(!virt || (virt & 3) || !access_ok(addr, sizeof(uint32_t))) {
+		return 0;
+	}
+
+	i386_task_t *task = sched_curr_task();
+	page_t *page = paging_get_page(virt, false, task->task_state->page_directory);
+
+	if(!page || !page->present) {
+		return 0;
+	}
+
+	return ((page->frame & 0xFFFFF) << 12) | (virt & 0xFFF);
+}
+
+static futex_bucket_t *futex_hash(uint32_t key) {
+	// Words are aligned, and neighbouring ones are often used together
+	return &futex_buckets[((key >> 2) ^ (key >> 12)) & (FUTEX_HASH_SIZE - 1)];
+}
+
+/*
+ * Removes a waiter from its bucket, which must be locked.
+ */
+static void futex_unqueue_locked(futex_bucket_t *bucket, futex_waiter_t *waiter) {
+	if(waiter->prev) {
+		waiter->prev->next = waiter->next;
+	} else {
+		bucket->first = waiter->next;
+	}
+
+	if(waiter->next) {
+		waiter->next->prev = waiter->prev;
+	} else {
+		bucket->last = waiter->prev;
+	}
+
+	waiter->queued = false;
+}
+
+/*
+ * Timer callback: wakes up a waiter whose timeout expired, unless it was
+ * woken up already.
+ */
+static void futex_timeout(void *context) {
+	futex_waiter_t *waiter = context;
+	futex_bucket_t *bucket = waiter->bucket;
+
+	uint32_t flags = spin_lock_irqsave(&bucket->lock);
+
+	if(waiter->queued) {
+		futex_unqueue_locked(bucket, waiter);
+		waiter->timed_out = true;
+
+		sched_wake(waiter->task);
+	}
+
+	spin_unlock_irqrestore(&bucket->lock, flags);
+
+	// Last access; the waiter may return as soon as it sees this
+	waiter->timer_done = true;
+}
+
+/*
+ * Sleeps until futex_wake is called on addr, if it still contains expected.
+ * Checking the word and going to sleep are atomic with respect to wakeups, so
+ * one that comes after user space changed the word isn't lost.
+ *
+ * Returns 0 when woken up, -EAGAIN if the word didn't contain expected,
+ * -ETIMEDOUT if timeout_ns (relative) passed first, or -EFAULT if the address
+ * is invalid.
+ */
+int futex_wait(uint32_t *addr, uint32_t expected, uint64_t timeout_ns) {
+	uint32_t key = futex_key(addr);
+
+	if(!key) {
+		return -EFAULT;
+	}
+
+	if(!sched_can_block()) {
+		return -EINVAL;
+	}
+
+	futex_bucket_t *bucket = futex_hash(key);
+	ktimer_t timer;
+
+	futex_waiter_t waiter;
+	waiter.key = key;
+	waiter.task = sched_curr_task();
+	waiter.bucket = bucket;
+	waiter.timed_out = waiter.timer_done = false;
+
+	uint32_t flags = spin_lock_irqsave(&bucket->lock);
+	uint32_t value;
+
+	if(copy_from_user(&value, addr, sizeof(value))) {
+		spin_unlock_irqrestore(&bucket->lock, flags);
+		return -EFAULT;
+	}
+
+	if(value != expected) {
+		spin_unlock_irqrestore(&bucket->lock, flags);
+
+		__sync_fetch_and_add(&futex_mismatches, 1);
+		return -EAGAIN;
+	}
+
+	waiter.next = NULL;
+	waiter.prev = bucket->last;
+
+	if(bucket->last) {
+		bucket->last->next = &waiter;
+	} else {
+		bucket->first = &waiter;
+	}
+
+	bucket->last = &waiter;
+	waiter.queued = true;
+
+	// Once marked, a wakeup between unlocking and blocking isn't lost
+	sched_prepare_block();
+
+	if(timeout_ns != FUTEX_NO_TIMEOUT) {
+		timer_add(&timer, ktime_get_ns() + timeout_ns, futex_timeout, &waiter);
+	}
+
+	spin_unlock_irqrestore(&bucket->lock, flags);
+
+	__sync_fetch_and_add(&futex_waits, 1);
+	sched_block();
+
+	// Whoever woke us took us off the queue; wait for them to let go
+	flags = spin_lock_irqsave(&bucket->lock);
+	ASSERT(!waiter.queued);
+	spin_unlock_irqrestore(&bucket->lock, flags);
+
+	// If the timer fired, its callback may still be using the waiter
+	if(timeout_ns != FUTEX_NO_TIMEOUT && !timer_cancel(&timer)) {
+		while(!waiter.timer_done) {
+			__asm__ volatile("pause" : : : "memory");
+		}
+	}
+
+	if(waiter.timed_out) {
+		__sync_fetch_and_add(&futex_timeouts, 1);
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+/*
+ * Wakes up at most count tasks waiting on addr, in the order they started
+ * waiting. Returns how many were woken, or -EFAULT if the address is invalid.
+ */
+int futex_wake(uint32_t *addr, unsigned int count) {
+	uint32_t key = futex_key(addr);
+
+	if(!key) {
+		return -EFAULT;
+	}
+
+	futex_bucket_t *bucket = futex_hash(key);
+	int woken = 0;
+
+	uint32_t flags = spin_lock_irqsave(&bucket->lock);
+
+	futex_waiter_t *waiter = bucket->first;
+
+	while(waiter && woken < count) {
+		futex_waiter_t *next = waiter->next;
+
+		if(waiter->key == key) {
+			futex_unqueue_locked(bucket, waiter);
+			sched_wake(waiter->task);
+
+			woken++;
+		}
+
+		waiter = next;
+	}
+
+	spin_unlock_irqrestore(&bucket->lock, flags);
+
+	__sync_fetch_and_add(&futex_wakes, woken);
+	return woken;
+}
+
+/*
+ * Debug console command: prints futex statistics.
+ */
+static void futex_cmd(int argc, char **argv) {
+	if(argc > 1 && !strcmp(argv[1], "reset")) {
+		futex_waits = futex_wakes = futex_timeouts = futex_mismatches = 0;
+		return;
+	}
+
+	kprintf("%u waits (%u timed out, %u value changed), %u tasks woken\n", futex_waits, futex_timeouts, futex_mismatches, futex_wakes);
+}
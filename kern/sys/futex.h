@@ -0,0 +1,21 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <types.h>
+
+/*
+ * Futexes let user space sleep on a word in its own memory: locks and
+ * condition variables are taken with atomic instructions, and only call into
+ * the kernel to wait for, or wake up, a contended word. Waiters are hashed by
+ * the physical address of the word, so tasks that map the same memory at
+ * different addresses still find each other.
+ */
+#define FUTEX_HASH_SIZE 64
+
+// Passed as the timeout to wait without one
+#define FUTEX_NO_TIMEOUT 0
+
+int futex_wait(uint32_t *addr, uint32_t expected, uint64_t timeout_ns);
+int futex_wake(uint32_t *addr, unsigned int count);
+
+#endif
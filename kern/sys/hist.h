@@ -0,0 +1,32 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <types.h>
+
+/*
+ * Log2 histograms, as kept by the scheduler and syscall statistics: bucket n
+ * counts samples in [2^(n-1), 2^n), and bucket 0 counts zero.
+ */
+
+/*
+ * Returns the bucket for a sample: the position of its most significant set
+ * bit, plus one. Samples past the last of the given number of buckets go into
+ * the last one.
+ */
+static inline unsigned int hist_bucket(uint64_t value, unsigned int buckets) {
+	uint32_t hi = value >> 32;
+	uint32_t lo = value & 0xFFFFFFFF;
+	unsigned int bucket;
+
+	if(hi) {
+		bucket = 64 - __builtin_clz(hi);
+	} else if(lo) {
+		bucket = 32 - __builtin_clz(lo);
+	} else {
+		bucket = 0;
+	}
+
+	return (bucket < buckets) ? bucket : (buckets - 1);
+}
+
+#endif
@@ -1,13 +1,16 @@
 #include <types.h>
 #include "irq.h"
 #include "system.h"
-#include "runtime/list.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "percpu.h"
+#include "preempt.h"
+#include "rcu.h"
+#include "clock.h"
+#include "io/debug_console.h"
 #include "runtime/hashmap.h"
 #include "device/pic.h"
 
-// Variable written to by IRQ handlers to indicate last IRQ
-uint32_t irq_last_request_num;
-
 // Definitions of assembly IRQ handlers.
 extern void irq_0(void);
 extern void irq_1(void);
@@ -25,39 +28,202 @@ extern void irq_12(void);
 extern void irq_13(void);
 extern void irq_14(void);
 extern void irq_15(void);
+extern void irq_16(void);
+extern void irq_17(void);
+extern void irq_18(void);
+extern void irq_19(void);
+extern void irq_20(void);
+extern void irq_21(void);
+extern void irq_22(void);
+extern void irq_23(void);
 
-// Type inserted into IRQ handler list.
-typedef struct {
+// Entry in an IRQ's handler chain
+typedef struct irq_handler {
 	irq_t function;
 	void* context;
+
+	// Number of interrupts this handler claimed
+	uint32_t claimed;
+
+	struct irq_handler *next;
+	rcu_head_t rcu;
 } irq_handler_t;
 
-// Holds lists with pointers to IRQ handlers.
-static list_t* irqHandlerList[MAX_IRQ];
+/*
+ * Descriptor of an IRQ line: its chain of handlers, which the interrupt walks
+ * under RCU, and statistics. Lines are only routed to the bootstrap processor,
+ * so the statistics aren't updated concurrently.
+ */
+typedef struct irq_desc {
+	irq_handler_t *handlers;
+	// Serialises changes to the chain
+	spinlock_t lock;
+
+	// Interrupts, and how many of them no handler claimed
+	uint32_t count;
+	uint32_t spurious;
+
+	// TSC cycles the handlers kept interrupts off, in total and at most
+	uint64_t cycles;
+	uint64_t max_cycles;
+
+	// Handler that claimed the last interrupt one did
+	irq_t last_claimed;
+
+	// Set if the line stays masked regardless of its handlers
+	bool disabled;
+} irq_desc_t;
+
+static irq_desc_t irq_descs[MAX_IRQ];
+
+static bool irq_pic_spurious(uint8_t number);
+
+static const irq_chip_t irq_pic_chip = {
+	.name = "8259",
+	.lines = 16,
+
+	.mask = sys_pic_irq_set_mask,
+	.unmask = sys_pic_irq_clear_mask,
+	.eoi = sys_pic_irq_eoi,
+	.spurious = irq_pic_spurious
+};
+
+// Controller lines are currently routed through
+static const irq_chip_t *irq_chip = &irq_pic_chip;
+
+static void irq_stats_cmd(int argc, char **argv);
 
 // Pointers to assembly IRQ handlers.
 static void* irq_handlers[MAX_IRQ] = {
 	irq_0, irq_1, irq_2, irq_3, irq_4, irq_5, irq_6, irq_7,
-	irq_8, irq_9, irq_10, irq_11, irq_12, irq_13, irq_14, irq_15
+	irq_8, irq_9, irq_10, irq_11, irq_12, irq_13, irq_14, irq_15,
+	irq_16, irq_17, irq_18, irq_19, irq_20, irq_21, irq_22, irq_23
 };
 
 /*
- * This IRQ handler is called by assembly routines, with the IRQ number is
- * placed in %eax.
+ * Returns whether an interrupt on IRQ 7 or 15 is a spurious one from the
+ * 8259: it raises these if the line that requested an interrupt deasserted
+ * before it was acknowledged, without setting its in-service bit.
  */
-void irq_handler() {
-	uint32_t number = irq_last_request_num;
+static bool irq_pic_spurious(uint8_t number) {
+	if(number != 7 && number != 15) {
+		return false;
+	}
+
+	if(sys_pic_irq_get_isr() & (1 << number)) {
+		return false;
+	}
+
+	// The slave's spurious interrupts are still acknowledged by the master
+	if(number == 15) {
+		sys_pic_irq_eoi(2);
+	}
+
+	return true;
+}
+
+/*
+ * This IRQ handler is called by assembly routines, with the IRQ number as the
+ * argument. Every handler on the line runs, as several devices sharing it may
+ * have raised it.
+ */
+void irq_handler(uint32_t number) {
+	uint64_t start = sys_rdtsc();
 	ASSERT(number < MAX_IRQ);
-	irq_handler_t *handler;
+	irq_enter();
+
+	irq_desc_t *desc = &irq_descs[number];
+	irq_t claimed = NULL;
+
+	desc->count++;
+
+	if(irq_chip->spurious && irq_chip->spurious(number)) {
+		desc->spurious++;
+
+		irq_exit();
+		return;
+	}
 
 	// Run all registered IRQ handlers
-	for(int i = 0; i < irqHandlerList[number]->num_entries; i++) {
-		handler = (irq_handler_t *) list_get(irqHandlerList[number], i);
-		handler->function(handler->context);
+	rcu_read_lock();
+
+	irq_handler_t *handler = rcu_dereference(desc->handlers);
+
+	while(handler) {
+		if(handler->function(handler->context) == IRQ_HANDLED) {
+			handler->claimed++;
+
+			if(!claimed) {
+				claimed = handler->function;
+			}
+		}
+
+		handler = rcu_dereference(handler->next);
 	}
 
+	rcu_read_unlock();
+
 	// Now, acknowledge the interrupt.
-	sys_pic_irq_eoi(number);
+	irq_chip->eoi(number);
+
+	if(claimed) {
+		desc->last_claimed = claimed;
+	} else {
+		desc->spurious++;
+	}
+
+	// Interrupts were disabled for the whole handler
+	uint64_t cycles = sys_rdtsc() - start;
+
+	desc->cycles += cycles;
+
+	if(cycles > desc->max_cycles) {
+		desc->max_cycles = cycles;
+	}
+
+	irq_exit();
+}
+
+/*
+ * Called at the start of every hardware interrupt handler. Interrupt handlers
+ * run on the interrupted task's stack, so preemption is disabled until they
+ * return.
+ */
+void irq_enter(void) {
+	preempt_disable();
+	percpu_inc(irq_depth);
+	percpu_inc(irq_count);
+}
+
+/*
+ * Called at the end of every hardware interrupt handler, after the interrupt
+ * was acknowledged, to run the bottom halves the handler deferred. Handlers
+ * that interrupted the softirqs leave them to the outermost one. If the
+ * interrupted code could have been preempted, it was not in an RCU read
+ * section, so this is a quiescent state.
+ *
+ * Whether to preempt is checked by the assembly wrapper once this returns.
+ */
+void irq_exit(void) {
+	percpu_dec(irq_depth);
+
+	if(percpu_read(irq_depth) == 0) {
+		// Only our own count: the interrupted code was preemptible
+		if(percpu_read(preempt_count) == 1) {
+			rcu_note_qs();
+		}
+
+		softirq_run();
+	}
+
+	preempt_enable_no_resched();
+}
+
+/*
+ * Returns whether this processor is running a hardware interrupt handler.
+ */
+bool irq_in_handler(void) {
+	return percpu_read(irq_depth) != 0;
 }
 
 /*
@@ -65,7 +231,8 @@ void irq_handler() {
  */
 void irq_init(void) {
 	for(int i = 0; i < MAX_IRQ; i++) {
-		irqHandlerList[i] = list_allocate();
+		irq_descs[i].handlers = NULL;
+		spin_lock_init(&irq_descs[i].lock);
 	}
 
 	// Install IRQ handlers
@@ -74,24 +241,151 @@ void irq_init(void) {
 	}
 }
 
+static int irq_stats_init(void) {
+	debugcon_register("irqs", "Per-IRQ interrupt counts and handler times ('irqs reset' clears them)", irq_stats_cmd);
+	return 0;
+}
+
+module_init(irq_stats_init);
+
 /*
- * Searches if the IRQ handler is already registered for the specified IRQ
- * number.
+ * Prints a number of TSC cycles, and the time it corresponds to if the TSC is
+ * the clock source.
  */
-static bool irq_is_registered(uint8_t number, irq_t function, void* context) {
-	ASSERT(number < MAX_IRQ);
+static void irq_print_cycles(uint64_t cycles, bool tsc) {
+	kprintf("%u", (uint32_t) cycles);
+
+	if(tsc) {
+		kprintf(" (%u ns)", (uint32_t) clock_cycles_to_ns(cycles));
+	}
+}
+
+/*
+ * Debug console command: prints the table of IRQ lines that fired, with how
+ * often no handler claimed the interrupt, the time handlers kept interrupts
+ * disabled on average and at most, and how many interrupts each handler
+ * claimed.
+ */
+static void irq_stats_cmd(int argc, char **argv) {
+	if(argc > 1 && !strcmp(argv[1], "reset")) {
+		for(int i = 0; i < MAX_IRQ; i++) {
+			irq_desc_t *desc = &irq_descs[i];
+			uint32_t flags = spin_lock_irqsave(&desc->lock);
+
+			desc->count = desc->spurious = 0;
+			desc->cycles = desc->max_cycles = 0;
+			desc->last_claimed = NULL;
+
+			for(irq_handler_t *handler = desc->handlers; handler; handler = handler->next) {
+				handler->claimed = 0;
+			}
+
+			spin_unlock_irqrestore(&desc->lock, flags);
+		}
+
+		return;
+	}
 
-	irq_handler_t *handler;
+	// Cycles are TSC cycles, so they only convert if the TSC is the clock
+	bool tsc = clock_get_source()->is_tsc;
 
-	for(int i = 0; i < irqHandlerList[number]->num_entries; i++) {
-		handler = (irq_handler_t *) list_get(irqHandlerList[number], i);
+	for(int i = 0; i < MAX_IRQ; i++) {
+		irq_desc_t *desc = &irq_descs[i];
+		uint32_t flags = spin_lock_irqsave(&desc->lock);
+
+		if(!desc->count) {
+			spin_unlock_irqrestore(&desc->lock, flags);
+			continue;
+		}
 
-		if(handler->function == function && handler->context == context) {
-			return true;
+		kprintf("IRQ %u: %u times, %u spurious; avg ", i, desc->count, desc->spurious);
+		irq_print_cycles(mstd_div_u64(desc->cycles, desc->count, NULL), tsc);
+		kprintf(", max ");
+		irq_print_cycles(desc->max_cycles, tsc);
+		kprintf(" cycles; last claimed by 0x%X\n", desc->last_claimed);
+
+		for(irq_handler_t *handler = desc->handlers; handler; handler = handler->next) {
+			kprintf("  0x%X (0x%X): %u claimed\n", handler->function, handler->context, handler->claimed);
 		}
+
+		spin_unlock_irqrestore(&desc->lock, flags);
+	}
+}
+
+/*
+ * Masks or unmasks a line on the interrupt controller, depending on whether
+ * it has handlers and isn't disabled. Lines the controller doesn't have stay
+ * unrouted. The line's lock must be held.
+ */
+static void irq_update_mask(uint8_t number) {
+	irq_desc_t *desc = &irq_descs[number];
+
+	if(number >= irq_chip->lines) {
+		return;
+	}
+
+	if(desc->handlers && !desc->disabled) {
+		irq_chip->unmask(number);
+	} else {
+		irq_chip->mask(number);
+	}
+}
+
+/*
+ * Routes all lines through a different interrupt controller. The lines in use
+ * are masked on the old one before they're unmasked on the new one. Lines are
+ * only routed to the bootstrap processor, so that's where this must run; with
+ * interrupts disabled meanwhile, no interrupt is acknowledged through the
+ * wrong controller.
+ */
+void irq_set_chip(const irq_chip_t *chip) {
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	for(int i = 0; i < MAX_IRQ; i++) {
+		spin_lock(&irq_descs[i].lock);
+
+		if(i < irq_chip->lines) {
+			irq_chip->mask(i);
+		}
+
+		spin_unlock(&irq_descs[i].lock);
+	}
+
+	irq_chip = chip;
+
+	for(int i = 0; i < MAX_IRQ; i++) {
+		spin_lock(&irq_descs[i].lock);
+		irq_update_mask(i);
+		spin_unlock(&irq_descs[i].lock);
+	}
+
+	kprintf("irq: routing interrupts through the %s\n", chip->name);
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+}
+
+/*
+ * Searches for a handler with the given function and context in an IRQ's
+ * chain, and returns the link pointing to it, or the NULL link at the end of
+ * the chain if there is none. The line's lock must be held.
+ */
+static irq_handler_t **irq_find_handler(uint8_t number, irq_t function, void* context) {
+	ASSERT(number < MAX_IRQ);
+
+	irq_handler_t **link = &irq_descs[number].handlers;
+
+	while(*link) {
+		if((*link)->function == function && (*link)->context == context) {
+			break;
+		}
+
+		link = &(*link)->next;
 	}
 
-	return false;
+	return link;
 }
 
 /*
@@ -101,21 +395,94 @@ static bool irq_is_registered(uint8_t number, irq_t function, void* context) {
 bool irq_register(uint8_t number, irq_t function, void* context) {
 	ASSERT(number < MAX_IRQ);
 
-	if(!irq_is_registered(number, function, context)) {
-		irq_handler_t *handler = (irq_handler_t *) kmalloc(sizeof(irq_handler_t));
-		memclr(handler, sizeof(irq_handler_t));
+	irq_handler_t *handler = (irq_handler_t *) kmalloc(sizeof(irq_handler_t));
+	memclr(handler, sizeof(irq_handler_t));
 
-		handler->context = context;
-		handler->function = function;
+	handler->context = context;
+	handler->function = function;
+
+	uint32_t flags = spin_lock_irqsave(&irq_descs[number].lock);
+	irq_handler_t **link = irq_find_handler(number, function, context);
+
+	if(*link) {
+		spin_unlock_irqrestore(&irq_descs[number].lock, flags);
+		kfree(handler);
 
-		list_add(irqHandlerList[number], handler);
-	} else {
 		kprintf("Already registered function 0x%X for IRQ %u\n", function, number);
 		return false;
 	}
 
+	// The handler is complete before the interrupt can see it
+	rcu_assign_pointer(*link, handler);
+
 	// Unmask the IRQ
-	sys_pic_irq_clear_mask(number);
+	irq_update_mask(number);
+
+	spin_unlock_irqrestore(&irq_descs[number].lock, flags);
+
+	return true;
+}
+
+/*
+ * Frees a handler once no interrupt can still be running it.
+ */
+static void irq_handler_free(rcu_head_t *head) {
+	kfree(rcu_entry(head, irq_handler_t, rcu));
+}
+
+/*
+ * Removes an IRQ handler registered with the same function and context. The
+ * handler may still be running on another processor when this returns, but
+ * won't be called for any interrupt after it.
+ */
+bool irq_unregister(uint8_t number, irq_t function, void* context) {
+	ASSERT(number < MAX_IRQ);
+
+	uint32_t flags = spin_lock_irqsave(&irq_descs[number].lock);
+	irq_handler_t **link = irq_find_handler(number, function, context);
+	irq_handler_t *handler = *link;
+
+	if(handler) {
+		// The handler keeps its next pointer, for interrupts still walking it
+		rcu_assign_pointer(*link, handler->next);
+	}
+
+	// Mask the IRQ if that was the last handler
+	if(handler) {
+		irq_update_mask(number);
+	}
+
+	spin_unlock_irqrestore(&irq_descs[number].lock, flags);
+
+	if(!handler) {
+		return false;
+	}
 
+	call_rcu(&handler->rcu, irq_handler_free);
 	return true;
-}
\ No newline at end of file
+}
+
+/*
+ * Masks a line until irq_enable is called, even while it has handlers.
+ */
+void irq_disable(uint8_t number) {
+	ASSERT(number < MAX_IRQ);
+
+	uint32_t flags = spin_lock_irqsave(&irq_descs[number].lock);
+
+	irq_descs[number].disabled = true;
+	irq_update_mask(number);
+
+	spin_unlock_irqrestore(&irq_descs[number].lock, flags);
+}
+
+void irq_enable(uint8_t number) {
+	ASSERT(number < MAX_IRQ);
+
+	uint32_t flags = spin_lock_irqsave(&irq_descs[number].lock);
+
+	irq_descs[number].disabled = false;
+	irq_update_mask(number);
+
+	spin_unlock_irqrestore(&irq_descs[number].lock, flags);
+}
@@ -1,13 +1,51 @@
 #ifndef IRQ_H
 #define IRQ_H
 
-#define MAX_IRQ 16
+// The 8259s have 16 lines; an I/O APIC adds GSIs up to 23
+#define MAX_IRQ 24
 
 #include <types.h>
 
-typedef void (*irq_t)(void*);
+/*
+ * IRQ handlers return whether their device raised the interrupt, so that on
+ * shared lines, it's known which handler claimed it. Interrupts no handler
+ * claims are counted as spurious.
+ */
+#define IRQ_NONE	0
+#define IRQ_HANDLED	1
+
+typedef int (*irq_t)(void*);
+
+/*
+ * Interrupt controller the lines are routed through: the 8259s, until an I/O
+ * APIC takes over. Line n always arrives on vector IRQ_0 + n.
+ */
+typedef struct irq_chip {
+	const char *name;
+	// Number of lines the controller has
+	unsigned int lines;
+
+	void (*mask)(uint8_t number);
+	void (*unmask)(uint8_t number);
+	// Acknowledges an interrupt once its handlers ran
+	void (*eoi)(uint8_t number);
+	// Returns true if the interrupt wasn't really raised, acknowledging it if
+	// needed; may be NULL
+	bool (*spurious)(uint8_t number);
+} irq_chip_t;
 
 void irq_init(void);
+void irq_set_chip(const irq_chip_t *chip);
+
 bool irq_register(uint8_t number, irq_t function, void* context);
+bool irq_unregister(uint8_t number, irq_t function, void* context);
+
+// Keeps a line masked even while it has handlers, or lets it be unmasked again
+void irq_disable(uint8_t number);
+void irq_enable(uint8_t number);
+
+void irq_enter(void);
+void irq_exit(void);
+bool irq_in_handler(void);
 
 #endif
\ No newline at end of file
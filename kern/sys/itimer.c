@@ -0,0 +1,233 @@
+#include <types.h>
+#include <errno.h>
+#include "itimer.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "clock.h"
+#include "uring.h"
+#include "vdso.h"
+
+static int itimer_read(file_t *file, void *buf, uint32_t len, uint32_t flags);
+static uint32_t itimer_poll(file_t *file, wait_queue_t **wq);
+static void itimer_release(file_t *file);
+
+static const file_ops_t itimer_ops = {
+	.read = itimer_read,
+	.poll = itimer_poll,
+	.release = itimer_release
+};
+
+/*
+ * Creates a disarmed interval timer, whose absolute times are on the given
+ * clock.
+ */
+int itimer_create(uint32_t clock, file_t **file) {
+	if(clock != VDSO_CLOCK_REALTIME && clock != VDSO_CLOCK_MONOTONIC) {
+		return -EINVAL;
+	}
+
+	itimer_t *it = (itimer_t *) kmalloc(sizeof(itimer_t));
+
+	if(!it) {
+		return -ENOMEM;
+	}
+
+	memclr(it, sizeof(itimer_t));
+	wait_queue_init(&it->wq);
+	it->clock = clock;
+
+	*file = file_alloc(&itimer_ops, it);
+
+	if(!*file) {
+		kfree(it);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns how many intervals fit into delta.
+ */
+static uint64_t itimer_intervals(uint64_t delta, uint64_t interval) {
+	if(interval <= 0xFFFFFFFF) {
+		return mstd_div_u64(delta, (uint32_t) interval, NULL);
+	}
+
+	uint64_t n = 0;
+
+	while(delta >= interval) {
+		delta -= interval;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * Timer callback: counts the expiration, along with any that were missed
+ * because the callback ran late, and arms the timer for the next one.
+ */
+static void itimer_fired(void *context) {
+	itimer_t *it = context;
+	uint64_t now = ktime_get_ns();
+
+	uint32_t irq = spin_lock_irqsave(&it->wq.lock);
+
+	it->in_flight = false;
+
+	// Disarmed, or re-armed for later, while this was on its way
+	if(!it->armed || now < it->expires) {
+		spin_unlock_irqrestore(&it->wq.lock, irq);
+		return;
+	}
+
+	uint64_t count = 1;
+
+	if(it->interval_ns) {
+		count += itimer_intervals(now - it->expires, it->interval_ns);
+
+		it->expires += count * it->interval_ns;
+		timer_add(&it->timer, it->expires, itimer_fired, it);
+	} else {
+		it->armed = false;
+	}
+
+	it->expirations += count;
+
+	if(it->ring) {
+		uring_complete(it->ring, it->user_data, (count > 0x7FFFFFFF) ? 0x7FFFFFFF : (int32_t) count);
+	}
+
+	wait_queue_wake_all_locked(&it->wq);
+	spin_unlock_irqrestore(&it->wq.lock, irq);
+}
+
+/*
+ * Disarms the timer, which must be locked. If it can't be cancelled, its
+ * callback is about to run, and will clear in_flight once it has the lock.
+ */
+static void itimer_disarm_locked(itimer_t *it) {
+	if(it->armed && !timer_cancel(&it->timer)) {
+		it->in_flight = true;
+	}
+
+	it->armed = false;
+}
+
+/*
+ * Arms or disarms a timer, discarding expirations that weren't read. With
+ * ITIMER_URING, expirations are also posted to the calling process'
+ * completion ring, which must be set up. Intervals are at least
+ * ITIMER_MIN_INTERVAL_NS.
+ */
+int itimer_settime(file_t *file, uint32_t flags, const itimer_spec_t *spec) {
+	if(file->ops != &itimer_ops) {
+		return -EBADF;
+	}
+
+	itimer_t *it = file->data;
+	struct uring *ring = NULL;
+
+	if(flags & ITIMER_URING) {
+		ring = ((i386_task_t *) sched_curr_task())->leader->uring;
+
+		if(!ring) {
+			return -EINVAL;
+		}
+	}
+
+	uint64_t now = ktime_get_ns();
+	uint64_t expires = spec->value_ns;
+	uint64_t interval = spec->interval_ns;
+
+	if(interval && interval < ITIMER_MIN_INTERVAL_NS) {
+		interval = ITIMER_MIN_INTERVAL_NS;
+	}
+
+	if(!(flags & ITIMER_ABSTIME)) {
+		expires += now;
+	} else if(it->clock == VDSO_CLOCK_REALTIME) {
+		uint64_t offset = vdso_get()->realtime_offset_ns;
+		expires = (expires > offset) ? (expires - offset) : 0;
+	}
+
+	uint32_t irq = spin_lock_irqsave(&it->wq.lock);
+
+	itimer_disarm_locked(it);
+
+	it->expirations = 0;
+	it->interval_ns = interval;
+	it->ring = ring;
+	it->user_data = spec->user_data;
+
+	if(spec->value_ns) {
+		it->expires = expires;
+		it->armed = true;
+
+		// Times that passed already expire right away
+		timer_add(&it->timer, (expires > now) ? expires : now, itimer_fired, it);
+	}
+
+	spin_unlock_irqrestore(&it->wq.lock, irq);
+
+	return 0;
+}
+
+/*
+ * Returns the number of expirations since the last read, as a 64-bit count,
+ * blocking until there is at least one.
+ */
+static int itimer_read(file_t *file, void *buf, uint32_t len, uint32_t flags) {
+	itimer_t *it = file->data;
+
+	if(len < sizeof(uint64_t)) {
+		return -EINVAL;
+	}
+
+	uint32_t irq = spin_lock_irqsave(&it->wq.lock);
+
+	while(!it->expirations) {
+		irq = wait_queue_sleep_locked(&it->wq, irq);
+	}
+
+	uint64_t count = it->expirations;
+	it->expirations = 0;
+
+	spin_unlock_irqrestore(&it->wq.lock, irq);
+
+	if(file_copy_out(buf, &count, sizeof(count), flags)) {
+		return -EFAULT;
+	}
+
+	return sizeof(count);
+}
+
+static uint32_t itimer_poll(file_t *file, wait_queue_t **wq) {
+	itimer_t *it = file->data;
+
+	*wq = &it->wq;
+	return it->expirations ? FILE_POLL_IN : 0;
+}
+
+/*
+ * Disarms the timer, and waits for a callback that was already on its way
+ * before freeing it.
+ */
+static void itimer_release(file_t *file) {
+	itimer_t *it = file->data;
+	uint32_t irq = spin_lock_irqsave(&it->wq.lock);
+
+	itimer_disarm_locked(it);
+
+	while(it->in_flight) {
+		spin_unlock_irqrestore(&it->wq.lock, irq);
+		__asm__ volatile("pause");
+		irq = spin_lock_irqsave(&it->wq.lock);
+	}
+
+	spin_unlock_irqrestore(&it->wq.lock, irq);
+
+	kfree(it);
+}
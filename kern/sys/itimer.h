@@ -0,0 +1,63 @@
+#ifndef ITIMER_H
+#define ITIMER_H
+
+#include <types.h>
+#include "file.h"
+#include "timer.h"
+#include "waitqueue.h"
+
+/*
+ * Interval timers are files: once armed, they expire at a given time, and
+ * then periodically if they have an interval. Reading one returns the number
+ * of expirations since the last read as a 64-bit count, blocking until there
+ * is at least one; it's readable to event poll objects meanwhile. A timer can
+ * also post a completion for each expiration to its process' completion ring,
+ * with the number of expirations as the result.
+ */
+
+// Flags for itimer_settime: the value is an absolute time, rather than relative
+#define ITIMER_ABSTIME	0x01
+// Post completions to the calling process' completion ring
+#define ITIMER_URING	0x02
+
+// Shorter intervals are rounded up, so a timer can't keep a processor busy
+#define ITIMER_MIN_INTERVAL_NS	10000
+
+typedef struct itimer_spec {
+	// First expiration (0 disarms the timer), and interval (0 for none)
+	uint64_t value_ns;
+	uint64_t interval_ns;
+
+	// Completion entries' user data, with ITIMER_URING
+	uint32_t user_data;
+} __attribute__((packed)) itimer_spec_t;
+
+struct uring;
+
+typedef struct itimer {
+	// Readers wait here; its lock protects the timer
+	wait_queue_t wq;
+
+	ktimer_t timer;
+	// Clock absolute values are relative to (vdso.h)
+	uint32_t clock;
+
+	bool armed;
+	// Set if the timer fired while being disarmed; cleared by its callback
+	bool in_flight;
+
+	// Next expiration, in ktime nanoseconds, and the interval
+	uint64_t expires;
+	uint64_t interval_ns;
+
+	// Expirations not read yet
+	uint64_t expirations;
+
+	struct uring *ring;
+	uint32_t user_data;
+} itimer_t;
+
+int itimer_create(uint32_t clock, file_t **file);
+int itimer_settime(file_t *file, uint32_t flags, const itimer_spec_t *spec);
+
+#endif
@@ -174,6 +174,7 @@ heap_t *create_heap(uint32_t start, uint32_t end_addr, uint32_t max, bool superv
 	heap->max_address = max;
 	heap->supervisor = supervisor;
 	heap->readonly = readonly;
+	spin_lock_init(&heap->lock);
 
 	// We start off with one large hole in the index.
 	header_t *hole = (header_t *)start;
@@ -185,7 +186,10 @@ heap_t *create_heap(uint32_t start, uint32_t end_addr, uint32_t max, bool superv
 	return heap;
 }
 
-void *alloc(uint32_t size, bool page_align, heap_t *heap) {
+/*
+ * Allocates from the heap, which must be locked.
+ */
+static void *alloc_locked(uint32_t size, bool page_align, heap_t *heap) {
 	// Make sure we take the size of header/footer into account.
 	uint32_t new_size = size + sizeof(header_t) + sizeof(footer_t);
 	// Find the smallest hole that will fit.
@@ -234,7 +238,7 @@ void *alloc(uint32_t size, bool page_align, heap_t *heap) {
 		}
 
 		// We now have enough space. Recurse, and call the function again.
-		return alloc(size, page_align, heap);
+		return alloc_locked(size, page_align, heap);
 	}
 
 	header_t *orig_hole_header = (header_t *) lookup_ordered_array(iterator, &heap->index);
@@ -295,11 +299,18 @@ void *alloc(uint32_t size, bool page_align, heap_t *heap) {
 	return (void *) ((uint32_t) block_header+sizeof(header_t));
 }
 
-void free(void *p, heap_t *heap) {
-	// Exit gracefully for null pointers.
-	if (p == 0) {
-		return;
-	}
+void *alloc(uint32_t size, bool page_align, heap_t *heap) {
+	uint32_t flags = spin_lock_irqsave(&heap->lock);
+	void *p = alloc_locked(size, page_align, heap);
+	spin_unlock_irqrestore(&heap->lock, flags);
+
+	return p;
+}
+
+/*
+ * Returns a block to the heap, which must be locked.
+ */
+static void free_locked(void *p, heap_t *heap) {
 
 	// Get the header and footer associated with this pointer.
 	header_t *header = (header_t*) ((uint32_t) p - sizeof(header_t));
@@ -378,3 +389,14 @@ void free(void *p, heap_t *heap) {
 		insert_ordered_array((void*) header, &heap->index);
 	}
 }
+
+void free(void *p, heap_t *heap) {
+	// Exit gracefully for null pointers.
+	if (p == 0) {
+		return;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&heap->lock);
+	free_locked(p, heap);
+	spin_unlock_irqrestore(&heap->lock, flags);
+}
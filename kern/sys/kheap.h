@@ -3,9 +3,11 @@
 
 #include <types.h>
 #include <runtime/ordered_array.h>
+#include "spinlock.h"
 
 #define KHEAP_START			0xC8000000
 #define KHEAP_INITIAL_SIZE	0x100000
+#define KHEAP_MAX_ADDRESS	0xCFFFF000
 
 #define HEAP_INDEX_SIZE		0x20000
 #define HEAP_MAGIC			0xDEADCAFE
@@ -32,6 +34,8 @@ typedef struct {
     uint32_t max_address;	// The maximum address the heap can be expanded to.
     bool supervisor;		// Should extra pages requested by us be mapped as supervisor-only?
     bool readonly;			// Should extra pages requested by us be mapped as read-only?
+
+    spinlock_t lock;		// Taken by alloc and free; also used from interrupt handlers
 } heap_t;
 
 /*
@@ -0,0 +1,483 @@
+#include <types.h>
+#include <errno.h>
+#include "msg.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "system.h"
+#include "clock.h"
+#include "uaccess.h"
+#include "io/debug_console.h"
+
+static uint32_t channel_poll_server(file_t *file, wait_queue_t **wq);
+static uint32_t channel_poll_client(file_t *file, wait_queue_t **wq);
+static void channel_release_server(file_t *file);
+static void channel_release_client(file_t *file);
+
+static const file_ops_t channel_server_ops = {
+	.poll = channel_poll_server,
+	.release = channel_release_server
+};
+
+static const file_ops_t channel_client_ops = {
+	.poll = channel_poll_client,
+	.release = channel_release_client
+};
+
+static void msg_bench_cmd(int argc, char **argv);
+
+static int msg_cmd_init(void) {
+	debugcon_register("msgbench", "Measures message round trips of 64 bytes to 1 MB ('msgbench [count]')", msg_bench_cmd);
+	return 0;
+}
+
+module_init(msg_cmd_init);
+
+/*
+ * Creates a channel, returning a file for each end.
+ */
+int channel_create(file_t **server, file_t **client) {
+	channel_t *chan = (channel_t *) kmalloc(sizeof(channel_t));
+
+	if(!chan) {
+		return -ENOMEM;
+	}
+
+	memclr(chan, sizeof(channel_t));
+	wait_queue_init(&chan->wq);
+
+	*server = file_alloc(&channel_server_ops, chan);
+	*client = file_alloc(&channel_client_ops, chan);
+
+	if(!*server || !*client) {
+		if(*server) kfree(*server);
+		if(*client) kfree(*client);
+
+		kfree(chan);
+		return -ENOMEM;
+	}
+
+	chan->servers = chan->clients = 1;
+
+	return 0;
+}
+
+/*
+ * Completes a message with the given status, waking its sender. The channel
+ * must be locked; the message may be gone as soon as it's unlocked.
+ */
+static void msg_complete(msg_t *msg, int status, bool sync) {
+	i386_task_t *sender = msg->sender;
+
+	msg->status = status;
+	msg->replied = true;
+
+	if(sync) {
+		sched_wake_sync(sender);
+	} else {
+		sched_wake(sender);
+	}
+}
+
+/*
+ * Drops an end of the channel. Without servers, messages that were sent fail
+ * with -EPIPE; without clients, waiting servers are woken up to find out that
+ * nothing more is coming. The channel is freed once both ends are gone.
+ */
+static void channel_release(channel_t *chan, bool server) {
+	uint32_t irq = spin_lock_irqsave(&chan->wq.lock);
+
+	if(server) {
+		chan->servers--;
+	} else {
+		chan->clients--;
+	}
+
+	if(!chan->servers) {
+		while(chan->first) {
+			msg_t *msg = chan->first;
+			chan->first = msg->next;
+
+			msg_complete(msg, -EPIPE, false);
+		}
+
+		while(chan->received) {
+			msg_t *msg = chan->received;
+			chan->received = msg->next;
+
+			msg_complete(msg, -EPIPE, false);
+		}
+
+		chan->last = NULL;
+	}
+
+	bool unused = !chan->servers && !chan->clients;
+
+	wait_queue_wake_all_locked(&chan->wq);
+	spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+	if(unused) {
+		kfree(chan);
+	}
+}
+
+static void channel_release_server(file_t *file) {
+	channel_release(file->data, true);
+}
+
+static void channel_release_client(file_t *file) {
+	channel_release(file->data, false);
+}
+
+/*
+ * The server end is readable while messages are waiting to be received, and
+ * hung up once the clients are gone. The client end can always send, unless
+ * the servers are gone.
+ */
+static uint32_t channel_poll_server(file_t *file, wait_queue_t **wq) {
+	channel_t *chan = file->data;
+	uint32_t mask = 0;
+
+	uint32_t irq = spin_lock_irqsave(&chan->wq.lock);
+
+	if(chan->first) {
+		mask |= FILE_POLL_IN;
+	}
+
+	if(!chan->clients) {
+		mask |= FILE_POLL_HUP;
+	}
+
+	spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+	*wq = &chan->wq;
+	return mask;
+}
+
+static uint32_t channel_poll_client(file_t *file, wait_queue_t **wq) {
+	channel_t *chan = file->data;
+
+	*wq = &chan->wq;
+	return chan->servers ? FILE_POLL_OUT : FILE_POLL_HUP;
+}
+
+/*
+ * Returns the address space of the calling task's buffers, depending on the
+ * flags; NULL means the kernel.
+ */
+static page_directory_t *msg_directory(uint32_t flags) {
+	if(flags & FILE_IO_KERNEL) {
+		return NULL;
+	}
+
+	return ((i386_task_t *) sched_curr_task())->task_state->page_directory;
+}
+
+/*
+ * Sends a message on a channel, and blocks until a server replies to it. The
+ * reply is copied to reply_buf, truncated to reply_len bytes. Returns the
+ * status the server replied with, or -EPIPE if the server end was closed.
+ */
+int msg_send(file_t *client, const void *send_buf, uint32_t send_len, void *reply_buf, uint32_t reply_len, uint32_t flags) {
+	if(client->ops != &channel_client_ops) {
+		return -EBADF;
+	}
+
+	if(!(flags & FILE_IO_KERNEL) && (!access_ok(send_buf, send_len) || !access_ok(reply_buf, reply_len))) {
+		return -EFAULT;
+	}
+
+	if(!sched_can_block()) {
+		return -EINVAL;
+	}
+
+	channel_t *chan = client->data;
+	msg_t msg;
+
+	msg.sender = sched_curr_task();
+	msg.directory = msg_directory(flags);
+	msg.send_buf = (uint32_t) send_buf;
+	msg.send_len = send_len;
+	msg.reply_buf = (uint32_t) reply_buf;
+	msg.reply_len = reply_len;
+	msg.status = 0;
+	msg.replied = false;
+	msg.next = NULL;
+
+	uint32_t irq = spin_lock_irqsave(&chan->wq.lock);
+
+	if(!chan->servers) {
+		spin_unlock_irqrestore(&chan->wq.lock, irq);
+		return -EPIPE;
+	}
+
+	if(chan->last) {
+		chan->last->next = &msg;
+	} else {
+		chan->first = &msg;
+	}
+
+	chan->last = &msg;
+
+	// A waiting server runs as soon as we block
+	wait_queue_wake_one_sync_locked(&chan->wq);
+
+	while(!msg.replied) {
+		sched_prepare_block();
+		spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+		sched_block();
+
+		irq = spin_lock_irqsave(&chan->wq.lock);
+	}
+
+	spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+	return msg.status;
+}
+
+/*
+ * Returns whether the n bytes a message was sent from can be read.
+ */
+static bool msg_send_readable(msg_t *msg, uint32_t n) {
+	if(!msg->directory) {
+		return true;
+	}
+
+	uint32_t addr = msg->send_buf;
+	uint32_t end = addr + n;
+
+	for(addr &= 0xFFFFF000; addr < end; addr += 0x1000) {
+		if(!paging_user_kernel_addr(msg->directory, addr, false)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Receives the next message sent on a channel, blocking until there is one.
+ * At most len bytes of it are copied to buf, and its full length is stored in
+ * msg_len, if given. Returns the ID to reply to the message with, or -EPIPE
+ * if no clients are left.
+ *
+ * If the sender's buffer can't be read, it gets -EFAULT as the reply, and the
+ * next message is received instead. If buf is bad, this returns -EFAULT, and
+ * the message stays first in line.
+ */
+int msg_receive(file_t *server, void *buf, uint32_t len, uint32_t *msg_len, uint32_t flags) {
+	if(server->ops != &channel_server_ops) {
+		return -EBADF;
+	}
+
+	channel_t *chan = server->data;
+	msg_t *msg;
+
+	uint32_t irq = spin_lock_irqsave(&chan->wq.lock);
+
+	while(1) {
+		while(!chan->first && chan->clients) {
+			irq = wait_queue_sleep_locked(&chan->wq, irq);
+		}
+
+		msg = chan->first;
+
+		if(!msg) {
+			spin_unlock_irqrestore(&chan->wq.lock, irq);
+			return -EPIPE;
+		}
+
+		chan->first = msg->next;
+
+		if(!chan->first) {
+			chan->last = NULL;
+		}
+
+		// IDs are never zero, so they're distinguishable from errors and nothing
+		if(++chan->next_rcvid & 0x80000000) {
+			chan->next_rcvid = 1;
+		}
+
+		msg->rcvid = chan->next_rcvid;
+
+		spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+		/*
+		 * The message is on neither list while it's copied, so nobody can
+		 * reply to it yet, and the sender stays blocked.
+		 */
+		uint32_t n = (len < msg->send_len) ? len : msg->send_len;
+		int err = copy_between(msg_directory(flags), (uint32_t) buf, msg->directory, msg->send_buf, n);
+
+		irq = spin_lock_irqsave(&chan->wq.lock);
+
+		if(!err) {
+			break;
+		}
+
+		if(msg_send_readable(msg, n)) {
+			// Our buffer is bad; the message waits for the next attempt
+			msg->next = chan->first;
+			chan->first = msg;
+
+			if(!chan->last) {
+				chan->last = msg;
+			}
+
+			// Another server may be able to take it in the meantime
+			wait_queue_wake_one_locked(&chan->wq);
+			spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+			return err;
+		}
+
+		msg_complete(msg, err, false);
+	}
+
+	msg->next = chan->received;
+	chan->received = msg;
+
+	uint32_t rcvid = msg->rcvid;
+	uint32_t send_len = msg->send_len;
+
+	spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+	if(msg_len) {
+		*msg_len = send_len;
+	}
+
+	return rcvid;
+}
+
+/*
+ * Replies to a received message, copying at most len bytes of buf to the
+ * sender's reply buffer; its send call returns status. The sender runs on
+ * this processor as soon as the caller blocks, typically to receive the next
+ * message.
+ */
+int msg_reply(file_t *server, uint32_t rcvid, int status, const void *buf, uint32_t len, uint32_t flags) {
+	if(server->ops != &channel_server_ops) {
+		return -EBADF;
+	}
+
+	channel_t *chan = server->data;
+	uint32_t irq = spin_lock_irqsave(&chan->wq.lock);
+
+	msg_t **link = &chan->received;
+
+	while(*link && (*link)->rcvid != rcvid) {
+		link = &(*link)->next;
+	}
+
+	msg_t *msg = *link;
+
+	if(!msg) {
+		spin_unlock_irqrestore(&chan->wq.lock, irq);
+		return -ENOTFOUND;
+	}
+
+	*link = msg->next;
+
+	spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+	uint32_t n = (len < msg->reply_len) ? len : msg->reply_len;
+	int err = copy_between(msg->directory, msg->reply_buf, msg_directory(flags), (uint32_t) buf, n);
+
+	irq = spin_lock_irqsave(&chan->wq.lock);
+	msg_complete(msg, err ? err : status, true);
+	spin_unlock_irqrestore(&chan->wq.lock, irq);
+
+	return err;
+}
+
+// Benchmark: a server replying to every message with its contents
+typedef struct msg_bench {
+	file_t *server;
+	uint32_t size;
+} msg_bench_t;
+
+static void msg_bench_server(void *context) {
+	msg_bench_t *bench = context;
+	file_t *server = bench->server;
+	uint32_t size = bench->size;
+
+	uint8_t *buf = (uint8_t *) kmalloc(size);
+	int rcvid;
+
+	while((rcvid = msg_receive(server, buf, size, NULL, FILE_IO_KERNEL)) > 0) {
+		msg_reply(server, rcvid, size, buf, size, FILE_IO_KERNEL);
+	}
+
+	kfree(buf);
+	file_put(server);
+}
+
+/*
+ * Debug console command: sends messages of 64 bytes, 4 KB and 1 MB to a
+ * server thread that replies with the same amount of data, and prints the
+ * round trip time and throughput for each.
+ */
+static void msg_bench_cmd(int argc, char **argv) {
+	static const uint32_t sizes[] = {64, 4096, 0x100000};
+	unsigned int count = 1000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("msgbench: can't block here\n");
+		return;
+	}
+
+	for(unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint32_t size = sizes[s];
+		unsigned int iterations = (size >= 0x100000) ? ((count / 64) ? (count / 64) : 1) : count;
+
+		file_t *server, *client;
+		msg_bench_t bench;
+
+		uint8_t *send_buf = (uint8_t *) kmalloc(size);
+		uint8_t *reply_buf = (uint8_t *) kmalloc(size);
+
+		if(!send_buf || !reply_buf || channel_create(&server, &client)) {
+			kprintf("msgbench: out of memory\n");
+			return;
+		}
+
+		memclr(send_buf, size);
+
+		bench.server = server;
+		bench.size = size;
+
+		sched_task_start(task_create_kernel("msgbench server", msg_bench_server, &bench));
+
+		uint64_t start = sys_rdtsc();
+
+		for(unsigned int i = 0; i < iterations; i++) {
+			msg_send(client, send_buf, size, reply_buf, size, FILE_IO_KERNEL);
+		}
+
+		uint64_t cycles = sys_rdtsc() - start;
+
+		// The server exits once it finds there are no clients left
+		file_put(client);
+
+		kfree(send_buf);
+		kfree(reply_buf);
+
+		uint32_t per_trip = (uint32_t) mstd_div_u64(cycles, iterations, NULL);
+		kprintf("msgbench: %u bytes, %u round trips, %u cycles each", size, iterations, per_trip);
+
+		if(clock_get_source()->is_tsc) {
+			uint32_t us = (uint32_t) mstd_div_u64(clock_cycles_to_ns(cycles), 1000, NULL);
+			uint64_t bytes = 2ULL * size * iterations;
+
+			// Bytes per microsecond are megabytes per second
+			kprintf(" (%u ns, %u MB/s)", (uint32_t) clock_cycles_to_ns(per_trip), (uint32_t) mstd_div_u64(bytes, us ? us : 1, NULL));
+		}
+
+		kprintf("\n");
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef MSG_H
+#define MSG_H
+
+#include <types.h>
+#include "file.h"
+#include "paging.h"
+#include "waitqueue.h"
+
+/*
+ * Synchronous message passing: a client sends a message on a channel and
+ * blocks until a server has received it and replied. Data is copied once,
+ * straight between the two tasks' buffers. When a message wakes a waiting
+ * server, or a reply wakes the client, the woken task runs next on the same
+ * processor, so a round trip takes two context switches and no trips through
+ * the run queue.
+ *
+ * A channel has two ends, like a pipe: the server end receives and replies,
+ * the client end sends.
+ */
+
+struct task;
+
+// A message in flight; lives on the sender's stack
+typedef struct msg {
+	struct task *sender;
+	// Address space of the sender's buffers; NULL for kernel memory
+	page_directory_t *directory;
+
+	uint32_t send_buf, send_len;
+	uint32_t reply_buf, reply_len;
+
+	// Identifies the message to the server until it replies
+	uint32_t rcvid;
+
+	// Status the server replied with; set before replied
+	int status;
+	volatile bool replied;
+
+	struct msg *next;
+} msg_t;
+
+typedef struct channel {
+	// Servers wait here; its lock protects the channel
+	wait_queue_t wq;
+
+	// Messages not yet received, and received ones awaiting a reply
+	msg_t *first, *last;
+	msg_t *received;
+
+	uint32_t next_rcvid;
+
+	// Open server and client ends
+	unsigned int servers, clients;
+} channel_t;
+
+int channel_create(file_t **server, file_t **client);
+
+int msg_send(file_t *client, const void *send_buf, uint32_t send_len, void *reply_buf, uint32_t reply_len, uint32_t flags);
+int msg_receive(file_t *server, void *buf, uint32_t len, uint32_t *msg_len, uint32_t flags);
+int msg_reply(file_t *server, uint32_t rcvid, int status, const void *buf, uint32_t len, uint32_t flags);
+
+#endif
@@ -4,6 +4,11 @@
 #include "kheap.h"
 #include "sys/multiboot.h"
 #include "runtime/error_handler.h"
+#include "uaccess.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "device/apic.h"
+#include "rusage.h"
  
 extern multiboot_info_t* sys_multiboot_info;
  
@@ -100,29 +105,40 @@ static uint32_t first_frame() {
 }
 
 /*
- * Function to allocate a frame.
+ * Allocates a frame for the page, unless it already has one. Returns false,
+ * leaving the page untouched, if no frames are free.
  */
-void alloc_frame(page_t* page, bool is_kernel, bool is_writeable) {
+bool alloc_frame_try(page_t* page, bool is_kernel, bool is_writeable) {
 	if (page->frame != 0) {
-		return;
-	} else {
-		uint32_t idx = first_frame();
+		return true;
+	}
 
-		if (idx == (uint32_t) -1) {
-			PANIC("No Free Frames");
-		}
+	uint32_t idx = first_frame();
 
-		set_frame(idx * 0x1000);
+	if (idx == (uint32_t) -1) {
+		return false;
+	}
 
-		// Clear the page's memory!
-		memclr(page, sizeof(page_t));
+	set_frame(idx * 0x1000);
 
-		page->present = 1;
-		page->rw = (is_writeable) ? 1 : 0;
-		page->user = (is_kernel) ? 0 : 1;
-		page->frame = idx;
+	// Clear the page's memory!
+	memclr(page, sizeof(page_t));
+
+	page->present = 1;
+	page->rw = (is_writeable) ? 1 : 0;
+	page->user = (is_kernel) ? 0 : 1;
+	page->frame = idx;
+
+	// kprintf("Mapped page at phys 0x%X\n", idx * 0x1000);
+	return true;
+}
 
-		// kprintf("Mapped page at phys 0x%X\n", idx * 0x1000);
+/*
+ * Function to allocate a frame.
+ */
+void alloc_frame(page_t* page, bool is_kernel, bool is_writeable) {
+	if (!alloc_frame_try(page, is_kernel, is_writeable)) {
+		PANIC("No Free Frames");
 	}
 }
 
@@ -134,7 +150,7 @@ void free_frame(page_t* page) {
 	if (!(frame=page->frame)) {
 		return;
 	} else {
-		clear_frame(frame);
+		clear_frame(frame * 0x1000);
 		page->frame = 0x0;
 	}
 }
@@ -173,6 +189,15 @@ void paging_init() {
 		page->user = 0;
 	}
 
+	// Create the rest of the heap's page tables now, so expanding the heap never
+	// has to allocate them from the heap while it's locked.
+	for(i = KHEAP_START + KHEAP_INITIAL_SIZE; i < KHEAP_MAX_ADDRESS; i += 0x1000) {
+		if(!kernel_directory->tables[i / 0x400000]) {
+			paging_get_page(i, true, kernel_directory);
+			memclr(kernel_directory->tables[i / 0x400000], sizeof(page_table_t));
+		}
+	}
+
 	// This step serves to map the kernel itself
 	// We don't allocate frames here, as that's done below.
 	for(i = 0xC0000000; i < 0xC7FFF000; i += 0x1000) {
@@ -216,7 +241,7 @@ void paging_init() {
 	paging_switch_directory(kernel_directory);
 
 	// Initialise a kernel heap
-	kheap = create_heap(KHEAP_START, KHEAP_START+KHEAP_INITIAL_SIZE, 0xCFFFF000, true, true);
+	kheap = create_heap(KHEAP_START, KHEAP_START+KHEAP_INITIAL_SIZE, KHEAP_MAX_ADDRESS, true, true);
 }
 
 /*
@@ -416,20 +441,55 @@ page_t* paging_get_page(uint32_t address, bool make, page_directory_t* dir) {
 }
 
 /*
- * Page fault handler
+ * Returns the address through which the kernel can access the byte at a user
+ * address in the given directory, whether or not it's the current one. It's
+ * NULL if the page isn't mapped for user mode (and writeable, if write is
+ * set), or its frame is outside the kernel's window on physical memory.
+ *
+ * The address is only good up to the end of that page.
+ */
+void *paging_user_kernel_addr(page_directory_t *dir, uint32_t address, bool write) {
+	if(address >= PAGING_PHYS_WINDOW_BASE) {
+		return NULL;
+	}
+
+	page_t *page = paging_get_page(address, false, dir);
+
+	if(!page || !page->present || !page->user || (write && !page->rw)) {
+		return NULL;
+	}
+
+	uint32_t phys = ((uint32_t) page->frame << 12) & 0xFFFFF000;
+
+	if(phys >= PAGING_PHYS_WINDOW_SIZE) {
+		return NULL;
+	}
+
+	return (void *) (PAGING_PHYS_WINDOW_BASE + phys + (address & 0xFFF));
+}
+
+/*
+ * Page fault handler. Faults the kernel takes while accessing user memory on
+ * behalf of a task resume at the accessing routine's fixup, which fails the
+ * access.
  */
-void paging_page_fault_handler(err_registers_t regs) {
+void paging_page_fault_handler(err_registers_t *regs) {
 	// A page fault has occurred.
 	// The faulting address is stored in the CR2 register.
 	uint32_t faulting_address;
 	__asm__ volatile("mov %%cr2, %0" : "=r" (faulting_address));
 
 	// The error code gives us details of what happened.
-	int present	= !(regs.err_code & 0x1); // Page not present
-	int rw = regs.err_code & 0x2; // Write operation?
-	int us = regs.err_code & 0x4; // Processor was in user-mode?
-	int reserved = regs.err_code & 0x8; // Overwritten CPU-reserved bits of page entry?
-	int id = regs.err_code & 0x10; // Caused by an instruction fetch?
+	int present	= !(regs->err_code & 0x1); // Page not present
+	int rw = regs->err_code & 0x2; // Write operation?
+	int us = regs->err_code & 0x4; // Processor was in user-mode?
+	int reserved = regs->err_code & 0x8; // Overwritten CPU-reserved bits of page entry?
+	int id = regs->err_code & 0x10; // Caused by an instruction fetch?
+
+	if(!us && uaccess_fixup(&regs->eip)) {
+		rusage_page_fault(false);
+		return;
+	}
 
 	kprintf("Page fault exception ( ");
 	if (present) kprintf("present ");
@@ -437,10 +497,10 @@ void paging_page_fault_handler(err_registers_t regs) {
 	if (us) kprintf("user-mode ");
 	if (reserved) kprintf("reserved ");
 	if(id) kprintf("instruction fetch");
-	kprintf(") at 0x%X (regs 0x%X)\n", faulting_address, regs.err_code);
+	kprintf(") at 0x%X (regs 0x%X)\n", faulting_address, regs->err_code);
 
 	// Dump registers
-	error_dump_regs(regs);
+	error_dump_regs(*regs);
 
 	while(1);
 
@@ -452,4 +512,69 @@ void paging_page_fault_handler(err_registers_t regs) {
  */
 void paging_flush_tlb(uint32_t addr) {
 	__asm__ volatile("invlpg (%0)" : : "r" (addr) : "memory");
-}
\ No newline at end of file
+}
+
+/*
+ * Flushes a range of pages out of this processor's TLB; for large ranges,
+ * reloading CR3 to flush all user mappings is cheaper.
+ */
+static void paging_flush_range(uint32_t addr, uint32_t pages) {
+	if(pages > PAGING_SHOOTDOWN_MAX_PAGES) {
+		uint32_t cr3;
+		__asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r" (cr3) : : "memory");
+
+		return;
+	}
+
+	for(uint32_t i = 0; i < pages; i++) {
+		paging_flush_tlb(addr + (i * 0x1000));
+	}
+}
+
+// Range being shot down, and processors that have yet to flush it
+static spinlock_t shootdown_lock = SPINLOCK_INIT;
+static uint32_t shootdown_addr, shootdown_pages;
+static volatile uint32_t shootdown_pending;
+
+/*
+ * Flushes a range of pages out of every processor's TLB, after their page
+ * table entries were changed in an address space other processors may be
+ * using, and waits until that's done.
+ *
+ * Must be called with interrupts enabled: a processor waiting for the lock
+ * must still be able to take the IPI of the one holding it.
+ */
+void paging_shootdown(uint32_t addr, uint32_t pages) {
+	unsigned int cpus = smp_num_cpus();
+
+	spin_lock(&shootdown_lock);
+	paging_flush_range(addr, pages);
+
+	if(cpus > 1 && apic_available()) {
+		unsigned int self = smp_cpu_id();
+
+		shootdown_addr = addr;
+		shootdown_pages = pages;
+		shootdown_pending = ((1 << cpus) - 1) & ~(1 << self);
+
+		for(unsigned int i = 0; i < cpus; i++) {
+			if(i != self) {
+				apic_send_ipi(smp_get_cpu(i)->apic_id, APIC_TLB_VECTOR);
+			}
+		}
+
+		while(shootdown_pending) {
+			__asm__ volatile("pause" : : : "memory");
+		}
+	}
+
+	spin_unlock(&shootdown_lock);
+}
+
+/*
+ * Called from the TLB shootdown IPI handler.
+ */
+void paging_shootdown_interrupt(void) {
+	paging_flush_range(shootdown_addr, shootdown_pages);
+	__sync_fetch_and_and(&shootdown_pending, ~(1 << smp_cpu_id()));
+}
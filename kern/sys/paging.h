@@ -19,12 +19,27 @@ typedef struct page {
 	int present:1;	// Page present in memory
 	int rw:1;		// Read-only if clear, readwrite if set
 	int user:1;		// Supervisor level only if clear
+	int write_through:1; // Write-through caching (PWT)
+	int cache_disable:1; // Caching disabled (PCD)
 	int accessed:1;	// Has the page been accessed since last refresh?
 	int dirty:1;	// Has the page been written to since last refresh?
-	int unused:7;	// Amalgamation of unused and reserved bits
+	int pat:1;		// Page attribute table index bit
+	int global:1;	// Not flushed on address space switch
+	int shared:1;	// Frame isn't owned by this mapping; never freed or moved through it
+	int unused:2;	// Available to software
 	int frame:20;	// Frame address (shifted right 12 bits)
 } page_t;
 
+/*
+ * The kernel maps the first 128 MB of physical memory at 0xC0000000, so any
+ * frame below that can be reached without mapping it first.
+ */
+#define PAGING_PHYS_WINDOW_BASE 0xC0000000
+#define PAGING_PHYS_WINDOW_SIZE 0x08000000
+
+// Shootdowns of more pages than this flush the whole TLB
+#define PAGING_SHOOTDOWN_MAX_PAGES 32
+
 typedef struct page_table {
 	page_t pages[1024];
 } page_table_t;
@@ -46,6 +61,7 @@ typedef struct paging_stats {
 } paging_stats_t;
 
 void alloc_frame(page_t*, bool, bool);
+bool alloc_frame_try(page_t*, bool, bool);
 void free_frame(page_t*);
 
 paging_stats_t paging_get_stats();
@@ -58,7 +74,11 @@ page_t* paging_get_page(uint32_t, bool, page_directory_t*);
 uint32_t paging_map_section(uint32_t, uint32_t, page_directory_t*, paging_memory_section_t);
 void paging_unmap_section(uint32_t, uint32_t, page_directory_t*);
 
+void *paging_user_kernel_addr(page_directory_t*, uint32_t, bool);
+
 void paging_page_fault_handler();
 void paging_flush_tlb(uint32_t);
+void paging_shootdown(uint32_t, uint32_t);
+void paging_shootdown_interrupt(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <types.h>
+#include "percpu.h"
+#include "system.h"
+#include "smp.h"
+#include "io/debug_console.h"
+
+static percpu_t percpu_data[SMP_MAX_CPUS];
+
+static void percpu_cmd(int argc, char **argv);
+
+static int percpu_cmd_init(void) {
+	debugcon_register("percpu", "Per-processor counters ('percpu reset' clears them)", percpu_cmd);
+	return 0;
+}
+
+module_init(percpu_cmd_init);
+
+/*
+ * Sets up a processor's block, and points GS at it. Must be called after the
+ * processor's GDT has been loaded.
+ */
+void percpu_init(unsigned int cpu) {
+	percpu_t *data = &percpu_data[cpu];
+
+	data->self = data;
+	data->cpu = cpu;
+
+	__asm__ volatile("mov %w0, %%gs" : : "r" (SYS_PERCPU_SEG));
+}
+
+/*
+ * Returns the block of any processor. Other processors may read it, but apart
+ * from clearing statistics and asking for a reschedule, only the processor
+ * itself writes it.
+ */
+percpu_t *percpu_get(unsigned int cpu) {
+	ASSERT(cpu < SMP_MAX_CPUS);
+	return &percpu_data[cpu];
+}
+
+/*
+ * Debug console command: prints each processor's counters.
+ */
+static void percpu_cmd(int argc, char **argv) {
+	unsigned int num_cpus = smp_num_cpus();
+
+	for(unsigned int i = 0; i < num_cpus; i++) {
+		percpu_t *data = &percpu_data[i];
+
+		if(argc > 1 && !strcmp(argv[1], "reset")) {
+			data->irq_count = data->syscall_count = data->context_switches = 0;
+			continue;
+		}
+
+		kprintf("cpu%u: %u irqs, %u syscalls, %u context switches\n", i, data->irq_count, data->syscall_count, data->context_switches);
+	}
+}
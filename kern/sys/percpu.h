@@ -0,0 +1,67 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <types.h>
+
+/*
+ * Each processor has a block of data that only it writes, reached through the
+ * segment in GS: every processor's GDT has a descriptor at SYS_PERCPU_SEG whose
+ * base is that processor's block, so the same selector (and the same code)
+ * addresses a different block on each processor. The kernel keeps GS loaded
+ * with it at all times; entry points from user mode reload it.
+ *
+ * Fields are accessed with the percpu_* macros, which compile to a single
+ * GS-relative instruction. They must be 32 bits wide.
+ */
+typedef struct percpu {
+	// Address of this block, for code that needs a pointer to it
+	struct percpu *self;
+	// Index of this processor
+	unsigned int cpu;
+
+	// Task running on this processor
+	void *curr_task;
+	// Top of the running task's kernel stack; SYSENTER_ESP points here
+	uint32_t kernel_stack_top;
+	// Base of the TLS segment in this processor's GDT
+	uint32_t tls_base;
+
+	// Hardware interrupt handlers currently running on this processor
+	uint32_t irq_depth;
+
+	// Preemption is possible while zero (preempt.h)
+	uint32_t preempt_count;
+	// Set when the running task should give up the processor; other
+	// processors set it before sending a reschedule IPI
+	uint32_t need_resched;
+
+	// Last RCU grace period this processor reported a quiescent state for
+	uint32_t rcu_gp_seen;
+
+	// Statistics
+	uint32_t irq_count;
+	uint32_t syscall_count;
+	uint32_t context_switches;
+} percpu_t;
+
+#define percpu_read(field) ({ \
+	__typeof__(((percpu_t *) 0)->field) __val; \
+	__asm__ volatile("movl %%gs:%c1, %0" : "=r" (__val) : "i" (offsetof(percpu_t, field))); \
+	__val; })
+
+#define percpu_write(field, val) \
+	__asm__ volatile("movl %0, %%gs:%c1" : : "ri" ((uint32_t) (val)), "i" (offsetof(percpu_t, field)) : "memory")
+
+#define percpu_inc(field) \
+	__asm__ volatile("incl %%gs:%c0" : : "i" (offsetof(percpu_t, field)) : "memory")
+
+#define percpu_dec(field) \
+	__asm__ volatile("decl %%gs:%c0" : : "i" (offsetof(percpu_t, field)) : "memory")
+
+// Returns this processor's block
+#define percpu_self() ((percpu_t *) percpu_read(self))
+
+void percpu_init(unsigned int cpu);
+percpu_t *percpu_get(unsigned int cpu);
+
+#endif
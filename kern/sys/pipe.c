@@ -0,0 +1,490 @@
+#include <types.h>
+#include <errno.h>
+#include "pipe.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "system.h"
+#include "clock.h"
+#include "uaccess.h"
+#include "io/debug_console.h"
+
+static int pipe_read(file_t *file, void *buf, uint32_t len, uint32_t flags);
+static int pipe_write(file_t *file, const void *buf, uint32_t len, uint32_t flags);
+static uint32_t pipe_poll_read(file_t *file, wait_queue_t **wq);
+static uint32_t pipe_poll_write(file_t *file, wait_queue_t **wq);
+static void pipe_release_read(file_t *file);
+static void pipe_release_write(file_t *file);
+
+static const file_ops_t pipe_read_ops = {
+	.read = pipe_read,
+	.poll = pipe_poll_read,
+	.release = pipe_release_read
+};
+
+static const file_ops_t pipe_write_ops = {
+	.write = pipe_write,
+	.poll = pipe_poll_write,
+	.release = pipe_release_write
+};
+
+static void pipe_bench_cmd(int argc, char **argv);
+
+static int pipe_cmd_init(void) {
+	debugcon_register("pipebench", "Measures pipe round trips of 64 bytes to 1 MB ('pipebench [count]')", pipe_bench_cmd);
+	return 0;
+}
+
+module_init(pipe_cmd_init);
+
+/*
+ * Creates a pipe, returning a file for each end.
+ */
+int pipe_create(file_t **read_end, file_t **write_end) {
+	pipe_t *pipe = (pipe_t *) kmalloc(sizeof(pipe_t));
+
+	if(!pipe) {
+		return -ENOMEM;
+	}
+
+	memclr(pipe, sizeof(pipe_t));
+	wait_queue_init(&pipe->wq);
+
+	pipe->buf = (uint8_t *) kmalloc(PIPE_BUF_SIZE);
+	*read_end = file_alloc(&pipe_read_ops, pipe);
+	*write_end = file_alloc(&pipe_write_ops, pipe);
+
+	if(!pipe->buf || !*read_end || !*write_end) {
+		if(*read_end) kfree(*read_end);
+		if(*write_end) kfree(*write_end);
+		if(pipe->buf) kfree(pipe->buf);
+
+		kfree(pipe);
+		return -ENOMEM;
+	}
+
+	pipe->readers = pipe->writers = 1;
+
+	return 0;
+}
+
+/*
+ * Drops an end of the pipe, and frees it once both are gone. Tasks waiting
+ * for the other end are woken up, to see they won't get anywhere.
+ */
+static void pipe_release(pipe_t *pipe, bool reader) {
+	uint32_t irq = spin_lock_irqsave(&pipe->wq.lock);
+
+	if(reader) {
+		pipe->readers--;
+	} else {
+		pipe->writers--;
+	}
+
+	bool unused = !pipe->readers && !pipe->writers;
+
+	wait_queue_wake_all_locked(&pipe->wq);
+	spin_unlock_irqrestore(&pipe->wq.lock, irq);
+
+	if(unused) {
+		kfree(pipe->buf);
+		kfree(pipe);
+	}
+}
+
+static void pipe_release_read(file_t *file) {
+	pipe_release(file->data, true);
+}
+
+static void pipe_release_write(file_t *file) {
+	pipe_release(file->data, false);
+}
+
+/*
+ * Copies data out of the ring buffer.
+ */
+static int pipe_read_ring(pipe_t *pipe, uint8_t *buf, uint32_t len, uint32_t flags) {
+	uint32_t avail = pipe->tail - pipe->head;
+	uint32_t n = (len < avail) ? len : avail;
+	uint32_t copied = 0;
+
+	while(copied < n) {
+		uint32_t offset = pipe->head % PIPE_BUF_SIZE;
+		uint32_t chunk = n - copied;
+
+		if(chunk > PIPE_BUF_SIZE - offset) {
+			chunk = PIPE_BUF_SIZE - offset;
+		}
+
+		if(file_copy_out(buf + copied, pipe->buf + offset, chunk, flags)) {
+			return copied ? (int) copied : -EFAULT;
+		}
+
+		pipe->head += chunk;
+		copied += chunk;
+	}
+
+	return copied;
+}
+
+/*
+ * Returns whether the n bytes at addr in a lent buffer can be read.
+ */
+static bool pipe_loan_readable(pipe_loan_t *loan, uint32_t addr, uint32_t n) {
+	if(!loan->directory) {
+		return true;
+	}
+
+	uint32_t end = addr + n;
+
+	for(addr &= 0xFFFFF000; addr < end; addr += 0x1000) {
+		if(!paging_user_kernel_addr(loan->directory, addr, false)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Copies from the buffer a writer lent the pipe. Called without the pipe locked, but with the loan
+ * marked busy, so other readers stay away, and the writer stays blocked.
+ * Returns the number of bytes read, -EFAULT if the reader's buffer is bad, or
+ * -EAGAIN if the writer's is.
+ */
+static int pipe_read_loan(pipe_loan_t *loan, uint8_t *buf, uint32_t len, uint32_t flags) {
+	uint32_t n = loan->len - loan->done;
+	uint32_t src = loan->addr + loan->done;
+	page_directory_t *directory = NULL;
+
+	if(len < n) {
+		n = len;
+	}
+
+	if(!(flags & FILE_IO_KERNEL)) {
+		directory = ((i386_task_t *) sched_curr_task())->task_state->page_directory;
+	}
+
+	if(copy_between(directory, (uint32_t) buf, loan->directory, src, n)) {
+		return pipe_loan_readable(loan, src, n) ? -EFAULT : -EAGAIN;
+	}
+
+	return n;
+}
+
+/*
+ * Reads up to len bytes, blocking until there is data, or no writers are
+ * left, in which case 0 is returned.
+ */
+static int pipe_read(file_t *file, void *buf, uint32_t len, uint32_t flags) {
+	pipe_t *pipe = file->data;
+	int ret;
+
+	if(!len) {
+		return 0;
+	}
+
+	uint32_t irq = spin_lock_irqsave(&pipe->wq.lock);
+
+	while(1) {
+		// A loan that failed is about to be withdrawn by its writer
+		while((pipe->head == pipe->tail && !pipe->loan && pipe->writers) || (pipe->loan && (pipe->loan->busy || pipe->loan->error))) {
+			irq = wait_queue_sleep_locked(&pipe->wq, irq);
+		}
+
+		if(!pipe->loan) {
+			ret = pipe_read_ring(pipe, buf, len, flags);
+			break;
+		}
+
+		// Large reads can take a while, so they're done with the pipe unlocked
+		pipe_loan_t *loan = pipe->loan;
+		loan->busy = true;
+
+		spin_unlock_irqrestore(&pipe->wq.lock, irq);
+		ret = pipe_read_loan(loan, buf, len, flags);
+		irq = spin_lock_irqsave(&pipe->wq.lock);
+
+		loan->busy = false;
+
+		// If the writer's buffer is bad, fail its write, and wait for more data
+		if(ret == -EAGAIN) {
+			loan->error = -EFAULT;
+			wait_queue_wake_all_locked(&pipe->wq);
+			continue;
+		}
+
+		if(ret > 0) {
+			loan->done += ret;
+		}
+
+		break;
+	}
+
+	wait_queue_wake_all_locked(&pipe->wq);
+	spin_unlock_irqrestore(&pipe->wq.lock, irq);
+
+	return ret;
+}
+
+/*
+ * The read end is readable while there's data in the ring buffer or a loan
+ * that's still good, and hung up once the writers are gone; the write end is
+ * writable while the ring buffer has space and nobody is lending, and in
+ * error once the readers are gone.
+ */
+static uint32_t pipe_poll_read(file_t *file, wait_queue_t **wq) {
+	pipe_t *pipe = file->data;
+	uint32_t mask = 0;
+
+	uint32_t irq = spin_lock_irqsave(&pipe->wq.lock);
+
+	if(pipe->head != pipe->tail || (pipe->loan && !pipe->loan->error)) {
+		mask |= FILE_POLL_IN;
+	}
+
+	if(!pipe->writers) {
+		mask |= FILE_POLL_HUP;
+	}
+
+	spin_unlock_irqrestore(&pipe->wq.lock, irq);
+
+	*wq = &pipe->wq;
+	return mask;
+}
+
+static uint32_t pipe_poll_write(file_t *file, wait_queue_t **wq) {
+	pipe_t *pipe = file->data;
+	uint32_t mask = 0;
+
+	uint32_t irq = spin_lock_irqsave(&pipe->wq.lock);
+
+	if(!pipe->readers) {
+		mask |= FILE_POLL_ERR;
+	} else if(!pipe->loan && pipe->tail - pipe->head < PIPE_BUF_SIZE) {
+		mask |= FILE_POLL_OUT;
+	}
+
+	spin_unlock_irqrestore(&pipe->wq.lock, irq);
+
+	*wq = &pipe->wq;
+	return mask;
+}
+
+/*
+ * Copies a write into the ring buffer, blocking while it's full. Returns the
+ * number of bytes written, which is less than len only if the readers went
+ * away or the buffer couldn't be read.
+ */
+static int pipe_write_ring(pipe_t *pipe, const uint8_t *buf, uint32_t len, uint32_t flags, uint32_t *irq) {
+	uint32_t written = 0;
+
+	while(written < len) {
+		while(pipe->readers && (pipe->loan || pipe->tail - pipe->head == PIPE_BUF_SIZE)) {
+			*irq = wait_queue_sleep_locked(&pipe->wq, *irq);
+		}
+
+		if(!pipe->readers) {
+			return written ? (int) written : -EPIPE;
+		}
+
+		uint32_t space = PIPE_BUF_SIZE - (pipe->tail - pipe->head);
+		uint32_t offset = pipe->tail % PIPE_BUF_SIZE;
+		uint32_t chunk = len - written;
+
+		if(chunk > space) chunk = space;
+		if(chunk > PIPE_BUF_SIZE - offset) chunk = PIPE_BUF_SIZE - offset;
+
+		if(file_copy_in(pipe->buf + offset, buf + written, chunk, flags)) {
+			return written ? (int) written : -EFAULT;
+		}
+
+		pipe->tail += chunk;
+		written += chunk;
+
+		wait_queue_wake_all_locked(&pipe->wq);
+	}
+
+	return written;
+}
+
+/*
+ * Lends the buffer to readers, once the ring buffer is drained and no other
+ * loan is in progress, and waits for them to consume all of it.
+ */
+static int pipe_write_loan(pipe_t *pipe, const uint8_t *buf, uint32_t len, uint32_t flags, uint32_t *irq) {
+	i386_task_t *task = sched_curr_task();
+	pipe_loan_t loan;
+
+	if(!(flags & FILE_IO_KERNEL) && !access_ok(buf, len)) {
+		return -EFAULT;
+	}
+
+	loan.directory = (flags & FILE_IO_KERNEL) ? NULL : task->task_state->page_directory;
+	loan.addr = (uint32_t) buf;
+	loan.len = len;
+	loan.done = 0;
+	loan.error = 0;
+	loan.busy = false;
+
+	while(pipe->readers && (pipe->loan || pipe->head != pipe->tail)) {
+		*irq = wait_queue_sleep_locked(&pipe->wq, *irq);
+	}
+
+	if(!pipe->readers) {
+		return -EPIPE;
+	}
+
+	pipe->loan = &loan;
+	wait_queue_wake_all_locked(&pipe->wq);
+
+	while(pipe->readers && loan.done < len && !loan.error) {
+		*irq = wait_queue_sleep_locked(&pipe->wq, *irq);
+	}
+
+	pipe->loan = NULL;
+	wait_queue_wake_all_locked(&pipe->wq);
+
+	if(loan.done) {
+		return loan.done;
+	}
+
+	return loan.error ? loan.error : -EPIPE;
+}
+
+/*
+ * Writes len bytes, blocking until they all fit into the pipe, or, for large
+ * writes, were read. Fails with -EPIPE if there are no readers.
+ */
+static int pipe_write(file_t *file, const void *buf, uint32_t len, uint32_t flags) {
+	pipe_t *pipe = file->data;
+	int ret;
+
+	if(!len) {
+		return 0;
+	}
+
+	uint32_t irq = spin_lock_irqsave(&pipe->wq.lock);
+
+	if(len >= PIPE_LOAN_THRESHOLD) {
+		ret = pipe_write_loan(pipe, buf, len, flags, &irq);
+	} else {
+		ret = pipe_write_ring(pipe, buf, len, flags, &irq);
+	}
+
+	spin_unlock_irqrestore(&pipe->wq.lock, irq);
+
+	return ret;
+}
+
+// Benchmark: a thread echoing whatever it reads from one pipe to another
+typedef struct pipe_bench {
+	file_t *in, *out;
+	uint8_t *buf;
+	uint32_t size;
+} pipe_bench_t;
+
+/*
+ * Reads exactly len bytes from a pipe, unless it hits the end first.
+ */
+static int pipe_bench_read_full(file_t *file, uint8_t *buf, uint32_t len) {
+	uint32_t done = 0;
+
+	while(done < len) {
+		int ret = file_read(file, buf + done, len - done, FILE_IO_KERNEL);
+
+		if(ret <= 0) {
+			return ret;
+		}
+
+		done += ret;
+	}
+
+	return done;
+}
+
+static void pipe_bench_echo(void *context) {
+	pipe_bench_t *bench = context;
+	file_t *out = bench->out;
+
+	while(pipe_bench_read_full(bench->in, bench->buf, bench->size) > 0) {
+		file_write(out, bench->buf, bench->size, FILE_IO_KERNEL);
+	}
+
+	file_put(bench->in);
+	file_put(out);
+}
+
+/*
+ * Debug console command: sends messages of 64 bytes, 4 KB and 1 MB through a
+ * pipe to a thread that echoes them back through another one, and prints the
+ * round trip time and throughput for each. Messages of 1 MB are lent rather
+ * than buffered, so they are copied once, directly between the two threads.
+ */
+static void pipe_bench_cmd(int argc, char **argv) {
+	static const uint32_t sizes[] = {64, 4096, 0x100000};
+	unsigned int count = 1000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("pipebench: can't block here\n");
+		return;
+	}
+
+	for(unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint32_t size = sizes[s];
+		unsigned int iterations = (size >= 0x100000) ? ((count / 64) ? (count / 64) : 1) : count;
+
+		file_t *to_echo, *to_echo_w, *from_echo, *from_echo_w;
+		pipe_bench_t bench;
+
+		uint8_t *buf = (uint8_t *) kmalloc(size);
+		bench.buf = (uint8_t *) kmalloc(size);
+
+		if(!buf || !bench.buf || pipe_create(&to_echo, &to_echo_w) || pipe_create(&from_echo, &from_echo_w)) {
+			kprintf("pipebench: out of memory\n");
+			return;
+		}
+
+		memclr(buf, size);
+
+		bench.in = to_echo;
+		bench.out = from_echo_w;
+		bench.size = size;
+
+		sched_task_start(task_create_kernel("pipebench echo", pipe_bench_echo, &bench));
+
+		uint64_t start = sys_rdtsc();
+
+		for(unsigned int i = 0; i < iterations; i++) {
+			file_write(to_echo_w, buf, size, FILE_IO_KERNEL);
+			pipe_bench_read_full(from_echo, buf, size);
+		}
+
+		uint64_t cycles = sys_rdtsc() - start;
+
+		// Once the echo thread sees the end of its input, it closes our input
+		file_put(to_echo_w);
+		while(file_read(from_echo, buf, size, FILE_IO_KERNEL) > 0);
+		file_put(from_echo);
+
+		kfree(buf);
+		kfree(bench.buf);
+
+		uint32_t per_trip = (uint32_t) mstd_div_u64(cycles, iterations, NULL);
+		kprintf("pipebench: %u bytes, %u round trips, %u cycles each", size, iterations, per_trip);
+
+		if(clock_get_source()->is_tsc) {
+			uint32_t us = (uint32_t) mstd_div_u64(clock_cycles_to_ns(cycles), 1000, NULL);
+			uint64_t bytes = 2ULL * size * iterations;
+
+			// Bytes per microsecond are megabytes per second
+			kprintf(" (%u ns, %u MB/s)", (uint32_t) clock_cycles_to_ns(per_trip), (uint32_t) mstd_div_u64(bytes, us ? us : 1, NULL));
+		}
+
+		kprintf("\n");
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <types.h>
+#include "file.h"
+#include "paging.h"
+#include "waitqueue.h"
+
+/*
+ * Pipes: small writes go through a ring buffer. Large writes aren't copied
+ * into the pipe at all; the writer lends its buffer to the pipe and blocks,
+ * and readers copy straight out of it, into their own buffers.
+ */
+
+#define PIPE_BUF_SIZE 4096
+
+// Writes of at least this many bytes are lent rather than buffered
+#define PIPE_LOAN_THRESHOLD 0x4000
+
+// A writer's buffer, lent to readers; lives on the writer's stack
+typedef struct pipe_loan {
+	// Address space of the buffer; NULL for kernel memory
+	page_directory_t *directory;
+
+	uint32_t addr;
+	uint32_t len;
+
+	// Bytes read so far, and the error to fail the write with, if any
+	uint32_t done;
+	int error;
+
+	// Set while a reader copies from the buffer with the pipe unlocked
+	bool busy;
+} pipe_loan_t;
+
+typedef struct pipe {
+	// Readers and writers wait here; its lock protects the pipe
+	wait_queue_t wq;
+
+	uint8_t *buf;
+	// Free running read and write positions
+	uint32_t head, tail;
+
+	// Open read and write ends
+	unsigned int readers, writers;
+
+	pipe_loan_t *loan;
+} pipe_t;
+
+int pipe_create(file_t **read_end, file_t **write_end);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PREEMPT_H
+#define PREEMPT_H
+
+#include <types.h>
+#include "percpu.h"
+
+/*
+ * Kernel code can be preempted whenever this processor's preempt count is
+ * zero and interrupts are enabled. Spinlocks and hardware interrupt handlers
+ * raise the count, and code that touches per-CPU state across several
+ * instructions can do so explicitly.
+ *
+ * If a reschedule was asked for while the count was raised, it happens when
+ * the count drops back to zero: in preempt_enable, or on exit from the
+ * interrupt that lowered it. The count belongs to the processor, not the task,
+ * so code must not block or yield with preemption disabled.
+ */
+void preempt_schedule(void);
+
+static inline void preempt_disable(void) {
+	percpu_inc(preempt_count);
+	__asm__ volatile("" : : : "memory");
+}
+
+/*
+ * Lowers the count without checking whether a reschedule is due; for paths
+ * that are about to check anyway, or can't schedule.
+ */
+static inline void preempt_enable_no_resched(void) {
+	__asm__ volatile("" : : : "memory");
+	percpu_dec(preempt_count);
+}
+
+static inline void preempt_enable(void) {
+	preempt_enable_no_resched();
+
+	if(__builtin_expect(percpu_read(need_resched) != 0, 0) && percpu_read(preempt_count) == 0) {
+		preempt_schedule();
+	}
+}
+
+// Returns whether the current context may be preempted
+static inline bool preemptible(void) {
+	uint32_t flags;
+	__asm__ volatile("pushf; pop %0" : "=r"(flags));
+
+	return percpu_read(preempt_count) == 0 && (flags & 0x200);
+}
+
+#endif
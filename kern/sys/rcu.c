@@ -0,0 +1,429 @@
+#include <types.h>
+#include "rcu.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+#include "softirq.h"
+#include "percpu.h"
+#include "smp.h"
+#include "sched.h"
+#include "task.h"
+#include "sync.h"
+#include "clock.h"
+#include "device/apic.h"
+#include "io/debug_console.h"
+
+/*
+ * Grace periods are numbered. While one is in progress, each processor that
+ * was online when it started must report a quiescent state; a processor
+ * remembers the number of the last grace period it reported for, so outside
+ * of grace periods reporting costs a single comparison.
+ *
+ * Callbacks queue up on rcu_next until a grace period starts, wait on
+ * rcu_wait while it is in progress, and are run from the RCU softirq once it
+ * has ended. Only one grace period is in progress at a time; callbacks queued
+ * during one start the next as soon as it ends.
+ */
+static spinlock_t rcu_lock = SPINLOCK_INIT;
+
+static volatile uint32_t rcu_gp_num;
+static volatile bool rcu_gp_active;
+static volatile uint32_t rcu_cpus_pending;
+
+static rcu_head_t *rcu_next, **rcu_next_tail = &rcu_next;
+static rcu_head_t *rcu_wait, **rcu_wait_tail = &rcu_wait;
+static rcu_head_t *rcu_done, **rcu_done_tail = &rcu_done;
+
+// Statistics
+static uint32_t rcu_gp_completed;
+static uint32_t rcu_callbacks_run;
+
+// State shared with synchronize_rcu's callback
+typedef struct rcu_sync {
+	rcu_head_t head;
+
+	wait_queue_t wq;
+	volatile bool done;
+} rcu_sync_t;
+
+static void rcu_softirq(void);
+static void rcu_cmd(int argc, char **argv);
+static void rcu_bench_cmd(int argc, char **argv);
+
+static int rcu_init(void) {
+	softirq_register(kSoftIRQRcu, rcu_softirq);
+	return 0;
+}
+
+module_early_init(rcu_init);
+
+static int rcu_cmd_init(void) {
+	debugcon_register("rcu", "RCU grace period statistics", rcu_cmd);
+	debugcon_register("rcubench", "Compares RCU and rwlock read throughput ('rcubench [count]')", rcu_bench_cmd);
+	return 0;
+}
+
+module_init(rcu_cmd_init);
+
+/*
+ * Starts a grace period for the callbacks on rcu_next. The lock must be held.
+ * Returns the processors that have to be asked to report a quiescent state.
+ */
+static uint32_t rcu_gp_start_locked(void) {
+	rcu_wait = rcu_next;
+	rcu_wait_tail = rcu_next_tail;
+
+	rcu_next = NULL;
+	rcu_next_tail = &rcu_next;
+
+	// The bootstrap processor counts even before SMP setup marks it online
+	uint32_t mask = 1;
+	unsigned int num_cpus = smp_num_cpus();
+
+	for(unsigned int i = 1; i < num_cpus; i++) {
+		if(smp_get_cpu(i)->online) {
+			mask |= (1 << i);
+		}
+	}
+
+	// The lock's atomic ticket orders this after the writer's unlinking
+	rcu_cpus_pending = mask;
+	rcu_gp_num++;
+	rcu_gp_active = true;
+
+	return mask;
+}
+
+/*
+ * Ends the grace period in progress: its callbacks may now run, and if more
+ * were queued in the meantime, the next grace period starts.
+ */
+static uint32_t rcu_gp_end_locked(void) {
+	if(rcu_wait) {
+		*rcu_done_tail = rcu_wait;
+		rcu_done_tail = rcu_wait_tail;
+
+		softirq_raise(kSoftIRQRcu);
+	}
+
+	rcu_wait = NULL;
+	rcu_wait_tail = &rcu_wait;
+
+	rcu_gp_active = false;
+	rcu_gp_completed++;
+
+	return rcu_next ? rcu_gp_start_locked() : 0;
+}
+
+/*
+ * Records that a processor is in a quiescent state, ending the grace period if
+ * it was the last one it waited for. Returns the processors to kick if a new
+ * grace period started.
+ */
+static uint32_t rcu_report_qs_locked(unsigned int cpu) {
+	uint32_t kick = 0;
+
+	percpu_write(rcu_gp_seen, rcu_gp_num);
+
+	if(rcu_gp_active && (rcu_cpus_pending & (1 << cpu))) {
+		rcu_cpus_pending &= ~(1 << cpu);
+
+		if(!rcu_cpus_pending) {
+			kick = rcu_gp_end_locked();
+
+			// We're still quiescent, which counts for the new one as well
+			if(kick & (1 << cpu)) {
+				percpu_write(rcu_gp_seen, rcu_gp_num);
+
+				kick &= ~(1 << cpu);
+				rcu_cpus_pending = kick;
+
+				if(!kick) {
+					kick = rcu_gp_end_locked();
+				}
+			}
+		}
+	}
+
+	return kick;
+}
+
+/*
+ * Sends the processors in mask, except for this one, a reschedule IPI. The
+ * interrupt lets each of them report a quiescent state on its way out, unless
+ * it's in a read section, in which case it reports at its next context switch
+ * or interrupt.
+ */
+static void rcu_kick(uint32_t mask) {
+	mask &= ~(1 << smp_cpu_id());
+
+	for(unsigned int i = 0; mask; i++, mask >>= 1) {
+		if(mask & 1) {
+			apic_send_ipi(smp_get_cpu(i)->apic_id, APIC_RESCHED_VECTOR);
+		}
+	}
+}
+
+/*
+ * Called by the scheduler on every context switch, by the idle loop, and on
+ * exit from an interrupt that was taken while preemptible: none of these can
+ * be inside a read section.
+ */
+void rcu_note_qs(void) {
+	if(likely(percpu_read(rcu_gp_seen) == rcu_gp_num)) {
+		return;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&rcu_lock);
+	uint32_t kick = rcu_report_qs_locked(smp_cpu_id());
+	spin_unlock_irqrestore(&rcu_lock, flags);
+
+	if(kick) {
+		rcu_kick(kick);
+	}
+}
+
+/*
+ * Queues func to be called with head once all read sections in progress have
+ * finished. May be called from anywhere, including read sections and
+ * interrupt handlers; the callback runs from a softirq, so it must not block.
+ */
+void call_rcu(rcu_head_t *head, rcu_callback_t func) {
+	head->func = func;
+	head->next = NULL;
+
+	uint32_t kick = 0;
+	uint32_t flags = spin_lock_irqsave(&rcu_lock);
+
+	*rcu_next_tail = head;
+	rcu_next_tail = &head->next;
+
+	if(!rcu_gp_active) {
+		kick = rcu_gp_start_locked();
+	}
+
+	spin_unlock_irqrestore(&rcu_lock, flags);
+
+	if(kick) {
+		rcu_kick(kick);
+	}
+}
+
+/*
+ * Wakes up the task waiting in synchronize_rcu.
+ */
+static void rcu_sync_done(rcu_head_t *head) {
+	rcu_sync_t *sync = rcu_entry(head, rcu_sync_t, head);
+
+	uint32_t flags = spin_lock_irqsave(&sync->wq.lock);
+	sync->done = true;
+	wait_queue_wake_all_locked(&sync->wq);
+	spin_unlock_irqrestore(&sync->wq.lock, flags);
+}
+
+/*
+ * Waits until all read sections in progress have finished. Must not be called
+ * from a read section, or anywhere else that can't block.
+ *
+ * With a single processor, the caller not being in a read section means none
+ * is in progress: read sections can't be preempted, and interrupt handlers
+ * finish theirs before returning.
+ */
+void synchronize_rcu(void) {
+	if(smp_num_cpus() == 1) {
+		return;
+	}
+
+	rcu_sync_t sync;
+	wait_queue_init(&sync.wq);
+	sync.done = false;
+
+	call_rcu(&sync.head, rcu_sync_done);
+
+	// We're not in a read section ourselves
+	rcu_note_qs();
+
+	// Before the scheduler runs, other processors still report when kicked
+	if(!sched_can_block()) {
+		while(!sync.done) {
+			rcu_note_qs();
+			__asm__ volatile("pause" : : : "memory");
+		}
+
+		return;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&sync.wq.lock);
+
+	while(!sync.done) {
+		flags = wait_queue_sleep_locked(&sync.wq, flags);
+	}
+
+	spin_unlock_irqrestore(&sync.wq.lock, flags);
+}
+
+/*
+ * RCU softirq: runs the callbacks whose grace period has ended.
+ */
+static void rcu_softirq(void) {
+	uint32_t flags = spin_lock_irqsave(&rcu_lock);
+
+	rcu_head_t *head = rcu_done;
+
+	rcu_done = NULL;
+	rcu_done_tail = &rcu_done;
+
+	spin_unlock_irqrestore(&rcu_lock, flags);
+
+	while(head) {
+		rcu_head_t *next = head->next;
+
+		head->func(head);
+		__sync_fetch_and_add(&rcu_callbacks_run, 1);
+
+		head = next;
+	}
+}
+
+/*
+ * Debug console command: prints grace period statistics.
+ */
+static void rcu_cmd(int argc, char **argv) {
+	kprintf("grace period %u (%s), %u completed, waiting for cpus 0x%X\n", rcu_gp_num, rcu_gp_active ? "in progress" : "idle", rcu_gp_completed, rcu_cpus_pending);
+	kprintf("%u callbacks run\n", rcu_callbacks_run);
+}
+
+/*
+ * Read throughput benchmark: a kernel task on each processor looks up keys in
+ * a small linked table, protected either by RCU or by an rwlock, whose readers
+ * all write the lock's cache line.
+ */
+#define RCU_BENCH_ENTRIES 32
+
+typedef struct rcu_bench_entry {
+	uint32_t key, value;
+	struct rcu_bench_entry *next;
+} rcu_bench_entry_t;
+
+static rcu_bench_entry_t rcu_bench_table[RCU_BENCH_ENTRIES];
+static rcu_bench_entry_t *rcu_bench_first;
+static rwlock_t rcu_bench_lock;
+
+static volatile bool rcu_bench_use_rwlock;
+static volatile uint32_t rcu_bench_count;
+static volatile uint32_t rcu_bench_finished;
+static uint64_t rcu_bench_ns[SMP_MAX_CPUS];
+
+static uint32_t rcu_bench_lookup(uint32_t key) {
+	rcu_bench_entry_t *entry = rcu_dereference(rcu_bench_first);
+
+	while(entry) {
+		if(entry->key == key) {
+			return entry->value;
+		}
+
+		entry = rcu_dereference(entry->next);
+	}
+
+	return 0;
+}
+
+static void rcu_bench_task(void *context) {
+	unsigned int cpu = (unsigned int) context;
+	uint32_t count = rcu_bench_count;
+	uint32_t sum = 0;
+
+	uint64_t start = ktime_get_ns();
+
+	for(uint32_t i = 0; i < count; i++) {
+		if(rcu_bench_use_rwlock) {
+			rwlock_read_lock(&rcu_bench_lock);
+			sum += rcu_bench_lookup(i % RCU_BENCH_ENTRIES);
+			rwlock_read_unlock(&rcu_bench_lock);
+		} else {
+			rcu_read_lock();
+			sum += rcu_bench_lookup(i % RCU_BENCH_ENTRIES);
+			rcu_read_unlock();
+		}
+	}
+
+	rcu_bench_ns[cpu] = ktime_get_ns() - start;
+
+	// Keeps the lookups from being optimised out
+	if(sum == 0xFFFFFFFF) {
+		kprintf("rcubench: unlikely sum\n");
+	}
+
+	__sync_fetch_and_add(&rcu_bench_finished, 1);
+}
+
+/*
+ * Runs one pass of the benchmark on every online processor, and prints how
+ * long a lookup took on average.
+ */
+static void rcu_bench_run(bool use_rwlock) {
+	unsigned int num_cpus = smp_num_cpus();
+	unsigned int started = 0;
+
+	rcu_bench_use_rwlock = use_rwlock;
+	rcu_bench_finished = 0;
+	memclr(rcu_bench_ns, sizeof(rcu_bench_ns));
+
+	for(unsigned int i = 0; i < num_cpus; i++) {
+		if(!smp_get_cpu(i)->online) continue;
+
+		i386_task_t *task = task_create_kernel("rcubench", rcu_bench_task, (void *) i);
+		sched_task_pin(task, i);
+		sched_task_start(task);
+
+		started++;
+	}
+
+	while(rcu_bench_finished != started) {
+		sched_yield();
+	}
+
+	uint64_t total = 0, longest = 0;
+
+	for(unsigned int i = 0; i < num_cpus; i++) {
+		total += rcu_bench_ns[i];
+
+		if(rcu_bench_ns[i] > longest) {
+			longest = rcu_bench_ns[i];
+		}
+	}
+
+	uint32_t per_lookup = (uint32_t) mstd_div_u64(total, rcu_bench_count * started, NULL);
+
+	kprintf("%s: %u lookups on %u cpus in %u us, %u ns per lookup\n", use_rwlock ? "rwlock" : "rcu", rcu_bench_count * started, started, (uint32_t) mstd_div_u64(longest, 1000, NULL), per_lookup);
+}
+
+/*
+ * Debug console command: runs the read throughput benchmark with RCU, then
+ * with an rwlock.
+ */
+static void rcu_bench_cmd(int argc, char **argv) {
+	uint32_t count = 100000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("rcubench: can't wait for the benchmark tasks from here\n");
+		return;
+	}
+
+	for(int i = 0; i < RCU_BENCH_ENTRIES; i++) {
+		rcu_bench_table[i].key = i;
+		rcu_bench_table[i].value = i + 1;
+		rcu_bench_table[i].next = (i + 1 < RCU_BENCH_ENTRIES) ? &rcu_bench_table[i + 1] : NULL;
+	}
+
+	rcu_bench_first = &rcu_bench_table[0];
+	rwlock_init(&rcu_bench_lock);
+
+	rcu_bench_count = count;
+
+	rcu_bench_run(false);
+	rcu_bench_run(true);
+}
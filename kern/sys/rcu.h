@@ -0,0 +1,55 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <types.h>
+#include "preempt.h"
+
+/*
+ * Read-copy-update, for tables that are read far more often than they change.
+ * Readers take no locks and write no shared memory: a read section only
+ * disables preemption on its processor. Writers still serialise among
+ * themselves with a lock, publish new entries with rcu_assign_pointer, and
+ * unlink old ones, but only free them once every processor has gone through
+ * a quiescent state (a context switch, the idle loop, or an interrupt taken
+ * while preemptible), after which no reader can still be looking at them.
+ *
+ * Read sections must not block, and may nest. Entries are linked with
+ * rcu_assign_pointer only once fully initialised, and followed by readers
+ * with rcu_dereference.
+ */
+typedef struct rcu_head {
+	struct rcu_head *next;
+	void (*func)(struct rcu_head *head);
+} rcu_head_t;
+
+typedef void (*rcu_callback_t)(rcu_head_t *head);
+
+// Gets the structure an rcu_head_t is embedded in
+#define rcu_entry(head, type, member) ((type *) ((uint8_t *) (head) - offsetof(type, member)))
+
+// Reads a pointer readers follow; x86 doesn't reorder dependent loads
+#define rcu_dereference(p) ({ \
+	__typeof__(p) __p = *((__typeof__(p) volatile *) &(p)); \
+	__asm__ volatile("" : : : "memory"); \
+	__p; })
+
+// Publishes a pointer after the stores initialising what it points to
+#define rcu_assign_pointer(p, v) do { \
+	__asm__ volatile("" : : : "memory"); \
+	*((__typeof__(p) volatile *) &(p)) = (v); \
+} while(0)
+
+static inline void rcu_read_lock(void) {
+	preempt_disable();
+}
+
+static inline void rcu_read_unlock(void) {
+	preempt_enable();
+}
+
+void rcu_note_qs(void);
+
+void call_rcu(rcu_head_t *head, rcu_callback_t func);
+void synchronize_rcu(void);
+
+#endif
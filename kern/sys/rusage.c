@@ -0,0 +1,137 @@
+#include <types.h>
+#include <errno.h>
+#include "rusage.h"
+#include "task.h"
+#include "sched.h"
+#include "sched_stats.h"
+#include "system.h"
+#include "io/debug_console.h"
+
+static void rusage_cmd(int argc, char **argv);
+
+static int rusage_cmd_init(void) {
+	debugcon_register("rusage", "Resource usage of processes, with their threads", rusage_cmd);
+	return 0;
+}
+
+module_init(rusage_cmd_init);
+
+/*
+ * Counts a page fault that the calling task took and that was resolved. So
+ * far, the only ones are kernel accesses to user memory that are fixed up;
+ * there's no demand paging, so nothing counts as major yet.
+ */
+void rusage_page_fault(bool major) {
+	i386_task_t *task = sched_curr_task();
+
+	if(!task) {
+		return;
+	}
+
+	if(major) {
+		task->rusage.majflt++;
+	} else {
+		task->rusage.minflt++;
+	}
+}
+
+void rusage_syscall(struct task *task) {
+	task->rusage.syscalls++;
+}
+
+/*
+ * Charges bytes read or written to the calling task; I/O done by kernel
+ * threads, such as ring pollers, is charged to them.
+ */
+void rusage_io(uint32_t bytes, bool write) {
+	i386_task_t *task = sched_curr_task();
+
+	if(!task) {
+		return;
+	}
+
+	if(write) {
+		task->rusage.written_bytes += bytes;
+	} else {
+		task->rusage.read_bytes += bytes;
+	}
+}
+
+/*
+ * Updates the number of user pages mapped into a process, and its peak.
+ * Threads may map and unmap concurrently, so both are updated atomically.
+ */
+void rusage_rss_add(struct task *leader, int pages) {
+	uint32_t rss = __sync_add_and_fetch(&leader->rss_pages, pages);
+	uint32_t max = leader->maxrss_pages;
+
+	while(rss > max) {
+		if(__sync_bool_compare_and_swap(&leader->maxrss_pages, max, rss)) {
+			break;
+		}
+
+		max = leader->maxrss_pages;
+	}
+}
+
+void rusage_add_task(struct task *task, rusage_t *out) {
+	sched_task_stats_t stats;
+	sched_stats_get_task(task, &stats);
+
+	out->utime_ns += stats.user_ns;
+	out->stime_ns += stats.kernel_ns;
+	out->nvcsw += stats.nvcsw;
+	out->nivcsw += stats.nivcsw;
+
+	out->minflt += task->rusage.minflt;
+	out->majflt += task->rusage.majflt;
+	out->syscalls += task->rusage.syscalls;
+	out->read_bytes += task->rusage.read_bytes;
+	out->written_bytes += task->rusage.written_bytes;
+}
+
+/*
+ * Fills out with the resource usage of the task's process, or only of the
+ * task itself. The peak resident set size is always that of the process.
+ */
+int rusage_get(struct task *task, uint32_t who, rusage_t *out) {
+	memclr(out, sizeof(rusage_t));
+
+	if(who == RUSAGE_SELF) {
+		task_get_rusage(task->leader, out);
+	} else if(who == RUSAGE_THREAD) {
+		rusage_add_task(task, out);
+	} else {
+		return -EINVAL;
+	}
+
+	out->maxrss_kb = task->leader->maxrss_pages * 4;
+
+	return 0;
+}
+
+static void rusage_cmd_task(i386_task_t *task, void *context) {
+	rusage_t usage;
+
+	if(task->leader != task) {
+		return;
+	}
+
+	// The list is locked already, which rusage_get would try as well
+	memclr(&usage, sizeof(rusage_t));
+	task_get_rusage_locked(task, &usage);
+	usage.maxrss_kb = task->maxrss_pages * 4;
+
+	kprintf("%u\t%u\t%u\t", task->pid, (uint32_t) mstd_div_u64(usage.utime_ns, 1000000, NULL), (uint32_t) mstd_div_u64(usage.stime_ns, 1000000, NULL));
+	kprintf("%u\t%u\t%u\t%u\t%u\t", usage.minflt, usage.majflt, usage.nvcsw, usage.nivcsw, usage.syscalls);
+	kprintf("%u\t%u\t%u\t%s\n", (uint32_t) (usage.read_bytes >> 10), (uint32_t) (usage.written_bytes >> 10), usage.maxrss_kb, task->name);
+}
+
+/*
+ * Debug console command: prints the usage of each process.
+ */
+static void rusage_cmd(int argc, char **argv) {
+	kprintf("PID\tutime ms\tstime ms\tminflt\tmajflt\tnvcsw\tnivcsw\tsyscalls\tread KB\twritten KB\tmaxrss KB\tname\n");
+
+	task_for_each(rusage_cmd_task, NULL);
+}
@@ -0,0 +1,58 @@
+#ifndef RUSAGE_H
+#define RUSAGE_H
+
+#include <types.h>
+
+/*
+ * Resource usage of tasks: each counts its page faults, syscalls, and bytes
+ * read and written through files and the VFS itself, alongside the CPU
+ * accounting the scheduler does (sched_stats.h). Processes also track how
+ * many user pages are mapped into them, and the most there ever were.
+ * Usage of a process is that of all of its threads, including the ones that
+ * exited already.
+ */
+
+// Scopes for rusage_get: the calling process, or only the calling thread
+#define RUSAGE_SELF		0
+#define RUSAGE_THREAD	1
+
+// Counters kept by each task; only the task itself updates them
+typedef struct task_rusage {
+	uint32_t minflt, majflt;
+	uint32_t syscalls;
+
+	uint64_t read_bytes, written_bytes;
+} task_rusage_t;
+
+// Layout is shared with the C library's resource.h
+typedef struct rusage {
+	uint64_t utime_ns, stime_ns;
+
+	// Page faults resolved without and with I/O
+	uint32_t minflt, majflt;
+	// Voluntary and involuntary context switches
+	uint32_t nvcsw, nivcsw;
+	uint32_t syscalls;
+
+	// Peak resident set size of the process
+	uint32_t maxrss_kb;
+
+	uint64_t read_bytes, written_bytes;
+} rusage_t;
+
+struct task;
+
+// Charging the calling task
+void rusage_page_fault(bool major);
+void rusage_syscall(struct task *task);
+void rusage_io(uint32_t bytes, bool write);
+
+// Pages mapped into (positive) or unmapped from (negative) a process
+void rusage_rss_add(struct task *leader, int pages);
+
+// Adds the usage of a single task to out
+void rusage_add_task(struct task *task, rusage_t *out);
+
+int rusage_get(struct task *task, uint32_t who, rusage_t *out);
+
+#endif
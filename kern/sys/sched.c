@@ -4,89 +4,510 @@
 #include "system.h"
 #include "kheap.h"
 #include "paging.h"
+#include "clock.h"
+#include "timer.h"
+#include "sched_stats.h"
+#include "smp.h"
+#include "percpu.h"
+#include "preempt.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "rcu.h"
+#include "vdso.h"
+#include "device/apic.h"
 
 // External handler
 extern void sched_trap(void);
 
-// Backup of stack pointer when scheduler trap is taken
-uint32_t sched_old_esp, sched_old_ebp;
+/*
+ * Per-processor scheduler state. Each processor has a run queue holding the
+ * runnable tasks that are not currently running; the lock protects the queue
+ * and the current task, as other processors may steal from the queue, place
+ * new tasks on it, or wake up a task that's blocking on this processor.
+ */
+typedef struct sched_cpu {
+	spinlock_t lock;
+
+	sched_task_t *rq_first, *rq_last;
+	volatile unsigned int nr_queued;
+
+	// Miscellaneous required stuff
+	uint64_t scheduler_cycle;
+
+	// Task currently executing, and the task running the idle loop
+	i386_task_t *curr;
+	i386_task_t *idle;
+
+	// Time at which the running task's quantum ends
+	uint64_t quantum_end;
 
-// Miscellaneous required stuff
-static uint64_t scheduler_cycle;
+	// Set while expired timers wait for the timer softirq to run them
+	volatile bool timers_deferred;
 
-// Point to the previous, current and next task's struct
-static i386_task_t *prevTask;
-static i386_task_t *currTask;
-static i386_task_t *nextTask;
+	// When the one-shot timer was last programmed to fire
+	volatile uint64_t timer_deadline;
+
+	// Task woken with sched_wake_sync, which runs next if still queued here
+	sched_task_t *handoff;
+} sched_cpu_t;
+
+static sched_cpu_t sched_cpus[SMP_MAX_CPUS];
+
+// Scheduling class in use
+static sched_class_t *sched_class;
+extern sched_class_t sched_rr_class;
 
 extern page_directory_t *kernel_directory;
 
-// Selects the next process to run
-void sched_chose_next();
+static sched_task_t *sched_chose_next(sched_cpu_t *sc, sched_task_t *prev);
+static sched_task_t *sched_steal(unsigned int cpu);
+static bool sched_can_steal(unsigned int cpu);
+static void sched_program_timer(sched_cpu_t *sc, uint64_t now);
+static void sched_timer_softirq(void);
 
 /*
- * Initialises the scheduler.
+ * Initialises the scheduler, and picks the scheduling class.
  */
 void sched_init() {
-	// Set up a trap gate in the IDT
-	sys_set_idt_gate(SCHED_TRAP_NUM, (uint32_t) sched_trap, 0x08, 0x8F);
+	// Set up an interrupt gate in the IDT, so the scheduler runs with IRQs off
+	sys_set_idt_gate(SCHED_TRAP_NUM, (uint32_t) sched_trap, 0x08, 0x8E);
+
+	sched_class = SCHED_DEFAULT_FAIR ? &sched_fair_class : &sched_rr_class;
+
+	char *class = sys_get_argument("sched");
+
+	if(class && !strcmp(class, "fair")) {
+		sched_class = &sched_fair_class;
+	} else if(class && !strcmp(class, "rr")) {
+		sched_class = &sched_rr_class;
+	}
+
+	sched_class->init();
+
+	softirq_register(kSoftIRQTimer, sched_timer_softirq);
+
+	kprintf("sched: using %s scheduling class\n", sched_class->name);
 }
 
 /*
- * Routine called by a process to yield processor control to another.
- *
- * This is usually done by a process executing "int $0x88" and the CPU
- * taking the trap to an assembly wrapper.
+ * Adds a task to a processor's run queue. The queue must be locked.
+ */
+static void sched_rq_enqueue(sched_cpu_t *sc, sched_task_t *info) {
+	unsigned int cpu = sc - sched_cpus;
+
+	sched_class->enqueue(cpu, info);
+	sc->nr_queued++;
+
+	info->cpu = cpu;
+	info->queued = true;
+}
+
+/*
+ * Removes a task from a processor's run queue. The queue must be locked.
+ */
+static void sched_rq_dequeue(sched_cpu_t *sc, sched_task_t *info) {
+	sched_class->dequeue(sc - sched_cpus, info);
+	sc->nr_queued--;
+
+	info->queued = false;
+}
+
+/*
+ * Round robin class: adds a task to the tail of the run queue.
+ */
+static void sched_rr_enqueue(unsigned int cpu, sched_task_t *info) {
+	sched_cpu_t *sc = &sched_cpus[cpu];
+
+	info->rq_next = NULL;
+	info->rq_prev = sc->rq_last;
+
+	if(sc->rq_last) {
+		sc->rq_last->rq_next = info;
+	} else {
+		sc->rq_first = info;
+	}
+
+	sc->rq_last = info;
+}
+
+/*
+ * Round robin class: removes a task from the run queue.
+ */
+static void sched_rr_dequeue(unsigned int cpu, sched_task_t *info) {
+	sched_cpu_t *sc = &sched_cpus[cpu];
+
+	if(info->rq_prev) {
+		info->rq_prev->rq_next = info->rq_next;
+	} else {
+		sc->rq_first = info->rq_next;
+	}
+
+	if(info->rq_next) {
+		info->rq_next->rq_prev = info->rq_prev;
+	} else {
+		sc->rq_last = info->rq_prev;
+	}
+
+	info->rq_prev = info->rq_next = NULL;
+}
+
+/*
+ * Picks the next task to run on this processor, and switches to it. Must be
+ * called with interrupts disabled; returns once the calling task is switched
+ * back in.
  *
- * NOTE: This function never returns, but still has to be CALLed to retain the
- * proper stack alignment when passing arguments on the stack.
+ * This is called from sched_trap, when a task executes "int $0x88" or an IRQ
+ * handler preempts it, in which case the task's full register frame is on its
+ * kernel stack. Kernel code that gives up the processor calls sched_yield
+ * instead, which skips the trap frame, as switch_to saves all the registers
+ * the C calling convention doesn't already.
  */
-void sched_yield(sched_trap_regs_t regs) {
-	// Save the task state
-	task_save_state(currTask, regs);
+void sched_schedule(void) {
+	unsigned int cpu = smp_cpu_id();
+	sched_cpu_t *sc = &sched_cpus[cpu];
+	uint64_t now = ktime_get_ns();
+
+	i386_task_t *prev = sc->curr;
+	sched_task_t *prevInfo = prev->scheduler_info;
+
+	// Whatever the outgoing task was doing, it's not in an RCU read section
+	rcu_note_qs();
+
+	// Account the outgoing task's time; it was preempted if we came from an IRQ
+	sched_stats_switch_out(&prev->acct, now, percpu_read(need_resched) != 0);
+
+	/*
+	 * Put the outgoing task back on the run queue unless it's blocking, and
+	 * pick the next one. The current task changes with the queue locked, so a
+	 * concurrent sched_wake knows whether the blocking task was taken off.
+	 */
+	spin_lock(&sc->lock);
+
+	if(prev != sc->idle) {
+		sched_class->account(cpu, prevInfo, now - prevInfo->exec_start);
+	}
+
+	if(prev != sc->idle && !prevInfo->queued && !prevInfo->blocked) {
+		sched_rq_enqueue(sc, prevInfo);
+	}
+
+	sched_task_t *nextInfo = sched_chose_next(sc, prevInfo);
 
-	// Prepare the next process for execution, if there is more
-	if(nextTask != NULL) {
-		prevTask = currTask;
-		currTask = nextTask;
+	// The idle task may only be missing while the boot processor sets up
+	sc->curr = nextInfo ? nextInfo->task_descriptor : (sc->idle ? sc->idle : prev);
+
+	spin_unlock(&sc->lock);
+
+	// Nothing to do here, so try to take work from a busier processor
+	if(!nextInfo && sc->idle) {
+		nextInfo = sched_steal(cpu);
+
+		if(nextInfo) {
+			spin_lock(&sc->lock);
+			nextInfo->cpu = cpu;
+			sc->curr = nextInfo->task_descriptor;
+			spin_unlock(&sc->lock);
+		}
 	}
 
-	// Run scheduler to decide next process
-	sched_chose_next();
+	i386_task_t *next = sc->curr;
+
+	nextInfo = next->scheduler_info;
+	nextInfo->on_cpu = 1;
+	nextInfo->cpu = cpu;
+	nextInfo->exec_start = now;
 
 	// Update scheduler cycle info
-	sched_task_t *schedInfo = currTask->scheduler_info;
-	schedInfo->last_cycle = scheduler_cycle;
-	
-	// Do context switch
-	task_switch(currTask);
+	nextInfo->last_cycle = sc->scheduler_cycle;
+
+	sched_stats_switch_in(&next->acct, now);
+
+	// Start a new quantum, and arm the timer for it or the next timer
+	sc->quantum_end = now + sched_class->timeslice(cpu, nextInfo);
+	percpu_write(need_resched, 0);
+	sched_program_timer(sc, now);
+
+	if(next == prev) {
+		return;
+	}
+
+	percpu_write(curr_task, next);
+	percpu_inc(context_switches);
+
+	// Interrupts taken in user mode run on the incoming task's kernel stack
+	if(next->kernel_stack) {
+		sys_set_tss_stack((uint32_t) next->kernel_stack + SYS_KERN_STACK_SIZE);
+	}
+
+	// Threads find their TLS block through GS; its base is per processor
+	if(percpu_read(tls_base) != next->tls_base) {
+		sys_set_tls(next->tls_base);
+	}
+
+	task_switch_fpu(prev, next);
+
+	// Once switched back in, we're on our own stack, and the last task is not
+	sched_finish_switch(switch_to(prev, next));
 }
 
 /*
- * Chooses the next process to run.
+ * Called on the incoming task's stack after a switch: the task switched away
+ * from may now run elsewhere, since its stack is no longer in use.
  */
-void sched_chose_next() {
+void sched_finish_switch(void *in) {
+	i386_task_t *last = in;
+	((sched_task_t *) last->scheduler_info)->on_cpu = 0;
+}
+
+/*
+ * Gives up the processor to another runnable task, if there is one. Unlike
+ * "int $0x88", this doesn't build a trap frame, so it's the fast path for
+ * kernel tasks.
+ */
+void sched_yield(void) {
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	sched_schedule();
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+}
+
+/*
+ * Programs the one-shot timer to fire at the earlier of the next timer
+ * deadline, and the end of the current task's quantum. The timer wheel is run
+ * by the bootstrap processor only; an idle application processor wakes up
+ * periodically to look for work to steal.
+ */
+static void sched_program_timer(sched_cpu_t *sc, uint64_t now) {
+	uint64_t deadline = TIMER_NO_DEADLINE;
+
+	// Until the softirq ran them, expired timers would fire the timer again
+	if(sc == &sched_cpus[0] && !sc->timers_deferred) {
+		deadline = timer_next_deadline();
+	}
+
+	if(sc->curr != sc->idle) {
+		if(sc->quantum_end < deadline) {
+			deadline = sc->quantum_end;
+		}
+	} else if(sc != &sched_cpus[0] && (now + SCHED_IDLE_BALANCE_NS) < deadline) {
+		deadline = now + SCHED_IDLE_BALANCE_NS;
+	}
+
+	// It can't be programmed further out than this
+	if(deadline > now + TIMER_MAX_ONESHOT_NS) {
+		sc->timer_deadline = now + TIMER_MAX_ONESHOT_NS;
+	} else {
+		sc->timer_deadline = deadline;
+	}
+
+	timer_program(deadline, now);
+}
+
+/*
+ * Called from the timer interrupt (either the one-shot timer, or the periodic
+ * PIT tick) with interrupts disabled. Expired timers are run from the timer
+ * softirq once the interrupt is acknowledged, and if the current task's
+ * quantum is over, it is preempted when the IRQ returns.
+ */
+void sched_timer_interrupt(void) {
+	unsigned int cpu = smp_cpu_id();
+	sched_cpu_t *sc = &sched_cpus[cpu];
+	uint64_t now = ktime_get_ns();
+
+	if(cpu == 0) {
+		vdso_update();
+
+		if(timer_next_deadline() <= now) {
+			sc->timers_deferred = true;
+			softirq_raise(kSoftIRQTimer);
+		}
+	}
+
+	if(sc->curr && sc->curr != sc->idle && now >= sc->quantum_end) {
+		// Only preempt if there's another task that could run
+		if(sc->nr_queued) {
+			percpu_write(need_resched, 1);
+		} else {
+			sc->quantum_end = now + sched_class->timeslice(cpu, sc->curr->scheduler_info);
+		}
+	}
+
+	sched_program_timer(sc, now);
+}
+
+/*
+ * Called when a timer was added that expires before the bootstrap processor's
+ * one-shot timer is programmed to fire, so it's reprogrammed; from another
+ * processor, it's sent a timer interrupt to reprogram it itself.
+ */
+void sched_timer_added(uint64_t expires) {
+	sched_cpu_t *sc = &sched_cpus[0];
+
+	// The timer softirq reprograms the timer once it's done anyway
+	if(!timer_is_oneshot() || sc->timers_deferred || expires >= sc->timer_deadline) {
+		return;
+	}
+
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	if(smp_cpu_id() == 0) {
+		sched_program_timer(sc, ktime_get_ns());
+	} else {
+		apic_send_ipi(smp_get_cpu(0)->apic_id, APIC_TIMER_VECTOR);
+	}
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+}
+
+/*
+ * Timer softirq: runs the expired timers on the bootstrap processor, then arms
+ * the timer for the next deadline.
+ */
+static void sched_timer_softirq(void) {
+	sched_cpu_t *sc = &sched_cpus[0];
+
+	timer_run(ktime_get_ns());
+
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	sc->timers_deferred = false;
+	sched_program_timer(sc, ktime_get_ns());
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+}
+
+/*
+ * Returns whether the task running on this processor should be preempted.
+ * Called by the assembly IRQ wrappers before returning from an interrupt, so
+ * both user and kernel code are preempted, unless the interrupted code had
+ * preemption disabled.
+ *
+ * Softirqs run on the interrupted task's stack with per-processor state, so
+ * the task can't be switched away from until they are done.
+ */
+uint32_t sched_should_resched(void) {
+	if(percpu_read(preempt_count) || softirq_in_progress()) {
+		return 0;
+	}
+
+	return percpu_read(need_resched);
+}
+
+/*
+ * Called when the preempt count drops to zero with a reschedule pending. If
+ * interrupts are disabled, it's left to the next interrupt to preempt.
+ */
+void preempt_schedule(void) {
+	if(!preemptible() || !percpu_read(curr_task)) {
+		return;
+	}
+
+	sched_yield();
+}
+
+/*
+ * Idle loop: when there is nothing else to do, halt the CPU until the next
+ * interrupt, which is at the latest the next timer deadline. If other tasks
+ * are runnable, or can be stolen from another processor, control is given to
+ * them instead.
+ */
+void sched_idle(void) {
+	unsigned int cpu = smp_cpu_id();
+	sched_cpu_t *sc = &sched_cpus[cpu];
+
+	if(!sc->idle) {
+		sc->idle = sc->curr;
+	}
+
+	while(1) {
+		__asm__ volatile("cli");
+
+		// Bottom halves left over from the last interrupt
+		if(softirq_pending()) {
+			softirq_run();
+		}
+
+		if(percpu_read(need_resched) || sc->nr_queued || sched_can_steal(cpu)) {
+			percpu_write(need_resched, 1);
+			sched_schedule();
+			continue;
+		}
+
+		rcu_note_qs();
+		sched_program_timer(sc, ktime_get_ns());
+
+		// STI only takes effect after the next instruction, so no IRQ is lost
+		__asm__ volatile("sti; hlt");
+	}
+}
+
+/*
+ * Chooses the next process to run from the processor's run queue, which must
+ * be locked, and dequeues it. Returns NULL if the queue is empty.
+ *
+ * A task that was woken up while its previous processor is still switching
+ * away from it can't run until it's off that stack; prev is the task this
+ * processor is switching away from, which it may of course pick again.
+ */
+static sched_task_t *sched_chose_next(sched_cpu_t *sc, sched_task_t *prev) {
+	unsigned int cpu = sc - sched_cpus;
+	sched_task_t *next = sc->handoff;
+
+	// A task the outgoing one handed the processor to goes ahead of the class
+	sc->handoff = NULL;
+
+	if(!next || !next->queued || next->cpu != cpu || (next->on_cpu && next != prev)) {
+		next = sched_class->pick_next(cpu, prev);
+	}
+
+	if(next) {
+		sched_rq_dequeue(sc, next);
+	}
+
+	return next;
+}
+
+/*
+ * Round robin class: picks the head of the run queue, but favours tasks that
+ * have events pending, as long as they haven't run too often this cycle.
+ */
+static sched_task_t *sched_rr_pick_next(unsigned int cpu, sched_task_t *prev) {
+	sched_cpu_t *sc = &sched_cpus[cpu];
+
 	// Check to see if we have any processes whose events have been processed
-	i386_task_t *iterator = task_get_first();
+	sched_task_t *iterator = sc->rq_first;
 
 	while(iterator) {
-		// Does task have an event pending?
-		if(iterator->isWaitingForEvent && iterator->eventHasArrived) {
-			sched_task_t *schedInfo = iterator->scheduler_info;
+		i386_task_t *task = iterator->task_descriptor;
 
+		if(iterator->on_cpu && iterator != prev) {
+			iterator = iterator->rq_next;
+			continue;
+		}
+
+		// Does task have an event pending?
+		if(task->isWaitingForEvent && task->eventHasArrived) {
 			// Check if it was executed this cycle
-			if(schedInfo->last_cycle != scheduler_cycle) {
+			if(iterator->last_cycle != sc->scheduler_cycle) {
 				// If not, run it and set CPU use counter
-				nextTask = iterator;
-				schedInfo->num_cpu_per_cycle = 1;
-				return;
+				iterator->num_cpu_per_cycle = 1;
+				return iterator;
 			} else {
 				// We now need to check if it's used the CPU more than permitted
-				if(schedInfo->num_cpu_per_cycle < SCHED_MAX_EXEC_PER_CYCLE) {
+				if(iterator->num_cpu_per_cycle < SCHED_MAX_EXEC_PER_CYCLE) {
 					// If not, run it
-					nextTask = iterator;
-					schedInfo->num_cpu_per_cycle++;
-					return;
+					iterator->num_cpu_per_cycle++;
+					return iterator;
 				} else {
 					// It's got an event pending but used its allowance of CPU cycles
 				}
@@ -94,19 +515,125 @@ void sched_chose_next() {
 		}
 
 		// Go to next task
-		iterator = iterator->next;
+		iterator = iterator->rq_next;
+	}
+
+	// If there's no tasks that have events, just pick the head of the queue
+	sched_task_t *next = sc->rq_first;
+
+	while(next && next->on_cpu && next != prev) {
+		next = next->rq_next;
+	}
+
+	// We've executed all tasks once the head was already run this cycle
+	if(next && next->last_cycle == sc->scheduler_cycle) {
+		sc->scheduler_cycle++;
+	}
+
+	return next;
+}
+
+/*
+ * Round robin class: the task that's waited longest may be stolen.
+ */
+static sched_task_t *sched_rr_pick_steal(unsigned int cpu) {
+	sched_task_t *info = sched_cpus[cpu].rq_first;
+
+	while(info && (info->on_cpu || info->pinned)) {
+		info = info->rq_next;
+	}
+
+	return info;
+}
+
+static void sched_rr_init(void) {
+
+}
+
+static void sched_rr_account(unsigned int cpu, sched_task_t *info, uint64_t delta) {
+
+}
+
+static uint64_t sched_rr_timeslice(unsigned int cpu, sched_task_t *info) {
+	return SCHED_QUANTUM_NS;
+}
+
+/*
+ * Round robin class: woken tasks wait for the running task's quantum to end.
+ */
+static bool sched_rr_check_preempt(unsigned int cpu, sched_task_t *curr, sched_task_t *woken) {
+	return false;
+}
+
+static void sched_rr_migrate(unsigned int from, unsigned int to, sched_task_t *info) {
+
+}
+
+sched_class_t sched_rr_class = {
+	.name = "rr",
+
+	.init = sched_rr_init,
+	.enqueue = sched_rr_enqueue,
+	.dequeue = sched_rr_dequeue,
+	.pick_next = sched_rr_pick_next,
+	.pick_steal = sched_rr_pick_steal,
+	.account = sched_rr_account,
+	.timeslice = sched_rr_timeslice,
+	.check_preempt = sched_rr_check_preempt,
+	.migrate = sched_rr_migrate
+};
+
+/*
+ * Returns true if any other processor has tasks waiting on its run queue.
+ */
+static bool sched_can_steal(unsigned int cpu) {
+	unsigned int num_cpus = smp_num_cpus();
+
+	for(unsigned int i = 0; i < num_cpus; i++) {
+		if(i != cpu && sched_cpus[i].nr_queued) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Takes a task from the busiest other processor's run queue, as chosen by the
+ * scheduling class. Tasks a processor is still switching away from can't be
+ * taken, since their stack is in use, and neither can pinned tasks.
+ */
+static sched_task_t *sched_steal(unsigned int cpu) {
+	unsigned int num_cpus = smp_num_cpus();
+	sched_cpu_t *victim = NULL;
+
+	for(unsigned int i = 0; i < num_cpus; i++) {
+		if(i == cpu) continue;
+
+		if(!victim || sched_cpus[i].nr_queued > victim->nr_queued) {
+			victim = &sched_cpus[i];
+		}
+	}
+
+	if(!victim || !victim->nr_queued) {
+		return NULL;
 	}
 
-	// If there's no tasks that have events, just pick the next one
-	i386_task_t *next = currTask->next;
+	spin_lock(&victim->lock);
 
-	// We've executed all tasks, loop over
-	if(!next) {
-		next = task_get_first();
-		scheduler_cycle++;
+	sched_task_t *info = sched_class->pick_steal(victim - sched_cpus);
+
+	if(info) {
+		sched_rq_dequeue(victim, info);
 	}
 
-	nextTask = next;
+	spin_unlock(&victim->lock);
+
+	if(info) {
+		sched_class->migrate(victim - sched_cpus, cpu, info);
+	}
+
+	return info;
 }
 
 /*
@@ -115,19 +642,27 @@ void sched_chose_next() {
  */
 void sched_task_deleted(void *in) {
 	i386_task_t *task = in;
+	sched_task_t *info = task->scheduler_info;
 
-	kfree(task->scheduler_info);
+	// Take the task off whichever run queue it's on
+	if(info->queued) {
+		sched_cpu_t *sc = &sched_cpus[info->cpu];
 
-	// The task slated for execution next is this one
-	if(nextTask == task) {
-		if(task->next) {
-			nextTask = task->next;
-		} else {
-			nextTask = task_get_first();
+		uint32_t flags = spin_lock_irqsave(&sc->lock);
+
+		if(info->queued) {
+			sched_rq_dequeue(sc, info);
 		}
+
+		spin_unlock_irqrestore(&sc->lock, flags);
+	}
+
+	// A processor it was handed to mustn't look at it anymore
+	for(unsigned int i = 0; i < SMP_MAX_CPUS; i++) {
+		__sync_bool_compare_and_swap(&sched_cpus[i].handoff, info, NULL);
 	}
 
-	kfree(task);
+	kfree(info);
 }
 
 /*
@@ -140,14 +675,256 @@ void sched_task_created(void *in) {
 	ASSERT(schedInfo != NULL);
 	memclr(schedInfo, sizeof(sched_task_t));
 
+	schedInfo->task_descriptor = task;
+	schedInfo->nice = 0;
+	schedInfo->weight = SCHED_NICE_0_WEIGHT;
+
 	task->scheduler_info = schedInfo;
 }
 
+/*
+ * Sets the nice value of a task, between SCHED_NICE_MIN and SCHED_NICE_MAX.
+ * Lower values get a larger share of processor time.
+ */
+void sched_set_nice(void *in, int nice) {
+	i386_task_t *task = in;
+	sched_task_t *info = task->scheduler_info;
+
+	if(nice < SCHED_NICE_MIN) {
+		nice = SCHED_NICE_MIN;
+	} else if(nice > SCHED_NICE_MAX) {
+		nice = SCHED_NICE_MAX;
+	}
+
+	// Queued tasks are requeued, so the class sees the new weight
+	sched_cpu_t *sc;
+	uint32_t flags;
+
+	while(1) {
+		sc = &sched_cpus[info->cpu];
+		flags = spin_lock_irqsave(&sc->lock);
+
+		if(&sched_cpus[info->cpu] == sc) {
+			break;
+		}
+
+		spin_unlock_irqrestore(&sc->lock, flags);
+	}
+
+	bool queued = info->queued;
+
+	if(queued) {
+		sched_rq_dequeue(sc, info);
+	}
+
+	info->nice = nice;
+	info->weight = sched_fair_weight(nice);
+
+	if(queued) {
+		sched_rq_enqueue(sc, info);
+	}
+
+	spin_unlock_irqrestore(&sc->lock, flags);
+}
+
+/*
+ * Returns the number of tasks on a processor's run queue.
+ */
+unsigned int sched_nr_queued(unsigned int cpu) {
+	return sched_cpus[cpu].nr_queued;
+}
+
+/*
+ * Makes a task runnable. It's placed on the processor with the least work (or
+ * the one it's pinned to), and that processor is poked if it's idle, or if the
+ * task should preempt the one running there.
+ */
+void sched_task_start(void *in) {
+	i386_task_t *task = in;
+	sched_task_t *info = task->scheduler_info;
+
+	unsigned int num_cpus = smp_num_cpus();
+	unsigned int best = info->cpu, best_load = 0xFFFFFFFF;
+
+	for(unsigned int i = 0; i < num_cpus && !info->pinned; i++) {
+		sched_cpu_t *sc = &sched_cpus[i];
+		unsigned int load = sc->nr_queued + ((sc->curr != sc->idle) ? 1 : 0);
+
+		if(load < best_load) {
+			best = i;
+			best_load = load;
+		}
+	}
+
+	sched_cpu_t *sc = &sched_cpus[best];
+	bool local = (best == smp_cpu_id());
+
+	uint32_t flags = spin_lock_irqsave(&sc->lock);
+	task->acct.runnable_since = ktime_get_ns();
+	sched_rq_enqueue(sc, info);
+
+	// Preempt the running task if the class says the new one should go first
+	bool preempt = false;
+
+	if(sc->curr) {
+		preempt = (sc->curr == sc->idle) || sched_class->check_preempt(best, sc->curr->scheduler_info, info);
+	}
+
+	if(preempt) {
+		percpu_get(best)->need_resched = 1;
+	}
+
+	// Locally, the preemption happens as soon as preemption is possible
+	spin_unlock_irqrestore(&sc->lock, flags);
+
+	if(preempt && !local) {
+		apic_send_ipi(smp_get_cpu(best)->apic_id, APIC_RESCHED_VECTOR);
+	}
+}
+
+/*
+ * Pins a task that isn't running yet to a processor: it's never stolen by
+ * another processor, and is woken up on the same one.
+ */
+void sched_task_pin(void *in, unsigned int cpu) {
+	i386_task_t *task = in;
+	sched_task_t *info = task->scheduler_info;
+
+	info->cpu = cpu;
+	info->pinned = true;
+}
+
+/*
+ * Returns true if the current task can block: the idle task and the boot
+ * context before the idle loop runs have nothing to switch to, so they must
+ * busy-wait instead. Interrupt handlers mustn't block either.
+ */
+bool sched_can_block(void) {
+	sched_cpu_t *sc = &sched_cpus[smp_cpu_id()];
+	return sc->idle && sc->curr && sc->curr != sc->idle;
+}
+
+/*
+ * Marks the current task as blocking. It keeps running until it calls
+ * sched_block, but is no longer put back on the run queue when it yields.
+ * If it's woken up in the meantime, sched_block just yields the processor.
+ */
+void sched_prepare_block(void) {
+	sched_cpu_t *sc = &sched_cpus[smp_cpu_id()];
+	sched_task_t *info = sc->curr->scheduler_info;
+
+	info->blocked = true;
+}
+
+/*
+ * Gives up the processor until the task is woken with sched_wake.
+ */
+void sched_block(void) {
+	sched_yield();
+}
+
+/*
+ * Clears the blocked flag of a task being woken up. Returns whether it has to
+ * be put on a run queue, which isn't the case if it wasn't blocked, or is
+ * still on its processor.
+ */
+static bool sched_wake_clear(sched_task_t *info) {
+	i386_task_t *task = info->task_descriptor;
+	sched_cpu_t *sc;
+	uint32_t flags;
+
+	while(1) {
+		sc = &sched_cpus[info->cpu];
+		flags = spin_lock_irqsave(&sc->lock);
+
+		if(!info->blocked) {
+			spin_unlock_irqrestore(&sc->lock, flags);
+			return false;
+		}
+
+		if(&sched_cpus[info->cpu] == sc) {
+			break;
+		}
+
+		spin_unlock_irqrestore(&sc->lock, flags);
+	}
+
+	info->blocked = false;
+	bool running = (sc->curr == task);
+
+	spin_unlock_irqrestore(&sc->lock, flags);
+
+	return !running;
+}
+
+/*
+ * Wakes up a task that blocked. If it's still switching away from (or hasn't
+ * yet gotten to sched_block on) its processor, clearing the blocked flag is
+ * enough for it to stay runnable; otherwise, it's put on a run queue.
+ *
+ * A blocked task stays on the processor it blocked on, so the processor read
+ * before locking is only stale if the task ran somewhere else since.
+ */
+void sched_wake(void *in) {
+	i386_task_t *task = in;
+
+	if(sched_wake_clear(task->scheduler_info)) {
+		sched_task_start(task);
+	}
+}
+
+/*
+ * Wakes up a task for synchronous IPC, where the caller is about to block
+ * waiting for it: rather than going to the least loaded processor, the task
+ * is queued on this one, and runs as soon as the caller gives it up, so the
+ * message is passed with one context switch. Pinned tasks are woken up
+ * normally.
+ */
+void sched_wake_sync(void *in) {
+	i386_task_t *task = in;
+	sched_task_t *info = task->scheduler_info;
+
+	if(!sched_wake_clear(info)) {
+		return;
+	}
+
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	unsigned int cpu = smp_cpu_id();
+
+	if(info->pinned && info->cpu != cpu) {
+		if(irqs) {
+			__asm__ volatile("sti");
+		}
+
+		sched_task_start(task);
+		return;
+	}
+
+	if(info->cpu != cpu) {
+		sched_class->migrate(info->cpu, cpu, info);
+	}
+
+	sched_cpu_t *sc = &sched_cpus[cpu];
+	spin_lock(&sc->lock);
+
+	task->acct.runnable_since = ktime_get_ns();
+	sched_rq_enqueue(sc, info);
+	sc->handoff = info;
+
+	spin_unlock(&sc->lock);
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+}
+
 /*
  * Returns a pointer to the current task that's being run.
  */
 void* sched_curr_task() {
-	return currTask;
+	return percpu_read(curr_task);
 }
 
 /*
@@ -159,8 +936,34 @@ void multitasking_init() {
 	task->task_state->page_directory = kernel_directory;
 	task->task_state->pagetable_phys = kernel_directory->physicalAddr;
 	task->isKernel = true;
+	task->acct.in_kernel = true;
 
 	memcpy(&task->name, "kernel_task", 11);
 
-	currTask = task;
-}
\ No newline at end of file
+	((sched_task_t *) task->scheduler_info)->on_cpu = 1;
+	((sched_task_t *) task->scheduler_info)->exec_start = ktime_get_ns();
+	sched_cpus[0].curr = task;
+	percpu_write(curr_task, task);
+	sched_stats_switch_in(&task->acct, ktime_get_ns());
+}
+
+/*
+ * Sets up scheduling on an application processor: the context it's booted on
+ * becomes its idle task.
+ */
+void sched_init_cpu(unsigned int cpu) {
+	i386_task_t *task = task_allocate(NULL);
+	task->isKernel = true;
+	task->acct.in_kernel = true;
+
+	sprintf(task->name, "idle/%u", cpu);
+
+	sched_task_t *info = task->scheduler_info;
+	info->on_cpu = 1;
+	info->cpu = cpu;
+
+	sched_cpus[cpu].curr = task;
+	sched_cpus[cpu].idle = task;
+	percpu_write(curr_task, task);
+	sched_stats_switch_in(&task->acct, ktime_get_ns());
+}
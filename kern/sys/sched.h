@@ -2,6 +2,7 @@
 #define SCHED_H
 
 #include <types.h>
+#include "runtime/rbtree.h"
 
 // software interrupt to trap into scheduler
 #define SCHED_TRAP_NUM 0x88
@@ -10,9 +11,36 @@
 #define SCHED_TIMESLICE 1194
 #define SCHED_TIMESLICE_MS SCHED_TIMESLICE / (3579545 / 3) * 1000
 
+// Length of a task's quantum when the one-shot timer drives scheduling
+#define SCHED_QUANTUM_NS 10000000
+
+// How often an idle processor looks for work to steal from busy ones
+#define SCHED_IDLE_BALANCE_NS 4000000
+
 // Maximum times a process can get run in one scheduling cycle
 #define SCHED_MAX_EXEC_PER_CYCLE 8
 
+/*
+ * Build with SCHED_DEFAULT_FAIR set to 1 to use the fair scheduling class by
+ * default; either way, "sched=fair" or "sched=rr" on the command line picks
+ * the class at boot.
+ */
+#ifndef SCHED_DEFAULT_FAIR
+#define SCHED_DEFAULT_FAIR 0
+#endif
+
+// Period over which the fair class tries to run every runnable task once
+#define SCHED_FAIR_LATENCY_NS 20000000
+// Default shortest slice a task gets; "sched_min_granularity=<us>" overrides it
+#define SCHED_FAIR_MIN_GRANULARITY_NS 2000000
+// How far ahead of the running task a woken task must be to preempt it
+#define SCHED_FAIR_WAKEUP_GRANULARITY_NS 1000000
+
+// Nice values, and the weight of a task at nice 0
+#define SCHED_NICE_MIN -20
+#define SCHED_NICE_MAX 19
+#define SCHED_NICE_0_WEIGHT 1024
+
 typedef struct sched_info {
 	// The last "scheduling cycle" this process was ran.
 	uint64_t last_cycle;
@@ -21,11 +49,72 @@ typedef struct sched_info {
 
 	// Pointer to the task descriptor
 	void *task_descriptor;
+
+	// Run queue linkage, and the processor whose run queue the task is on
+	struct sched_info *rq_prev, *rq_next;
+	unsigned int cpu;
+	bool queued;
+
+	// Set while a processor runs the task, or is still switching away from it
+	volatile uint32_t on_cpu;
+
+	// Set while the task waits to be woken up with sched_wake
+	volatile bool blocked;
+
+	// Pinned tasks only ever run on the processor in cpu
+	bool pinned;
+
+	// Time the task last started running
+	uint64_t exec_start;
+
+	// Fair class: weighted runtime, which orders the run queue tree
+	uint64_t vruntime;
+	rb_node_t rb_node;
+
+	int nice;
+	uint32_t weight;
 } sched_task_t;
 
-typedef struct sched_trap_registers {
-	uint32_t event_code, event_state;
+/*
+ * A scheduling class decides how tasks on a processor's run queue are ordered,
+ * and for how long they may run. All functions are called with the run queue
+ * of the processor cpu locked.
+ */
+typedef struct sched_class {
+	const char *name;
+
+	// Sets up the per-processor run queues
+	void (*init)(void);
+
+	void (*enqueue)(unsigned int cpu, sched_task_t *info);
+	void (*dequeue)(unsigned int cpu, sched_task_t *info);
+
+	/*
+	 * Returns the task that should run next without dequeueing it, or NULL.
+	 * Tasks still running elsewhere must be skipped, except prev: the task
+	 * this processor is switching away from.
+	 */
+	sched_task_t *(*pick_next)(unsigned int cpu, sched_task_t *prev);
+	// Returns a task another processor may take (not running or pinned), or NULL
+	sched_task_t *(*pick_steal)(unsigned int cpu);
+
+	// Charges a task for delta ns of execution
+	void (*account)(unsigned int cpu, sched_task_t *info, uint64_t delta);
+	// Returns how long a task may run once picked
+	uint64_t (*timeslice)(unsigned int cpu, sched_task_t *info);
+	// Returns whether a task that was just queued should preempt curr
+	bool (*check_preempt)(unsigned int cpu, sched_task_t *curr, sched_task_t *woken);
 
+	// A task was moved between processors; called with neither queue locked
+	void (*migrate)(unsigned int from, unsigned int to, sched_task_t *info);
+} sched_class_t;
+
+// Fair scheduling class (sched_fair.c)
+extern sched_class_t sched_fair_class;
+uint32_t sched_fair_weight(int nice);
+
+// Frame sched_trap pushes onto the task's kernel stack
+typedef struct sched_trap_registers {
 	uint32_t gs, fs, es, ds;
 
 	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax; // Pushed by pusha.
@@ -38,9 +127,44 @@ void sched_init();
 void sched_task_deleted(void*);
 // Called when a task is created
 void sched_task_created(void*);
+// Makes a task runnable, placing it on the least loaded processor
+void sched_task_start(void*);
+// Makes a task only run on one processor; call before starting it
+void sched_task_pin(void*, unsigned int cpu);
 // Returns the currently executing task.
 void* sched_curr_task();
 // Initialises multitasking
 void multitasking_init();
+// Sets up scheduling on an application processor
+void sched_init_cpu(unsigned int cpu);
+// Switches to the next task; called with interrupts disabled
+void sched_schedule(void);
+// Finishes a switch away from the given task, on the new task's stack
+void sched_finish_switch(void*);
+// Gives up the processor without taking the scheduler trap
+void sched_yield(void);
+// Returns nonzero if the current task should be preempted on IRQ exit
+uint32_t sched_should_resched(void);
+// Called from the timer interrupt to run timers and check the quantum
+void sched_timer_interrupt(void);
+// Called by timer_add, so the one-shot timer fires in time for a new timer
+void sched_timer_added(uint64_t expires);
+// Idles the CPU until there is something to do; never returns
+void sched_idle(void);
+
+// Returns whether the current task may block
+bool sched_can_block(void);
+// Marks the current task as blocking, then gives up the processor
+void sched_prepare_block(void);
+void sched_block(void);
+// Makes a blocked task runnable again
+void sched_wake(void*);
+// Same, but runs it on this processor as soon as the caller blocks
+void sched_wake_sync(void*);
+
+// Sets a task's nice value, which weighs its share of time in the fair class
+void sched_set_nice(void*, int nice);
+// Returns the number of tasks on a processor's run queue
+unsigned int sched_nr_queued(unsigned int cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include <types.h>
+#include "sched.h"
+#include "smp.h"
+#include "system.h"
+#include "clock.h"
+
+/*
+ * Fair scheduling class: every task accumulates virtual runtime, which is the
+ * time it ran scaled by the inverse of its weight, and the task with the least
+ * virtual runtime runs next. Runnable tasks are kept in a red-black tree
+ * ordered by virtual runtime, so picking one is O(1) and queueing O(log n).
+ *
+ * Over SCHED_FAIR_LATENCY_NS, each task gets a slice proportional to its
+ * weight; slices never get shorter than the minimum granularity, so with many
+ * tasks the period is stretched instead.
+ */
+typedef struct sched_fair_rq {
+	rb_tree_t tree;
+
+	// Only increases, and is where new and waking tasks are placed
+	uint64_t min_vruntime;
+	// Sum of the weights of the queued tasks
+	uint32_t load;
+} sched_fair_rq_t;
+
+static sched_fair_rq_t fair_rqs[SMP_MAX_CPUS];
+
+static uint64_t fair_min_granularity = SCHED_FAIR_MIN_GRANULARITY_NS;
+
+/*
+ * Weights of nice levels -20 to 19. Each level is about 10% more or less CPU
+ * time than its neighbour, so the weights step by a factor of 1.25.
+ */
+static const uint32_t fair_nice_weights[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	9548, 7620, 6100, 4904, 3906,
+	3121, 2501, 1991, 1586, 1277,
+	1024, 820, 655, 526, 423,
+	335, 272, 215, 172, 137,
+	110, 87, 70, 56, 45,
+	36, 29, 23, 18, 15
+};
+
+/*
+ * Returns the weight of a nice level.
+ */
+uint32_t sched_fair_weight(int nice) {
+	return fair_nice_weights[nice - SCHED_NICE_MIN];
+}
+
+/*
+ * Converts time a task ran to virtual runtime, by its weight.
+ */
+static uint64_t sched_fair_scale(sched_task_t *info, uint64_t delta) {
+	if(info->weight == SCHED_NICE_0_WEIGHT) {
+		return delta;
+	}
+
+	return mstd_div_u64(delta * SCHED_NICE_0_WEIGHT, info->weight, NULL);
+}
+
+/*
+ * Orders nodes in the tree by virtual runtime.
+ */
+static int sched_fair_compare(rb_node_t *a, rb_node_t *b) {
+	sched_task_t *ta = rb_entry(a, sched_task_t, rb_node);
+	sched_task_t *tb = rb_entry(b, sched_task_t, rb_node);
+
+	return (ta->vruntime < tb->vruntime) ? -1 : 1;
+}
+
+/*
+ * Sets up each processor's tree. The minimum granularity may be changed with
+ * the "sched_min_granularity" argument, in microseconds.
+ */
+static void sched_fair_init(void) {
+	for(int i = 0; i < SMP_MAX_CPUS; i++) {
+		rb_tree_init(&fair_rqs[i].tree, sched_fair_compare);
+		fair_rqs[i].min_vruntime = 0;
+		fair_rqs[i].load = 0;
+	}
+
+	char *granularity = sys_get_argument("sched_min_granularity");
+
+	if(granularity && atoi(granularity) > 0) {
+		fair_min_granularity = (uint64_t) atoi(granularity) * 1000;
+	}
+}
+
+/*
+ * Adds a task to the tree. Tasks that slept for a long time (or are new) have
+ * fallen behind, so they are placed no further back than half a period before
+ * the queue's minimum; this keeps them from monopolising the processor.
+ */
+static void sched_fair_enqueue(unsigned int cpu, sched_task_t *info) {
+	sched_fair_rq_t *rq = &fair_rqs[cpu];
+	uint64_t floor = 0;
+
+	if(rq->min_vruntime > (SCHED_FAIR_LATENCY_NS / 2)) {
+		floor = rq->min_vruntime - (SCHED_FAIR_LATENCY_NS / 2);
+	}
+
+	if(info->vruntime < floor) {
+		info->vruntime = floor;
+	}
+
+	rb_insert(&rq->tree, &info->rb_node);
+	rq->load += info->weight;
+}
+
+static void sched_fair_dequeue(unsigned int cpu, sched_task_t *info) {
+	sched_fair_rq_t *rq = &fair_rqs[cpu];
+
+	rb_erase(&rq->tree, &info->rb_node);
+	rq->load -= info->weight;
+}
+
+/*
+ * Picks the task with the least virtual runtime.
+ */
+static sched_task_t *sched_fair_pick_next(unsigned int cpu, sched_task_t *prev) {
+	rb_node_t *node = rb_first(&fair_rqs[cpu].tree);
+
+	while(node) {
+		sched_task_t *info = rb_entry(node, sched_task_t, rb_node);
+
+		if(!info->on_cpu || info == prev) {
+			return info;
+		}
+
+		node = rb_next(node);
+	}
+
+	return NULL;
+}
+
+/*
+ * The task furthest behind may be stolen, as it would run next here anyway.
+ */
+static sched_task_t *sched_fair_pick_steal(unsigned int cpu) {
+	rb_node_t *node = rb_first(&fair_rqs[cpu].tree);
+
+	while(node) {
+		sched_task_t *info = rb_entry(node, sched_task_t, rb_node);
+
+		if(!info->on_cpu && !info->pinned) {
+			return info;
+		}
+
+		node = rb_next(node);
+	}
+
+	return NULL;
+}
+
+/*
+ * Charges a task for the time it ran, weighted, and advances the minimum
+ * virtual runtime of the queue.
+ */
+static void sched_fair_account(unsigned int cpu, sched_task_t *info, uint64_t delta) {
+	sched_fair_rq_t *rq = &fair_rqs[cpu];
+
+	info->vruntime += sched_fair_scale(info, delta);
+
+	uint64_t min = info->vruntime;
+	rb_node_t *first = rb_first(&rq->tree);
+
+	if(first && rb_entry(first, sched_task_t, rb_node)->vruntime < min) {
+		min = rb_entry(first, sched_task_t, rb_node)->vruntime;
+	}
+
+	if(min > rq->min_vruntime) {
+		rq->min_vruntime = min;
+	}
+}
+
+/*
+ * Returns the task's share of the scheduling period. The task has already been
+ * taken off the queue, so its weight is added to the queue's load.
+ */
+static uint64_t sched_fair_timeslice(unsigned int cpu, sched_task_t *info) {
+	sched_fair_rq_t *rq = &fair_rqs[cpu];
+
+	uint64_t period = SCHED_FAIR_LATENCY_NS;
+	uint64_t nr_running = sched_nr_queued(cpu) + 1;
+
+	if(nr_running * fair_min_granularity > period) {
+		period = nr_running * fair_min_granularity;
+	}
+
+	uint64_t slice = mstd_div_u64(period * info->weight, rq->load + info->weight, NULL);
+
+	if(slice < fair_min_granularity) {
+		slice = fair_min_granularity;
+	}
+
+	return slice;
+}
+
+/*
+ * A woken task preempts the running one if it's behind it by more than the
+ * wakeup granularity. The running task hasn't been charged for its current
+ * slice yet, so that's added in.
+ */
+static bool sched_fair_check_preempt(unsigned int cpu, sched_task_t *curr, sched_task_t *woken) {
+	uint64_t vruntime = curr->vruntime + sched_fair_scale(curr, ktime_get_ns() - curr->exec_start);
+
+	return (woken->vruntime + SCHED_FAIR_WAKEUP_GRANULARITY_NS) < vruntime;
+}
+
+/*
+ * Virtual runtimes of different processors aren't related, so a migrating task
+ * keeps its lag relative to the queue's minimum.
+ */
+static void sched_fair_migrate(unsigned int from, unsigned int to, sched_task_t *info) {
+	int64_t lag = (int64_t) (info->vruntime - fair_rqs[from].min_vruntime);
+
+	if(lag < 0 && (uint64_t) -lag > fair_rqs[to].min_vruntime) {
+		info->vruntime = 0;
+	} else {
+		info->vruntime = fair_rqs[to].min_vruntime + lag;
+	}
+}
+
+sched_class_t sched_fair_class = {
+	.name = "fair",
+
+	.init = sched_fair_init,
+	.enqueue = sched_fair_enqueue,
+	.dequeue = sched_fair_dequeue,
+	.pick_next = sched_fair_pick_next,
+	.pick_steal = sched_fair_pick_steal,
+	.account = sched_fair_account,
+	.timeslice = sched_fair_timeslice,
+	.check_preempt = sched_fair_check_preempt,
+	.migrate = sched_fair_migrate
+};
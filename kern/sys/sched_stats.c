@@ -0,0 +1,560 @@
+#include <types.h>
+#include "sched_stats.h"
+#include "hist.h"
+#include "sched.h"
+#include "task.h"
+#include "smp.h"
+#include "percpu.h"
+#include "system.h"
+#include "clock.h"
+#include "timer.h"
+#include "sleep.h"
+#include "io/debug_console.h"
+
+// Each processor only updates its own histograms
+static sched_hist_t sched_hists[SMP_MAX_CPUS][kSchedHistMax];
+
+static const char *sched_hist_names[kSchedHistMax] = {
+	"wakeup-to-run latency",
+	"timeslice length"
+};
+
+// Set while the yield benchmark runs, and how often its partner task ran
+static volatile bool sched_bench_running;
+static volatile uint32_t sched_bench_partner_runs;
+
+// How long the latency benchmark's task sleeps, and how much each memcpy copies
+#define SCHED_LAT_INTERVAL_NS	1000000
+#define SCHED_LAT_COPY_SIZE		(256 * 1024)
+
+// Preemption latency benchmark: the high priority task's timer, and samples
+static ktimer_t sched_lat_timer;
+static volatile uint64_t sched_lat_woken_at;
+static volatile bool sched_lat_done;
+static uint32_t sched_lat_samples;
+static uint64_t sched_lat_sum, sched_lat_max;
+
+// Fairness benchmark: nice levels of the CPU hogs, and how many have exited
+static const int sched_fair_bench_nice[] = {-5, 0, 5, 10};
+#define SCHED_FAIR_BENCH_HOGS	(sizeof(sched_fair_bench_nice) / sizeof(sched_fair_bench_nice[0]))
+
+static volatile bool sched_fair_bench_running;
+static volatile unsigned int sched_fair_bench_exited;
+
+static void sched_stats_cmd(int argc, char **argv);
+static void sched_bench_cmd(int argc, char **argv);
+static void sched_lat_cmd(int argc, char **argv);
+static void sched_fair_bench_cmd(int argc, char **argv);
+
+/*
+ * Registers the debug console commands.
+ */
+static int sched_stats_init(void) {
+	debugcon_register("sched", "Scheduler statistics ('sched reset' clears them)", sched_stats_cmd);
+	debugcon_register("yieldbench", "Measures a kernel task yield round trip ('yieldbench [count]')", sched_bench_cmd);
+	debugcon_register("preemptbench", "Measures wakeup latency during a long memcpy ('preemptbench [ms]')", sched_lat_cmd);
+	debugcon_register("fairbench", "Measures the CPU share of hogs at different nice levels ('fairbench [ms]')", sched_fair_bench_cmd);
+	return 0;
+}
+
+module_init(sched_stats_init);
+
+/*
+ * Adds a sample to one of this processor's histograms. Interrupts are
+ * disabled, so the task can't move to another processor meanwhile.
+ */
+static void sched_hist_add(sched_hist_id_t which, uint64_t ns) {
+	sched_hist_t *hist = &sched_hists[percpu_read(cpu)][which];
+
+	hist->buckets[hist_bucket(ns, SCHED_HIST_BUCKETS)]++;
+	hist->count++;
+	hist->sum += ns;
+
+	if(ns > hist->max) {
+		hist->max = ns;
+	}
+}
+
+/*
+ * Charges the time since the last stamp to the task's user or kernel time.
+ */
+static inline void sched_stats_charge(sched_acct_t *acct, uint64_t now) {
+	if(acct->last_stamp && now > acct->last_stamp) {
+		if(acct->in_kernel) {
+			acct->kernel_ns += now - acct->last_stamp;
+		} else {
+			acct->user_ns += now - acct->last_stamp;
+		}
+	}
+
+	acct->last_stamp = now;
+}
+
+/*
+ * Called with interrupts disabled when a task loses the CPU. As tasks stay on
+ * the run queue, the task becomes runnable immediately.
+ */
+void sched_stats_switch_out(sched_acct_t *acct, uint64_t now, bool preempted) {
+	sched_stats_charge(acct, now);
+
+	if(acct->switched_in) {
+		sched_hist_add(kSchedHistTimeslice, now - acct->switched_in);
+	}
+
+	if(preempted) {
+		acct->nivcsw++;
+	} else {
+		acct->nvcsw++;
+	}
+
+	acct->runnable_since = now;
+}
+
+/*
+ * Called with interrupts disabled when a task is given the CPU.
+ */
+void sched_stats_switch_in(sched_acct_t *acct, uint64_t now) {
+	if(acct->runnable_since) {
+		uint64_t waited = now - acct->runnable_since;
+
+		acct->wait_ns += waited;
+		sched_hist_add(kSchedHistWakeupLatency, waited);
+
+		acct->runnable_since = 0;
+	}
+
+	acct->switched_in = now;
+	acct->last_stamp = now;
+}
+
+/*
+ * Called on entry to and exit from a syscall, so time is charged to the right
+ * mode. IRQs taken in user mode are charged to user time.
+ */
+void sched_stats_kernel_enter(sched_acct_t *acct, uint64_t now) {
+	sched_stats_charge(acct, now);
+	acct->in_kernel = true;
+}
+
+void sched_stats_kernel_exit(sched_acct_t *acct, uint64_t now) {
+	sched_stats_charge(acct, now);
+	acct->in_kernel = false;
+}
+
+/*
+ * Takes a snapshot of the task's accounting data. For the running task, the
+ * time not yet charged is included.
+ */
+void sched_stats_get_task(void *in, sched_task_stats_t *out) {
+	i386_task_t *task = in;
+	sched_acct_t *acct = &task->acct;
+
+	bool irqs = sys_irq_enabled();
+	__asm__ volatile("cli");
+
+	out->user_ns = acct->user_ns;
+	out->kernel_ns = acct->kernel_ns;
+	out->wait_ns = acct->wait_ns;
+	out->nvcsw = acct->nvcsw;
+	out->nivcsw = acct->nivcsw;
+
+	if(task == sched_curr_task() && acct->last_stamp) {
+		uint64_t pending = ktime_get_ns() - acct->last_stamp;
+
+		if(acct->in_kernel) {
+			out->kernel_ns += pending;
+		} else {
+			out->user_ns += pending;
+		}
+	}
+
+	if(irqs) {
+		__asm__ volatile("sti");
+	}
+}
+
+/*
+ * Gets one of the global histograms, summed over all processors.
+ */
+void sched_stats_get_hist(sched_hist_id_t which, sched_hist_t *out) {
+	ASSERT(which < kSchedHistMax);
+
+	memclr(out, sizeof(sched_hist_t));
+
+	for(int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+		sched_hist_t *hist = &sched_hists[cpu][which];
+
+		out->count += hist->count;
+		out->sum += hist->sum;
+
+		if(hist->max > out->max) {
+			out->max = hist->max;
+		}
+
+		for(int b = 0; b < SCHED_HIST_BUCKETS; b++) {
+			out->buckets[b] += hist->buckets[b];
+		}
+	}
+}
+
+static void sched_stats_reset_task(i386_task_t *task, void *context) {
+	task->acct.user_ns = task->acct.kernel_ns = task->acct.wait_ns = 0;
+	task->acct.nvcsw = task->acct.nivcsw = 0;
+}
+
+/*
+ * Clears the histograms, and the counters of all tasks.
+ */
+void sched_stats_reset(void) {
+	memclr(sched_hists, sizeof(sched_hists));
+
+	task_for_each(sched_stats_reset_task, NULL);
+}
+
+/*
+ * Prints a duration with a sensible unit, since kprintf can't do 64 bits.
+ */
+static void sched_stats_print_ns(uint64_t ns) {
+	if(ns < NSEC_PER_USEC) {
+		kprintf("%u ns", (uint32_t) ns);
+	} else if(ns < NSEC_PER_MSEC) {
+		kprintf("%u us", (uint32_t) mstd_div_u64(ns, NSEC_PER_USEC, NULL));
+	} else if(ns < NSEC_PER_SEC) {
+		kprintf("%u ms", (uint32_t) mstd_div_u64(ns, NSEC_PER_MSEC, NULL));
+	} else {
+		kprintf("%u s", (uint32_t) mstd_div_u64(ns, NSEC_PER_SEC, NULL));
+	}
+}
+
+static void sched_stats_dump_task(i386_task_t *task, void *context) {
+	sched_task_stats_t stats;
+	sched_stats_get_task(task, &stats);
+
+	kprintf("%u\t", task->pid);
+	sched_stats_print_ns(stats.user_ns);
+	kprintf("\t");
+	sched_stats_print_ns(stats.kernel_ns);
+	kprintf("\t");
+	sched_stats_print_ns(stats.wait_ns);
+	kprintf("\t%u\t%u\t%s\n", stats.nvcsw, stats.nivcsw, task->name);
+}
+
+/*
+ * Prints per-task accounting and the histograms to the console.
+ */
+void sched_stats_dump(void) {
+	sched_hist_t hist;
+
+	kprintf(CONSOLE_BOLD "pid\tuser\tkernel\twait\tvol\tinvol\tname\n" CONSOLE_REG);
+
+	task_for_each(sched_stats_dump_task, NULL);
+
+	for(int i = 0; i < kSchedHistMax; i++) {
+		sched_stats_get_hist(i, &hist);
+
+		kprintf(CONSOLE_BOLD "\n%s: " CONSOLE_REG "%u samples, max ", sched_hist_names[i], hist.count);
+		sched_stats_print_ns(hist.max);
+
+		if(hist.count) {
+			kprintf(", mean ");
+			sched_stats_print_ns(mstd_div_u64(hist.sum, hist.count, NULL));
+		}
+
+		kprintf("\n");
+
+		for(int b = 0; b < SCHED_HIST_BUCKETS; b++) {
+			if(!hist.buckets[b]) continue;
+
+			kprintf("  < ");
+			sched_stats_print_ns(1ULL << b);
+			kprintf("\t%u\n", hist.buckets[b]);
+		}
+	}
+}
+
+/*
+ * Debug console command.
+ */
+static void sched_stats_cmd(int argc, char **argv) {
+	if(argc > 1 && !strcmp(argv[1], "reset")) {
+		sched_stats_reset();
+		kprintf("Scheduler statistics cleared\n");
+	} else {
+		sched_stats_dump();
+	}
+}
+
+/*
+ * Pins the current task to the processor it's running on, so it stays on the
+ * same one as the benchmark's other task. Returns the processor, and whether
+ * the task was pinned already.
+ */
+static unsigned int sched_bench_pin(bool *was_pinned) {
+	i386_task_t *self = sched_curr_task();
+	sched_task_t *info = self->scheduler_info;
+
+	__asm__ volatile("cli");
+	*was_pinned = info->pinned;
+	info->pinned = true;
+	unsigned int cpu = info->cpu;
+	__asm__ volatile("sti");
+
+	return cpu;
+}
+
+static void sched_bench_unpin(bool was_pinned) {
+	i386_task_t *self = sched_curr_task();
+	((sched_task_t *) self->scheduler_info)->pinned = was_pinned;
+}
+
+/*
+ * Partner of the yield benchmark: yields straight back for as long as the
+ * benchmark runs.
+ */
+static void sched_bench_partner(void *context) {
+	while(sched_bench_running) {
+		sched_bench_partner_runs++;
+		sched_yield();
+	}
+}
+
+/*
+ * Debug console command: measures the round trip of a kernel task yielding to
+ * another one on the same processor, which yields straight back. Both tasks
+ * are pinned, so idle processors can't steal either; the partner's run count
+ * shows how many yields actually switched.
+ */
+static void sched_bench_cmd(int argc, char **argv) {
+	unsigned int count = 100000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("yieldbench: no task to yield to from here\n");
+		return;
+	}
+
+	bool pinned;
+	unsigned int cpu = sched_bench_pin(&pinned);
+
+	i386_task_t *partner = task_create_kernel("yieldbench", sched_bench_partner, NULL);
+
+	sched_bench_running = true;
+	sched_task_pin(partner, cpu);
+	sched_task_start(partner);
+
+	// Let the partner get going before starting the clock
+	sched_yield();
+
+	uint32_t runs = sched_bench_partner_runs;
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		sched_yield();
+	}
+
+	uint64_t cycles = sys_rdtsc() - start;
+	runs = sched_bench_partner_runs - runs;
+
+	// The partner exits the next time it runs, and is freed
+	sched_bench_running = false;
+	sched_bench_unpin(pinned);
+
+	uint32_t per_trip = (uint32_t) mstd_div_u64(cycles, count, NULL);
+	kprintf("yieldbench: %u yields, %u to the partner, %u cycles per round trip", count, runs, per_trip);
+
+	if(clock_get_source()->is_tsc) {
+		kprintf(" (%u ns)", (uint32_t) clock_cycles_to_ns(per_trip));
+	}
+
+	kprintf("\n");
+}
+
+/*
+ * Timer callback of the latency benchmark: wakes up the high priority task.
+ */
+static void sched_lat_wake(void *context) {
+	sched_lat_woken_at = ktime_get_ns();
+	sched_wake(context);
+}
+
+/*
+ * High priority task of the latency benchmark: sleeps for a bit, then records
+ * how long it took from being woken up to running.
+ */
+static void sched_lat_task(void *context) {
+	i386_task_t *self = sched_curr_task();
+
+	while(sched_bench_running) {
+		sched_prepare_block();
+		timer_add(&sched_lat_timer, ktime_get_ns() + SCHED_LAT_INTERVAL_NS, sched_lat_wake, self);
+		sched_block();
+
+		uint64_t latency = ktime_get_ns() - sched_lat_woken_at;
+
+		sched_lat_samples++;
+		sched_lat_sum += latency;
+
+		if(latency > sched_lat_max) {
+			sched_lat_max = latency;
+		}
+	}
+
+	sched_lat_done = true;
+}
+
+/*
+ * Debug console command: copies memory in a loop for a while, as an example
+ * of a long path through the kernel, while a task at the highest priority on
+ * the same processor repeatedly sleeps briefly. The time from its wakeup to it
+ * running shows how quickly the copying task is preempted.
+ */
+static void sched_lat_cmd(int argc, char **argv) {
+	unsigned int ms = 1000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		ms = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("preemptbench: no task to yield to from here\n");
+		return;
+	}
+
+	uint8_t *src = (uint8_t *) kmalloc(SCHED_LAT_COPY_SIZE);
+	uint8_t *dst = (uint8_t *) kmalloc(SCHED_LAT_COPY_SIZE);
+
+	if(!src || !dst) {
+		kprintf("preemptbench: couldn't allocate buffers\n");
+
+		if(src) kfree(src);
+		if(dst) kfree(dst);
+
+		return;
+	}
+
+	bool pinned;
+	unsigned int cpu = sched_bench_pin(&pinned);
+
+	sched_lat_samples = 0;
+	sched_lat_sum = sched_lat_max = 0;
+	sched_lat_done = false;
+
+	i386_task_t *task = task_create_kernel("preemptbench", sched_lat_task, NULL);
+	sched_set_nice(task, SCHED_NICE_MIN);
+	sched_task_pin(task, cpu);
+
+	sched_bench_running = true;
+	sched_task_start(task);
+
+	uint64_t end = ktime_get_ns() + ((uint64_t) ms * 1000000);
+	uint32_t copies = 0;
+
+	while(ktime_get_ns() < end) {
+		memcpy(dst, src, SCHED_LAT_COPY_SIZE);
+		copies++;
+	}
+
+	// The task notices on its next wakeup, after which its timer is idle
+	sched_bench_running = false;
+
+	while(!sched_lat_done) {
+		sched_yield();
+	}
+
+	sched_bench_unpin(pinned);
+
+	kfree(src);
+	kfree(dst);
+
+	kprintf("preemptbench: %u copies of %u KB, %u wakeups\n", copies, SCHED_LAT_COPY_SIZE / 1024, sched_lat_samples);
+
+	if(sched_lat_samples) {
+		uint32_t avg = (uint32_t) mstd_div_u64(sched_lat_sum, sched_lat_samples, NULL);
+		kprintf("wakeup to run: avg %u us, max %u us\n", avg / 1000, (uint32_t) mstd_div_u64(sched_lat_max, 1000, NULL));
+	}
+}
+
+/*
+ * CPU hog of the fairness benchmark: spins until the benchmark is over.
+ */
+static void sched_fair_bench_hog(void *context) {
+	while(sched_fair_bench_running) {
+		__asm__ volatile("pause");
+	}
+
+	__sync_fetch_and_add(&sched_fair_bench_exited, 1);
+}
+
+/*
+ * Debug console command: runs CPU hogs at different nice levels on this
+ * processor for a while, and prints the share of CPU time each got next to
+ * the share its weight entitles it to. Shares only follow the weights under
+ * the fair scheduling class.
+ */
+static void sched_fair_bench_cmd(int argc, char **argv) {
+	i386_task_t *hogs[SCHED_FAIR_BENCH_HOGS];
+	uint32_t ran_us[SCHED_FAIR_BENCH_HOGS];
+	uint32_t total_us = 0;
+	uint32_t weights = 0;
+	unsigned int ms = 2000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		ms = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("fairbench: can't wait for the benchmark tasks from here\n");
+		return;
+	}
+
+	bool pinned;
+	unsigned int cpu = sched_bench_pin(&pinned);
+
+	sched_fair_bench_running = true;
+	sched_fair_bench_exited = 0;
+
+	for(unsigned int i = 0; i < SCHED_FAIR_BENCH_HOGS; i++) {
+		hogs[i] = task_create_kernel("fairbench", sched_fair_bench_hog, NULL);
+		sched_set_nice(hogs[i], sched_fair_bench_nice[i]);
+		sched_task_pin(hogs[i], cpu);
+
+		weights += sched_fair_weight(sched_fair_bench_nice[i]);
+	}
+
+	for(unsigned int i = 0; i < SCHED_FAIR_BENCH_HOGS; i++) {
+		sched_task_start(hogs[i]);
+	}
+
+	// Sleeping, we don't take any of the hogs' time
+	sleep_ns((uint64_t) ms * 1000000);
+
+	// The hogs are still around until the flag is cleared
+	for(unsigned int i = 0; i < SCHED_FAIR_BENCH_HOGS; i++) {
+		sched_task_stats_t stats;
+		sched_stats_get_task(hogs[i], &stats);
+
+		ran_us[i] = (uint32_t) mstd_div_u64(stats.user_ns + stats.kernel_ns, 1000, NULL);
+		total_us += ran_us[i];
+	}
+
+	sched_fair_bench_running = false;
+
+	while(sched_fair_bench_exited != SCHED_FAIR_BENCH_HOGS) {
+		sched_yield();
+	}
+
+	sched_bench_unpin(pinned);
+
+	kprintf("fairbench: %u hogs on cpu %u for %u ms\n", SCHED_FAIR_BENCH_HOGS, cpu, ms);
+
+	for(unsigned int i = 0; i < SCHED_FAIR_BENCH_HOGS; i++) {
+		uint32_t weight = sched_fair_weight(sched_fair_bench_nice[i]);
+		uint32_t expected = (uint32_t) mstd_div_u64((uint64_t) weight * 1000, weights, NULL);
+		uint32_t share = total_us ? (uint32_t) mstd_div_u64((uint64_t) ran_us[i] * 1000, total_us, NULL) : 0;
+
+		kprintf("nice %d (weight %u): %u ms, %u.%u%% of the CPU, %u.%u%% expected\n", sched_fair_bench_nice[i], weight, ran_us[i] / 1000, share / 10, share % 10, expected / 10, expected % 10);
+	}
+}
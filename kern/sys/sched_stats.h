@@ -0,0 +1,70 @@
+#ifndef SCHED_STATS_H
+#define SCHED_STATS_H
+
+#include <types.h>
+
+/*
+ * Scheduler statistics: per-task CPU accounting, and global histograms of
+ * scheduling latencies. All times are in nanoseconds, measured with ktime,
+ * which is backed by the TSC when it is usable.
+ */
+
+// Bucket n counts samples in [2^(n-1), 2^n) ns; bucket 0 counts zero
+#define SCHED_HIST_BUCKETS 40
+
+typedef enum {
+	// Time from a task becoming runnable until it gets the CPU
+	kSchedHistWakeupLatency = 0,
+	// Time a task had the CPU before it was switched out
+	kSchedHistTimeslice = 1,
+
+	kSchedHistMax
+} sched_hist_id_t;
+
+typedef struct sched_hist {
+	uint32_t buckets[SCHED_HIST_BUCKETS];
+
+	uint32_t count;
+	uint64_t sum;
+	uint64_t max;
+} sched_hist_t;
+
+// Per-task accounting data, embedded in the task struct
+typedef struct sched_acct {
+	uint64_t user_ns, kernel_ns;
+	// Total time spent runnable, but waiting for the CPU
+	uint64_t wait_ns;
+
+	// Voluntary (yield) and involuntary (preempted) context switches
+	uint32_t nvcsw, nivcsw;
+
+	// Start of the interval not yet charged to user or kernel time
+	uint64_t last_stamp;
+	// When the task was last switched in, and last became runnable
+	uint64_t switched_in;
+	uint64_t runnable_since;
+
+	bool in_kernel;
+} sched_acct_t;
+
+// Snapshot of a task's accounting data
+typedef struct sched_task_stats {
+	uint64_t user_ns, kernel_ns, wait_ns;
+	uint32_t nvcsw, nivcsw;
+} sched_task_stats_t;
+
+// Called by the scheduler on context switches
+void sched_stats_switch_out(sched_acct_t *acct, uint64_t now, bool preempted);
+void sched_stats_switch_in(sched_acct_t *acct, uint64_t now);
+
+// Charges time to user or kernel on syscall entry and exit
+void sched_stats_kernel_enter(sched_acct_t *acct, uint64_t now);
+void sched_stats_kernel_exit(sched_acct_t *acct, uint64_t now);
+
+// Kernel API to read statistics
+void sched_stats_get_task(void *task, sched_task_stats_t *out);
+void sched_stats_get_hist(sched_hist_id_t which, sched_hist_t *out);
+void sched_stats_reset(void);
+void sched_stats_dump(void);
+
+#endif
@@ -0,0 +1,416 @@
+#include <types.h>
+#include <errno.h>
+#include "shm.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "spinlock.h"
+#include "sync.h"
+#include "io/debug_console.h"
+
+extern page_directory_t *kernel_directory;
+
+// Named objects
+static shm_object_t *shm_objects = NULL;
+static spinlock_t shm_objects_lock = SPINLOCK_INIT;
+
+// Pages taken by all objects, named or not, against SHM_MAX_TOTAL_SIZE
+static volatile uint32_t shm_pages_used = 0;
+
+static void shm_cmd(int argc, char **argv);
+
+static int shm_cmd_init(void) {
+	debugcon_register("shm", "Lists shared memory objects", shm_cmd);
+	return 0;
+}
+
+module_init(shm_cmd_init);
+
+/*
+ * Returns the linked object with the given name. The lock must be held.
+ */
+static shm_object_t *shm_find_locked(const char *name) {
+	for(shm_object_t *obj = shm_objects; obj; obj = obj->next) {
+		if(!strncmp(obj->name, name, SHM_NAME_MAX)) {
+			return obj;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Frees the frames backing an object, up to the given page.
+ */
+static void shm_free_frames(shm_object_t *obj, uint32_t pages) {
+	page_t page;
+
+	for(uint32_t i = 0; i < pages; i++) {
+		memclr(&page, sizeof(page_t));
+		page.frame = obj->frames[i] >> 12;
+
+		free_frame(&page);
+	}
+}
+
+/*
+ * Allocates and zeroes the frames backing an object, and charges them against
+ * the limit on shared memory. They're zeroed through the kernel's window on
+ * physical memory, so frames outside it can't be used. Returns -ENOMEM if the
+ * limit would be exceeded or physical memory runs out.
+ */
+static int shm_alloc_frames(shm_object_t *obj) {
+	page_t page;
+
+	if(__sync_add_and_fetch(&shm_pages_used, obj->pages) > (SHM_MAX_TOTAL_SIZE >> 12)) {
+		__sync_fetch_and_sub(&shm_pages_used, obj->pages);
+		return -ENOMEM;
+	}
+
+	uint32_t i;
+
+	for(i = 0; i < obj->pages; i++) {
+		memclr(&page, sizeof(page_t));
+
+		if(!alloc_frame_try(&page, false, true)) {
+			break;
+		}
+
+		uint32_t phys = ((uint32_t) page.frame << 12) & 0xFFFFF000;
+
+		if(phys >= PAGING_PHYS_WINDOW_SIZE) {
+			free_frame(&page);
+			break;
+		}
+
+		memclr((void *) (PAGING_PHYS_WINDOW_BASE + phys), 0x1000);
+		obj->frames[i] = phys;
+	}
+
+	if(i != obj->pages) {
+		shm_free_frames(obj, i);
+		__sync_fetch_and_sub(&shm_pages_used, obj->pages);
+
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Creates an object of at least size bytes, rounded up to whole pages, under
+ * the given name. Returns -EBUSY if the name is taken.
+ */
+int shm_create(const char *name, uint32_t size) {
+	if(!name[0] || strlen((char *) name) >= SHM_NAME_MAX || !size || size > SHM_MAX_SIZE) {
+		return -EINVAL;
+	}
+
+	shm_object_t *obj = (shm_object_t *) kmalloc(sizeof(shm_object_t));
+
+	if(!obj) {
+		return -ENOMEM;
+	}
+
+	memclr(obj, sizeof(shm_object_t));
+	strncpy(obj->name, name, SHM_NAME_MAX - 1);
+
+	obj->pages = (size + 0xFFF) >> 12;
+	obj->size = obj->pages << 12;
+	obj->frames = (uint32_t *) kmalloc(obj->pages * sizeof(uint32_t));
+
+	if(!obj->frames || shm_alloc_frames(obj)) {
+		if(obj->frames) kfree(obj->frames);
+		kfree(obj);
+
+		return -ENOMEM;
+	}
+
+	// The name's reference
+	obj->refs = 1;
+
+	uint32_t flags = spin_lock_irqsave(&shm_objects_lock);
+
+	if(shm_find_locked(obj->name)) {
+		spin_unlock_irqrestore(&shm_objects_lock, flags);
+
+		shm_put(obj);
+
+		return -EBUSY;
+	}
+
+	obj->next = shm_objects;
+	shm_objects = obj;
+
+	spin_unlock_irqrestore(&shm_objects_lock, flags);
+
+	return 0;
+}
+
+/*
+ * Removes an object's name. Mappings of it stay valid; its memory is freed
+ * once they're gone as well.
+ */
+int shm_unlink(const char *name) {
+	uint32_t flags = spin_lock_irqsave(&shm_objects_lock);
+	shm_object_t **link = &shm_objects;
+
+	while(*link && strncmp((*link)->name, name, SHM_NAME_MAX)) {
+		link = &(*link)->next;
+	}
+
+	shm_object_t *obj = *link;
+
+	if(!obj) {
+		spin_unlock_irqrestore(&shm_objects_lock, flags);
+		return -ENOTFOUND;
+	}
+
+	*link = obj->next;
+
+	spin_unlock_irqrestore(&shm_objects_lock, flags);
+
+	shm_put(obj);
+	return 0;
+}
+
+/*
+ * Returns the object with the given name, with a reference the caller must
+ * drop with shm_put; or NULL if there is none.
+ */
+shm_object_t *shm_open(const char *name) {
+	uint32_t flags = spin_lock_irqsave(&shm_objects_lock);
+	shm_object_t *obj = shm_find_locked(name);
+
+	// Linked objects hold a reference, so this one can't be going away
+	if(obj) {
+		__sync_fetch_and_add(&obj->refs, 1);
+	}
+
+	spin_unlock_irqrestore(&shm_objects_lock, flags);
+
+	return obj;
+}
+
+/*
+ * Drops a reference to an object, freeing its memory when it was the last.
+ */
+void shm_put(shm_object_t *obj) {
+	if(__sync_sub_and_fetch(&obj->refs, 1) != 0) {
+		return;
+	}
+
+	shm_free_frames(obj, obj->pages);
+	__sync_fetch_and_sub(&shm_pages_used, obj->pages);
+
+	kfree(obj->frames);
+	kfree(obj);
+}
+
+/*
+ * Returns the address through which the kernel can access a page of an object.
+ * Pages aren't contiguous.
+ */
+void *shm_page_addr(shm_object_t *obj, uint32_t page) {
+	if(page >= obj->pages) {
+		return NULL;
+	}
+
+	return (void *) (PAGING_PHYS_WINDOW_BASE + obj->frames[page]);
+}
+
+/*
+ * Returns how many of the pages starting at addr are unmapped, stopping at
+ * the first mapped one.
+ */
+static uint32_t shm_free_pages(page_directory_t *directory, uint32_t addr, uint32_t pages) {
+	uint32_t i;
+
+	for(i = 0; i < pages; i++) {
+		page_t *page = paging_get_page(addr + (i * 0x1000), false, directory);
+
+		if(page && page->present) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/*
+ * Finds the lowest unmapped range of the given number of pages in the shared
+ * memory area. Returns 0 if there is none.
+ */
+static uint32_t shm_find_area(page_directory_t *directory, uint32_t pages) {
+	uint32_t addr = SHM_AREA_START;
+
+	while(addr + (pages * 0x1000) <= SHM_AREA_END) {
+		uint32_t free = shm_free_pages(directory, addr, pages);
+
+		if(free == pages) {
+			return addr;
+		}
+
+		// Continue past the mapped page
+		addr += (free + 1) * 0x1000;
+	}
+
+	return 0;
+}
+
+/*
+ * Maps the object with the given name into the calling process, with the
+ * given caching attributes, and returns the address it was mapped at. If addr
+ * is 0, one is picked in the shared memory area; otherwise, the pages at addr
+ * must be unmapped, and lie below the end of that area.
+ */
+int shm_map(const char *name, uint32_t addr, uint32_t flags, uint32_t cache) {
+	i386_task_t *leader = ((i386_task_t *) sched_curr_task())->leader;
+	page_directory_t *directory = leader->task_state->page_directory;
+
+	// Kernel tasks have no address space of their own to map into
+	if(directory == kernel_directory || cache > SHM_CACHE_UNCACHED || (addr & 0xFFF)) {
+		return -EINVAL;
+	}
+
+	shm_object_t *obj = shm_open(name);
+
+	if(!obj) {
+		return -ENOTFOUND;
+	}
+
+	shm_mapping_t *map = (shm_mapping_t *) kmalloc(sizeof(shm_mapping_t));
+
+	if(!map) {
+		shm_put(obj);
+		return -ENOMEM;
+	}
+
+	mutex_lock(&leader->shm_lock);
+
+	int ret = 0;
+
+	if(!addr) {
+		addr = shm_find_area(directory, obj->pages);
+
+		if(!addr) {
+			ret = -ENOMEM;
+		}
+	} else if(addr > SHM_AREA_END || obj->size > SHM_AREA_END - addr) {
+		ret = -EINVAL;
+	} else if(shm_free_pages(directory, addr, obj->pages) != obj->pages) {
+		ret = -EBUSY;
+	}
+
+	if(ret) {
+		mutex_unlock(&leader->shm_lock);
+
+		kfree(map);
+		shm_put(obj);
+
+		return ret;
+	}
+
+	/*
+	 * The entries weren't present before, so no TLB can have them cached.
+	 * Page tables created for them stay around until the process exits.
+	 */
+	for(uint32_t i = 0; i < obj->pages; i++) {
+		page_t *page = paging_get_page(addr + (i * 0x1000), true, directory);
+
+		memclr(page, sizeof(page_t));
+		page->frame = obj->frames[i] >> 12;
+		page->rw = (flags & SHM_MAP_READONLY) ? 0 : 1;
+		page->user = 1;
+		page->write_through = (cache == SHM_CACHE_WRITETHROUGH) ? 1 : 0;
+		page->cache_disable = (cache == SHM_CACHE_UNCACHED) ? 1 : 0;
+		page->shared = 1;
+		page->present = 1;
+	}
+
+	map->obj = obj;
+	map->addr = addr;
+	map->next = leader->shm_maps;
+	leader->shm_maps = map;
+
+	rusage_rss_add(leader, obj->pages);
+
+	mutex_unlock(&leader->shm_lock);
+
+	return addr;
+}
+
+/*
+ * Unmaps the object mapped at addr from the calling process. Other threads of
+ * the process may still have the mapping cached in their processors' TLBs, so
+ * those are flushed before the reference is dropped.
+ */
+int shm_unmap(uint32_t addr) {
+	i386_task_t *leader = ((i386_task_t *) sched_curr_task())->leader;
+	page_directory_t *directory = leader->task_state->page_directory;
+
+	mutex_lock(&leader->shm_lock);
+
+	shm_mapping_t **link = &leader->shm_maps;
+
+	while(*link && (*link)->addr != addr) {
+		link = &(*link)->next;
+	}
+
+	shm_mapping_t *map = *link;
+
+	if(!map) {
+		mutex_unlock(&leader->shm_lock);
+		return -EINVAL;
+	}
+
+	*link = map->next;
+
+	for(uint32_t i = 0; i < map->obj->pages; i++) {
+		memclr(paging_get_page(addr + (i * 0x1000), false, directory), sizeof(page_t));
+	}
+
+	if(task_address_space_private(leader)) {
+		for(uint32_t i = 0; i < map->obj->pages; i++) {
+			paging_flush_tlb(addr + (i * 0x1000));
+		}
+	} else {
+		paging_shootdown(addr, map->obj->pages);
+	}
+
+	rusage_rss_add(leader, -(int) map->obj->pages);
+
+	mutex_unlock(&leader->shm_lock);
+
+	shm_put(map->obj);
+	kfree(map);
+
+	return 0;
+}
+
+/*
+ * Drops the mappings of a process that's going away. Their page table entries
+ * are marked shared, so freeing the directory leaves the frames alone.
+ */
+void shm_unmap_all(i386_task_t *leader) {
+	while(leader->shm_maps) {
+		shm_mapping_t *map = leader->shm_maps;
+		leader->shm_maps = map->next;
+
+		shm_put(map->obj);
+		kfree(map);
+	}
+}
+
+/*
+ * Debug console command: lists named objects.
+ */
+static void shm_cmd(int argc, char **argv) {
+	uint32_t flags = spin_lock_irqsave(&shm_objects_lock);
+
+	for(shm_object_t *obj = shm_objects; obj; obj = obj->next) {
+		kprintf("%s: %u bytes, %u references\n", obj->name, obj->size, obj->refs);
+	}
+
+	spin_unlock_irqrestore(&shm_objects_lock, flags);
+}
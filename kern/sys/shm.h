@@ -0,0 +1,75 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <types.h>
+#include "paging.h"
+
+/*
+ * Named shared memory objects. An object is a set of zeroed frames that stays
+ * around while its name exists or any process has it mapped; processes map
+ * it into their part of the address space by name, either at an address of
+ * their choosing or at one picked from the shared memory area.
+ *
+ * Mappings don't own the frames: their page table entries are marked shared,
+ * and the frames are freed when the last reference to the object goes away.
+ */
+
+#define SHM_NAME_MAX	32
+#define SHM_MAX_SIZE	0x1000000
+// Limit on the memory of all objects together
+#define SHM_MAX_TOTAL_SIZE	0x4000000
+
+/*
+ * Addresses are picked from here; it ends where the ring and thread stack
+ * areas begin, which chosen addresses mustn't reach into either.
+ */
+#define SHM_AREA_START	0x60000000
+#define SHM_AREA_END	0x6FFF0000
+
+// Mapping flags
+#define SHM_MAP_READONLY	0x01
+
+/*
+ * Caching attributes of a mapping. Write-combining would need the PAT to be
+ * programmed, which it isn't.
+ */
+#define SHM_CACHE_WRITEBACK		0
+#define SHM_CACHE_WRITETHROUGH	1
+#define SHM_CACHE_UNCACHED		2
+
+typedef struct shm_object {
+	char name[SHM_NAME_MAX];
+
+	uint32_t size;
+	uint32_t pages;
+	// Physical address of each page
+	uint32_t *frames;
+
+	// Held by the name until it's unlinked, and by every mapping
+	volatile uint32_t refs;
+
+	struct shm_object *next;
+} shm_object_t;
+
+// A mapping of an object into a process; leaders keep a list of them
+typedef struct shm_mapping {
+	shm_object_t *obj;
+	uint32_t addr;
+
+	struct shm_mapping *next;
+} shm_mapping_t;
+
+struct task;
+
+int shm_create(const char *name, uint32_t size);
+int shm_unlink(const char *name);
+
+shm_object_t *shm_open(const char *name);
+void shm_put(shm_object_t *obj);
+void *shm_page_addr(shm_object_t *obj, uint32_t page);
+
+int shm_map(const char *name, uint32_t addr, uint32_t flags, uint32_t cache);
+int shm_unmap(uint32_t addr);
+void shm_unmap_all(struct task *leader);
+
+#endif
@@ -0,0 +1,142 @@
+#include <types.h>
+#include <errno.h>
+#include "sleep.h"
+#include "sched.h"
+#include "timer.h"
+#include "clock.h"
+#include "system.h"
+#include "io/debug_console.h"
+
+// Buckets of the wakeup latency histogram; each is twice as wide as the last
+#define SLEEP_HIST_BUCKETS 16
+
+// A sleeping task; lives on its stack
+typedef struct sleeper {
+	void *task;
+	volatile bool expired;
+} sleeper_t;
+
+static void sleep_bench_cmd(int argc, char **argv);
+
+static int sleep_cmd_init(void) {
+	debugcon_register("sleepbench", "Wakeup latency histograms of 10 us, 1 ms and 10 ms sleeps ('sleepbench [count]')", sleep_bench_cmd);
+	return 0;
+}
+
+module_init(sleep_cmd_init);
+
+/*
+ * Timer callback: wakes up the sleeping task.
+ */
+static void sleep_expired(void *context) {
+	sleeper_t *sleeper = context;
+
+	// The sleeper may return as soon as it sees this
+	void *task = sleeper->task;
+	sleeper->expired = true;
+
+	sched_wake(task);
+}
+
+/*
+ * Blocks the calling task until ktime_get_ns() reaches deadline.
+ */
+int sleep_until(uint64_t deadline) {
+	if(!sched_can_block()) {
+		return -EINVAL;
+	}
+
+	if(deadline <= ktime_get_ns()) {
+		return 0;
+	}
+
+	sleeper_t sleeper;
+	sleeper.task = sched_curr_task();
+	sleeper.expired = false;
+
+	ktimer_t timer;
+	memclr(&timer, sizeof(ktimer_t));
+
+	// Once marked, the wakeup isn't lost if the timer fires before we block
+	sched_prepare_block();
+	timer_add(&timer, deadline, sleep_expired, &sleeper);
+
+	while(1) {
+		sched_block();
+
+		if(sleeper.expired) {
+			break;
+		}
+
+		// Woken up by someone else; if the timer fired before this, undo it
+		sched_prepare_block();
+
+		if(sleeper.expired) {
+			sched_wake(sleeper.task);
+		}
+	}
+
+	return 0;
+}
+
+int sleep_ns(uint64_t ns) {
+	return sleep_until(ktime_get_ns() + ns);
+}
+
+/*
+ * Debug console command: sleeps repeatedly for 10 us, 1 ms and 10 ms, and
+ * prints how late the wakeups were. Latency includes the time it takes the
+ * woken task to run again.
+ */
+static void sleep_bench_cmd(int argc, char **argv) {
+	static const uint32_t durations[] = {10000, 1000000, 10000000};
+	unsigned int count = 100;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("sleepbench: can't block here\n");
+		return;
+	}
+
+	for(unsigned int d = 0; d < sizeof(durations) / sizeof(durations[0]); d++) {
+		uint32_t hist[SLEEP_HIST_BUCKETS];
+		uint32_t min = 0xFFFFFFFF, max = 0;
+		uint64_t total = 0;
+
+		memclr(hist, sizeof(hist));
+
+		for(unsigned int i = 0; i < count; i++) {
+			uint64_t deadline = ktime_get_ns() + durations[d];
+
+			sleep_until(deadline);
+
+			uint64_t late = ktime_get_ns() - deadline;
+			uint32_t ns = (late > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t) late;
+			uint32_t us = ns / 1000;
+
+			unsigned int bucket = 0;
+
+			while(us && bucket < SLEEP_HIST_BUCKETS - 1) {
+				us >>= 1;
+				bucket++;
+			}
+
+			hist[bucket]++;
+			total += ns;
+
+			if(ns < min) min = ns;
+			if(ns > max) max = ns;
+		}
+
+		kprintf("sleepbench: %u ns, %u sleeps; late by %u ns min, %u ns avg, %u ns max\n", durations[d], count, min, (uint32_t) mstd_div_u64(total, count, NULL), max);
+
+		for(unsigned int b = 0; b < SLEEP_HIST_BUCKETS; b++) {
+			if(hist[b]) {
+				kprintf("  < %u us: %u\n", 1 << b, hist[b]);
+			}
+		}
+	}
+}
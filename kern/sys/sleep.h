@@ -0,0 +1,17 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include <types.h>
+
+/*
+ * Sleeping for a given time: the task blocks on a kernel timer, which wakes
+ * it up. With a one-shot timer device, adding the timer reprograms it if
+ * needed, so wakeups are as precise as its resolution allows; otherwise they
+ * happen on the next PIT tick.
+ */
+
+// Sleeps until ktime_get_ns() reaches deadline, or for a number of nanoseconds
+int sleep_until(uint64_t deadline);
+int sleep_ns(uint64_t ns);
+
+#endif
@@ -0,0 +1,254 @@
+#include <types.h>
+#include "smp.h"
+#include "system.h"
+#include "sched.h"
+#include "task.h"
+#include "syscall.h"
+#include "clock.h"
+#include "paging.h"
+#include "acpi/madt.h"
+#include "device/apic.h"
+#include "io/debug_console.h"
+
+// Trampoline code and its parameter block (smp_trampoline.S)
+extern uint8_t smp_trampoline_start, smp_trampoline_end, smp_trampoline_params;
+
+extern uint32_t kern_dir_phys;
+
+static smp_cpu_t smp_cpus[SMP_MAX_CPUS];
+static unsigned int smp_cpus_online = 1;
+
+void smp_ap_entry(unsigned int cpu);
+
+static void smp_bench_cmd(int argc, char **argv);
+
+static int smp_cmd_init(void) {
+	debugcon_register("smpbench", "Measures how CPU-bound work scales with processors ('smpbench [million iterations]')", smp_bench_cmd);
+	return 0;
+}
+
+module_init(smp_cmd_init);
+
+/*
+ * Busy-waits for the specified number of nanoseconds.
+ */
+static void smp_delay(uint64_t ns) {
+	uint64_t start = ktime_get_ns();
+
+	while(ktime_get_ns() - start < ns) {
+		__asm__ volatile("pause");
+	}
+}
+
+/*
+ * Starts the processor with the given local APIC ID as processor number cpu,
+ * using the INIT-SIPI-SIPI sequence. Returns true if it came online.
+ */
+static bool smp_start_ap(unsigned int cpu, uint8_t apic_id) {
+	smp_trampoline_params_t *params = (smp_trampoline_params_t *) (SMP_TRAMPOLINE_BASE + (&smp_trampoline_params - &smp_trampoline_start));
+
+	smp_cpu_t *info = &smp_cpus[cpu];
+	info->index = cpu;
+	info->apic_id = apic_id;
+	info->online = false;
+
+	// Each processor boots on its own stack
+	uint8_t *stack = (uint8_t *) kmalloc(SYS_KERN_STACK_SIZE);
+	ASSERT(stack != NULL);
+
+	params->stack = ((uint32_t) stack) + SYS_KERN_STACK_SIZE;
+	params->cpu = cpu;
+
+	// INIT, then two startup IPIs pointing at the trampoline page
+	apic_send_ipi(apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT | APIC_ICR_LEVEL);
+	smp_delay(SMP_INIT_DELAY_NS);
+
+	for(int i = 0; i < 2 && !info->online; i++) {
+		apic_send_ipi(apic_id, APIC_ICR_STARTUP | (SMP_TRAMPOLINE_BASE >> 12));
+		smp_delay(SMP_SIPI_DELAY_NS);
+	}
+
+	// Wait for it to check in
+	uint64_t start = ktime_get_ns();
+
+	while(!info->online && (ktime_get_ns() - start) < SMP_AP_TIMEOUT_NS) {
+		__asm__ volatile("pause");
+	}
+
+	if(!info->online) {
+		kprintf("smp: processor with APIC ID %u didn't start\n", apic_id);
+		kfree(stack);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Finds the application processors in the MADT, and starts them.
+ *
+ * The "maxcpus=n" kernel argument limits the number of processors used.
+ */
+static int smp_init(void) {
+	uint32_t cr0, cr4;
+
+	// The bootstrap processor is always processor 0
+	smp_cpus[0].index = 0;
+	smp_cpus[0].apic_id = apic_available() ? apic_get_id() : 0;
+	smp_cpus[0].online = true;
+
+	madt_info_t *madt = acpi_madt_get();
+
+	if(!madt || !apic_available()) {
+		kprintf("smp: uniprocessor system\n");
+		return 0;
+	}
+
+	unsigned int max_cpus = SMP_MAX_CPUS;
+	char *max_cpus_arg = sys_get_argument("maxcpus");
+
+	if(max_cpus_arg && atoi(max_cpus_arg) > 0 && atoi(max_cpus_arg) <= SMP_MAX_CPUS) {
+		max_cpus = atoi(max_cpus_arg);
+	}
+
+	// Copy the trampoline, and tell it how to get into the kernel
+	size_t length = &smp_trampoline_end - &smp_trampoline_start;
+	memcpy((void *) SMP_TRAMPOLINE_BASE, &smp_trampoline_start, length);
+
+	__asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+	__asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+
+	smp_trampoline_params_t *params = (smp_trampoline_params_t *) (SMP_TRAMPOLINE_BASE + (&smp_trampoline_params - &smp_trampoline_start));
+	params->cr3 = kern_dir_phys;
+	params->cr0 = cr0;
+	params->cr4 = cr4;
+	params->entry = (uint32_t) smp_ap_entry;
+
+	for(unsigned int i = 0; i < madt->num_cpus; i++) {
+		uint8_t apic_id = madt->cpus[i].apic_id;
+
+		if(apic_id == smp_cpus[0].apic_id) continue;
+
+		if(smp_cpus_online == max_cpus) {
+			kprintf("smp: limited to %u processors\n", max_cpus);
+			break;
+		}
+
+		// Indices are handed out only to processors that came up
+		if(smp_start_ap(smp_cpus_online, apic_id)) {
+			smp_cpus_online++;
+		}
+	}
+
+	kprintf("smp: %u processors online\n", smp_cpus_online);
+
+	return 0;
+}
+
+module_post_driver_init(smp_init);
+
+/*
+ * Entry point of application processors, called by the trampoline on the
+ * processor's boot stack with paging enabled.
+ */
+void smp_ap_entry(unsigned int cpu) {
+	// Descriptor tables, and this processor's TSS
+	sys_build_cpu_gdt(cpu);
+	sys_install_idt();
+	sys_init_cpu_tss(cpu);
+
+	// Local APIC and its timer
+	apic_init_ap();
+
+	// SYSENTER MSRs are per processor
+	syscall_init();
+
+	// The boot context becomes this processor's idle task
+	sched_init_cpu(cpu);
+
+	smp_cpus[cpu].online = true;
+
+	sched_idle();
+}
+
+/*
+ * Returns the number of processors that are online.
+ */
+unsigned int smp_num_cpus(void) {
+	return smp_cpus_online;
+}
+
+/*
+ * Returns information about a processor.
+ */
+smp_cpu_t *smp_get_cpu(unsigned int index) {
+	ASSERT(index < SMP_MAX_CPUS);
+	return &smp_cpus[index];
+}
+
+// Benchmark: a fixed amount of CPU-bound work, split between workers
+static volatile uint32_t smp_bench_iterations;
+static volatile unsigned int smp_bench_finished;
+
+static void smp_bench_task(void *context) {
+	uint32_t count = smp_bench_iterations;
+	uint32_t x = 2463534242u + (uint32_t) context;
+
+	// xorshift, so the loop can't be optimised away or vectorised
+	for(uint32_t i = 0; i < count; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+
+	if(x == 0) {
+		kprintf("smpbench: unlikely result\n");
+	}
+
+	__sync_fetch_and_add(&smp_bench_finished, 1);
+}
+
+/*
+ * Debug console command: runs the same total amount of work with one worker
+ * task, then two, and so on up to one per online processor, and prints how
+ * long each run took and its speedup over one worker. The workers aren't
+ * pinned, so this also shows how well they get spread across processors.
+ */
+static void smp_bench_cmd(int argc, char **argv) {
+	uint32_t millions = 200;
+	uint32_t base_us = 0;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		millions = atoi(argv[1]);
+	}
+
+	if(!sched_can_block()) {
+		kprintf("smpbench: can't wait for the benchmark tasks from here\n");
+		return;
+	}
+
+	for(unsigned int workers = 1; workers <= smp_num_cpus(); workers++) {
+		smp_bench_iterations = mstd_div_u64((uint64_t) millions * 1000000, workers, NULL);
+		smp_bench_finished = 0;
+
+		uint64_t start = ktime_get_ns();
+
+		for(unsigned int i = 0; i < workers; i++) {
+			sched_task_start(task_create_kernel("smpbench", smp_bench_task, (void *) i));
+		}
+
+		while(smp_bench_finished != workers) {
+			sched_yield();
+		}
+
+		uint32_t us = (uint32_t) mstd_div_u64(ktime_get_ns() - start, 1000, NULL);
+
+		if(workers == 1) {
+			base_us = us ? us : 1;
+		}
+
+		uint32_t speedup = (uint32_t) mstd_div_u64((uint64_t) base_us * 100, us ? us : 1, NULL);
+
+		kprintf("%u workers: %u us, speedup %u.%02u\n", workers, us, speedup / 100, speedup % 100);
+	}
+}
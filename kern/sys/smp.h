@@ -0,0 +1,50 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <types.h>
+#include "percpu.h"
+
+/*
+ * Multiprocessor support: application processors are found through the ACPI
+ * MADT, and started through a real mode trampoline.
+ */
+
+#define SMP_MAX_CPUS 8
+
+// Physical address the AP trampoline is copied to (SIPI vector 0x07)
+#define SMP_TRAMPOLINE_BASE 0x7000
+
+// Time to wait after INIT, between SIPIs, and for an AP to come up
+#define SMP_INIT_DELAY_NS 10000000
+#define SMP_SIPI_DELAY_NS 200000
+#define SMP_AP_TIMEOUT_NS 100000000
+
+typedef struct smp_cpu {
+	unsigned int index;
+	uint8_t apic_id;
+
+	volatile bool online;
+} smp_cpu_t;
+
+// Parameters the trampoline reads; layout is shared with smp_trampoline.S
+typedef struct smp_trampoline_params {
+	uint32_t cr3;
+	uint32_t cr0;
+	uint32_t cr4;
+	uint32_t stack;
+	uint32_t entry;
+	uint32_t cpu;
+} __attribute__((packed)) smp_trampoline_params_t;
+
+/*
+ * Returns the index of the processor this is executing on, from its per-CPU
+ * data rather than by reading the local APIC ID.
+ */
+static inline unsigned int smp_cpu_id(void) {
+	return percpu_read(cpu);
+}
+
+unsigned int smp_num_cpus(void);
+smp_cpu_t *smp_get_cpu(unsigned int index);
+
+#endif
@@ -0,0 +1,137 @@
+#include <types.h>
+#include "softirq.h"
+#include "system.h"
+#include "smp.h"
+#include "clock.h"
+#include "io/debug_console.h"
+
+static softirq_handler_t softirq_handlers[kSoftIRQMax];
+
+static const char *softirq_names[kSoftIRQMax] = {
+	"timer", "rcu"
+};
+
+// Per-processor pending bits, and whether softirqs are being processed
+static volatile uint32_t softirq_pending_mask[SMP_MAX_CPUS];
+static volatile bool softirq_active[SMP_MAX_CPUS];
+
+// How often each softirq ran, and the longest it took, in TSC cycles
+static uint32_t softirq_count[kSoftIRQMax];
+static uint64_t softirq_max_cycles[kSoftIRQMax];
+
+// Times processing stopped with softirqs still pending
+static uint32_t softirq_deferred;
+
+static void softirq_cmd(int argc, char **argv);
+
+static int softirq_init(void) {
+	debugcon_register("softirq", "Softirq statistics ('softirq reset' clears them)", softirq_cmd);
+	return 0;
+}
+
+module_init(softirq_init);
+
+/*
+ * Sets the function that services a softirq.
+ */
+void softirq_register(softirq_t nr, softirq_handler_t handler) {
+	ASSERT(nr < kSoftIRQMax);
+	softirq_handlers[nr] = handler;
+}
+
+/*
+ * Marks a softirq as pending on this processor. It runs when the current
+ * interrupt handler returns, or when the processor next goes idle.
+ */
+void softirq_raise(softirq_t nr) {
+	ASSERT(nr < kSoftIRQMax);
+	__sync_fetch_and_or(&softirq_pending_mask[smp_cpu_id()], (1 << nr));
+}
+
+/*
+ * Returns whether softirqs are pending on this processor.
+ */
+bool softirq_pending(void) {
+	return softirq_pending_mask[smp_cpu_id()] != 0;
+}
+
+/*
+ * Returns whether this processor is processing softirqs. The task doing so
+ * mustn't be switched away from, as the state is per processor.
+ */
+bool softirq_in_progress(void) {
+	return softirq_active[smp_cpu_id()];
+}
+
+/*
+ * Runs the pending softirqs with interrupts enabled. Softirqs raised while
+ * doing so are picked up again, up to SOFTIRQ_MAX_RESTART times, so a flood
+ * of interrupts can't keep the interrupted task from running indefinitely.
+ *
+ * Must be called with interrupts disabled, and returns with them disabled.
+ */
+void softirq_run(void) {
+	unsigned int cpu = smp_cpu_id();
+
+	if(softirq_active[cpu] || !softirq_pending_mask[cpu]) {
+		return;
+	}
+
+	softirq_active[cpu] = true;
+
+	for(int restart = 0; restart < SOFTIRQ_MAX_RESTART && softirq_pending_mask[cpu]; restart++) {
+		uint32_t pending = __sync_lock_test_and_set(&softirq_pending_mask[cpu], 0);
+
+		__asm__ volatile("sti");
+
+		for(int nr = 0; nr < kSoftIRQMax; nr++) {
+			if(!(pending & (1 << nr)) || !softirq_handlers[nr]) continue;
+
+			uint64_t start = sys_rdtsc();
+			softirq_handlers[nr]();
+			uint64_t cycles = sys_rdtsc() - start;
+
+			softirq_count[nr]++;
+
+			if(cycles > softirq_max_cycles[nr]) {
+				softirq_max_cycles[nr] = cycles;
+			}
+		}
+
+		__asm__ volatile("cli");
+	}
+
+	if(softirq_pending_mask[cpu]) {
+		softirq_deferred++;
+	}
+
+	softirq_active[cpu] = false;
+}
+
+/*
+ * Debug console command: prints how often each softirq ran, and for how long
+ * at most.
+ */
+static void softirq_cmd(int argc, char **argv) {
+	if(argc > 1 && !strcmp(argv[1], "reset")) {
+		memclr(softirq_count, sizeof(softirq_count));
+		memclr(softirq_max_cycles, sizeof(softirq_max_cycles));
+		softirq_deferred = 0;
+		return;
+	}
+
+	// Cycles are TSC cycles, so they only convert if the TSC is the clock
+	bool tsc = clock_get_source()->is_tsc;
+
+	for(int nr = 0; nr < kSoftIRQMax; nr++) {
+		kprintf("%s: %u runs, max %u cycles", softirq_names[nr], softirq_count[nr], (uint32_t) softirq_max_cycles[nr]);
+
+		if(tsc) {
+			kprintf(" (%u ns)", (uint32_t) clock_cycles_to_ns(softirq_max_cycles[nr]));
+		}
+
+		kprintf("\n");
+	}
+
+	kprintf("deferred with work pending: %u\n", softirq_deferred);
+}
@@ -0,0 +1,33 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <types.h>
+
+/*
+ * Software interrupts are bottom halves raised by interrupt handlers, and run
+ * with interrupts enabled on the same processor once the hardware interrupt
+ * handler is done. They run on the interrupted task's stack, so they must not
+ * block; anything that might goes into a work queue instead.
+ */
+typedef enum {
+	kSoftIRQTimer = 0,
+	kSoftIRQRcu = 1,
+
+	kSoftIRQMax
+} softirq_t;
+
+// Rounds of pending softirqs processed per interrupt; the rest waits
+#define SOFTIRQ_MAX_RESTART 8
+
+typedef void (*softirq_handler_t)(void);
+
+void softirq_register(softirq_t nr, softirq_handler_t handler);
+void softirq_raise(softirq_t nr);
+
+// Runs pending softirqs; called with interrupts disabled on IRQ exit
+void softirq_run(void);
+
+bool softirq_pending(void);
+bool softirq_in_progress(void);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <types.h>
+#include "preempt.h"
+
+/*
+ * Ticket spinlocks: a processor takes a ticket by atomically incrementing
+ * "next", and spins until "owner" reaches it, so the lock is handed out in
+ * the order it was asked for. They may be taken from interrupt handlers; data
+ * shared with one must be locked with the IRQ-saving variants, so that the
+ * handler can't interrupt the lock holder on the same processor.
+ *
+ * Holding a spinlock disables preemption, so the holder can't be switched
+ * away from while other processors spin on it.
+ */
+typedef struct spinlock {
+	volatile uint16_t owner;
+	volatile uint16_t next;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock_init(spinlock_t *lock) {
+	lock->owner = 0;
+	lock->next = 0;
+}
+
+static inline void spin_lock(spinlock_t *lock) {
+	preempt_disable();
+
+	uint16_t ticket = __sync_fetch_and_add(&lock->next, 1);
+
+	while(lock->owner != ticket) {
+		__asm__ volatile("pause" : : : "memory");
+	}
+
+	__asm__ volatile("" : : : "memory");
+}
+
+/*
+ * Takes the lock only if nobody holds or is waiting for it.
+ */
+static inline bool spin_trylock(spinlock_t *lock) {
+	preempt_disable();
+
+	uint32_t old = *((volatile uint32_t *) lock);
+	uint16_t ticket = old >> 16;
+
+	if((old & 0xFFFF) == ticket) {
+		uint32_t new = old + (1 << 16);
+
+		if(__sync_bool_compare_and_swap((volatile uint32_t *) lock, old, new)) {
+			return true;
+		}
+	}
+
+	preempt_enable();
+	return false;
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+	__asm__ volatile("" : : : "memory");
+	lock->owner++;
+
+	preempt_enable();
+}
+
+static inline bool spin_is_locked(spinlock_t *lock) {
+	return lock->owner != lock->next;
+}
+
+/*
+ * Disables interrupts and takes the lock. The returned flags are passed to
+ * spin_unlock_irqrestore to put the interrupt flag back as it was.
+ */
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+	uint32_t flags;
+	__asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+
+	spin_lock(lock);
+	return flags;
+}
+
+/*
+ * Releases the lock, and puts the interrupt flag back; only then can a
+ * reschedule that came up while the lock was held happen.
+ */
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+	__asm__ volatile("" : : : "memory");
+	lock->owner++;
+
+	if(flags & 0x200) {
+		__asm__ volatile("sti" : : : "memory");
+	}
+
+	preempt_enable();
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef STATIC_KEY_H
+#define STATIC_KEY_H
+
+#include <types.h>
+
+/*
+ * Switches for rarely enabled instrumentation on hot paths. A disabled key
+ * costs a load and a not-taken branch, which the compiler lays out so the
+ * instrumented code is out of line; there's no code patching, so it's not
+ * quite free, but close.
+ *
+ * Keys are flipped from the debug console or similar; code that tests a key
+ * more than once per pass must cope with it changing in between.
+ */
+typedef struct static_key {
+	volatile uint32_t enabled;
+} static_key_t;
+
+#define STATIC_KEY_INIT_FALSE { .enabled = 0 }
+#define STATIC_KEY_INIT_TRUE { .enabled = 1 }
+
+#define static_branch_unlikely(key) __builtin_expect((key)->enabled != 0, 0)
+#define static_branch_likely(key) __builtin_expect((key)->enabled != 0, 1)
+
+static inline void static_key_enable(static_key_t *key) {
+	key->enabled = 1;
+}
+
+static inline void static_key_disable(static_key_t *key) {
+	key->enabled = 0;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#include <types.h>
+#include "sync.h"
+#include "sched.h"
+#include "clock.h"
+#include "timer.h"
+
+/*
+ * Initialises an unlocked mutex.
+ */
+void mutex_init(mutex_t *mutex) {
+	wait_queue_init(&mutex->wq);
+
+	mutex->locked = false;
+	mutex->owner = NULL;
+}
+
+/*
+ * Acquires the mutex, sleeping until it's available.
+ */
+void mutex_lock(mutex_t *mutex) {
+	uint32_t flags = spin_lock_irqsave(&mutex->wq.lock);
+
+	while(mutex->locked) {
+		ASSERT(mutex->owner != sched_curr_task() || !sched_can_block());
+		flags = wait_queue_sleep_locked(&mutex->wq, flags);
+	}
+
+	mutex->locked = true;
+	mutex->owner = sched_curr_task();
+
+	spin_unlock_irqrestore(&mutex->wq.lock, flags);
+}
+
+/*
+ * Acquires the mutex if it's available, returning true if so.
+ */
+bool mutex_trylock(mutex_t *mutex) {
+	uint32_t flags = spin_lock_irqsave(&mutex->wq.lock);
+	bool acquired = !mutex->locked;
+
+	if(acquired) {
+		mutex->locked = true;
+		mutex->owner = sched_curr_task();
+	}
+
+	spin_unlock_irqrestore(&mutex->wq.lock, flags);
+
+	return acquired;
+}
+
+/*
+ * Releases the mutex, and wakes up the task that's waited on it the longest.
+ */
+void mutex_unlock(mutex_t *mutex) {
+	uint32_t flags = spin_lock_irqsave(&mutex->wq.lock);
+
+	ASSERT(mutex->locked);
+
+	mutex->locked = false;
+	mutex->owner = NULL;
+
+	wait_queue_wake_one_locked(&mutex->wq);
+
+	spin_unlock_irqrestore(&mutex->wq.lock, flags);
+}
+
+/*
+ * Initialises a semaphore with count units available.
+ */
+void semaphore_init(semaphore_t *sem, int count) {
+	wait_queue_init(&sem->wq);
+	sem->count = count;
+}
+
+/*
+ * Takes units from the semaphore, sleeping until that many are available.
+ */
+void semaphore_down(semaphore_t *sem, unsigned int units) {
+	uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+
+	while(sem->count < (int) units) {
+		flags = wait_queue_sleep_locked(&sem->wq, flags);
+	}
+
+	sem->count -= units;
+
+	spin_unlock_irqrestore(&sem->wq.lock, flags);
+}
+
+/*
+ * Takes units from the semaphore if that many are available.
+ */
+bool semaphore_trydown(semaphore_t *sem, unsigned int units) {
+	uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+	bool acquired = (sem->count >= (int) units);
+
+	if(acquired) {
+		sem->count -= units;
+	}
+
+	spin_unlock_irqrestore(&sem->wq.lock, flags);
+
+	return acquired;
+}
+
+// A waiter's timeout; lives on its stack
+typedef struct semaphore_timeout {
+	semaphore_t *sem;
+
+	volatile bool expired;
+	volatile bool done;
+} semaphore_timeout_t;
+
+/*
+ * Timer callback: wakes up the waiters, so the one whose timeout this is sees
+ * that it expired.
+ */
+static void semaphore_timeout(void *context) {
+	semaphore_timeout_t *timeout = context;
+	semaphore_t *sem = timeout->sem;
+
+	uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+
+	timeout->expired = true;
+	wait_queue_wake_all_locked(&sem->wq);
+
+	spin_unlock_irqrestore(&sem->wq.lock, flags);
+
+	// Last access; the waiter may return as soon as it sees this
+	timeout->done = true;
+}
+
+/*
+ * Takes units from the semaphore, giving up after timeout_ns nanoseconds.
+ * Returns true if the units were taken. Where the caller can't block, this
+ * polls instead of sleeping.
+ */
+bool semaphore_down_timeout(semaphore_t *sem, unsigned int units, uint64_t timeout_ns) {
+	uint64_t now = ktime_get_ns();
+	uint64_t end = TIMER_NO_DEADLINE - 1;
+
+	// Timeouts too far out to be represented never expire
+	if(timeout_ns < end - now) {
+		end = now + timeout_ns;
+	}
+
+	if(!sched_can_block()) {
+		while(!semaphore_trydown(sem, units)) {
+			if(ktime_get_ns() >= end) {
+				return false;
+			}
+
+			__asm__ volatile("pause");
+		}
+
+		return true;
+	}
+
+	semaphore_timeout_t timeout;
+	ktimer_t timer;
+
+	timeout.sem = sem;
+	timeout.expired = timeout.done = false;
+
+	memclr(&timer, sizeof(ktimer_t));
+	timer_add(&timer, end, semaphore_timeout, &timeout);
+
+	uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+
+	while(sem->count < (int) units && !timeout.expired) {
+		flags = wait_queue_sleep_locked(&sem->wq, flags);
+	}
+
+	// Units that became available just as the timeout expired are still taken
+	bool acquired = (sem->count >= (int) units);
+
+	if(acquired) {
+		sem->count -= units;
+	}
+
+	spin_unlock_irqrestore(&sem->wq.lock, flags);
+
+	// If the timer fired, its callback may still be using the timeout
+	if(!timer_cancel(&timer)) {
+		while(!timeout.done) {
+			__asm__ volatile("pause" : : : "memory");
+		}
+	}
+
+	return acquired;
+}
+
+/*
+ * Returns units to the semaphore. All waiters are woken up, since they may
+ * each be waiting for a different number of units.
+ */
+void semaphore_up(semaphore_t *sem, unsigned int units) {
+	uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+
+	sem->count += units;
+
+	wait_queue_wake_all_locked(&sem->wq);
+
+	spin_unlock_irqrestore(&sem->wq.lock, flags);
+}
+
+/*
+ * Initialises an unlocked reader-writer lock.
+ */
+void rwlock_init(rwlock_t *lock) {
+	wait_queue_init(&lock->wq);
+
+	lock->readers = 0;
+	lock->writers_waiting = 0;
+	lock->writer = false;
+}
+
+/*
+ * Takes the lock for reading. Readers wait while there's a writer holding or
+ * waiting for the lock.
+ */
+void rwlock_read_lock(rwlock_t *lock) {
+	uint32_t flags = spin_lock_irqsave(&lock->wq.lock);
+
+	while(lock->writer || lock->writers_waiting) {
+		flags = wait_queue_sleep_locked(&lock->wq, flags);
+	}
+
+	lock->readers++;
+
+	spin_unlock_irqrestore(&lock->wq.lock, flags);
+}
+
+void rwlock_read_unlock(rwlock_t *lock) {
+	uint32_t flags = spin_lock_irqsave(&lock->wq.lock);
+
+	ASSERT(lock->readers);
+
+	// The last reader lets waiting writers in
+	if(--lock->readers == 0) {
+		wait_queue_wake_all_locked(&lock->wq);
+	}
+
+	spin_unlock_irqrestore(&lock->wq.lock, flags);
+}
+
+/*
+ * Takes the lock for writing, waiting until all readers have left.
+ */
+void rwlock_write_lock(rwlock_t *lock) {
+	uint32_t flags = spin_lock_irqsave(&lock->wq.lock);
+
+	lock->writers_waiting++;
+
+	while(lock->writer || lock->readers) {
+		flags = wait_queue_sleep_locked(&lock->wq, flags);
+	}
+
+	lock->writers_waiting--;
+	lock->writer = true;
+
+	spin_unlock_irqrestore(&lock->wq.lock, flags);
+}
+
+void rwlock_write_unlock(rwlock_t *lock) {
+	uint32_t flags = spin_lock_irqsave(&lock->wq.lock);
+
+	ASSERT(lock->writer);
+
+	lock->writer = false;
+	wait_queue_wake_all_locked(&lock->wq);
+
+	spin_unlock_irqrestore(&lock->wq.lock, flags);
+}
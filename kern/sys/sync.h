@@ -0,0 +1,61 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <types.h>
+#include "waitqueue.h"
+
+/*
+ * Sleeping locks. Contended tasks block on a wait queue instead of spinning,
+ * so they may only be used where blocking is allowed: never from interrupt
+ * handlers, or with a spinlock held.
+ */
+
+/*
+ * Mutual exclusion lock, which must be released by the task holding it.
+ */
+typedef struct mutex {
+	wait_queue_t wq;
+
+	volatile bool locked;
+	void *owner;
+} mutex_t;
+
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+bool mutex_trylock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+/*
+ * Counting semaphore.
+ */
+typedef struct semaphore {
+	wait_queue_t wq;
+
+	volatile int count;
+} semaphore_t;
+
+void semaphore_init(semaphore_t *sem, int count);
+void semaphore_down(semaphore_t *sem, unsigned int units);
+bool semaphore_trydown(semaphore_t *sem, unsigned int units);
+bool semaphore_down_timeout(semaphore_t *sem, unsigned int units, uint64_t timeout_ns);
+void semaphore_up(semaphore_t *sem, unsigned int units);
+
+/*
+ * Reader-writer lock: any number of readers, or one writer. Waiting writers
+ * keep new readers out, so they can't be starved.
+ */
+typedef struct rwlock {
+	wait_queue_t wq;
+
+	volatile unsigned int readers;
+	volatile unsigned int writers_waiting;
+	volatile bool writer;
+} rwlock_t;
+
+void rwlock_init(rwlock_t *lock);
+void rwlock_read_lock(rwlock_t *lock);
+void rwlock_read_unlock(rwlock_t *lock);
+void rwlock_write_lock(rwlock_t *lock);
+void rwlock_write_unlock(rwlock_t *lock);
+
+#endif
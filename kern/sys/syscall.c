@@ -3,22 +3,466 @@
 #include "system.h"
 #include "sched.h"
 #include "task.h"
+#include "clock.h"
+#include "percpu.h"
+#include "futex.h"
+#include "uaccess.h"
+#include "uring.h"
+#include "vdso.h"
+#include "syscall_stats.h"
+#include "file.h"
+#include "pipe.h"
+#include "msg.h"
+#include "shm.h"
+#include "epoll.h"
+#include "sleep.h"
+#include "itimer.h"
+#include "rusage.h"
+#include "io/debug_console.h"
+#include <errno.h>
 
 extern void syscall_handler_stub(void);
-static void* syscallStack;
+extern void syscall_int_stub(void);
+
+static void syscall_bench_cmd(int argc, char **argv);
+
+static int syscall_cmd_init(void) {
+	debugcon_register("syscallbench", "Measures a null syscall round trip ('syscallbench [count]')", syscall_bench_cmd);
+	return 0;
+}
+
+module_init(syscall_cmd_init);
+
+/*
+ * Does nothing; the cost of calling it is that of getting in and out of the
+ * kernel.
+ */
+static int syscall_null(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return 0;
+}
+
+/*
+ * File syscalls: read and write take a descriptor, a buffer and its length,
+ * and return the number of bytes transferred.
+ */
+static int syscall_read(uint32_t fd, uint32_t buf, uint32_t len, uint32_t a4, uint32_t a5) {
+	file_t *file = file_lookup(fd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = file_read(file, (void *) buf, len, 0);
+	file_put(file);
+
+	return ret;
+}
+
+static int syscall_write(uint32_t fd, uint32_t buf, uint32_t len, uint32_t a4, uint32_t a5) {
+	file_t *file = file_lookup(fd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = file_write(file, (void *) buf, len, 0);
+	file_put(file);
+
+	return ret;
+}
+
+static int syscall_close(uint32_t fd, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return file_close(fd);
+}
+
+/*
+ * Gives two files descriptors, and stores them at fds_ptr. If either can't
+ * be, both files are dropped.
+ */
+static int syscall_install_pair(file_t *first, file_t *second, uint32_t fds_ptr) {
+	int fds[2];
+
+	fds[0] = file_install(first);
+
+	if(fds[0] < 0) {
+		file_put(first);
+		file_put(second);
+		return fds[0];
+	}
+
+	fds[1] = file_install(second);
+
+	if(fds[1] < 0) {
+		file_put(second);
+		file_close(fds[0]);
+		return fds[1];
+	}
+
+	if(copy_to_user((void *) fds_ptr, fds, sizeof(fds))) {
+		file_close(fds[0]);
+		file_close(fds[1]);
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/*
+ * Creates a pipe; its read end's descriptor is stored at fds_ptr, followed by
+ * that of its write end.
+ */
+static int syscall_pipe(uint32_t fds_ptr, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	file_t *read_end, *write_end;
+	int ret = pipe_create(&read_end, &write_end);
+
+	if(ret) {
+		return ret;
+	}
+
+	return syscall_install_pair(read_end, write_end, fds_ptr);
+}
+
+/*
+ * Message syscalls: channel creation stores the server end's descriptor at
+ * fds_ptr, followed by the client end's. Send takes the client descriptor,
+ * the message and a buffer for the reply; receive takes the server
+ * descriptor, a buffer, and where to store the message's length. Reply takes
+ * the server descriptor, the ID receive returned, the status send returns,
+ * and the reply data.
+ */
+static int syscall_channel_create(uint32_t fds_ptr, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	file_t *server, *client;
+	int ret = channel_create(&server, &client);
+
+	if(ret) {
+		return ret;
+	}
+
+	return syscall_install_pair(server, client, fds_ptr);
+}
+
+static int syscall_msg_send(uint32_t fd, uint32_t send_buf, uint32_t send_len, uint32_t reply_buf, uint32_t reply_len) {
+	file_t *file = file_lookup(fd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = msg_send(file, (void *) send_buf, send_len, (void *) reply_buf, reply_len, 0);
+	file_put(file);
+
+	return ret;
+}
+
+static int syscall_msg_receive(uint32_t fd, uint32_t buf, uint32_t len, uint32_t len_ptr, uint32_t a5) {
+	file_t *file = file_lookup(fd);
+	uint32_t msg_len;
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = msg_receive(file, (void *) buf, len, &msg_len, 0);
+	file_put(file);
+
+	if(ret > 0 && len_ptr && copy_to_user((void *) len_ptr, &msg_len, sizeof(msg_len))) {
+		return -EFAULT;
+	}
+
+	return ret;
+}
+
+static int syscall_msg_reply(uint32_t fd, uint32_t rcvid, uint32_t status, uint32_t buf, uint32_t len) {
+	file_t *file = file_lookup(fd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = msg_reply(file, rcvid, status, (void *) buf, len, 0);
+	file_put(file);
+
+	return ret;
+}
+
+/*
+ * Event poll syscalls: create returns a descriptor. Control takes it, the
+ * operation, the descriptor to register, and its event (ignored when it's
+ * removed). Wait takes it, a buffer for at most max events, and a timeout in
+ * milliseconds (-1 to wait forever), and returns the number of events.
+ */
+static int syscall_epoll_create(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	file_t *file;
+	int ret = epoll_create(&file);
+
+	if(ret) {
+		return ret;
+	}
+
+	ret = file_install(file);
+
+	if(ret < 0) {
+		file_put(file);
+	}
+
+	return ret;
+}
+
+static int syscall_epoll_ctl(uint32_t epfd, uint32_t op, uint32_t fd, uint32_t event_ptr, uint32_t a5) {
+	epoll_event_t event = { 0, 0 };
+
+	if(op != EPOLL_CTL_DEL && copy_from_user(&event, (void *) event_ptr, sizeof(event))) {
+		return -EFAULT;
+	}
+
+	file_t *file = file_lookup(epfd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	file_t *target = file_lookup(fd);
+	int ret;
+
+	if(!target) {
+		ret = -EBADF;
+	} else {
+		ret = (target == file) ? -EINVAL : epoll_ctl(file, op, fd, target, &event);
+		file_put(target);
+	}
+
+	file_put(file);
+
+	return ret;
+}
+
+static int syscall_epoll_wait(uint32_t epfd, uint32_t events, uint32_t max, uint32_t timeout_ms, uint32_t a5) {
+	file_t *file = file_lookup(epfd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = epoll_wait(file, (epoll_event_t *) events, max, timeout_ms, 0);
+	file_put(file);
+
+	return ret;
+}
+
+/*
+ * Copies the name of a shared memory object from user space.
+ */
+static int syscall_shm_name(char *name, uint32_t name_ptr) {
+	int len = strncpy_from_user(name, (const char *) name_ptr, SHM_NAME_MAX);
+
+	if(len < 0) {
+		return len;
+	}
+
+	return (len == 0 || len == SHM_NAME_MAX) ? -EINVAL : 0;
+}
+
+/*
+ * Shared memory syscalls: create takes the object's name and size. Map takes
+ * the name, the address to map it at (0 to pick one), the mapping flags and
+ * the caching attributes, and returns the address. Unmap takes the address
+ * the object was mapped at; unlink takes the name.
+ */
+static int syscall_shm_create(uint32_t name_ptr, uint32_t size, uint32_t a3, uint32_t a4, uint32_t a5) {
+	char name[SHM_NAME_MAX];
+	int ret = syscall_shm_name(name, name_ptr);
+
+	return ret ? ret : shm_create(name, size);
+}
+
+static int syscall_shm_map(uint32_t name_ptr, uint32_t addr, uint32_t flags, uint32_t cache, uint32_t a5) {
+	char name[SHM_NAME_MAX];
+	int ret = syscall_shm_name(name, name_ptr);
+
+	return ret ? ret : shm_map(name, addr, flags, cache);
+}
+
+static int syscall_shm_unmap(uint32_t addr, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return shm_unmap(addr);
+}
+
+static int syscall_shm_unlink(uint32_t name_ptr, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	char name[SHM_NAME_MAX];
+	int ret = syscall_shm_name(name, name_ptr);
+
+	return ret ? ret : shm_unlink(name);
+}
 
 /*
- * Stub for unimplemented syscalls.
+ * Futex syscalls: wait takes the address of the word, the value it is expected
+ * to contain, and a relative timeout in nanoseconds (low word, then high word),
+ * 0 meaning none. Wake takes the address and the number of tasks to wake.
  */
-int syscall_stub(void* task, syscall_callstack_t regs, void* syscall_struct) {
-	return -1;
+static int syscall_futex_wait(uint32_t addr, uint32_t val, uint32_t timeout_lo, uint32_t timeout_hi, uint32_t a5) {
+	uint64_t timeout_ns = ((uint64_t) timeout_hi << 32) | timeout_lo;
+	return futex_wait((uint32_t *) addr, val, timeout_ns);
+}
+
+static int syscall_futex_wake(uint32_t addr, uint32_t count, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return futex_wake((uint32_t *) addr, count);
 }
 
-/* 
- * Stores the return value of the function to be placed in %eax on return by the assembly
- * syscall handler so we don't need to modify the stack image
+/*
+ * Thread syscalls: create starts a thread at entry in the caller's process,
+ * passing it two arguments, and returns its ID. Exit doesn't return; join
+ * waits for a thread to exit, and stores the value it passed to exit at the
+ * address given, if any.
  */
-int syscall_return_value;
+static int syscall_thread_create(uint32_t entry, uint32_t arg0, uint32_t arg1, uint32_t a4, uint32_t a5) {
+	i386_task_t *thread = task_create_thread(sched_curr_task(), entry, arg0, arg1);
+
+	if(!thread) {
+		return -EAGAIN;
+	}
+
+	sched_task_start(thread);
+	return thread->pid;
+}
+
+static int syscall_thread_exit(uint32_t value, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return task_thread_exit(value);
+}
+
+static int syscall_thread_join(uint32_t tid, uint32_t value_ptr, uint32_t a3, uint32_t a4, uint32_t a5) {
+	uint32_t value;
+	int ret = task_thread_join(tid, &value);
+
+	if(ret == 0 && value_ptr) {
+		return copy_to_user((void *) value_ptr, &value, sizeof(value));
+	}
+
+	return ret;
+}
+
+/*
+ * Ring syscalls: setup takes flags, and returns the address the rings are
+ * mapped at. Enter takes the number of completions to wait for, and flags.
+ */
+static int syscall_uring_setup(uint32_t flags, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return uring_setup(flags);
+}
+
+static int syscall_uring_enter(uint32_t min_complete, uint32_t flags, uint32_t a3, uint32_t a4, uint32_t a5) {
+	return uring_enter(min_complete, flags);
+}
+
+/*
+ * Reads a clock (VDSO_CLOCK_*) into a pair of words at ts: seconds, then
+ * nanoseconds. User space only needs this if the clock isn't the TSC.
+ */
+static int syscall_clock_gettime(uint32_t clock, uint32_t ts, uint32_t a3, uint32_t a4, uint32_t a5) {
+	uint64_t ns = ktime_get_ns();
+	uint32_t value[2];
+
+	if(clock == VDSO_CLOCK_REALTIME) {
+		ns += vdso_get()->realtime_offset_ns;
+	} else if(clock != VDSO_CLOCK_MONOTONIC) {
+		return -EINVAL;
+	}
+
+	value[0] = (uint32_t) mstd_div_u64(ns, NSEC_PER_SEC, &value[1]);
+
+	return copy_to_user((void *) ts, value, sizeof(value));
+}
+
+/*
+ * Copies the statistics of syscall number (syscall_stats.h) to buf, either the
+ * global ones or the calling thread's, depending on scope.
+ */
+static int syscall_syscall_stats(uint32_t number, uint32_t buf, uint32_t scope, uint32_t a4, uint32_t a5) {
+	syscall_stats_t stats;
+	int ret = syscall_stats_get(sched_curr_task(), number, scope, &stats);
+
+	if(ret != 0) {
+		return ret;
+	}
+
+	return copy_to_user((void *) buf, &stats, sizeof(stats));
+}
+
+/*
+ * Sleeps for a time in nanoseconds (low word, then high word), or, with
+ * ITIMER_ABSTIME in flags, until that time on the given clock.
+ */
+static int syscall_clock_nanosleep(uint32_t clock, uint32_t flags, uint32_t ns_lo, uint32_t ns_hi, uint32_t a5) {
+	uint64_t ns = ((uint64_t) ns_hi << 32) | ns_lo;
+
+	if(clock != VDSO_CLOCK_REALTIME && clock != VDSO_CLOCK_MONOTONIC) {
+		return -EINVAL;
+	}
+
+	if(!(flags & ITIMER_ABSTIME)) {
+		return sleep_ns(ns);
+	}
+
+	if(clock == VDSO_CLOCK_REALTIME) {
+		uint64_t offset = vdso_get()->realtime_offset_ns;
+		ns = (ns > offset) ? (ns - offset) : 0;
+	}
+
+	return sleep_until(ns);
+}
+
+/*
+ * Interval timer syscalls: create takes the clock absolute times are on, and
+ * returns a descriptor. Set time takes it, flags, and the address of an
+ * itimer_spec_t.
+ */
+static int syscall_itimer_create(uint32_t clock, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+	file_t *file;
+	int ret = itimer_create(clock, &file);
+
+	if(ret) {
+		return ret;
+	}
+
+	ret = file_install(file);
+
+	if(ret < 0) {
+		file_put(file);
+	}
+
+	return ret;
+}
+
+static int syscall_itimer_settime(uint32_t fd, uint32_t flags, uint32_t spec_ptr, uint32_t a4, uint32_t a5) {
+	itimer_spec_t spec;
+
+	if(copy_from_user(&spec, (void *) spec_ptr, sizeof(spec))) {
+		return -EFAULT;
+	}
+
+	file_t *file = file_lookup(fd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = itimer_settime(file, flags, &spec);
+	file_put(file);
+
+	return ret;
+}
+
+/*
+ * Copies the resource usage (rusage.h) of the calling process, or only of the
+ * calling thread, to buf.
+ */
+static int syscall_getrusage(uint32_t who, uint32_t buf, uint32_t a3, uint32_t a4, uint32_t a5) {
+	rusage_t usage;
+	int ret = rusage_get(sched_curr_task(), who, &usage);
+
+	if(ret) {
+		return ret;
+	}
+
+	return copy_to_user((void *) buf, &usage, sizeof(usage)) ? -EFAULT : 0;
+}
 
 /*
  * This table holds an array for each available syscall in the system. The compiler will
@@ -26,64 +470,131 @@ int syscall_return_value;
  * from our syscall handler.
  */
 static const syscall_routine syscall_table[SYSCALL_TABLE_SIZE] = {
-	syscall_stub
+	[SYSCALL_NULL] = syscall_null,
+	[SYSCALL_READ] = syscall_read,
+	[SYSCALL_WRITE] = syscall_write,
+	[SYSCALL_CLOSE] = syscall_close,
+
+	[SYSCALL_FUTEX_WAIT] = syscall_futex_wait,
+	[SYSCALL_FUTEX_WAKE] = syscall_futex_wake,
+
+	[SYSCALL_THREAD_CREATE] = syscall_thread_create,
+	[SYSCALL_THREAD_EXIT] = syscall_thread_exit,
+	[SYSCALL_THREAD_JOIN] = syscall_thread_join,
+
+	[SYSCALL_URING_SETUP] = syscall_uring_setup,
+	[SYSCALL_URING_ENTER] = syscall_uring_enter,
+
+	[SYSCALL_CLOCK_GETTIME] = syscall_clock_gettime,
+
+	[SYSCALL_SYSCALL_STATS] = syscall_syscall_stats,
+
+	[SYSCALL_PIPE] = syscall_pipe,
+	[SYSCALL_CHANNEL_CREATE] = syscall_channel_create,
+	[SYSCALL_MSG_SEND] = syscall_msg_send,
+	[SYSCALL_MSG_RECEIVE] = syscall_msg_receive,
+	[SYSCALL_MSG_REPLY] = syscall_msg_reply,
+
+	[SYSCALL_SHM_CREATE] = syscall_shm_create,
+	[SYSCALL_SHM_MAP] = syscall_shm_map,
+	[SYSCALL_SHM_UNMAP] = syscall_shm_unmap,
+	[SYSCALL_SHM_UNLINK] = syscall_shm_unlink,
+
+	[SYSCALL_EPOLL_CREATE] = syscall_epoll_create,
+	[SYSCALL_EPOLL_CTL] = syscall_epoll_ctl,
+	[SYSCALL_EPOLL_WAIT] = syscall_epoll_wait,
+
+	[SYSCALL_CLOCK_NANOSLEEP] = syscall_clock_nanosleep,
+	[SYSCALL_ITIMER_CREATE] = syscall_itimer_create,
+	[SYSCALL_ITIMER_SETTIME] = syscall_itimer_settime,
+
+	[SYSCALL_GETRUSAGE] = syscall_getrusage
 };
 
 /*
- * Initialises the syscall environment by configuring MSRs.
+ * Initialises the syscall environment by configuring this processor's MSRs.
  */
 void syscall_init() {
-	// Allocate a stack for syscalls
-	syscallStack = (void *) kmalloc(SYS_KERN_STACK_SIZE/2);
-	memclr(syscallStack, SYS_KERN_STACK_SIZE/2);
-
 	// Set GDT entry for system code segment
 	sys_write_MSR(SYS_MSR_IA32_SYSENTER_CS, SYS_KERN_CODE_SEG, 0);
 
-	// Set kernel stack and syscall entry point
-	sys_write_MSR(SYS_MSR_IA32_SYSENTER_ESP, (uint32_t) syscallStack, 0);
+	/*
+	 * The stack SYSENTER loads is this processor's kernel_stack_top field,
+	 * from which the stub loads the current task's kernel stack.
+	 */
+	sys_write_MSR(SYS_MSR_IA32_SYSENTER_ESP, (uint32_t) &percpu_self()->kernel_stack_top, 0);
 	sys_write_MSR(SYS_MSR_IA32_SYSENTER_EIP, (uint32_t) syscall_handler_stub, 0);
+
+	// The INT entry point can be used from user mode
+	sys_set_idt_gate(SYSCALL_VECTOR, (uint32_t) syscall_int_stub, 0x08, 0xEE);
 }
 
 /*
- * Handler that processes all syscalls given to the OS by the SYSENTER instruction.
- * The struct passed in contains the info that was pushed on the stack, including
- * contents of registers before the call to this function.
- *
- * The C library (or whatever other library is in use) will have placed the syscall
- * that it wants executed into the EBX register, and a pointer to a syscall-specific
- * information struct in the EAX register, if any. Alternatively, if the syscall takes
- * only a single argument that can fit in a register, it is placed into EAX.
- *
- * Before calling this function, it's imperative that the caller places the return
- * address directly after the SYSENTER opcode into EDX, and the stack pointer to
- * restore into ECX. This is done by the _kern_syscall stub in process memory.
+ * Dispatches a syscall from either entry point. The syscall number is in EAX,
+ * and the arguments in EBX, ECX, EDX, ESI and EDI. The value returned is
+ * placed in EAX when returning to the caller.
  */
-int syscall_handler(syscall_callstack_t regs) {
-	// Syscall number and info
-	uint32_t syscall_id = regs.ebx;
-	void* syscall_struct = (void *) regs.eax;
+int syscall_handler(syscall_regs_t *regs) {
+	uint32_t syscall_id = regs->eax;
+	uint64_t start = 0;
+	int ret = -1;
+
+	percpu_inc(syscall_count);
 
 	// The task that called this syscall
 	i386_task_t *task = sched_curr_task();
+	sched_stats_kernel_enter(&task->acct, ktime_get_ns());
+	rusage_syscall(task);
 
-	if(syscall_id > SYSCALL_TABLE_SIZE) {
+	if(static_branch_unlikely(&syscall_stats_key)) {
+		start = sys_rdtsc();
+	}
+
+	if(syscall_id >= SYSCALL_TABLE_SIZE) {
 		kprintf("Got invalid syscall 0x%X\n", syscall_id);
+	} else if(syscall_table[syscall_id] != NULL) {
+		ret = syscall_table[syscall_id](regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
 	} else {
-		if(syscall_table[syscall_id] != NULL) {
-			syscall_return_value = (syscall_table[syscall_id](task, regs, syscall_struct));
-		} else {
-			kprintf("Undefined syscall: 0x%X\n", syscall_id);
-		}
+		kprintf("Undefined syscall: 0x%X\n", syscall_id);
+	}
+
+	// Statistics may have been turned on during the syscall
+	if(static_branch_unlikely(&syscall_stats_key) && start) {
+		syscall_stats_record(task, syscall_id, ret, sys_rdtsc() - start);
 	}
 
-	// Before we run the syscall, ensure the return address in EDX is valid
-	uint16_t *returnAddress = ((uint16_t *) regs.edx)-1; // 1 word = size of SYSENTER opcode
-	uint16_t opcode = *returnAddress;
+	sched_stats_kernel_exit(&task->acct, ktime_get_ns());
 
-	if(opcode != SYSCALL_SYSENTER_OPCODE) {
-		kprintf("Invalid return address: process will be killed!");
+	return ret;
+}
+
+/*
+ * Debug console command: makes null syscalls through the INT entry point.
+ * From the kernel, there's no privilege change or stack switch, so this gives
+ * a lower bound on the cost of a syscall from user mode.
+ */
+static void syscall_bench_cmd(int argc, char **argv) {
+	unsigned int count = 100000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
 	}
 
-	return 0;
-}
\ No newline at end of file
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		uint32_t ret;
+		__asm__ volatile("int $0x80" : "=a" (ret) : "a" (SYSCALL_NULL) : "memory");
+	}
+
+	uint64_t cycles = sys_rdtsc() - start;
+	uint32_t per_call = (uint32_t) mstd_div_u64(cycles, count, NULL);
+
+	kprintf("syscallbench: %u null syscalls, %u cycles each", count, per_call);
+
+	if(clock_get_source()->is_tsc) {
+		kprintf(" (%u ns)", (uint32_t) clock_cycles_to_ns(per_call));
+	}
+
+	kprintf("\n");
+}
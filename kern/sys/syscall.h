@@ -3,21 +3,55 @@
 
 #include <types.h>
 
-#define SYSCALL_STRUCT_MAGIC "SYCL"
-
-// these are endian swapped because gcc sucks
-#define SYSCALL_SYSENTER_OPCODE 0x340F
-#define SYSCALL_SYSEXIT_OPCODE 0x350F
+// Interrupt vector of the INT entry point
+#define SYSCALL_VECTOR 0x80
 
 #define SYSCALL_TABLE_SIZE 64
 
-typedef struct registers {
-   uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax; // Pushed by pusha.
-} syscall_callstack_t;
-
-typedef int (*syscall_routine)(void* task, syscall_callstack_t regs, void* info);
+// Syscall numbers; these must match the C library's syscall_num.h
+#define SYSCALL_NULL 0
+#define SYSCALL_READ 3
+#define SYSCALL_WRITE 4
+#define SYSCALL_CLOSE 6
+#define SYSCALL_FUTEX_WAIT 16
+#define SYSCALL_FUTEX_WAKE 17
+#define SYSCALL_THREAD_CREATE 18
+#define SYSCALL_THREAD_EXIT 19
+#define SYSCALL_THREAD_JOIN 20
+#define SYSCALL_URING_SETUP 21
+#define SYSCALL_URING_ENTER 22
+#define SYSCALL_CLOCK_GETTIME 23
+#define SYSCALL_SYSCALL_STATS 24
+#define SYSCALL_PIPE 25
+#define SYSCALL_CHANNEL_CREATE 26
+#define SYSCALL_MSG_SEND 27
+#define SYSCALL_MSG_RECEIVE 28
+#define SYSCALL_MSG_REPLY 29
+#define SYSCALL_SHM_CREATE 30
+#define SYSCALL_SHM_MAP 31
+#define SYSCALL_SHM_UNMAP 32
+#define SYSCALL_SHM_UNLINK 33
+#define SYSCALL_EPOLL_CREATE 34
+#define SYSCALL_EPOLL_CTL 35
+#define SYSCALL_EPOLL_WAIT 36
+#define SYSCALL_CLOCK_NANOSLEEP 37
+#define SYSCALL_ITIMER_CREATE 38
+#define SYSCALL_ITIMER_SETTIME 39
+#define SYSCALL_GETRUSAGE 40
+
+// Frame the entry stubs push (syscall.S)
+typedef struct syscall_regs {
+	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax; // Pushed by pusha.
+	uint32_t gs;
+} syscall_regs_t;
+
+/*
+ * Syscall routines get the arguments from EBX, ECX, EDX, ESI and EDI, in that
+ * order; the ones a syscall doesn't take are undefined.
+ */
+typedef int (*syscall_routine)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 
 void syscall_init();
-int syscall_handler(syscall_callstack_t regs);
+int syscall_handler(syscall_regs_t *regs);
 
 #endif
\ No newline at end of file
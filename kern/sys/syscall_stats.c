@@ -0,0 +1,211 @@
+#include <types.h>
+#include <errno.h>
+#include "syscall_stats.h"
+#include "hist.h"
+#include "syscall.h"
+#include "task.h"
+#include "smp.h"
+#include "percpu.h"
+#include "preempt.h"
+#include "system.h"
+#include "kheap.h"
+#include "io/debug_console.h"
+
+static_key_t syscall_stats_key = STATIC_KEY_INIT_FALSE;
+
+// Global statistics; each processor only updates its own
+static syscall_stats_t syscall_stats_cpu[SMP_MAX_CPUS][SYSCALL_TABLE_SIZE];
+
+static void syscall_stats_cmd(int argc, char **argv);
+
+/*
+ * Registers the debug console command.
+ */
+static int syscall_stats_init(void) {
+	debugcon_register("syscalls", "Syscall statistics ('syscalls [on|off|reset|<nr>|pid <pid>]')", syscall_stats_cmd);
+	return 0;
+}
+
+module_init(syscall_stats_init);
+
+static inline void syscall_stats_add(syscall_stats_t *stats, unsigned int bucket, int ret, uint64_t cycles) {
+	stats->count++;
+	stats->cycles += cycles;
+	stats->hist[bucket]++;
+
+	if(ret < 0) {
+		stats->errors++;
+	}
+}
+
+/*
+ * Records a call of syscall id by task, which returned ret after the given
+ * number of cycles. The task's table is allocated on its first syscall with
+ * statistics enabled; if that fails, only the global ones are updated.
+ */
+void syscall_stats_record(i386_task_t *task, uint32_t id, int ret, uint64_t cycles) {
+	if(id >= SYSCALL_TABLE_SIZE) {
+		return;
+	}
+
+	unsigned int bucket = hist_bucket(cycles, SYSCALL_HIST_BUCKETS);
+
+	preempt_disable();
+	syscall_stats_add(&syscall_stats_cpu[percpu_read(cpu)][id], bucket, ret, cycles);
+	preempt_enable();
+
+	if(!task->syscall_stats) {
+		syscall_stats_t *table = (syscall_stats_t *) kmalloc(sizeof(syscall_stats_t) * SYSCALL_TABLE_SIZE);
+
+		if(!table) {
+			return;
+		}
+
+		memclr(table, sizeof(syscall_stats_t) * SYSCALL_TABLE_SIZE);
+		task->syscall_stats = table;
+	}
+
+	// Only the task itself writes these
+	syscall_stats_add(&task->syscall_stats[id], bucket, ret, cycles);
+}
+
+/*
+ * Gets the statistics for syscall id, either for a task or summed over all
+ * processors. A task that made no syscalls with statistics enabled reads as
+ * zero.
+ */
+int syscall_stats_get(i386_task_t *task, uint32_t id, unsigned int scope, syscall_stats_t *out) {
+	if(id >= SYSCALL_TABLE_SIZE) {
+		return -EINVAL;
+	}
+
+	memclr(out, sizeof(syscall_stats_t));
+
+	if(scope == SYSCALL_STATS_TASK) {
+		if(task->syscall_stats) {
+			memcpy(out, &task->syscall_stats[id], sizeof(syscall_stats_t));
+		}
+
+		return 0;
+	} else if(scope != SYSCALL_STATS_GLOBAL) {
+		return -EINVAL;
+	}
+
+	for(int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+		syscall_stats_t *stats = &syscall_stats_cpu[cpu][id];
+
+		out->count += stats->count;
+		out->errors += stats->errors;
+		out->cycles += stats->cycles;
+
+		for(int b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+			out->hist[b] += stats->hist[b];
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Releases a task's statistics; called when it's deallocated.
+ */
+void syscall_stats_task_free(i386_task_t *task) {
+	if(task->syscall_stats) {
+		kfree(task->syscall_stats);
+		task->syscall_stats = NULL;
+	}
+}
+
+/*
+ * Clears the global statistics, and those of every task.
+ */
+static void syscall_stats_reset(void) {
+	memclr(syscall_stats_cpu, sizeof(syscall_stats_cpu));
+
+	i386_task_t *task = task_get_first();
+
+	while(task) {
+		if(task->syscall_stats) {
+			memclr(task->syscall_stats, sizeof(syscall_stats_t) * SYSCALL_TABLE_SIZE);
+		}
+
+		task = task->next;
+	}
+}
+
+/*
+ * Prints a line for each syscall that was called, either globally or by task.
+ */
+static void syscall_stats_dump(i386_task_t *task) {
+	unsigned int scope = task ? SYSCALL_STATS_TASK : SYSCALL_STATS_GLOBAL;
+	syscall_stats_t stats;
+
+	kprintf("Syscall statistics are %s\n", static_branch_unlikely(&syscall_stats_key) ? "on" : "off");
+	kprintf(CONSOLE_BOLD "nr\tcalls\terrors\tmean cycles\n" CONSOLE_REG);
+
+	for(uint32_t id = 0; id < SYSCALL_TABLE_SIZE; id++) {
+		syscall_stats_get(task, id, scope, &stats);
+
+		if(!stats.count) continue;
+
+		kprintf("%u\t%u\t%u\t%u\n", id, stats.count, stats.errors, (uint32_t) mstd_div_u64(stats.cycles, stats.count, NULL));
+	}
+}
+
+/*
+ * Prints the global latency histogram of one syscall.
+ */
+static void syscall_stats_dump_hist(uint32_t id) {
+	syscall_stats_t stats;
+
+	if(syscall_stats_get(NULL, id, SYSCALL_STATS_GLOBAL, &stats) != 0) {
+		kprintf("No syscall %u\n", id);
+		return;
+	}
+
+	kprintf(CONSOLE_BOLD "Syscall %u: " CONSOLE_REG "%u calls, %u errors\n", id, stats.count, stats.errors);
+
+	for(int b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+		if(!stats.hist[b]) continue;
+
+		if(b == SYSCALL_HIST_BUCKETS - 1) {
+			kprintf("  >= %u\t%u\n", 1U << (b - 1), stats.hist[b]);
+		} else {
+			kprintf("  < %u\t%u\n", 1U << b, stats.hist[b]);
+		}
+	}
+}
+
+/*
+ * Debug console command: turns statistics on or off, clears them, or prints
+ * them globally, for one task, or as a histogram for one syscall.
+ */
+static void syscall_stats_cmd(int argc, char **argv) {
+	if(argc < 2) {
+		syscall_stats_dump(NULL);
+	} else if(!strcmp(argv[1], "on")) {
+		static_key_enable(&syscall_stats_key);
+		kprintf("Syscall statistics enabled\n");
+	} else if(!strcmp(argv[1], "off")) {
+		static_key_disable(&syscall_stats_key);
+		kprintf("Syscall statistics disabled\n");
+	} else if(!strcmp(argv[1], "reset")) {
+		syscall_stats_reset();
+		kprintf("Syscall statistics cleared\n");
+	} else if(!strcmp(argv[1], "pid") && argc > 2) {
+		uint32_t pid = atoi(argv[2]);
+		i386_task_t *task = task_get_first();
+
+		while(task && task->pid != pid) {
+			task = task->next;
+		}
+
+		if(task) {
+			syscall_stats_dump(task);
+		} else {
+			kprintf("No task with pid %u\n", pid);
+		}
+	} else {
+		syscall_stats_dump_hist(atoi(argv[1]));
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef SYSCALL_STATS_H
+#define SYSCALL_STATS_H
+
+#include <types.h>
+#include "static_key.h"
+
+/*
+ * Syscall statistics: for each syscall number, how often it was called, how
+ * often it failed (returned a negative value), and a histogram of the time it
+ * took, in TSC cycles. They're kept globally and for each task, and only while
+ * syscall_stats_key is enabled.
+ */
+
+// Bucket n counts calls taking [2^(n-1), 2^n) cycles; the last one, the rest
+#define SYSCALL_HIST_BUCKETS 24
+
+// Layout is shared with the C library's syscall_stats.h
+typedef struct syscall_stats {
+	uint32_t count;
+	uint32_t errors;
+	uint64_t cycles;
+
+	uint32_t hist[SYSCALL_HIST_BUCKETS];
+} syscall_stats_t;
+
+// Scopes for syscall_stats_get
+#define SYSCALL_STATS_GLOBAL 0
+#define SYSCALL_STATS_TASK 1
+
+struct task;
+
+extern static_key_t syscall_stats_key;
+
+void syscall_stats_record(struct task *task, uint32_t id, int ret, uint64_t cycles);
+int syscall_stats_get(struct task *task, uint32_t id, unsigned int scope, syscall_stats_t *out);
+
+void syscall_stats_task_free(struct task *task);
+
+#endif
@@ -9,6 +9,11 @@
 #include "system.h"
 #include "sched.h"
 #include "syscall.h"
+#include "clock.h"
+#include "timer.h"
+#include "vdso.h"
+#include "smp.h"
+#include "percpu.h"
 #include "sys/multiboot.h"
 #include "runtime/hashmap.h"
 #include "task.h"
@@ -28,10 +33,10 @@ char *kern_elf_strtab;
 elf_symbol_entry_t *kern_elf_symtab;
 unsigned int kern_elf_symtab_entries;
 
-// Allocate memory in the BSS for IDT, GDT, and TSSes
+// Allocate memory in the BSS for IDT, and each CPU's GDT and TSS
 static idt_entry_t sys_idt[256];
-static gdt_entry_t sys_gdt[16];
-static i386_thread_state_t sys_tss[SYS_NUM_TSS];
+static gdt_entry_t sys_gdt[SMP_MAX_CPUS][SYS_GDT_ENTRIES];
+static i386_thread_state_t sys_tss[SMP_MAX_CPUS];
 
 // Sets location of GDT
 void sys_install_gdt(void* location);
@@ -66,7 +71,7 @@ extern void isr16(void);
 extern void isr17(void);
 extern void isr18(void);
 
-void sys_timer_tick_handler(void* context);
+int sys_timer_tick_handler(void* context);
 
 /*
  * Initialises the system into a known state.
@@ -78,6 +83,13 @@ void system_init() {
 	// Read TSC
 	sys_tsc_boot_ticks = sys_rdtsc();
 
+	// Calibrate the TSC and set up the nanosecond clock
+	clock_init();
+	timer_init();
+
+	// Publish the clock to user space
+	vdso_init();
+
 	// Set up the TSS and their stacks
 	sys_init_tss();
 
@@ -109,7 +121,7 @@ void sys_copy_multiboot() {
 	if(MULTIBOOT_CHECK_FLAG(lowmemStruct->flags, 2)) {
 		size_t length = strlen((char *) lowmemStruct->cmdline);
 		char *cmdline = (char *) kmalloc(length+2);
-		memcpy(cmdline, (void *) lowmemStruct->cmdline, length);
+		memcpy(cmdline, (void *) lowmemStruct->cmdline, length+1);
 		himemStruct->cmdline = (uint32_t) cmdline;
 
 		// Allocate kernel command line hashmap
@@ -117,14 +129,19 @@ void sys_copy_multiboot() {
 
 		// Parse the command line
 		char *cmdline_tmp = (char *) kmalloc(length+2);
-		memcpy(cmdline_tmp, cmdline, length);
+		memcpy(cmdline_tmp, cmdline, length+1);
 
-		char *pch = strtok(cmdline, " ");
+		// The first token is the kernel's path, which we skip
+		char *pch = strtok(cmdline_tmp, " ");
 
 		// Loop through all entries
 		while(pch) {
 			pch = strtok(NULL, " ");
 
+			if(!pch) {
+				break;
+			}
+
 			// This is not a key/value string
 			if(strchr(pch, '=') == NULL) {
 				hashmap_insert(sys_kern_arguments, pch, NULL);
@@ -205,6 +222,18 @@ void sys_copy_multiboot() {
 	}
 }
 
+/*
+ * Returns the value of a key=value argument passed on the kernel command line,
+ * or NULL if it wasn't specified.
+ */
+char* sys_get_argument(char *key) {
+	if(!sys_kern_arguments) {
+		return NULL;
+	}
+
+	return hashmap_get(sys_kern_arguments, key);
+}
+
 /*
  * Builds the Interrupt Descriptor Table at a fixed location in memory.
  */
@@ -242,7 +271,14 @@ void sys_build_idt() {
 	sys_set_idt_gate(14, (uint32_t) isr14, 0x08, 0x8E);
 
 	// Install IDT (LIDT instruction)
-	sys_set_idt((void *) idt, sizeof(idt_entry_t)*256);
+	sys_install_idt();
+}
+
+/*
+ * Loads the IDT on the calling processor. All processors share one IDT.
+ */
+void sys_install_idt() {
+	sys_set_idt((void *) &sys_idt, sizeof(idt_entry_t)*256);
 }
 
 void sys_setup_ints() {
@@ -277,56 +313,103 @@ void sys_set_idt_gate(uint8_t entry, uint32_t function, uint8_t segment, uint8_t
 }
 
 /*
- * Builds the Global Descriptor Table with the proper code/data segments, and
- * space for some task state segment descriptors.
+ * Builds the Global Descriptor Table of the bootstrap processor.
  */
 void sys_build_gdt() {
-	gdt_entry_t *gdt = (gdt_entry_t *) &sys_gdt;
+	sys_build_cpu_gdt(0);
+}
+
+/*
+ * Builds a processor's Global Descriptor Table with the proper code/data
+ * segments, and descriptors for its task state segment and per-CPU data, then
+ * loads it.
+ */
+void sys_build_cpu_gdt(unsigned int cpu) {
+	gdt_entry_t *gdt = (gdt_entry_t *) &sys_gdt[cpu];
 
 	// Set up null entry
-	memset(gdt, 0x00, sizeof(gdt_entry_t));
+	memset(gdt, 0x00, sizeof(gdt_entry_t) * SYS_GDT_ENTRIES);
 
 	// Kernel code segment and data segments
-	sys_set_gdt_gate((SYS_KERN_CODE_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0x9A, 0xCF);
-	sys_set_gdt_gate((SYS_KERN_DATA_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0x92, 0xCF);
+	sys_set_gdt_gate(cpu, (SYS_KERN_CODE_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0x9A, 0xCF);
+	sys_set_gdt_gate(cpu, (SYS_KERN_DATA_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0x92, 0xCF);
 
 	// User code and data segments
-	sys_set_gdt_gate((SYS_USER_CODE_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0xFA, 0xCF);
-	sys_set_gdt_gate((SYS_USER_DATA_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0xF2, 0xCF);
+	sys_set_gdt_gate(cpu, (SYS_USER_CODE_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0xFA, 0xCF);
+	sys_set_gdt_gate(cpu, (SYS_USER_DATA_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0xF2, 0xCF);
 
-	// Create the correct number of TSS descriptors
-	for(int i = 0; i < SYS_NUM_TSS; i++) {
-		sys_set_gdt_gate(i+5, ((uint32_t) &sys_tss)+(i*sizeof(i386_thread_state_t)), sizeof(i386_thread_state_t), 0x89, 0x4F);
-	}
+	// This processor's TSS
+	sys_set_gdt_gate(cpu, (SYS_TSS_SEG >> 3), (uint32_t) &sys_tss[cpu], sizeof(i386_thread_state_t), 0x89, 0x4F);
+
+	// Its per-CPU data, with byte granularity so accesses past the end fault
+	sys_set_gdt_gate(cpu, (SYS_PERCPU_SEG >> 3), (uint32_t) percpu_get(cpu), sizeof(percpu_t) - 1, 0x92, 0x40);
+
+	// TLS of the running thread; the scheduler moves its base
+	sys_set_gdt_gate(cpu, (SYS_USER_TLS_SEG >> 3), 0x00000000, 0xFFFFFFFF, 0xF2, 0xCF);
 
 	sys_install_gdt(gdt);
+
+	// Loading the GDT reset GS to the data segment
+	percpu_init(cpu);
 }
 
 /*
- * Initialises the TSS structs: this should be called with paging enabled to
- * allow the use of the kernel heap at 0xC0000000 or whereever.
+ * Initialises the bootstrap processor's TSS: this should be called with paging
+ * enabled to allow the use of the kernel heap at 0xC0000000 or whereever.
  */
 void sys_init_tss() {
-	// Create the correct number of TSS descriptors
-	for(int i = 0; i < SYS_NUM_TSS; i++) {
-		// Initialise the TSS and zero it
-		i386_thread_state_t *tss = &sys_tss[i];
-		memclr(tss, sizeof(i386_thread_state_t));
-
-		// Set up kernel stack meepen
-		tss->iomap = (uint16_t) sizeof(i386_thread_state_t);
-		tss->ss0 = SYS_KERN_DATA_SEG;
-	
-		// Allocate a kernel stack
-		uint32_t* stack = (uint32_t *) kmalloc(SYS_KERN_STACK_SIZE);
+	sys_init_cpu_tss(0);
+}
 
-		// Stack grows downwards
-		tss->esp0 = ((uint32_t) stack) + SYS_KERN_STACK_SIZE;
-	}
+/*
+ * Initialises a processor's TSS with a fresh kernel stack, and loads the task
+ * register with it.
+ */
+void sys_init_cpu_tss(unsigned int cpu) {
+	// Initialise the TSS and zero it
+	i386_thread_state_t *tss = &sys_tss[cpu];
+	memclr(tss, sizeof(i386_thread_state_t));
+
+	// Set up kernel stack meepen
+	tss->iomap = (uint16_t) sizeof(i386_thread_state_t);
+	tss->ss0 = SYS_KERN_DATA_SEG;
+
+	// Allocate a kernel stack
+	uint32_t* stack = (uint32_t *) kmalloc(SYS_KERN_STACK_SIZE);
+
+	// Stack grows downwards
+	tss->esp0 = ((uint32_t) stack) + SYS_KERN_STACK_SIZE;
+	percpu_get(cpu)->kernel_stack_top = tss->esp0;
+
+	__asm__ volatile("ltr %w0" : : "r"(SYS_TSS_SEG));
+}
+
+/*
+ * Sets the stack this processor switches to when an interrupt is taken in user
+ * mode; each task has its own.
+ */
+void sys_set_tss_stack(uint32_t esp0) {
+	sys_tss[smp_cpu_id()].esp0 = esp0;
+	percpu_write(kernel_stack_top, esp0);
 }
 
-void sys_set_gdt_gate(uint16_t num, uint32_t base, uint32_t limit, uint8_t flags, uint8_t gran) {
-	gdt_entry_t *gdt = (gdt_entry_t *) &sys_gdt;
+/*
+ * Points this processor's TLS segment at base. User mode reloads GS on every
+ * return from the kernel, so the new base takes effect then.
+ */
+void sys_set_tls(uint32_t base) {
+	gdt_entry_t *gdt = (gdt_entry_t *) &sys_gdt[smp_cpu_id()];
+	unsigned int num = SYS_USER_TLS_SEG >> 3;
+
+	gdt[num].base_low = (base & 0xFFFF);
+	gdt[num].base_middle = (base >> 16) & 0xFF;
+	gdt[num].base_high = (base >> 24) & 0xFF;
+
+	percpu_write(tls_base, base);
+}
+
+void sys_set_gdt_gate(unsigned int cpu, uint16_t num, uint32_t base, uint32_t limit, uint8_t flags, uint8_t gran) {
+	gdt_entry_t *gdt = (gdt_entry_t *) &sys_gdt[cpu];
 	
 	gdt[num].base_low = (base & 0xFFFF);
 	gdt[num].base_middle = (base >> 16) & 0xFF;
@@ -348,7 +431,7 @@ void sys_install_gdt(void* location) {
 		uint32_t base;
 	} __attribute__((__packed__)) IDTR;
  
-	IDTR.length = (0x18 + (SYS_NUM_TSS * 0x08)) - 1;
+	IDTR.length = (sizeof(gdt_entry_t) * SYS_GDT_ENTRIES) - 1;
 	IDTR.base = (uint32_t) location;
 	__asm__ volatile("lgdt (%0)" : : "p"(&IDTR));
 	
@@ -408,7 +491,7 @@ uint64_t sys_rdtsc() {
 	// RDTSC copies contents of 64-bit TSC into EDX:EAX
 	__asm__ volatile("rdtsc" : "=a" (lo), "=d" (hi));
 
-	return (lo & 0xFFFFFFFF) | (hi << 0x20);
+	return ((uint64_t) hi << 0x20) | lo;
 }
 
 /*
@@ -435,8 +518,15 @@ void sys_write_MSR(uint32_t msr, uint32_t lo, uint32_t hi) {
 /*
  * IRQ handler for the system tick.
  */
-void sys_timer_tick_handler(void* context) {
+int sys_timer_tick_handler(void* context) {
 	sys_timer_ticks++;
+
+	// Without a one-shot timer, the tick drives timers and preemption
+	if(!timer_is_oneshot()) {
+		sched_timer_interrupt();
+	}
+
+	return IRQ_HANDLED;
 }
 
 /*
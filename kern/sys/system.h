@@ -21,9 +21,15 @@
 #define SYS_MSR_IA32_SYSENTER_ESP 0x175
 #define SYS_MSR_IA32_SYSENTER_EIP 0x176
 
-// We need 2 TSS per privilege level
-#define SYS_NUM_TSS_PER_PRIV 2
-#define SYS_NUM_TSS SYS_NUM_TSS_PER_PRIV*4
+// Each CPU has its own GDT, in which this selector is that CPU's TSS
+#define SYS_TSS_SEG 0x28
+// ...and this one the CPU's per-CPU data block, which GS is loaded with
+#define SYS_PERCPU_SEG 0x30
+// ...and this one a user data segment based at the running thread's TLS block
+#define SYS_USER_TLS_SEG 0x38
+
+// Null, kernel/user code and data, TSS, per-CPU data, and thread TLS
+#define SYS_GDT_ENTRIES 8
 
 #define	IRQ_0			0x20	// IRQ0 = PIT timer tick
 #define	IRQ_1			0x21	// IRQ1 = PS2 channel 1
@@ -103,8 +109,11 @@ void sys_set_idt_gate(uint8_t entry, uint32_t function, uint8_t segment, uint8_t
 void sys_setup_ints();
 bool sys_irq_enabled();
 
-void sys_set_gdt_gate(uint16_t num, uint32_t base, uint32_t limit, uint8_t flags, uint8_t gran);
+void sys_set_gdt_gate(unsigned int cpu, uint16_t num, uint32_t base, uint32_t limit, uint8_t flags, uint8_t gran);
 void sys_init_tss();
+void sys_init_cpu_tss(unsigned int cpu);
+void sys_set_tss_stack(uint32_t esp0);
+void sys_set_tls(uint32_t base);
 
 cpu_info_t* sys_get_cpu_info();
 
@@ -116,5 +125,8 @@ void sys_write_MSR(uint32_t msr, uint32_t lo, uint32_t hi);
 void sys_read_MSR(uint32_t msr, uint32_t *lo, uint32_t *hi);
 void sys_flush_cpu_caches(void);
 void sys_build_idt();
+void sys_install_idt();
 void sys_build_gdt();
-void sys_copy_multiboot();
\ No newline at end of file
+void sys_build_cpu_gdt(unsigned int cpu);
+void sys_copy_multiboot();
+char* sys_get_argument(char *key);
\ No newline at end of file
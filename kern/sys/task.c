@@ -2,10 +2,23 @@
 #include "task.h"
 #include "kheap.h"
 #include "system.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "clock.h"
+#include "uring.h"
+#include "vdso.h"
+#include "syscall_stats.h"
+#include "file.h"
+#include "shm.h"
+#include "io/debug_console.h"
+#include <errno.h>
 
 // Needed to set up the task
 static uint32_t next_pid;
 
+// Protects the task list, and the thread bookkeeping of process leaders
+static spinlock_t task_list_lock = SPINLOCK_INIT;
+
 // Used to speed up linked-list stuff
 static i386_task_t* task_first;
 static i386_task_t* task_last;
@@ -13,72 +26,105 @@ static i386_task_t* task_last;
 extern page_directory_t *kernel_directory;
 
 // External assembly routines
-void task_restore_context(i386_task_state_t*);
+void task_enter(void);
+
+static void task_bench_cmd(int argc, char **argv);
+
+static int task_cmd_init(void) {
+	debugcon_register("threadbench", "Compares thread and process creation ('threadbench [count]')", task_bench_cmd);
+	return 0;
+}
 
-uint8_t task_temp_fxsave_region[512] __attribute__((aligned(16)));
+module_init(task_cmd_init);
 
 /*
- * Saves the state of the task.
+ * Saves the FPU/SSE state of the outgoing task, and loads the incoming one's.
  */
-void task_save_state(i386_task_t* task, sched_trap_regs_t regs) {
-	// Back up the process' FPU/SSE state
-	i386_task_state_t *state = task->task_state;
+void task_switch_fpu(i386_task_t *prev, i386_task_t *next) {
+	__asm__ volatile("fxsave (%0); fxrstor (%1)" : : "r" (prev->fpu_state), "r" (next->fpu_state) : "memory");
+}
+
+/*
+ * Sets up a new task's kernel stack below stack, so that the first switch_to
+ * to the task returns into task_enter.
+ */
+static void task_init_kernel_stack(i386_task_t *task, uint32_t *stack) {
+	// Return address, and EBP, EBX, ESI and EDI popped by switch_to
+	*--stack = (uint32_t) task_enter;
+	stack -= 4;
+
+	task->kernel_esp = (uint32_t) stack;
+}
+
+/*
+ * Creates the page directory of a new process, which shares the kernel's page
+ * tables from 0xC0000000 up. The page-aligned directory's physical address is
+ * that of its tablesPhysical array, which is what CR3 is loaded with.
+ */
+static page_directory_t *task_new_directory(void) {
+	uint32_t directory_phys;
 
-	// If FPU state memory area is not allocated, allocate it
-	if(state->fpu_state == NULL) {
-		state->fpu_state = (void *) kmalloc(512);
+	page_directory_t *directory = (page_directory_t *) kmalloc_ap(sizeof(page_directory_t), &directory_phys);
+	ASSERT(directory != NULL);
+	memclr(directory, sizeof(page_directory_t));
+
+	// Set up 0xC0000000 and above to point to the kernel page tables (copy 0x100)
+	for(int i = 0x300; i < 0x400; i++) {
+		directory->tables[i] = kernel_directory->tables[i];
+		directory->tablesPhysical[i] = kernel_directory->tablesPhysical[i];
 	}
 
-	ASSERT(state->fpu_state != NULL);
+	directory->physicalAddr = directory_phys + offsetof(page_directory_t, tablesPhysical);
 
-	__asm__ volatile("fxsave %0; " : "=m" (task_temp_fxsave_region));
+	vdso_map(directory);
 
-	// Copy FPU state into the thread context table
-	memcpy(state->fpu_state, &task_temp_fxsave_region, 512);
+	return directory;
+}
 
-	// DS and CS are fixed for kernel/user
-	// state->ds = regs->ds;
-	// state->cs = regs->cs;
+/*
+ * Frees a process' page directory, along with its user page tables and any
+ * frames still mapped by them.
+ */
+static void task_free_directory(page_directory_t *directory) {
+	vdso_unmap(directory);
 
-	if(task->isKernel) {
-		state->cs = SYS_KERN_CODE_SEG;
-		state->ds = SYS_KERN_DATA_SEG;
-	} else {
-		state->cs = SYS_USER_CODE_SEG;
-		state->ds = SYS_USER_DATA_SEG;
-	}
+	for(int i = 0; i < 0x300; i++) {
+		page_table_t *table = directory->tables[i];
+
+		if(!table) {
+			continue;
+		}
 
-	// Copy registers
-	state->gs = regs.gs;
-	state->fs = regs.fs;
-	state->es = regs.es;
+		for(int j = 0; j < 1024; j++) {
+			// Shared frames belong to whatever mapped them here
+			if(table->pages[j].present && !table->pages[j].shared) {
+				free_frame(&table->pages[j]);
+			}
+		}
 
-	state->edi = regs.edi;
-	state->esi = regs.esi;
-	state->ebp = regs.ebp;
-	state->esp = regs.esp;
-	state->ebx = regs.ebx;
-	state->edx = regs.edx;
-	state->ecx = regs.ecx;
-	state->eax = regs.eax;
+		kfree(table);
+	}
 
-	state->eip = regs.eip;
-	state->eflags = regs.eflags;
-	state->useresp = regs.useresp;
-	state->ss = regs.ss;
+	kfree(directory);
 }
 
 /*
- * Performs a context switch to the specified task.
+ * Sets up the segments a task enters user mode with, and its kernel stack.
  */
-void task_switch(i386_task_t* task) {
+static void task_init_user(i386_task_t *task) {
 	i386_task_state_t *state = task->task_state;
 
-	// Copy backed-up FPU state to memory
-	memcpy(&task_temp_fxsave_region, state->fpu_state, 512);
+	// The task enters user mode with interrupts enabled
+	state->gs = state->fs = state->es = state->ds = SYS_USER_DATA_SEG | 3;
+	state->ss = SYS_USER_DATA_SEG | 3;
+	state->cs = SYS_USER_CODE_SEG | 3;
+	state->eflags = 0x202;
+
+	// Interrupts and syscalls taken in user mode run on the kernel stack
+	task->kernel_stack = (void *) kmalloc(SYS_KERN_STACK_SIZE);
+	ASSERT(task->kernel_stack != NULL);
 
-	// Restore CPU state
-	task_restore_context(state);
+	task_init_kernel_stack(task, (uint32_t *) ((uint32_t) task->kernel_stack + SYS_KERN_STACK_SIZE));
 }
 
 /*
@@ -93,6 +139,14 @@ i386_task_t* task_allocate(elf_file_t* binary) {
 	// Set up the task struct
 	memclr(task, sizeof(i386_task_t));
 
+	task->leader = task;
+	task->thread_slot = -1;
+	wait_queue_init(&task->exit_wq);
+	spin_lock_init(&task->files_lock);
+	mutex_init(&task->shm_lock);
+
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+
 	// If there is a previous task, set its next task to this
 	if(task_last) {
 		task_last->next = task;
@@ -108,43 +162,28 @@ i386_task_t* task_allocate(elf_file_t* binary) {
 	task_last = task;
 
 	task->pid = next_pid++;
+
+	spin_unlock_irqrestore(&task_list_lock, flags);
+
 	// Try to get memory for the state struct
 	i386_task_state_t *state = (i386_task_state_t*) kmalloc(sizeof(i386_task_state_t));
 	ASSERT(state != NULL);
 	task->task_state = state;
 	memclr(state, sizeof(i386_task_state_t));
 
-	// Set up the state struct
-	task->task_state->fpu_state = (void *) kmalloc(512);
-	memclr(task->task_state->fpu_state, 512);
+	// The FPU and SSE control words start out at their defaults
+	*((uint16_t *) task->fpu_state) = 0x037F;
+	*((uint32_t *) (task->fpu_state + 24)) = 0x1F80;
 
 	if(binary) {
 		// Set up page table
-		uint32_t directory_phys, directory_phys_phys;
-
-		page_directory_t *directory = (page_directory_t *) kmalloc_p(sizeof(page_directory_t), &directory_phys);
-		ASSERT(directory != NULL);
-		memclr(directory, sizeof(page_directory_t));
-
-		directory_phys_phys = directory_phys + (sizeof(page_table_t*) * 1024);
-
-		kprintf("Process page table at 0x%X virt 0x%X (0x%X) phys\n", directory, directory_phys, directory_phys_phys);
-
-		// Set up 0xC0000000 and above to point to the kernel page tables (copy 0x100)
-		for(int i = 0x300; i < 0x400; i++) {
-			directory->tables[i] = kernel_directory->tables[i];
-			directory->tablesPhysical[i] = kernel_directory->tablesPhysical[i];
-		}
-
-		// Switch to the process' pagetable so we can allocate frames
-		// __asm__ volatile("mov %0, %%cr3" : : "r"(directory_phys_phys));
-
-		// Switch back to kernel pagetable
-		paging_switch_directory(kernel_directory);
+		page_directory_t *directory = task_new_directory();
 
 		// Store page table pointers
 		state->page_directory = directory;
-		state->pagetable_phys = directory_phys;
+		state->pagetable_phys = directory->physicalAddr;
+
+		task_init_user(task);
 	} else { // The binary is NULL, so use kernel pagetables
 		task->task_state->page_directory = kernel_directory;
 		task->task_state->pagetable_phys = kernel_directory->physicalAddr;
@@ -156,10 +195,317 @@ i386_task_t* task_allocate(elf_file_t* binary) {
 	return task;
 }
 
+/*
+ * Creates a user thread in the process parent belongs to. It shares the
+ * process' page directory, so switching between its threads doesn't reload
+ * CR3, and gets a user stack of its own in the thread stack area, with its
+ * TLS block on top.
+ *
+ * The thread starts at entry with arg0 in EAX, arg1 in EDX, its ID in ECX, and
+ * the address of its TLS block in EBX and ESP; the C library's trampoline
+ * turns these into a call. Returns NULL if the process has too many threads
+ * or there's no memory for the stack. The thread must be started with
+ * sched_task_start.
+ */
+i386_task_t* task_create_thread(i386_task_t *parent, uint32_t entry, uint32_t arg0, uint32_t arg1) {
+	i386_task_t *leader = parent->leader;
+	int slot = -1;
+
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+
+	for(int i = 0; i < TASK_THREAD_MAX; i++) {
+		if(!(leader->thread_slots & (1 << i))) {
+			leader->thread_slots |= (1 << i);
+			leader->nr_threads++;
+
+			slot = i;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&task_list_lock, flags);
+
+	if(slot == -1) {
+		return NULL;
+	}
+
+	page_directory_t *directory = leader->task_state->page_directory;
+
+	/*
+	 * Map the stack, leaving the page below it unmapped as a guard. Frames
+	 * may still hold another process' data, so they're zeroed through the
+	 * physical window; frames outside it can't be, and aren't used.
+	 */
+	uint32_t stride = TASK_THREAD_STACK_SIZE + 0x1000;
+	uint32_t top = TASK_THREAD_STACK_AREA + ((slot + 1) * stride);
+	uint32_t base = top - TASK_THREAD_STACK_SIZE;
+	uint32_t addr;
+
+	for(addr = base; addr < top; addr += 0x1000) {
+		page_t *page = paging_get_page(addr, true, directory);
+
+		if(!alloc_frame_try(page, false, true)) {
+			break;
+		}
+
+		uint32_t phys = ((uint32_t) page->frame << 12) & 0xFFFFF000;
+
+		if(phys >= PAGING_PHYS_WINDOW_SIZE) {
+			free_frame(page);
+			memclr(page, sizeof(page_t));
+			break;
+		}
+
+		memclr((void *) (PAGING_PHYS_WINDOW_BASE + phys), 0x1000);
+	}
+
+	// Out of memory: nothing ran on the stack yet, so it can just be dropped
+	if(addr != top) {
+		for(uint32_t unmap = base; unmap < addr; unmap += 0x1000) {
+			page_t *page = paging_get_page(unmap, false, directory);
+
+			free_frame(page);
+			memclr(page, sizeof(page_t));
+		}
+
+		flags = spin_lock_irqsave(&task_list_lock);
+		leader->thread_slots &= ~(1 << slot);
+		leader->nr_threads--;
+		spin_unlock_irqrestore(&task_list_lock, flags);
+
+		return NULL;
+	}
+
+	rusage_rss_add(leader, TASK_THREAD_STACK_SIZE / 0x1000);
+
+	i386_task_t *task = task_allocate(NULL);
+	task->leader = leader;
+	task->thread_slot = slot;
+
+	strncpy(task->name, leader->name, sizeof(task->name) - 1);
+
+	i386_task_state_t *state = task->task_state;
+
+	state->page_directory = directory;
+	state->pagetable_phys = leader->task_state->pagetable_phys;
+
+	task->tls_base = top - TASK_THREAD_TLS_SIZE;
+
+	task_init_user(task);
+	state->gs = SYS_USER_TLS_SEG | 3;
+
+	state->eip = entry;
+	state->useresp = task->tls_base;
+	state->eax = arg0;
+	state->edx = arg1;
+	state->ecx = task->pid;
+	state->ebx = task->tls_base;
+
+	return task;
+}
+
+/*
+ * Unmaps a thread's user stack, and gives its slot back to the process. Other
+ * threads of the process may have touched the stack, and this processor may
+ * go on to run one of them without reloading CR3, so any TLB may still map
+ * it: the frames are only freed once every processor flushed the entries.
+ */
+static void task_thread_free_stack(i386_task_t *task) {
+	i386_task_t *leader = task->leader;
+	page_directory_t *directory = task->task_state->page_directory;
+
+	uint32_t stride = TASK_THREAD_STACK_SIZE + 0x1000;
+	uint32_t top = TASK_THREAD_STACK_AREA + ((task->thread_slot + 1) * stride);
+	uint32_t base = top - TASK_THREAD_STACK_SIZE;
+	uint32_t pages = TASK_THREAD_STACK_SIZE / 0x1000;
+
+	for(uint32_t addr = base; addr < top; addr += 0x1000) {
+		paging_get_page(addr, false, directory)->present = 0;
+	}
+
+	if(task_address_space_private(leader)) {
+		for(uint32_t addr = base; addr < top; addr += 0x1000) {
+			paging_flush_tlb(addr);
+		}
+	} else {
+		paging_shootdown(base, pages);
+	}
+
+	for(uint32_t addr = base; addr < top; addr += 0x1000) {
+		free_frame(paging_get_page(addr, false, directory));
+	}
+
+	rusage_rss_add(leader, -(int) pages);
+
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+	leader->thread_slots &= ~(1 << task->thread_slot);
+	spin_unlock_irqrestore(&task_list_lock, flags);
+}
+
+/*
+ * Ends the calling thread, handing value to whoever joins it. The thread's
+ * user stack is released right away; the task itself blocks forever, and is
+ * freed by the joiner. A process' main thread can't exit this way, so for it,
+ * this fails with -EINVAL.
+ */
+int task_thread_exit(uint32_t value) {
+	i386_task_t *task = sched_curr_task();
+
+	if(task == task->leader) {
+		return -EINVAL;
+	}
+
+	task_thread_free_stack(task);
+
+	// Once marked as blocking, waking the joiner can't make us miss anything
+	uint32_t flags = spin_lock_irqsave(&task->exit_wq.lock);
+
+	task->exit_value = value;
+	task->exited = true;
+
+	wait_queue_wake_all_locked(&task->exit_wq);
+	sched_prepare_block();
+
+	spin_unlock_irqrestore(&task->exit_wq.lock, flags);
+
+	while(1) {
+		sched_block();
+	}
+}
+
+/*
+ * Waits for the thread with the given ID, which must belong to the caller's
+ * process, to exit, stores the value it exited with in value, and frees it.
+ * Each thread can only be joined once.
+ */
+int task_thread_join(uint32_t tid, uint32_t *value) {
+	i386_task_t *self = sched_curr_task();
+	i386_task_t *task;
+
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+
+	for(task = task_first; task; task = task->next) {
+		if(task->pid == tid) {
+			break;
+		}
+	}
+
+	if(!task) {
+		spin_unlock_irqrestore(&task_list_lock, flags);
+		return -ENOTFOUND;
+	}
+
+	if(task == self || task == task->leader || task->leader != self->leader || task->joined) {
+		spin_unlock_irqrestore(&task_list_lock, flags);
+		return -EINVAL;
+	}
+
+	task->joined = true;
+	spin_unlock_irqrestore(&task_list_lock, flags);
+
+	flags = spin_lock_irqsave(&task->exit_wq.lock);
+
+	while(!task->exited) {
+		flags = wait_queue_sleep_locked(&task->exit_wq, flags);
+	}
+
+	spin_unlock_irqrestore(&task->exit_wq.lock, flags);
+
+	// It may still be switching away from its kernel stack
+	sched_task_t *info = task->scheduler_info;
+
+	while(info->on_cpu) {
+		sched_yield();
+	}
+
+	if(value) {
+		*value = task->exit_value;
+	}
+
+	task_deallocate(task);
+	return 0;
+}
+
+/*
+ * Work item freeing a kernel thread that exited, once no processor is still
+ * switching away from its stack.
+ */
+static void task_reap(void *context) {
+	i386_task_t *task = context;
+	sched_task_t *info = task->scheduler_info;
+
+	while(info->on_cpu) {
+		sched_yield();
+	}
+
+	task_deallocate(task);
+}
+
+/*
+ * Called when a kernel thread's entry point returns. The thread's stack can't
+ * be released while it's running on it, so it blocks forever, and a work item
+ * frees it.
+ */
+static void task_kernel_exit(void) {
+	i386_task_t *task = sched_curr_task();
+
+	work_init(&task->reap_work, task_reap, task);
+
+	sched_prepare_block();
+	work_queue(&task->reap_work);
+
+	while(1) {
+		sched_block();
+	}
+}
+
+/*
+ * Creates a kernel thread, which starts executing entry(context) on its own
+ * kernel stack with interrupts enabled once it's started.
+ *
+ * The stack is set up as if the thread was interrupted right before calling
+ * entry: on top is the IRET image that task_restore_context returns through,
+ * followed by the return address and argument of entry. Below that is the
+ * frame switch_to returns into task_enter with.
+ */
+i386_task_t* task_create_kernel(char *name, void (*entry)(void*), void *context) {
+	i386_task_t *task = task_allocate(NULL);
+	task->isKernel = true;
+	task->acct.in_kernel = true;
+
+	strncpy(task->name, name, sizeof(task->name) - 1);
+
+	task->kernel_stack = (void *) kmalloc(SYS_KERN_STACK_SIZE);
+	ASSERT(task->kernel_stack != NULL);
+
+	uint32_t *stack = (uint32_t *) ((uint32_t) task->kernel_stack + SYS_KERN_STACK_SIZE);
+
+	*--stack = (uint32_t) context;
+	*--stack = (uint32_t) task_kernel_exit;
+
+	// Space for the IRET image, filled in from the state when switching
+	stack -= 3;
+
+	i386_task_state_t *state = task->task_state;
+
+	state->fs = state->es = state->ds = SYS_KERN_DATA_SEG;
+	state->gs = SYS_PERCPU_SEG;
+	state->cs = SYS_KERN_CODE_SEG;
+	state->eip = (uint32_t) entry;
+	state->eflags = 0x202;
+	state->esp = (uint32_t) stack;
+
+	task_init_kernel_stack(task, stack);
+
+	return task;
+}
+
 /*
  * Deallocates the task.
  */
 void task_deallocate(i386_task_t* task) {
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+
 	i386_task_t *next = task->next;
 	i386_task_t *prev = task->prev;
 
@@ -181,15 +527,101 @@ void task_deallocate(i386_task_t* task) {
 		}
 	}
 
+	if(task_first == task) {
+		task_first = next;
+	}
+
+	if(task_last == task) {
+		task_last = prev;
+	}
+
+	// Keep the usage of threads around for their process
+	if(task->leader != task) {
+		task->leader->nr_threads--;
+		rusage_add_task(task, &task->leader->rusage_exited);
+	}
+
+	spin_unlock_irqrestore(&task_list_lock, flags);
+
 	// Notify scheduler that this task is removed
 	sched_task_deleted(task);
 
+	// Interval timers may post to the ring, so they go first
+	if(task->leader == task) {
+		file_close_all(task);
+		shm_unmap_all(task);
+	}
+
+	if(task->uring) {
+		uring_destroy(task->uring);
+	}
+
+	syscall_stats_task_free(task);
+
 	// Clean up memory.
-	kfree(task->task_state->fpu_state);
+	if(task->kernel_stack) {
+		kfree(task->kernel_stack);
+	}
+
+	// Threads share their process' directory, which goes away with it
+	page_directory_t *directory = task->task_state->page_directory;
+
+	if(task->leader == task && directory != kernel_directory) {
+		ASSERT(task->nr_threads == 0);
+		task_free_directory(directory);
+	}
+
 	kfree(task->task_state);
 	kfree(task);
 }
 
+/*
+ * Returns whether the task's address space is used by no other task: it's a
+ * process without threads or a ring poller. Its mappings can then be changed
+ * while it's blocked without invalidating other processors' TLBs, as it must
+ * reload CR3 to run again.
+ */
+bool task_address_space_private(i386_task_t *task) {
+	i386_task_t *leader = task->leader;
+
+	if(leader->task_state->page_directory == kernel_directory) {
+		return false;
+	}
+
+	return leader->nr_threads == 0 && !(leader->uring && leader->uring->poller);
+}
+
+/*
+ * Adds the resource usage of a process to out: that of its leader and live
+ * threads, and of the threads that were freed already. The task list must be
+ * locked, as it is while task_for_each calls back.
+ */
+void task_get_rusage_locked(i386_task_t *leader, rusage_t *out) {
+	for(i386_task_t *task = task_first; task; task = task->next) {
+		if(task->leader == leader) {
+			rusage_add_task(task, out);
+		}
+	}
+
+	rusage_t *exited = &leader->rusage_exited;
+
+	out->utime_ns += exited->utime_ns;
+	out->stime_ns += exited->stime_ns;
+	out->minflt += exited->minflt;
+	out->majflt += exited->majflt;
+	out->nvcsw += exited->nvcsw;
+	out->nivcsw += exited->nivcsw;
+	out->syscalls += exited->syscalls;
+	out->read_bytes += exited->read_bytes;
+	out->written_bytes += exited->written_bytes;
+}
+
+void task_get_rusage(i386_task_t *leader, rusage_t *out) {
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+	task_get_rusage_locked(leader, out);
+	spin_unlock_irqrestore(&task_list_lock, flags);
+}
+
 /*
  * Access to the linked list pointers
  */
@@ -199,4 +631,65 @@ i386_task_t* task_get_first() {
 
 i386_task_t* task_get_last() {
 	return task_last;
-}
\ No newline at end of file
+}
+
+/*
+ * Calls fn for every task, with the list locked so that none of them can be
+ * freed meanwhile. fn runs with interrupts disabled, so it mustn't block.
+ */
+void task_for_each(void (*fn)(i386_task_t *task, void *context), void *context) {
+	uint32_t flags = spin_lock_irqsave(&task_list_lock);
+
+	for(i386_task_t *task = task_first; task; task = task->next) {
+		fn(task, context);
+	}
+
+	spin_unlock_irqrestore(&task_list_lock, flags);
+}
+
+/*
+ * Debug console command: times creating and freeing processes, which get a
+ * page directory of their own, against threads sharing one process' directory.
+ * Neither is started, so no user code is needed.
+ */
+static void task_bench_cmd(int argc, char **argv) {
+	// task_allocate only checks whether there's a binary to set up a process
+	static elf_file_t bench_binary;
+	unsigned int count = 1000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		task_deallocate(task_allocate(&bench_binary));
+	}
+
+	uint64_t process_cycles = sys_rdtsc() - start;
+
+	i386_task_t *leader = task_allocate(&bench_binary);
+	start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		i386_task_t *thread = task_create_thread(leader, 0, 0, 0);
+
+		task_thread_free_stack(thread);
+		task_deallocate(thread);
+	}
+
+	uint64_t thread_cycles = sys_rdtsc() - start;
+	task_deallocate(leader);
+
+	uint32_t per_process = (uint32_t) mstd_div_u64(process_cycles, count, NULL);
+	uint32_t per_thread = (uint32_t) mstd_div_u64(thread_cycles, count, NULL);
+
+	kprintf("threadbench: %u of each, %u cycles per process, %u per thread", count, per_process, per_thread);
+
+	if(clock_get_source()->is_tsc) {
+		kprintf(" (%u ns, %u ns)", (uint32_t) clock_cycles_to_ns(per_process), (uint32_t) clock_cycles_to_ns(per_thread));
+	}
+
+	kprintf("\n");
+}
@@ -3,11 +3,34 @@
 
 #include <types.h>
 #include "sched.h"
+#include "sched_stats.h"
 #include "paging.h"
 #include "vm.h"
 #include "binfmt_elf.h"
-
-// Task's context information
+#include "workqueue.h"
+#include "waitqueue.h"
+#include "sync.h"
+#include "rusage.h"
+
+/*
+ * Threads of a process share its page directory. Each gets a user stack in the
+ * thread stack area, with an unmapped guard page below it; the top of the
+ * stack holds the thread's TLS block, which the TLS segment GS is loaded with
+ * points at.
+ */
+#define TASK_THREAD_STACK_AREA	0x70000000
+#define TASK_THREAD_STACK_SIZE	0x10000
+#define TASK_THREAD_TLS_SIZE	0x100
+#define TASK_THREAD_MAX			32
+
+// Size of a process' file table (file.h)
+#define TASK_MAX_FILES			32
+
+/*
+ * State a task is entered with the first time it runs. After that, a task's
+ * registers live on its kernel stack: the trap frame when it entered the
+ * kernel, and the callee-saved registers pushed by switch_to.
+ */
 typedef struct task_state {
 	// Manually backed up
 	uint32_t gs, fs, es, ds;
@@ -21,9 +44,6 @@ typedef struct task_state {
 	// Page table address (physical)
 	uint32_t pagetable_phys;
 
-	// FPU/SSE state memory (must be aligned to 16 byte boundary)
-	void *fpu_state; // FXSAVE/FXRSTOR
-
 	// Paging-specific stuff
 	page_directory_t *page_directory;
 } __attribute__((packed)) i386_task_state_t;
@@ -32,6 +52,8 @@ typedef struct task_state {
 typedef struct task {
 	// Task state structure
 	i386_task_state_t* task_state;
+	// Stack pointer saved by switch_to (switch_to depends on these offsets)
+	uint32_t kernel_esp;
 
 	// Miscellaneous task info
 	uint32_t pid;
@@ -39,11 +61,19 @@ typedef struct task {
 	uint32_t group;
 	bool isKernel;
 
+	// Bottom of the task's kernel stack; tasks made from a processor's boot
+	// context keep running on the stack they booted on, and have none
+	void *kernel_stack;
+
 	char name[128];
 
 	// Pointer to scheduler-specific data (kernel ptr)
 	void* scheduler_info;
 
+	// CPU accounting, and other resource usage
+	sched_acct_t acct;
+	task_rusage_t rusage;
+
 	// Event handling
 	bool isWaitingForEvent;
 	bool eventHasArrived; // If true, scheduler favours this
@@ -51,9 +81,50 @@ typedef struct task {
 	uint32_t eventCode;
 	uint32_t eventUsr;
 
+	// Frees the task once it exited (kernel threads)
+	work_t reap_work;
+
+	// Task owning the address space: itself, unless this is a thread
+	struct task *leader;
+	// Leaders: stack slots in use by threads, and how many threads exist
+	uint32_t thread_slots;
+	unsigned int nr_threads;
+
+	// Threads: stack slot, and base of the TLS segment (0 for none)
+	int thread_slot;
+	uint32_t tls_base;
+
+	// Threads: set when the thread exited, which joiners wait for
+	volatile bool exited;
+	bool joined;
+	uint32_t exit_value;
+	wait_queue_t exit_wq;
+
+	// Leaders: usage of threads that were freed already, and user pages
+	// mapped into the process (rusage.h)
+	rusage_t rusage_exited;
+	volatile uint32_t rss_pages, maxrss_pages;
+
+	// Leaders: submission and completion rings (uring.h)
+	struct uring *uring;
+
+	// Syscall statistics, indexed by number; allocated on first use (syscall_stats.h)
+	struct syscall_stats *syscall_stats;
+
+	// Leaders: open files, indexed by descriptor (file.h)
+	struct file *files[TASK_MAX_FILES];
+	spinlock_t files_lock;
+
+	// Leaders: shared memory mappings (shm.h), changed with shm_lock held
+	struct shm_mapping *shm_maps;
+	mutex_t shm_lock;
+
 	// Linked list
 	struct task* prev;
 	struct task* next;
+
+	// FPU/SSE state (FXSAVE/FXRSTOR); tasks are page aligned, so this is too
+	uint8_t fpu_state[512] __attribute__((aligned(16)));
 } i386_task_t;
 
 // Struct passed to the task's specified entry point
@@ -64,17 +135,33 @@ typedef struct task_entry_info {
 	int num_arguments;
 } task_entry_info_t;
 
-// Saves the state of the task in an interrupt/syscall handler
-void task_save_state(i386_task_t*, sched_trap_regs_t);
-// Switches to the specified task
-void task_switch(i386_task_t*);
+// Switches stacks and address spaces to next; returns the previous task (sched.S)
+i386_task_t* switch_to(i386_task_t *prev, i386_task_t *next);
+// Saves the FPU/SSE state of prev and loads that of next
+void task_switch_fpu(i386_task_t *prev, i386_task_t *next);
 
 // Creation/destruction of tasks
 i386_task_t* task_allocate(elf_file_t*);
 void task_deallocate(i386_task_t*);
 
+// Creates a kernel thread that runs entry(context); it must be started with sched_task_start
+i386_task_t* task_create_kernel(char *name, void (*entry)(void*), void *context);
+
+// User threads sharing the address space of parent's process
+i386_task_t* task_create_thread(i386_task_t *parent, uint32_t entry, uint32_t arg0, uint32_t arg1);
+int task_thread_exit(uint32_t value);
+int task_thread_join(uint32_t tid, uint32_t *value);
+
+// Whether no other task can be running in the task's address space
+bool task_address_space_private(i386_task_t *task);
+
+// Adds the resource usage of a process, with all of its threads, to out
+void task_get_rusage(i386_task_t *leader, rusage_t *out);
+void task_get_rusage_locked(i386_task_t *leader, rusage_t *out);
+
 // Access to the linked list
 i386_task_t* task_get_first();
 i386_task_t* task_get_last();
+void task_for_each(void (*fn)(i386_task_t *task, void *context), void *context);
 
 #endif
\ No newline at end of file
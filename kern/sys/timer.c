@@ -0,0 +1,230 @@
+#include <types.h>
+#include "timer.h"
+#include "clock.h"
+#include "system.h"
+#include "spinlock.h"
+#include "sched.h"
+
+#define TIMER_SLOT(x) (((x) >> TIMER_WHEEL_SHIFT) & (TIMER_WHEEL_SLOTS - 1))
+
+// Heads of the lists of timers in each slot
+static ktimer_t *timer_wheel[TIMER_WHEEL_SLOTS];
+
+// Time up to which the wheel has been processed
+static uint64_t timer_wheel_time;
+
+// Cached earliest deadline; recalculated when dirty
+static uint64_t timer_next;
+static bool timer_next_dirty;
+static uint32_t timer_num_pending;
+
+// Protects the wheel, as any processor may add or cancel timers
+static spinlock_t timer_lock = SPINLOCK_INIT;
+
+// Function to program the one-shot event device with
+static void (*timer_oneshot_program)(uint64_t);
+
+static void timer_unlink(ktimer_t *timer);
+
+/*
+ * Initialises the timer wheel.
+ */
+void timer_init(void) {
+	memclr(&timer_wheel, sizeof(timer_wheel));
+
+	timer_wheel_time = ktime_get_ns();
+	timer_next = TIMER_NO_DEADLINE;
+	timer_next_dirty = false;
+}
+
+/*
+ * Arms a timer to call callback with context once ktime_get_ns() reaches
+ * expires. Re-adding a pending timer moves it to the new expiry time.
+ */
+void timer_add(ktimer_t *timer, uint64_t expires, timer_callback_t callback, void *context) {
+	uint32_t flags = spin_lock_irqsave(&timer_lock);
+
+	if(timer->pending) {
+		timer_unlink(timer);
+	}
+
+	timer->expires = expires;
+	timer->callback = callback;
+	timer->context = context;
+
+	// Insert at the head of the slot
+	ktimer_t **slot = &timer_wheel[TIMER_SLOT(expires)];
+
+	timer->prev = NULL;
+	timer->next = *slot;
+
+	if(*slot) {
+		(*slot)->prev = timer;
+	}
+
+	*slot = timer;
+
+	timer->pending = true;
+	timer_num_pending++;
+
+	if(expires < timer_next) {
+		timer_next = expires;
+	}
+
+	spin_unlock_irqrestore(&timer_lock, flags);
+
+	// Make sure the one-shot timer fires in time for it
+	sched_timer_added(expires);
+}
+
+/*
+ * Disarms a timer. Returns true if it was pending.
+ */
+bool timer_cancel(ktimer_t *timer) {
+	uint32_t flags = spin_lock_irqsave(&timer_lock);
+
+	bool pending = timer->pending;
+
+	if(pending) {
+		timer_unlink(timer);
+	}
+
+	spin_unlock_irqrestore(&timer_lock, flags);
+
+	return pending;
+}
+
+/*
+ * Fires all timers that expired before now. This is called from the timer
+ * softirq, so callbacks run with interrupts enabled.
+ *
+ * Callbacks run without the wheel locked, so they may re-arm timers; the slot
+ * is scanned again afterwards, as it may have changed in the meantime.
+ */
+void timer_run(uint64_t now) {
+	// Walk every slot between the last run and now, at most one revolution
+	uint64_t slot_time = timer_wheel_time & ~((1ULL << TIMER_WHEEL_SHIFT) - 1);
+	uint32_t slots = 0;
+
+	uint32_t flags = spin_lock_irqsave(&timer_lock);
+
+	while(slots < TIMER_WHEEL_SLOTS) {
+		ktimer_t *timer = timer_wheel[TIMER_SLOT(slot_time)];
+
+		while(timer) {
+			if(timer->expires <= now) {
+				timer_unlink(timer);
+
+				spin_unlock_irqrestore(&timer_lock, flags);
+				timer->callback(timer->context);
+				flags = spin_lock_irqsave(&timer_lock);
+
+				timer = timer_wheel[TIMER_SLOT(slot_time)];
+				continue;
+			}
+
+			timer = timer->next;
+		}
+
+		// Stop once the slot containing now has been processed
+		if(slot_time + (1 << TIMER_WHEEL_SHIFT) > now) {
+			break;
+		}
+
+		slot_time += (1 << TIMER_WHEEL_SHIFT);
+		slots++;
+	}
+
+	timer_wheel_time = now;
+
+	spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * Returns the expiry time of the earliest pending timer, or TIMER_NO_DEADLINE.
+ */
+uint64_t timer_next_deadline(void) {
+	if(!timer_next_dirty) {
+		return timer_next;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&timer_lock);
+
+	uint64_t next = TIMER_NO_DEADLINE;
+
+	if(timer_num_pending) {
+		// Slots are only hashes of the expiry time, so every one must be checked
+		for(int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+			for(ktimer_t *timer = timer_wheel[i]; timer; timer = timer->next) {
+				if(timer->expires < next) {
+					next = timer->expires;
+				}
+			}
+		}
+	}
+
+	timer_next = next;
+	timer_next_dirty = false;
+
+	spin_unlock_irqrestore(&timer_lock, flags);
+
+	return next;
+}
+
+/*
+ * Registers a one-shot event device. program is called with the number of
+ * nanoseconds from now the device should next interrupt.
+ */
+void timer_register_oneshot(void (*program)(uint64_t)) {
+	timer_oneshot_program = program;
+}
+
+/*
+ * Returns true if a one-shot event device is in use; otherwise, the PIT
+ * drives the timers periodically.
+ */
+bool timer_is_oneshot(void) {
+	return (timer_oneshot_program != NULL);
+}
+
+/*
+ * Programs the one-shot event device to fire at the given deadline.
+ */
+void timer_program(uint64_t deadline, uint64_t now) {
+	if(!timer_oneshot_program) {
+		return;
+	}
+
+	uint64_t delta = (deadline > now) ? (deadline - now) : 0;
+
+	if(delta > TIMER_MAX_ONESHOT_NS) {
+		delta = TIMER_MAX_ONESHOT_NS;
+	}
+
+	timer_oneshot_program(delta);
+}
+
+/*
+ * Removes a timer from its slot.
+ */
+static void timer_unlink(ktimer_t *timer) {
+	if(timer->prev) {
+		timer->prev->next = timer->next;
+	} else {
+		timer_wheel[TIMER_SLOT(timer->expires)] = timer->next;
+	}
+
+	if(timer->next) {
+		timer->next->prev = timer->prev;
+	}
+
+	timer->prev = timer->next = NULL;
+	timer->pending = false;
+
+	timer_num_pending--;
+
+	// The cached deadline may have been this timer
+	if(timer->expires <= timer_next) {
+		timer_next_dirty = true;
+	}
+}
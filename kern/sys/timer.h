@@ -0,0 +1,50 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <types.h>
+
+/*
+ * Kernel timers are kept in a hashed timer wheel: each slot covers 2^20 ns
+ * (~1ms) of time, and a timer is hashed into a slot by its expiry time. Timers
+ * more than one revolution in the future simply stay in their slot until the
+ * wheel comes around to them again.
+ */
+#define TIMER_WHEEL_SLOTS 256
+#define TIMER_WHEEL_SHIFT 20
+
+// Returned by timer_next_deadline if no timers are pending
+#define TIMER_NO_DEADLINE 0xFFFFFFFFFFFFFFFFULL
+
+// Longest single interval the one-shot timer is programmed for
+#define TIMER_MAX_ONESHOT_NS 1000000000ULL
+
+typedef void (*timer_callback_t)(void*);
+
+typedef struct ktimer {
+	// Absolute expiry time, in ktime nanoseconds
+	uint64_t expires;
+
+	timer_callback_t callback;
+	void *context;
+
+	bool pending;
+
+	// Linkage in the wheel slot
+	struct ktimer *prev;
+	struct ktimer *next;
+} ktimer_t;
+
+void timer_init(void);
+
+void timer_add(ktimer_t *timer, uint64_t expires, timer_callback_t callback, void *context);
+bool timer_cancel(ktimer_t *timer);
+
+void timer_run(uint64_t now);
+uint64_t timer_next_deadline(void);
+
+// One-shot event device, such as the local APIC timer
+void timer_register_oneshot(void (*program)(uint64_t delta_ns));
+bool timer_is_oneshot(void);
+void timer_program(uint64_t deadline, uint64_t now);
+
+#endif
@@ -0,0 +1,127 @@
+#include <types.h>
+#include "uaccess.h"
+#include "paging.h"
+#include <errno.h>
+
+// Bounds of the fixup table (kern.ld)
+extern uaccess_fixup_t __kern_fixup_start[];
+extern uaccess_fixup_t __kern_fixup_end[];
+
+// Assembly routines
+uint32_t uaccess_copy(void *to, const void *from, size_t n);
+int uaccess_strncpy(char *to, const char *from, size_t n);
+
+/*
+ * Copies n bytes from user space. Returns 0, or -EFAULT if the range isn't in
+ * user space, or part of it isn't mapped.
+ */
+int copy_from_user(void *to, const void *from, size_t n) {
+	if(!access_ok(from, n)) {
+		return -EFAULT;
+	}
+
+	return uaccess_copy(to, from, n) ? -EFAULT : 0;
+}
+
+/*
+ * Copies n bytes to user space. Returns 0, or -EFAULT if the range isn't in
+ * user space, or part of it isn't mapped.
+ */
+int copy_to_user(void *to, const void *from, size_t n) {
+	if(!access_ok(to, n)) {
+		return -EFAULT;
+	}
+
+	return uaccess_copy(to, from, n) ? -EFAULT : 0;
+}
+
+/*
+ * Returns the kernel address for an address in the given directory, or the
+ * address itself if the directory is NULL.
+ */
+static inline void *copy_between_addr(page_directory_t *dir, uint32_t addr, bool write) {
+	return dir ? paging_user_kernel_addr(dir, addr, write) : (void *) addr;
+}
+
+/*
+ * Copies n bytes from one address space to another, either of which may be a
+ * process that isn't running, going through the kernel's mapping of physical
+ * memory a page at a time. A NULL directory stands for kernel memory. Pages
+ * are looked up rather than touched, so this never faults; returns 0, or
+ * -EFAULT if a user page isn't mapped with the access needed.
+ *
+ * The pages must not be unmapped while this runs; typically, the task they
+ * belong to is blocked waiting for the copy.
+ */
+int copy_between(page_directory_t *to_dir, uint32_t to, page_directory_t *from_dir, uint32_t from, size_t n) {
+	if((to_dir && !access_ok((void *) to, n)) || (from_dir && !access_ok((void *) from, n))) {
+		return -EFAULT;
+	}
+
+	while(n) {
+		uint32_t chunk = n;
+
+		if(to_dir && chunk > 0x1000 - (to & 0xFFF)) {
+			chunk = 0x1000 - (to & 0xFFF);
+		}
+
+		if(from_dir && chunk > 0x1000 - (from & 0xFFF)) {
+			chunk = 0x1000 - (from & 0xFFF);
+		}
+
+		void *dst = copy_between_addr(to_dir, to, true);
+		void *src = copy_between_addr(from_dir, from, false);
+
+		if(!dst || !src) {
+			return -EFAULT;
+		}
+
+		memcpy(dst, src, chunk);
+
+		to += chunk;
+		from += chunk;
+		n -= chunk;
+	}
+
+	return 0;
+}
+
+/*
+ * Copies a string of at most n bytes (including the terminator) from user
+ * space. Returns the length of the string, or n if it's longer than that, in
+ * which case to isn't terminated. If the string runs into unmapped memory or
+ * the kernel's half of the address space, -EFAULT is returned.
+ */
+int strncpy_from_user(char *to, const char *from, size_t n) {
+	uint32_t start = (uint32_t) from;
+
+	if(start >= UACCESS_USER_END) {
+		return -EFAULT;
+	}
+
+	// Stop at the end of user space; only fault if the string goes on
+	size_t max = UACCESS_USER_END - start;
+	int ret = uaccess_strncpy(to, from, (n < max) ? n : max);
+
+	if(ret < 0 || (n > max && (size_t) ret == max)) {
+		return -EFAULT;
+	}
+
+	return ret;
+}
+
+/*
+ * Called by the page fault handler for faults in kernel mode. If the faulting
+ * instruction is one that accesses user memory, eip is changed to point to its
+ * fixup, and true is returned. The table only has a handful of entries.
+ */
+bool uaccess_fixup(uint32_t *eip) {
+	for(uaccess_fixup_t *entry = __kern_fixup_start; entry < __kern_fixup_end; entry++) {
+		if(entry->insn == *eip) {
+			*eip = entry->fixup;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,42 @@
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include <types.h>
+
+// User space ends where the kernel's half of every address space starts
+#define UACCESS_USER_END 0xC0000000
+
+/*
+ * Instructions that access user memory have an entry in the fixup table: if
+ * one of them faults, the page fault handler resumes at its fixup instead.
+ * Entries are emitted by the assembly routines that access user memory into
+ * the __fixup_table section.
+ */
+typedef struct uaccess_fixup {
+	uint32_t insn;
+	uint32_t fixup;
+} uaccess_fixup_t;
+
+/*
+ * Returns whether the len bytes at addr lie entirely in user space.
+ */
+static inline bool access_ok(const void *addr, size_t len) {
+	uint32_t start = (uint32_t) addr;
+	return len <= UACCESS_USER_END && start <= UACCESS_USER_END - len;
+}
+
+// Copies between kernel and user memory; return 0, or -EFAULT
+int copy_from_user(void *to, const void *from, size_t n);
+int copy_to_user(void *to, const void *from, size_t n);
+
+// Copies between address spaces that need not be current; NULL is the kernel
+struct page_directory;
+int copy_between(struct page_directory *to_dir, uint32_t to, struct page_directory *from_dir, uint32_t from, size_t n);
+
+// Returns the length of the string copied (n if it didn't fit), or -EFAULT
+int strncpy_from_user(char *to, const char *from, size_t n);
+
+// Page fault handler: points eip at a fixup, if the instruction has one
+bool uaccess_fixup(uint32_t *eip);
+
+#endif
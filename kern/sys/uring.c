@@ -0,0 +1,719 @@
+#include <types.h>
+#include <errno.h>
+#include "uring.h"
+#include "task.h"
+#include "sched.h"
+#include "kheap.h"
+#include "paging.h"
+#include "clock.h"
+#include "uaccess.h"
+#include "syscall.h"
+#include "system.h"
+#include "file.h"
+#include "pipe.h"
+#include "fs/vfs.h"
+#include "io/console.h"
+#include "io/debug_console.h"
+
+// Longest mount point and path file operations accept
+#define URING_MAX_MOUNT 64
+#define URING_MAX_PATH 256
+
+extern page_directory_t *kernel_directory;
+
+static void uring_bench_cmd(int argc, char **argv);
+
+static int uring_cmd_init(void) {
+	debugcon_register("uringbench", "Compares batched ring submissions to syscalls ('uringbench [count] [batch]')", uring_bench_cmd);
+	return 0;
+}
+
+module_init(uring_cmd_init);
+
+/*
+ * Allocates rings for owner, without mapping them into its address space.
+ * Returns NULL if there's no memory for them.
+ */
+uring_t *uring_alloc(struct task *owner) {
+	uring_t *ring = (uring_t *) kmalloc(sizeof(uring_t));
+
+	if(!ring) {
+		return NULL;
+	}
+
+	memclr(ring, sizeof(uring_t));
+
+	ring->shared = (uring_shared_t *) kmalloc_a(sizeof(uring_shared_t));
+
+	if(!ring->shared) {
+		kfree(ring);
+		return NULL;
+	}
+
+	memclr(ring->shared, sizeof(uring_shared_t));
+
+	ring->owner = owner;
+
+	mutex_init(&ring->sq_lock);
+	wait_queue_init(&ring->cq_wq);
+	wait_queue_init(&ring->sq_wq);
+
+	return ring;
+}
+
+/*
+ * Adds a completion; the completion ring must be locked. If user space hasn't
+ * made room for it, it's dropped and counted instead.
+ */
+static void uring_complete_locked(uring_t *ring, uint32_t user_data, int32_t res) {
+	uring_shared_t *shared = ring->shared;
+	uint32_t tail = shared->cq_tail;
+
+	if(tail - shared->cq_head >= URING_CQ_ENTRIES) {
+		shared->cq_overflow++;
+		return;
+	}
+
+	shared->cqes[tail & (URING_CQ_ENTRIES - 1)].user_data = user_data;
+	shared->cqes[tail & (URING_CQ_ENTRIES - 1)].res = res;
+
+	// The entry must be visible before the new tail is
+	__asm__ volatile("" : : : "memory");
+	shared->cq_tail = tail + 1;
+
+	wait_queue_wake_all_locked(&ring->cq_wq);
+}
+
+/*
+ * Adds a completion. Besides submissions, interval timers complete this way.
+ */
+void uring_complete(uring_t *ring, uint32_t user_data, int32_t res) {
+	uint32_t flags = spin_lock_irqsave(&ring->cq_wq.lock);
+	uring_complete_locked(ring, user_data, res);
+	spin_unlock_irqrestore(&ring->cq_wq.lock, flags);
+}
+
+/*
+ * Timer callback of a timeout: completes it, and frees it.
+ */
+static void uring_timeout_fired(void *context) {
+	uring_timeout_t *timeout = context;
+	uring_t *ring = timeout->ring;
+
+	uint32_t flags = spin_lock_irqsave(&ring->cq_wq.lock);
+
+	if(timeout->prev) {
+		timeout->prev->next = timeout->next;
+	} else {
+		ring->timeouts = timeout->next;
+	}
+
+	if(timeout->next) {
+		timeout->next->prev = timeout->prev;
+	}
+
+	ring->nr_timeouts--;
+	uring_complete_locked(ring, timeout->user_data, -ETIMEDOUT);
+
+	// Once unlinked, uring_destroy doesn't wait for this timeout anymore
+	spin_unlock_irqrestore(&ring->cq_wq.lock, flags);
+
+	kfree(timeout);
+}
+
+/*
+ * Writes a user buffer to the console.
+ */
+static int uring_op_console_write(uring_sqe_t *sqe) {
+	char buffer[64];
+	uint32_t done = 0;
+
+	while(done < sqe->len) {
+		uint32_t chunk = sqe->len - done;
+		chunk = (chunk > sizeof(buffer)) ? sizeof(buffer) : chunk;
+
+		if(copy_from_user(buffer, (void *) (sqe->addr + done), chunk)) {
+			return done ? (int) done : -EFAULT;
+		}
+
+		for(uint32_t i = 0; i < chunk; i++) {
+			console_putc(buffer[i]);
+		}
+
+		done += chunk;
+	}
+
+	return done;
+}
+
+/*
+ * Reads or writes a file through the VFS, using a kernel buffer, since the
+ * filesystem drivers can't handle faults.
+ */
+static int uring_op_vfs(uring_sqe_t *sqe, bool write) {
+	char mount[URING_MAX_MOUNT], path[URING_MAX_PATH];
+	int ret;
+
+	if(sqe->len > URING_MAX_IO) {
+		return -EINVAL;
+	}
+
+	if((ret = strncpy_from_user(mount, (char *) sqe->mount, sizeof(mount))) < 0) {
+		return ret;
+	} else if(ret == sizeof(mount)) {
+		return -EINVAL;
+	}
+
+	if((ret = strncpy_from_user(path, (char *) sqe->path, sizeof(path))) < 0) {
+		return ret;
+	} else if(ret == sizeof(path)) {
+		return -EINVAL;
+	}
+
+	void *buffer = (void *) kmalloc(sqe->len);
+
+	if(!buffer) {
+		return -ENOMEM;
+	}
+
+	if(write) {
+		if(!(ret = copy_from_user(buffer, (void *) sqe->addr, sqe->len))) {
+			ret = vfs_write(mount, path, buffer, sqe->len);
+		}
+	} else {
+		if(!(ret = vfs_read(mount, path, buffer, sqe->len))) {
+			ret = copy_to_user((void *) sqe->addr, buffer, sqe->len);
+		}
+	}
+
+	kfree(buffer);
+
+	return ret ? ret : (int) sqe->len;
+}
+
+/*
+ * Writes a user buffer to one of the owning process' file descriptors.
+ */
+static int uring_op_write(uring_t *ring, uring_sqe_t *sqe) {
+	file_t *file = file_lookup_in(ring->owner->leader, sqe->fd);
+
+	if(!file) {
+		return -EBADF;
+	}
+
+	int ret = file_write(file, (void *) sqe->addr, sqe->len, 0);
+	file_put(file);
+
+	return ret;
+}
+
+/*
+ * Arms a timeout, which completes once it expires, or right away with -ENOMEM
+ * if it can't be, or -EBUSY if the ring has too many pending already.
+ */
+static void uring_op_timeout(uring_t *ring, uring_sqe_t *sqe) {
+	uring_timeout_t *timeout = (uring_timeout_t *) kmalloc(sizeof(uring_timeout_t));
+
+	if(!timeout) {
+		uring_complete(ring, sqe->user_data, -ENOMEM);
+		return;
+	}
+
+	// timer_add looks at whether the timer is pending already
+	memclr(timeout, sizeof(uring_timeout_t));
+
+	timeout->ring = ring;
+	timeout->user_data = sqe->user_data;
+
+	// Timeouts too far out to be represented never expire
+	uint64_t now = ktime_get_ns();
+	uint64_t expires = TIMER_NO_DEADLINE - 1;
+
+	if(sqe->timeout_ns < expires - now) {
+		expires = now + sqe->timeout_ns;
+	}
+
+	uint32_t flags = spin_lock_irqsave(&ring->cq_wq.lock);
+
+	if(ring->nr_timeouts >= URING_MAX_TIMEOUTS) {
+		uring_complete_locked(ring, sqe->user_data, -EBUSY);
+		spin_unlock_irqrestore(&ring->cq_wq.lock, flags);
+
+		kfree(timeout);
+		return;
+	}
+
+	ring->nr_timeouts++;
+	timeout->next = ring->timeouts;
+
+	if(ring->timeouts) {
+		ring->timeouts->prev = timeout;
+	}
+
+	ring->timeouts = timeout;
+
+	// The callback takes the lock, so it can't run before this is linked
+	timer_add(&timeout->timer, expires, uring_timeout_fired, timeout);
+
+	spin_unlock_irqrestore(&ring->cq_wq.lock, flags);
+}
+
+/*
+ * Consumes all entries in the submission ring, carrying them out in order.
+ * Must run in the owning process' address space. Returns the number of
+ * entries consumed.
+ */
+unsigned int uring_submit(uring_t *ring) {
+	uring_shared_t *shared = ring->shared;
+	unsigned int count = 0;
+
+	mutex_lock(&ring->sq_lock);
+
+	uint32_t head = shared->sq_head;
+	uint32_t tail = shared->sq_tail;
+	__asm__ volatile("" : : : "memory");
+
+	// A tail that's too far ahead is bogus; don't run stale entries
+	if(tail - head > URING_SQ_ENTRIES) {
+		tail = head + URING_SQ_ENTRIES;
+	}
+
+	while(head != tail) {
+		// User space may still scribble over the entry, so work on a copy
+		uring_sqe_t sqe = shared->sqes[head & (URING_SQ_ENTRIES - 1)];
+		head++;
+
+		switch(sqe.opcode) {
+			case URING_OP_NOP:
+				uring_complete(ring, sqe.user_data, 0);
+				break;
+
+			case URING_OP_CONSOLE_WRITE:
+				uring_complete(ring, sqe.user_data, uring_op_console_write(&sqe));
+				break;
+
+			case URING_OP_VFS_READ:
+			case URING_OP_VFS_WRITE:
+				uring_complete(ring, sqe.user_data, uring_op_vfs(&sqe, sqe.opcode == URING_OP_VFS_WRITE));
+				break;
+
+			case URING_OP_TIMEOUT:
+				uring_op_timeout(ring, &sqe);
+				break;
+
+			case URING_OP_WRITE:
+				uring_complete(ring, sqe.user_data, uring_op_write(ring, &sqe));
+				break;
+
+			default:
+				uring_complete(ring, sqe.user_data, -EINVAL);
+				break;
+		}
+
+		count++;
+	}
+
+	shared->sq_head = head;
+	ring->submitted += count;
+
+	mutex_unlock(&ring->sq_lock);
+
+	return count;
+}
+
+/*
+ * Polling thread: consumes submissions as they come in, running in the owning
+ * process' address space. After the ring has been idle for a while, it sets
+ * URING_SQ_NEED_WAKEUP and sleeps until user space wakes it up through
+ * uring_enter.
+ */
+static void uring_poll_thread(void *context) {
+	uring_t *ring = context;
+	uring_shared_t *shared = ring->shared;
+	uint64_t idle_since = ktime_get_ns();
+
+	while(!ring->stopping) {
+		if(uring_submit(ring)) {
+			idle_since = ktime_get_ns();
+			continue;
+		}
+
+		if(ktime_get_ns() - idle_since < URING_SQPOLL_IDLE_NS) {
+			sched_yield();
+			continue;
+		}
+
+		uint32_t flags = spin_lock_irqsave(&ring->sq_wq.lock);
+
+		// User space checks the flag after advancing the tail, and this
+		// checks the tail after setting the flag, so one sees the other
+		shared->flags |= URING_SQ_NEED_WAKEUP;
+		__sync_synchronize();
+
+		while(!ring->stopping && shared->sq_head == shared->sq_tail) {
+			flags = wait_queue_sleep_locked(&ring->sq_wq, flags);
+		}
+
+		shared->flags &= ~URING_SQ_NEED_WAKEUP;
+		spin_unlock_irqrestore(&ring->sq_wq.lock, flags);
+
+		idle_since = ktime_get_ns();
+	}
+
+	// Go back to the kernel's address space, so freeing this thread leaves the process' alone
+	i386_task_t *self = sched_curr_task();
+	self->task_state->page_directory = kernel_directory;
+	self->task_state->pagetable_phys = kernel_directory->physicalAddr;
+
+	__asm__ volatile("mov %0, %%cr3" : : "r" (kernel_directory->physicalAddr) : "memory");
+
+	ring->poller_exited = true;
+}
+
+/*
+ * Stops the polling thread, cancels pending timeouts, unmaps the rings from
+ * the process, and frees them.
+ */
+void uring_destroy(uring_t *ring) {
+	if(ring->poller) {
+		ring->stopping = true;
+		wait_queue_wake_all(&ring->sq_wq);
+
+		while(!ring->poller_exited) {
+			sched_yield();
+		}
+	}
+
+	uint32_t flags = spin_lock_irqsave(&ring->cq_wq.lock);
+
+	for(uring_timeout_t *timeout = ring->timeouts; timeout; ) {
+		uring_timeout_t *next = timeout->next;
+
+		if(timer_cancel(&timeout->timer)) {
+			if(timeout->prev) {
+				timeout->prev->next = next;
+			} else {
+				ring->timeouts = next;
+			}
+
+			if(next) {
+				next->prev = timeout->prev;
+			}
+
+			ring->nr_timeouts--;
+			kfree(timeout);
+		}
+
+		timeout = next;
+	}
+
+	// Timeouts that already fired unlink themselves
+	while(ring->timeouts) {
+		spin_unlock_irqrestore(&ring->cq_wq.lock, flags);
+		sched_yield();
+		flags = spin_lock_irqsave(&ring->cq_wq.lock);
+	}
+
+	spin_unlock_irqrestore(&ring->cq_wq.lock, flags);
+
+	// The frames belong to the kernel heap, so the directory mustn't free them
+	if(ring->user_addr) {
+		i386_task_t *owner = ring->owner;
+		page_directory_t *directory = owner->task_state->page_directory;
+
+		for(uint32_t i = 0; i < URING_PAGES; i++) {
+			page_t *page = paging_get_page(ring->user_addr + (i * 0x1000), false, directory);
+
+			page->present = 0;
+			page->frame = 0;
+		}
+	}
+
+	kfree(ring->shared);
+	kfree(ring);
+}
+
+/*
+ * Creates the rings of the calling process, and maps them into it. With
+ * URING_SETUP_SQPOLL, a kernel thread consumes the submission ring. Returns
+ * the address of the rings, or a negative error code.
+ */
+int uring_setup(uint32_t flags) {
+	i386_task_t *leader = ((i386_task_t *) sched_curr_task())->leader;
+	page_directory_t *directory = leader->task_state->page_directory;
+
+	if(leader->uring) {
+		return -EBUSY;
+	}
+
+	// Kernel tasks have no address space of their own to map the rings into
+	if(directory == kernel_directory) {
+		return -EINVAL;
+	}
+
+	uring_t *ring = uring_alloc(leader);
+
+	if(!ring) {
+		return -ENOMEM;
+	}
+
+	if(!__sync_bool_compare_and_swap(&leader->uring, NULL, ring)) {
+		uring_destroy(ring);
+		return -EBUSY;
+	}
+
+	// Map the heap frames backing the rings into the process as well
+	for(uint32_t i = 0; i < URING_PAGES; i++) {
+		uint32_t virt = (uint32_t) ring->shared + (i * 0x1000);
+		page_t *kernel_page = paging_get_page(virt, false, kernel_directory);
+		page_t *page = paging_get_page(URING_USER_ADDR + (i * 0x1000), true, directory);
+
+		memclr(page, sizeof(page_t));
+		page->frame = kernel_page->frame;
+		page->rw = 1;
+		page->user = 1;
+		page->shared = 1;
+		page->present = 1;
+	}
+
+	ring->user_addr = URING_USER_ADDR;
+	rusage_rss_add(leader, URING_PAGES);
+
+	if(flags & URING_SETUP_SQPOLL) {
+		i386_task_t *poller = task_create_kernel("uring poll", uring_poll_thread, ring);
+
+		poller->task_state->page_directory = directory;
+		poller->task_state->pagetable_phys = leader->task_state->pagetable_phys;
+
+		ring->poller = poller;
+		sched_task_start(poller);
+	}
+
+	return ring->user_addr;
+}
+
+/*
+ * Consumes the calling process' submission ring, unless a polling thread
+ * does that, in which case URING_ENTER_SQ_WAKEUP wakes it up. With
+ * URING_ENTER_GETEVENTS, it then waits until at least min_complete
+ * completions are in the completion ring. Returns the number of submissions
+ * consumed.
+ */
+int uring_enter(uint32_t min_complete, uint32_t flags) {
+	uring_t *ring = ((i386_task_t *) sched_curr_task())->leader->uring;
+	int submitted = 0;
+
+	if(!ring) {
+		return -EINVAL;
+	}
+
+	ring->enters++;
+
+	if(ring->poller) {
+		if(flags & URING_ENTER_SQ_WAKEUP) {
+			wait_queue_wake_all(&ring->sq_wq);
+		}
+	} else {
+		submitted = uring_submit(ring);
+	}
+
+	if(flags & URING_ENTER_GETEVENTS) {
+		uring_shared_t *shared = ring->shared;
+
+		if(min_complete > URING_CQ_ENTRIES) {
+			min_complete = URING_CQ_ENTRIES;
+		}
+
+		uint32_t irq_flags = spin_lock_irqsave(&ring->cq_wq.lock);
+
+		while(shared->cq_tail - shared->cq_head < min_complete) {
+			irq_flags = wait_queue_sleep_locked(&ring->cq_wq, irq_flags);
+		}
+
+		spin_unlock_irqrestore(&ring->cq_wq.lock, irq_flags);
+	}
+
+	return submitted;
+}
+
+// Benchmark: size of each small write, and the task draining the pipe
+#define URING_BENCH_WRITE_SIZE 16
+
+static volatile bool uring_bench_drained;
+
+static void uring_bench_drain(void *context) {
+	file_t *file = context;
+	uint8_t buf[256];
+
+	while(file_read(file, buf, sizeof(buf), FILE_IO_KERNEL) > 0);
+
+	file_put(file);
+	uring_bench_drained = true;
+}
+
+/*
+ * Issues count operations through the rings of the calling task, batch at a
+ * time, entering the kernel once per batch. Returns the TSC cycles taken.
+ */
+static uint64_t uring_bench_ring(uring_t *ring, unsigned int count, unsigned int batch, uring_sqe_t *op) {
+	uring_shared_t *shared = ring->shared;
+	uint32_t ret;
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int done = 0; done < count; ) {
+		unsigned int n = (count - done < batch) ? (count - done) : batch;
+		uint32_t tail = shared->sq_tail;
+
+		for(unsigned int i = 0; i < n; i++) {
+			uring_sqe_t *sqe = &shared->sqes[(tail + i) & (URING_SQ_ENTRIES - 1)];
+
+			*sqe = *op;
+			sqe->user_data = done + i;
+		}
+
+		shared->sq_tail = tail + n;
+
+		__asm__ volatile("int $0x80" : "=a" (ret) : "a" (SYSCALL_URING_ENTER), "b" (n), "c" (URING_ENTER_GETEVENTS) : "memory");
+
+		// Reap the completions
+		shared->cq_head = shared->cq_tail;
+		done += n;
+	}
+
+	return sys_rdtsc() - start;
+}
+
+/*
+ * Prints the cycles per operation of the syscall and ring paths.
+ */
+static void uring_bench_print(const char *what, unsigned int count, unsigned int batch, uint64_t syscall_cycles, uint64_t ring_cycles) {
+	uint32_t per_syscall = (uint32_t) mstd_div_u64(syscall_cycles, count, NULL);
+	uint32_t per_op = (uint32_t) mstd_div_u64(ring_cycles, count, NULL);
+
+	kprintf("uringbench: %u %s, %u per batch: %u cycles per syscall, %u per ring entry", count, what, batch, per_syscall, per_op);
+
+	if(clock_get_source()->is_tsc) {
+		kprintf(" (%u ns, %u ns)", (uint32_t) clock_cycles_to_ns(per_syscall), (uint32_t) clock_cycles_to_ns(per_op));
+	}
+
+	kprintf("\n");
+}
+
+/*
+ * Debug console command: issues no-op operations through the rings of the
+ * calling task, entering the kernel through the syscall gate once per batch,
+ * and compares that with one null syscall per operation. Then does the same
+ * with small writes to a pipe, which another task drains, against one write
+ * syscall each. The rings aren't mapped anywhere; this task fills them
+ * through the kernel mapping. The written data is on a scratch user page,
+ * mapped where the rings would go.
+ */
+static void uring_bench_cmd(int argc, char **argv) {
+	unsigned int count = 100000, batch = 64;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(argc > 2 && atoi(argv[2]) > 0) {
+		batch = atoi(argv[2]);
+	}
+
+	if(batch > URING_SQ_ENTRIES) {
+		batch = URING_SQ_ENTRIES;
+	}
+
+	i386_task_t *self = sched_curr_task();
+
+	if(self->leader->uring) {
+		kprintf("uringbench: this task already has rings\n");
+		return;
+	}
+
+	if(!sched_can_block()) {
+		kprintf("uringbench: can't wait for the pipe to drain from here\n");
+		return;
+	}
+
+	uint32_t ret;
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		__asm__ volatile("int $0x80" : "=a" (ret) : "a" (SYSCALL_NULL) : "memory");
+	}
+
+	uint64_t syscall_cycles = sys_rdtsc() - start;
+
+	uring_t *ring = uring_alloc(self);
+
+	if(!ring) {
+		kprintf("uringbench: out of memory\n");
+		return;
+	}
+
+	self->leader->uring = ring;
+
+	uring_sqe_t op;
+	memclr(&op, sizeof(op));
+	op.opcode = URING_OP_NOP;
+
+	uint64_t ring_cycles = uring_bench_ring(ring, count, batch, &op);
+	uring_bench_print("no-ops", count, batch, syscall_cycles, ring_cycles);
+
+	// Small writes, from a scratch user page to a pipe
+	file_t *read_end, *write_end;
+
+	if(pipe_create(&read_end, &write_end)) {
+		kprintf("uringbench: couldn't create a pipe\n");
+		goto done;
+	}
+
+	int fd = file_install(write_end);
+
+	if(fd < 0) {
+		kprintf("uringbench: no descriptor for the pipe\n");
+		file_put(read_end);
+		file_put(write_end);
+		goto done;
+	}
+
+	page_directory_t *directory = self->task_state->page_directory;
+	page_t *page = paging_get_page(URING_USER_ADDR, true, directory);
+	alloc_frame(page, false, true);
+	paging_flush_tlb(URING_USER_ADDR);
+	memset((void *) URING_USER_ADDR, 'x', URING_BENCH_WRITE_SIZE);
+
+	uring_bench_drained = false;
+	sched_task_start(task_create_kernel("uringbench drain", uring_bench_drain, read_end));
+
+	start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		__asm__ volatile("int $0x80" : "=a" (ret) : "a" (SYSCALL_WRITE), "b" (fd), "c" (URING_USER_ADDR), "d" (URING_BENCH_WRITE_SIZE) : "memory");
+	}
+
+	syscall_cycles = sys_rdtsc() - start;
+
+	op.opcode = URING_OP_WRITE;
+	op.fd = fd;
+	op.addr = URING_USER_ADDR;
+	op.len = URING_BENCH_WRITE_SIZE;
+
+	ring_cycles = uring_bench_ring(ring, count, batch, &op);
+	uring_bench_print("16 byte writes", count, batch, syscall_cycles, ring_cycles);
+
+	// Without writers, the drain task reads the end of the pipe and exits
+	file_close(fd);
+
+	while(!uring_bench_drained) {
+		sched_yield();
+	}
+
+	page->present = 0;
+	paging_shootdown(URING_USER_ADDR, 1);
+	free_frame(page);
+
+done: ;
+	self->leader->uring = NULL;
+	uring_destroy(ring);
+}
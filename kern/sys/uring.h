@@ -0,0 +1,146 @@
+#ifndef URING_H
+#define URING_H
+
+#include <types.h>
+#include "sync.h"
+#include "waitqueue.h"
+#include "timer.h"
+
+/*
+ * Submission and completion rings let a process queue up many operations and
+ * have them carried out with a single syscall, or none at all if a polling
+ * thread is consuming the submission ring. Both rings live in two pages that
+ * are mapped into the kernel and the process at the same time.
+ *
+ * User space fills submission entries and advances sq_tail; the kernel
+ * advances sq_head as it consumes them. The kernel adds completion entries and
+ * advances cq_tail, and user space advances cq_head. The layout must match the
+ * C library's uring.h.
+ */
+#define URING_SQ_ENTRIES 128
+#define URING_CQ_ENTRIES 256
+
+// Where the rings are mapped in a process; right below the thread stacks
+#define URING_USER_ADDR 0x6FFF0000
+
+// Longest buffer a single read or write may use
+#define URING_MAX_IO 0x10000
+
+// Most timeouts a ring may have pending at once
+#define URING_MAX_TIMEOUTS 64
+
+// How long the polling thread spins on an empty ring before sleeping
+#define URING_SQPOLL_IDLE_NS 2000000ULL
+
+// Operations
+#define URING_OP_NOP 0
+#define URING_OP_CONSOLE_WRITE 1
+#define URING_OP_VFS_READ 2
+#define URING_OP_VFS_WRITE 3
+#define URING_OP_TIMEOUT 4
+#define URING_OP_WRITE 5
+
+// Setup flags: consume the submission ring from a kernel thread
+#define URING_SETUP_SQPOLL 0x01
+
+// Enter flags: wait for completions, or wake up a sleeping polling thread
+#define URING_ENTER_GETEVENTS 0x01
+#define URING_ENTER_SQ_WAKEUP 0x02
+
+// Shared flags: set while the polling thread sleeps
+#define URING_SQ_NEED_WAKEUP 0x01
+
+typedef struct uring_sqe {
+	uint8_t opcode;
+	uint8_t flags;
+	// Descriptor operations: the file descriptor
+	uint16_t fd;
+
+	// Copied into the completion entry
+	uint32_t user_data;
+
+	// Buffer to read into or write from, and its length
+	uint32_t addr;
+	uint32_t len;
+
+	// File operations: mount point, and path on that filesystem
+	uint32_t mount;
+	uint32_t path;
+
+	// Timeouts: relative, in nanoseconds
+	uint64_t timeout_ns;
+} __attribute__((packed)) uring_sqe_t;
+
+typedef struct uring_cqe {
+	uint32_t user_data;
+	// Bytes transferred, or a negative error code
+	int32_t res;
+} uring_cqe_t;
+
+typedef struct uring_shared {
+	volatile uint32_t sq_head, sq_tail;
+	volatile uint32_t cq_head, cq_tail;
+
+	volatile uint32_t flags;
+	// Completions dropped because the completion ring was full
+	volatile uint32_t cq_overflow;
+
+	uint32_t reserved[10];
+
+	// Completions fill the rest of the first page, submissions the second
+	uring_cqe_t cqes[URING_CQ_ENTRIES];
+	uint8_t padding[0x1000 - 64 - (URING_CQ_ENTRIES * sizeof(uring_cqe_t))];
+
+	uring_sqe_t sqes[URING_SQ_ENTRIES];
+} uring_shared_t;
+
+#define URING_PAGES (sizeof(uring_shared_t) / 0x1000)
+
+typedef struct uring_timeout {
+	ktimer_t timer;
+
+	struct uring *ring;
+	uint32_t user_data;
+
+	struct uring_timeout *prev, *next;
+} uring_timeout_t;
+
+typedef struct uring {
+	// Kernel mapping of the rings, and where they're mapped in the process (0 if not)
+	uring_shared_t *shared;
+	uint32_t user_addr;
+
+	// Process the rings belong to
+	struct task *owner;
+
+	// Held while consuming submissions
+	mutex_t sq_lock;
+
+	// Its lock protects the completion ring and pending timeouts; tasks
+	// waiting for completions sleep on it
+	wait_queue_t cq_wq;
+
+	// Polling thread, which sleeps on sq_wq while the ring is idle
+	struct task *poller;
+	wait_queue_t sq_wq;
+	volatile bool stopping;
+	volatile bool poller_exited;
+
+	uring_timeout_t *timeouts;
+	uint32_t nr_timeouts;
+
+	// Statistics
+	uint32_t submitted;
+	uint32_t enters;
+} uring_t;
+
+uring_t *uring_alloc(struct task *owner);
+void uring_destroy(uring_t *ring);
+
+int uring_setup(uint32_t flags);
+int uring_enter(uint32_t min_complete, uint32_t flags);
+
+unsigned int uring_submit(uring_t *ring);
+void uring_complete(uring_t *ring, uint32_t user_data, int32_t res);
+
+#endif
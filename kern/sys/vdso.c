@@ -0,0 +1,218 @@
+#include <types.h>
+#include <errno.h>
+#include "vdso.h"
+#include "clock.h"
+#include "system.h"
+#include "kheap.h"
+#include "syscall.h"
+#include "sched.h"
+#include "task.h"
+#include "io/debug_console.h"
+
+extern page_directory_t *kernel_directory;
+
+static vdso_time_t *vdso_page;
+// Frame of the page, which processes map
+static uint32_t vdso_frame;
+
+static void vdso_bench_cmd(int argc, char **argv);
+static void vdso_check_cmd(int argc, char **argv);
+
+static int vdso_cmd_init(void) {
+	debugcon_register("vdsobench", "Compares reading the time from the shared page to the syscall ('vdsobench [count]')", vdso_bench_cmd);
+	debugcon_register("vdsocheck", "Checks that syscalls can't write to the read-only time page", vdso_check_cmd);
+	return 0;
+}
+
+module_init(vdso_cmd_init);
+
+/*
+ * Allocates the time page, and fills it in from the clock source. Must be
+ * called after clock_init, and before any process is created.
+ */
+void vdso_init(void) {
+	vdso_page = (vdso_time_t *) kmalloc_a(0x1000);
+	ASSERT(vdso_page != NULL);
+	memclr(vdso_page, 0x1000);
+
+	vdso_frame = paging_get_page((uint32_t) vdso_page, false, kernel_directory)->frame;
+
+	clock_source_t *cs = clock_get_source();
+
+	vdso_page->is_tsc = cs->is_tsc;
+	vdso_page->mult = cs->mult;
+	vdso_page->shift = cs->shift;
+
+	// There's no RTC driver, so wall clock time counts from boot
+	vdso_page->realtime_offset_ns = 0;
+
+	vdso_update();
+}
+
+/*
+ * Moves the base time forward to now. Only the bootstrap processor calls this,
+ * from its timer interrupt, so there's a single writer.
+ */
+void vdso_update(void) {
+	if(!vdso_page || !vdso_page->is_tsc) {
+		return;
+	}
+
+	clock_source_t *cs = clock_get_source();
+
+	uint64_t cycles = sys_rdtsc();
+	uint64_t ns = cs->base_ns + clock_mul_u64_u32_shr(cycles - cs->base_cycles, cs->mult, cs->shift);
+
+	vdso_page->seq++;
+	__asm__ volatile("" : : : "memory");
+
+	vdso_page->base_cycles = cycles;
+	vdso_page->base_ns = ns;
+
+	__asm__ volatile("" : : : "memory");
+	vdso_page->seq++;
+}
+
+/*
+ * Maps the time page into a process' page directory, read-only.
+ */
+void vdso_map(page_directory_t *directory) {
+	if(!vdso_page) {
+		return;
+	}
+
+	page_t *page = paging_get_page(VDSO_USER_ADDR, true, directory);
+
+	memclr(page, sizeof(page_t));
+	page->frame = vdso_frame;
+	page->user = 1;
+	page->shared = 1;
+	page->present = 1;
+}
+
+/*
+ * Removes the time page from a directory about to be freed, so that its frame
+ * isn't freed with the process' memory.
+ */
+void vdso_unmap(page_directory_t *directory) {
+	page_t *page = paging_get_page(VDSO_USER_ADDR, false, directory);
+
+	if(page) {
+		page->present = 0;
+		page->frame = 0;
+	}
+}
+
+/*
+ * Returns the kernel's mapping of the time page.
+ */
+vdso_time_t *vdso_get(void) {
+	return vdso_page;
+}
+
+/*
+ * Reads a clock the way user space does: from the time page, retrying while
+ * it's being updated.
+ */
+uint64_t vdso_read_ns(uint32_t clock) {
+	uint32_t seq;
+	uint64_t ns;
+
+	do {
+		seq = vdso_page->seq;
+		__asm__ volatile("" : : : "memory");
+
+		ns = vdso_page->base_ns + clock_mul_u64_u32_shr(sys_rdtsc() - vdso_page->base_cycles, vdso_page->mult, vdso_page->shift);
+
+		if(clock == VDSO_CLOCK_REALTIME) {
+			ns += vdso_page->realtime_offset_ns;
+		}
+
+		__asm__ volatile("" : : : "memory");
+	} while((seq & 1) || seq != vdso_page->seq);
+
+	return ns;
+}
+
+/*
+ * Debug console command: reads the time the way user space does, from the time
+ * page, and through the clock_gettime syscall. The syscall is passed a kernel
+ * buffer, which it refuses to copy to, so it's slightly cheaper here than it
+ * would be from user space.
+ */
+static void vdso_bench_cmd(int argc, char **argv) {
+	unsigned int count = 100000;
+
+	if(argc > 1 && atoi(argv[1]) > 0) {
+		count = atoi(argv[1]);
+	}
+
+	if(!vdso_page->is_tsc) {
+		kprintf("vdsobench: the clock isn't the TSC, so user space uses the syscall\n");
+		return;
+	}
+
+	uint64_t start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		vdso_read_ns(VDSO_CLOCK_MONOTONIC);
+	}
+
+	uint64_t page_cycles = sys_rdtsc() - start;
+
+	uint32_t ts[2], ret;
+	start = sys_rdtsc();
+
+	for(unsigned int i = 0; i < count; i++) {
+		__asm__ volatile("int $0x80" : "=a" (ret) : "a" (SYSCALL_CLOCK_GETTIME), "b" (VDSO_CLOCK_MONOTONIC), "c" (ts) : "memory");
+	}
+
+	uint64_t syscall_cycles = sys_rdtsc() - start;
+
+	uint32_t per_page = (uint32_t) mstd_div_u64(page_cycles, count, NULL);
+	uint32_t per_syscall = (uint32_t) mstd_div_u64(syscall_cycles, count, NULL);
+
+	kprintf("vdsobench: %u reads, %u cycles from the page (%u ns), %u through the syscall (%u ns)\n", count, per_page, (uint32_t) clock_cycles_to_ns(per_page), per_syscall, (uint32_t) clock_cycles_to_ns(per_syscall));
+}
+
+/*
+ * Debug console command: passes the time page, mapped read-only as in any
+ * process, as the output buffer of clock_gettime, which must fail with -EFAULT
+ * and leave the page alone. The page is mapped into this task's directory for
+ * the check if it isn't there already.
+ */
+static void vdso_check_cmd(int argc, char **argv) {
+	if(!sched_can_block()) {
+		kprintf("vdsocheck: can't flush other processors' TLBs from here\n");
+		return;
+	}
+
+	i386_task_t *self = sched_curr_task();
+	page_directory_t *directory = self->task_state->page_directory;
+	page_t *page = paging_get_page(VDSO_USER_ADDR, false, directory);
+	bool mapped = !page || !page->present;
+
+	if(mapped) {
+		vdso_map(directory);
+		paging_flush_tlb(VDSO_USER_ADDR);
+	}
+
+	// clock_gettime writes the seconds over seq, and the nanoseconds over is_tsc
+	uint32_t is_tsc = vdso_page->is_tsc;
+	int ret;
+
+	__asm__ volatile("int $0x80" : "=a" (ret) : "a" (SYSCALL_CLOCK_GETTIME), "b" (VDSO_CLOCK_MONOTONIC), "c" (VDSO_USER_ADDR) : "memory");
+
+	bool intact = (vdso_page->is_tsc == is_tsc);
+
+	if(mapped) {
+		vdso_unmap(directory);
+		paging_shootdown(VDSO_USER_ADDR, 1);
+	}
+
+	if(ret == -EFAULT && intact) {
+		kprintf("vdsocheck: write to the time page failed with -EFAULT, as it should\n");
+	} else {
+		kprintf("vdsocheck: FAILED: syscall returned %d, page %s\n", ret, intact ? "intact" : "overwritten");
+	}
+}
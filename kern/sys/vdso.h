@@ -0,0 +1,48 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <types.h>
+#include "paging.h"
+
+/*
+ * Every process has a read-only page mapped at VDSO_USER_ADDR from which it
+ * can read the time without entering the kernel: it holds the clock's
+ * conversion parameters and a base time, which the bootstrap processor's
+ * timer interrupt refreshes under a sequence count. Readers retry if the
+ * count was odd, or changed while they were reading.
+ *
+ * The layout must match the C library's time code.
+ */
+#define VDSO_USER_ADDR 0xBFFFF000
+
+typedef struct vdso_time {
+	volatile uint32_t seq;
+
+	// If zero, the clock isn't the TSC, and the time must be read through the syscall
+	uint32_t is_tsc;
+
+	// ns = base_ns + (((cycles - base_cycles) * mult) >> shift)
+	uint32_t mult;
+	uint32_t shift;
+
+	uint64_t base_cycles;
+	uint64_t base_ns;
+
+	// Added to the monotonic time to get the wall clock time
+	uint64_t realtime_offset_ns;
+} vdso_time_t;
+
+// Clock IDs
+#define VDSO_CLOCK_REALTIME 0
+#define VDSO_CLOCK_MONOTONIC 1
+
+void vdso_init(void);
+void vdso_update(void);
+
+void vdso_map(page_directory_t *directory);
+void vdso_unmap(page_directory_t *directory);
+
+vdso_time_t *vdso_get(void);
+uint64_t vdso_read_ns(uint32_t clock);
+
+#endif
@@ -0,0 +1,168 @@
+#include <types.h>
+#include "waitqueue.h"
+#include "sched.h"
+
+/*
+ * Initialises an empty wait queue.
+ */
+void wait_queue_init(wait_queue_t *wq) {
+	spin_lock_init(&wq->lock);
+	wq->first = wq->last = NULL;
+	wq->watches = NULL;
+}
+
+/*
+ * Puts the current task to sleep on the wait queue, whose lock the caller
+ * took with spin_lock_irqsave, returning flags. The lock is dropped while the
+ * task sleeps, and taken again before returning; the new flags are returned.
+ *
+ * Callers must check their condition again after this returns, as another
+ * task may have gotten there first. Tasks that can't block (such as the idle
+ * task, or code running before the scheduler is up) return immediately after
+ * briefly dropping the lock, so they effectively spin on the condition.
+ */
+uint32_t wait_queue_sleep_locked(wait_queue_t *wq, uint32_t flags) {
+	if(!sched_can_block()) {
+		spin_unlock_irqrestore(&wq->lock, flags);
+		__asm__ volatile("pause");
+		return spin_lock_irqsave(&wq->lock);
+	}
+
+	wait_queue_entry_t entry;
+	entry.task = sched_curr_task();
+	entry.next = NULL;
+	entry.woken = false;
+
+	if(wq->last) {
+		wq->last->next = &entry;
+	} else {
+		wq->first = &entry;
+	}
+
+	wq->last = &entry;
+
+	// Once marked, a wakeup between unlocking and blocking isn't lost
+	sched_prepare_block();
+	spin_unlock_irqrestore(&wq->lock, flags);
+
+	sched_block();
+
+	flags = spin_lock_irqsave(&wq->lock);
+	ASSERT(entry.woken);
+
+	return flags;
+}
+
+/*
+ * Wakes up the task that's waited longest, handing it this processor when the
+ * caller blocks if sync is set. Returns false if there was none.
+ */
+static bool wait_queue_wake_first(wait_queue_t *wq, bool sync) {
+	wait_queue_entry_t *entry = wq->first;
+
+	if(!entry) {
+		return false;
+	}
+
+	wq->first = entry->next;
+
+	if(!wq->first) {
+		wq->last = NULL;
+	}
+
+	// The entry is on the waiter's stack, so it mustn't be touched afterwards
+	void *task = entry->task;
+	entry->woken = true;
+
+	if(sync) {
+		sched_wake_sync(task);
+	} else {
+		sched_wake(task);
+	}
+
+	return true;
+}
+
+/*
+ * Calls back the queue's watches.
+ */
+static void wait_queue_notify(wait_queue_t *wq) {
+	for(wait_queue_watch_t *watch = wq->watches; watch; watch = watch->next) {
+		watch->notify(watch);
+	}
+}
+
+bool wait_queue_wake_one_locked(wait_queue_t *wq) {
+	wait_queue_notify(wq);
+	return wait_queue_wake_first(wq, false);
+}
+
+/*
+ * Wakes up the task that's waited longest, for a caller that's about to block
+ * waiting for it to do something; it runs on this processor right away.
+ */
+bool wait_queue_wake_one_sync_locked(wait_queue_t *wq) {
+	wait_queue_notify(wq);
+	return wait_queue_wake_first(wq, true);
+}
+
+/*
+ * Wakes up all waiting tasks, returning how many there were.
+ */
+unsigned int wait_queue_wake_all_locked(wait_queue_t *wq) {
+	unsigned int woken = 0;
+
+	wait_queue_notify(wq);
+
+	while(wait_queue_wake_first(wq, false)) {
+		woken++;
+	}
+
+	return woken;
+}
+
+bool wait_queue_wake_one(wait_queue_t *wq) {
+	uint32_t flags = spin_lock_irqsave(&wq->lock);
+	bool woken = wait_queue_wake_one_locked(wq);
+	spin_unlock_irqrestore(&wq->lock, flags);
+
+	return woken;
+}
+
+unsigned int wait_queue_wake_all(wait_queue_t *wq) {
+	uint32_t flags = spin_lock_irqsave(&wq->lock);
+	unsigned int woken = wait_queue_wake_all_locked(wq);
+	spin_unlock_irqrestore(&wq->lock, flags);
+
+	return woken;
+}
+
+/*
+ * Adds a watch to the queue; it's called back on every wakeup until removed.
+ */
+void wait_queue_add_watch(wait_queue_t *wq, wait_queue_watch_t *watch) {
+	uint32_t flags = spin_lock_irqsave(&wq->lock);
+
+	watch->next = wq->watches;
+	wq->watches = watch;
+
+	spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+/*
+ * Removes a watch. Once this returns, it's not being called back anymore.
+ */
+void wait_queue_remove_watch(wait_queue_t *wq, wait_queue_watch_t *watch) {
+	uint32_t flags = spin_lock_irqsave(&wq->lock);
+	wait_queue_watch_t **link = &wq->watches;
+
+	while(*link && *link != watch) {
+		link = &(*link)->next;
+	}
+
+	if(*link) {
+		*link = watch->next;
+	}
+
+	spin_unlock_irqrestore(&wq->lock, flags);
+}
@@ -0,0 +1,59 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include <types.h>
+#include "spinlock.h"
+
+/*
+ * A wait queue is a FIFO of tasks blocking until some condition becomes true.
+ * Entries live on the stack of the waiting task. The lock also serves to
+ * protect whatever state the condition depends on, so that checking it and
+ * going to sleep is atomic with respect to wakeups.
+ */
+typedef struct wait_queue_entry {
+	void *task;
+	struct wait_queue_entry *next;
+
+	// Set by the waker after it removed the entry from the queue
+	volatile bool woken;
+} wait_queue_entry_t;
+
+/*
+ * A watch gets called back whenever waiters are woken up, whether there are
+ * any or not, so something other than a task (such as an event poll object)
+ * can find out about changes. Callbacks run with the queue locked.
+ */
+typedef struct wait_queue_watch {
+	void (*notify)(struct wait_queue_watch *watch);
+	struct wait_queue_watch *next;
+} wait_queue_watch_t;
+
+typedef struct wait_queue {
+	spinlock_t lock;
+	wait_queue_entry_t *first, *last;
+
+	wait_queue_watch_t *watches;
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t *wq);
+
+// Sleeps on wq, whose lock must be held; it's released and taken again
+uint32_t wait_queue_sleep_locked(wait_queue_t *wq, uint32_t flags);
+
+// Wake up waiters; the lock must be held
+bool wait_queue_wake_one_locked(wait_queue_t *wq);
+bool wait_queue_wake_one_sync_locked(wait_queue_t *wq);
+unsigned int wait_queue_wake_all_locked(wait_queue_t *wq);
+
+// Same as above, but take the lock themselves
+bool wait_queue_wake_one(wait_queue_t *wq);
+unsigned int wait_queue_wake_all(wait_queue_t *wq);
+
+void wait_queue_add_watch(wait_queue_t *wq, wait_queue_watch_t *watch);
+void wait_queue_remove_watch(wait_queue_t *wq, wait_queue_watch_t *watch);
+
+static inline bool wait_queue_empty(wait_queue_t *wq) {
+	return wq->first == NULL;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include <types.h>
+#include "workqueue.h"
+#include "waitqueue.h"
+#include "task.h"
+#include "sched.h"
+
+// Queued work items; the wait queue's lock protects the list
+static work_t *work_first, *work_last;
+static wait_queue_t work_waiters;
+
+static void workqueue_thread(void *context);
+
+/*
+ * Starts the worker threads.
+ */
+static int workqueue_init(void) {
+	char name[16];
+
+	wait_queue_init(&work_waiters);
+
+	for(int i = 0; i < WORKQUEUE_NUM_THREADS; i++) {
+		sprintf(name, "kworker/%u", i);
+
+		i386_task_t *task = task_create_kernel(name, workqueue_thread, NULL);
+		sched_task_start(task);
+	}
+
+	return 0;
+}
+
+module_early_init(workqueue_init);
+
+/*
+ * Initialises a work item that calls func with context.
+ */
+void work_init(work_t *work, work_func_t func, void *context) {
+	work->func = func;
+	work->context = context;
+	work->next = NULL;
+	work->pending = false;
+}
+
+/*
+ * Queues a work item, and wakes up a worker to run it. Returns false if the
+ * item was already queued, in which case it runs only once.
+ */
+bool work_queue(work_t *work) {
+	uint32_t flags = spin_lock_irqsave(&work_waiters.lock);
+
+	if(work->pending) {
+		spin_unlock_irqrestore(&work_waiters.lock, flags);
+		return false;
+	}
+
+	work->pending = true;
+	work->next = NULL;
+
+	if(work_last) {
+		work_last->next = work;
+	} else {
+		work_first = work;
+	}
+
+	work_last = work;
+
+	wait_queue_wake_one_locked(&work_waiters);
+	spin_unlock_irqrestore(&work_waiters.lock, flags);
+
+	return true;
+}
+
+/*
+ * Worker thread: takes items off the queue and runs them, sleeping while the
+ * queue is empty.
+ */
+static void workqueue_thread(void *context) {
+	while(1) {
+		uint32_t flags = spin_lock_irqsave(&work_waiters.lock);
+
+		while(!work_first) {
+			flags = wait_queue_sleep_locked(&work_waiters, flags);
+		}
+
+		work_t *work = work_first;
+		work_first = work->next;
+
+		if(!work_first) {
+			work_last = NULL;
+		}
+
+		// Once it's off the queue, the item may be queued again
+		work->pending = false;
+
+		spin_unlock_irqrestore(&work_waiters.lock, flags);
+
+		work->func(work->context);
+	}
+}
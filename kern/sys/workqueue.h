@@ -0,0 +1,32 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <types.h>
+
+/*
+ * Work items are run by a pool of kernel threads, so unlike softirqs, they may
+ * block. Interrupt handlers use them to defer anything that doesn't need to
+ * happen with interrupts disabled.
+ */
+
+// Number of kernel threads servicing the work queue
+#define WORKQUEUE_NUM_THREADS 4
+
+typedef void (*work_func_t)(void *context);
+
+typedef struct work {
+	work_func_t func;
+	void *context;
+
+	struct work *next;
+
+	// Set while the item is queued; it's cleared before the function runs
+	volatile bool pending;
+} work_t;
+
+void work_init(work_t *work, work_func_t func, void *context);
+
+// Queues a work item unless it's already pending; may be called from IRQs
+bool work_queue(work_t *work);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * SQULibC - Event polling
+ *
+ * Waits for any of a set of descriptors to become ready. The kernel keeps
+ * track of which ones changed, so the cost of a wait doesn't depend on how
+ * many descriptors are registered. Registered descriptors stay registered
+ * until removed, even if they're closed.
+ */
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include <stdint-gcc.h>
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLLIN 0x001
+#define EPOLLOUT 0x004
+#define EPOLLERR 0x008
+#define EPOLLHUP 0x010
+
+// Report a descriptor once per change, rather than for as long as it's ready
+#define EPOLLET 0x80000000
+
+typedef struct epoll_event {
+	uint32_t events;
+	uint32_t data;
+} epoll_event_t;
+
+int epoll_create(void);
+int epoll_ctl(int epfd, int op, int fd, epoll_event_t *event);
+
+// Returns the number of events; a timeout of -1 waits forever
+int epoll_wait(int epfd, epoll_event_t *events, int max, int timeout_ms);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * SQULibC - Message passing
+ *
+ * A client sends a message on a channel and blocks until a server receives
+ * it and replies. Data is copied once, between the two buffers, and the
+ * kernel switches straight to the task that's woken up, so a round trip is
+ * about as cheap as two syscalls.
+ */
+#ifndef MSG_H
+#define MSG_H
+
+#include <stdint-gcc.h>
+#include <stddef.h>
+
+// Creates a channel: fds[0] is the server end, fds[1] the client end
+int channel_create(int fds[2]);
+
+// Returns the status the server replied with, or -1
+int msg_send(int fd, const void *msg, size_t len, void *reply, size_t reply_len);
+
+// Returns the ID to reply with, and stores the message's full length in len
+int msg_receive(int fd, void *buf, size_t buf_len, size_t *len);
+int msg_reply(int fd, int rcvid, int status, const void *reply, size_t len);
+
+#endif
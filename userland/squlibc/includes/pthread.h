@@ -0,0 +1,55 @@
+/*
+ * SQULibC - Threads and synchronisation
+ *
+ * Mutexes and condition variables are built on futexes: as long as nobody has
+ * to wait, they only use atomic instructions, and never enter the kernel.
+ *
+ * Threads share the address space of their process. Each has its own stack,
+ * with a small thread-local block on top that GS points at.
+ */
+#ifndef PTHREAD_H
+#define PTHREAD_H
+
+#include <stdint-gcc.h>
+
+// Attributes aren't supported; pass NULL
+typedef int pthread_attr_t;
+typedef int pthread_mutexattr_t;
+typedef int pthread_condattr_t;
+
+// Thread ID, as assigned by the kernel
+typedef uint32_t pthread_t;
+
+typedef struct {
+	// 0 if unlocked, 1 if locked, 2 if locked and threads may be waiting
+	volatile uint32_t state;
+} pthread_mutex_t;
+
+#define PTHREAD_MUTEX_INITIALIZER { 0 }
+
+typedef struct {
+	// Bumped by every signal, so a waiter can tell it missed one
+	volatile uint32_t seq;
+	volatile uint32_t waiters;
+} pthread_cond_t;
+
+#define PTHREAD_COND_INITIALIZER { 0, 0 }
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg);
+int pthread_join(pthread_t thread, void **value);
+void pthread_exit(void *value) __attribute__((noreturn));
+pthread_t pthread_self(void);
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int pthread_cond_destroy(pthread_cond_t *cond);
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int pthread_cond_signal(pthread_cond_t *cond);
+int pthread_cond_broadcast(pthread_cond_t *cond);
+
+#endif
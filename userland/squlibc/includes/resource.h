@@ -0,0 +1,37 @@
+/*
+ * SQULibC - Resource usage
+ *
+ * The kernel counts, for each thread, its CPU time, page faults, context
+ * switches, syscalls, and bytes read and written. Usage of a process adds up
+ * that of all its threads, including ones that exited; its peak resident set
+ * size is the most user pages that were ever mapped into it.
+ *
+ * The layout of struct rusage must match the kernel's rusage.h.
+ */
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include <stdint-gcc.h>
+
+// Whose usage getrusage returns
+#define RUSAGE_SELF 0
+#define RUSAGE_THREAD 1
+
+struct rusage {
+	uint64_t ru_utime_ns, ru_stime_ns;
+
+	// Page faults resolved without and with I/O
+	uint32_t ru_minflt, ru_majflt;
+	// Voluntary and involuntary context switches
+	uint32_t ru_nvcsw, ru_nivcsw;
+	uint32_t ru_nsyscalls;
+
+	// Peak resident set size, in KB
+	uint32_t ru_maxrss;
+
+	uint64_t ru_read_bytes, ru_written_bytes;
+};
+
+int getrusage(int who, struct rusage *usage);
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * SQULibC - Shared memory
+ *
+ * Named objects that any process can map. An object's memory is freed once
+ * its name was unlinked and the last process unmapped it.
+ */
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint-gcc.h>
+#include <stddef.h>
+
+#define SHM_NAME_MAX 32
+
+// Mapping flags
+#define SHM_MAP_READONLY 0x01
+
+// Caching attributes
+#define SHM_CACHE_WRITEBACK 0
+#define SHM_CACHE_WRITETHROUGH 1
+#define SHM_CACHE_UNCACHED 2
+
+int shm_create(const char *name, size_t size);
+int shm_unlink(const char *name);
+
+// Maps at addr, or where the kernel picks if it's NULL; returns NULL on error
+void *shm_map(const char *name, void *addr, int flags, int cache);
+int shm_unmap(void *addr);
+
+#endif
@@ -1 +1,29 @@
-#define SYSCALL_WRITE 4
\ No newline at end of file
+#define SYSCALL_NULL 0
+#define SYSCALL_READ 3
+#define SYSCALL_WRITE 4
+#define SYSCALL_CLOSE 6
+#define SYSCALL_FUTEX_WAIT 16
+#define SYSCALL_FUTEX_WAKE 17
+#define SYSCALL_THREAD_CREATE 18
+#define SYSCALL_THREAD_EXIT 19
+#define SYSCALL_THREAD_JOIN 20
+#define SYSCALL_URING_SETUP 21
+#define SYSCALL_URING_ENTER 22
+#define SYSCALL_CLOCK_GETTIME 23
+#define SYSCALL_SYSCALL_STATS 24
+#define SYSCALL_PIPE 25
+#define SYSCALL_CHANNEL_CREATE 26
+#define SYSCALL_MSG_SEND 27
+#define SYSCALL_MSG_RECEIVE 28
+#define SYSCALL_MSG_REPLY 29
+#define SYSCALL_SHM_CREATE 30
+#define SYSCALL_SHM_MAP 31
+#define SYSCALL_SHM_UNMAP 32
+#define SYSCALL_SHM_UNLINK 33
+#define SYSCALL_EPOLL_CREATE 34
+#define SYSCALL_EPOLL_CTL 35
+#define SYSCALL_EPOLL_WAIT 36
+#define SYSCALL_CLOCK_NANOSLEEP 37
+#define SYSCALL_ITIMER_CREATE 38
+#define SYSCALL_ITIMER_SETTIME 39
+#define SYSCALL_GETRUSAGE 40
@@ -0,0 +1,32 @@
+/*
+ * SQULibC - Syscall statistics
+ *
+ * While the kernel has them turned on (the "syscalls on" debug console
+ * command), it counts the calls, failures and time taken of every syscall,
+ * both globally and for each thread.
+ *
+ * The layout of the statistics must match the kernel's syscall_stats.h.
+ */
+#ifndef SYSCALL_STATS_H
+#define SYSCALL_STATS_H
+
+#include <stdint-gcc.h>
+
+// Bucket n counts calls taking [2^(n-1), 2^n) cycles; the last one, the rest
+#define SYSCALL_HIST_BUCKETS 24
+
+typedef struct syscall_stats {
+	uint32_t count;
+	uint32_t errors;
+	uint64_t cycles;
+
+	uint32_t hist[SYSCALL_HIST_BUCKETS];
+} syscall_stats_t;
+
+// Scopes
+#define SYSCALL_STATS_GLOBAL 0
+#define SYSCALL_STATS_SELF 1
+
+int syscall_stats(unsigned int number, syscall_stats_t *stats, int scope);
+
+#endif
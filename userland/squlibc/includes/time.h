@@ -0,0 +1,63 @@
+/*
+ * SQULibC - Time
+ *
+ * The kernel maps a page with its clock's parameters into every process, so
+ * reading the time normally doesn't involve a syscall.
+ */
+#ifndef TIME_H
+#define TIME_H
+
+#include <stdint-gcc.h>
+
+typedef int32_t time_t;
+typedef int32_t suseconds_t;
+typedef int clockid_t;
+
+struct timespec {
+	time_t tv_sec;
+	long tv_nsec;
+};
+
+struct timeval {
+	time_t tv_sec;
+	suseconds_t tv_usec;
+};
+
+// Time zones aren't supported; pass NULL
+struct timezone {
+	int tz_minuteswest;
+	int tz_dsttime;
+};
+
+// The wall clock counts from boot, as there's no way to set it yet
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+
+struct itimerspec {
+	struct timespec it_interval;
+	struct timespec it_value;
+};
+
+// The time to sleep until or to arm a timer for is absolute, not relative
+#define TIMER_ABSTIME 0x01
+
+int clock_gettime(clockid_t clock, struct timespec *ts);
+int gettimeofday(struct timeval *tv, struct timezone *tz);
+
+// Sleeps can't be interrupted, so rem is never written
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req, struct timespec *rem);
+
+/*
+ * Interval timers are descriptors: reading one returns the number of
+ * expirations since the last read as a uint64_t, and it can be waited for
+ * with epoll. With ITIMER_URING, each expiration also posts a completion with
+ * the given user data to the completion ring, whose result is the number of
+ * expirations.
+ */
+#define ITIMER_URING 0x02
+
+int itimer_create(clockid_t clock);
+int itimer_settime(int fd, int flags, const struct itimerspec *value, uint32_t user_data);
+
+#endif
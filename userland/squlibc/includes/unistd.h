@@ -1,3 +1,26 @@
+#ifndef UNISTD_H
+#define UNISTD_H
+
+#include <stddef.h>
+
 #define STDIN_FILENO 0
 #define STDOUT_FILENO 1
-#define STDERR_FILENO 2
\ No newline at end of file
+#define STDERR_FILENO 2
+
+typedef int ssize_t;
+
+ssize_t read(int fd, void *buf, size_t len);
+ssize_t write(int fd, const void *buf, size_t len);
+int close(int fd);
+
+/*
+ * Creates a pipe, storing its read end in fds[0] and its write end in fds[1].
+ *
+ * Writes of 16 KB or more aren't buffered: they block until they've been
+ * read, and are copied straight into the reader's buffer. If both buffers are
+ * page aligned, pages may be moved to the reader instead, leaving the
+ * writer's buffer zeroed.
+ */
+int pipe(int fds[2]);
+
+#endif
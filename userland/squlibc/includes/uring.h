@@ -0,0 +1,100 @@
+/*
+ * SQULibC - Submission and completion rings
+ *
+ * Operations are queued in a ring shared with the kernel, and carried out
+ * when uring_submit is called, with a single syscall for the whole batch; or,
+ * if the rings were set up with URING_SETUP_SQPOLL, by a kernel thread that
+ * picks them up without any syscall at all. Each operation produces a
+ * completion carrying its user_data and result.
+ *
+ * The layout of the rings must match the kernel's uring.h.
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <stdint-gcc.h>
+
+#define URING_SQ_ENTRIES 128
+#define URING_CQ_ENTRIES 256
+
+// Operations
+#define URING_OP_NOP 0
+#define URING_OP_CONSOLE_WRITE 1
+#define URING_OP_VFS_READ 2
+#define URING_OP_VFS_WRITE 3
+#define URING_OP_TIMEOUT 4
+#define URING_OP_WRITE 5
+
+// Setup flags
+#define URING_SETUP_SQPOLL 0x01
+
+// Enter flags
+#define URING_ENTER_GETEVENTS 0x01
+#define URING_ENTER_SQ_WAKEUP 0x02
+
+// Shared flags
+#define URING_SQ_NEED_WAKEUP 0x01
+
+typedef struct {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t fd;
+
+	uint32_t user_data;
+
+	void *addr;
+	uint32_t len;
+
+	const char *mount;
+	const char *path;
+
+	uint64_t timeout_ns;
+} __attribute__((packed)) uring_sqe_t;
+
+typedef struct {
+	uint32_t user_data;
+	// Bytes transferred, or a negative error code
+	int32_t res;
+} uring_cqe_t;
+
+typedef struct {
+	volatile uint32_t sq_head, sq_tail;
+	volatile uint32_t cq_head, cq_tail;
+
+	volatile uint32_t flags;
+	volatile uint32_t cq_overflow;
+
+	uint32_t reserved[10];
+
+	uring_cqe_t cqes[URING_CQ_ENTRIES];
+	uint8_t padding[0x1000 - 64 - (URING_CQ_ENTRIES * sizeof(uring_cqe_t))];
+
+	uring_sqe_t sqes[URING_SQ_ENTRIES];
+} uring_shared_t;
+
+typedef struct {
+	uring_shared_t *shared;
+	uint32_t flags;
+
+	// Entries handed out, but not yet submitted, end here
+	uint32_t sq_tail;
+} uring_t;
+
+int uring_init(uring_t *ring, uint32_t flags);
+
+uring_sqe_t *uring_get_sqe(uring_t *ring);
+int uring_submit(uring_t *ring);
+int uring_submit_and_wait(uring_t *ring, uint32_t wait_nr);
+
+uring_cqe_t *uring_peek_cqe(uring_t *ring);
+int uring_wait_cqe(uring_t *ring, uring_cqe_t **cqe);
+void uring_cqe_seen(uring_t *ring);
+
+// Fill in entries returned by uring_get_sqe
+void uring_prep_console_write(uring_sqe_t *sqe, const void *buf, uint32_t len, uint32_t user_data);
+void uring_prep_read(uring_sqe_t *sqe, const char *mount, const char *path, void *buf, uint32_t len, uint32_t user_data);
+void uring_prep_write(uring_sqe_t *sqe, const char *mount, const char *path, const void *buf, uint32_t len, uint32_t user_data);
+void uring_prep_timeout(uring_sqe_t *sqe, uint64_t timeout_ns, uint32_t user_data);
+void uring_prep_fd_write(uring_sqe_t *sqe, int fd, const void *buf, uint32_t len, uint32_t user_data);
+
+#endif
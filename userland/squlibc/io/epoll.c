@@ -0,0 +1,27 @@
+#include "io_internal.h"
+#include <syscall/syscalls_internal.h>
+#include <epoll.h>
+
+static inline int epoll_result(int ret) {
+	if(ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+int epoll_create(void) {
+	return epoll_result(do_syscall(SYSCALL_EPOLL_CREATE, 0, 0, 0, 0, 0));
+}
+
+int epoll_ctl(int epfd, int op, int fd, epoll_event_t *event) {
+	return epoll_result(do_syscall(SYSCALL_EPOLL_CTL, epfd, op, fd, (uint32_t) event, 0));
+}
+
+/*
+ * At most 64 events are returned by one call.
+ */
+int epoll_wait(int epfd, epoll_event_t *events, int max, int timeout_ms) {
+	return epoll_result(do_syscall(SYSCALL_EPOLL_WAIT, epfd, (uint32_t) events, max, timeout_ms, 0));
+}
@@ -0,0 +1,32 @@
+#include "io_internal.h"
+#include <syscall/syscalls_internal.h>
+#include <unistd.h>
+
+/*
+ * Converts a syscall's return value: negative error codes are stored in errno,
+ * and turn into -1.
+ */
+static inline int fd_result(int ret) {
+	if(ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+ssize_t read(int fd, void *buf, size_t len) {
+	return fd_result(do_syscall(SYSCALL_READ, fd, (uint32_t) buf, len, 0, 0));
+}
+
+ssize_t write(int fd, const void *buf, size_t len) {
+	return fd_result(do_syscall(SYSCALL_WRITE, fd, (uint32_t) buf, len, 0, 0));
+}
+
+int close(int fd) {
+	return fd_result(do_syscall(SYSCALL_CLOSE, fd, 0, 0, 0, 0));
+}
+
+int pipe(int fds[2]) {
+	return fd_result(do_syscall(SYSCALL_PIPE, (uint32_t) fds, 0, 0, 0, 0));
+}
@@ -2,14 +2,16 @@
 #include <syscall/syscalls_internal.h>
 #include <unistd.h>
 
+/*
+ * Writes nobj objects of size bytes to a stream, whose handle is the file
+ * descriptor. Returns the number of whole objects written.
+ */
 size_t fwrite(const void *ptr, size_t size, size_t nobj, FILE *stream) {
-	syscall_write_struct infoStruct;
+	ssize_t ret = write(*stream, ptr, size * nobj);
 
-	infoStruct.data = ptr;
-	infoStruct.count = nobj;
-	infoStruct.size = size;
-	infoStruct.file = stream;
+	if(ret < 0 || !size) {
+		return 0;
+	}
 
-	errno = do_syscall(SYSCALL_WRITE, &infoStruct);
-	return errno;
+	return ret / size;
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "io_internal.h"
+#include <syscall/syscalls_internal.h>
+#include <msg.h>
+
+static inline int msg_result(int ret) {
+	if(ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+int channel_create(int fds[2]) {
+	return msg_result(do_syscall(SYSCALL_CHANNEL_CREATE, (uint32_t) fds, 0, 0, 0, 0));
+}
+
+/*
+ * Sends a message, and waits for the reply, which is truncated to reply_len
+ * bytes. Returns the server's status; negative ones are taken as error codes,
+ * so servers should reply with those only to report errors.
+ */
+int msg_send(int fd, const void *msg, size_t len, void *reply, size_t reply_len) {
+	return msg_result(do_syscall(SYSCALL_MSG_SEND, fd, (uint32_t) msg, len, (uint32_t) reply, reply_len));
+}
+
+int msg_receive(int fd, void *buf, size_t buf_len, size_t *len) {
+	return msg_result(do_syscall(SYSCALL_MSG_RECEIVE, fd, (uint32_t) buf, buf_len, (uint32_t) len, 0));
+}
+
+int msg_reply(int fd, int rcvid, int status, const void *reply, size_t len) {
+	return msg_result(do_syscall(SYSCALL_MSG_REPLY, fd, rcvid, status, (uint32_t) reply, len));
+}
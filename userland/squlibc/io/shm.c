@@ -0,0 +1,39 @@
+#include "io_internal.h"
+#include <syscall/syscalls_internal.h>
+#include <shm.h>
+
+static inline int shm_result(int ret) {
+	if(ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Creates an object of at least size bytes, which is zeroed. Fails with EBUSY
+ * if the name is taken.
+ */
+int shm_create(const char *name, size_t size) {
+	return shm_result(do_syscall(SYSCALL_SHM_CREATE, (uint32_t) name, size, 0, 0, 0));
+}
+
+int shm_unlink(const char *name) {
+	return shm_result(do_syscall(SYSCALL_SHM_UNLINK, (uint32_t) name, 0, 0, 0, 0));
+}
+
+void *shm_map(const char *name, void *addr, int flags, int cache) {
+	int ret = do_syscall(SYSCALL_SHM_MAP, (uint32_t) name, (uint32_t) addr, flags, cache, 0);
+
+	if(ret < 0) {
+		errno = -ret;
+		return NULL;
+	}
+
+	return (void *) ret;
+}
+
+int shm_unmap(void *addr) {
+	return shm_result(do_syscall(SYSCALL_SHM_UNMAP, (uint32_t) addr, 0, 0, 0, 0));
+}
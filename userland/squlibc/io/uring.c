@@ -0,0 +1,161 @@
+#include "io_internal.h"
+#include <syscall/syscalls_internal.h>
+#include <uring.h>
+
+/*
+ * Sets up this process' rings; there can only be one set per process.
+ * Returns 0, or an error code.
+ */
+int uring_init(uring_t *ring, uint32_t flags) {
+	int ret = uring_setup_syscall(flags);
+
+	if(ret < 0) {
+		return -ret;
+	}
+
+	ring->shared = (uring_shared_t *) ret;
+	ring->flags = flags;
+	ring->sq_tail = ring->shared->sq_tail;
+
+	return 0;
+}
+
+/*
+ * Returns the next free submission entry, or NULL if the ring is full. It's
+ * passed to the kernel by the next uring_submit.
+ */
+uring_sqe_t *uring_get_sqe(uring_t *ring) {
+	uring_shared_t *shared = ring->shared;
+
+	if(ring->sq_tail - shared->sq_head >= URING_SQ_ENTRIES) {
+		return NULL;
+	}
+
+	uring_sqe_t *sqe = &shared->sqes[ring->sq_tail & (URING_SQ_ENTRIES - 1)];
+	ring->sq_tail++;
+
+	sqe->flags = 0;
+	sqe->fd = 0;
+
+	return sqe;
+}
+
+/*
+ * Makes the entries gotten so far visible to the kernel, and, unless a
+ * polling thread is awake to pick them up, enters the kernel to carry them
+ * out. Returns the number of entries the kernel consumed (0 with a polling
+ * thread), or a negative error code.
+ */
+static int uring_flush(uring_t *ring, uint32_t wait_nr) {
+	uring_shared_t *shared = ring->shared;
+	uint32_t flags = wait_nr ? URING_ENTER_GETEVENTS : 0;
+
+	// Entries must be visible before the tail that covers them
+	__asm__ volatile("" : : : "memory");
+	shared->sq_tail = ring->sq_tail;
+
+	if(ring->flags & URING_SETUP_SQPOLL) {
+		// The kernel checks the tail after setting the flag
+		__sync_synchronize();
+
+		if(shared->flags & URING_SQ_NEED_WAKEUP) {
+			flags |= URING_ENTER_SQ_WAKEUP;
+		}
+
+		if(!flags) {
+			return 0;
+		}
+	}
+
+	return uring_enter_syscall(wait_nr, flags);
+}
+
+int uring_submit(uring_t *ring) {
+	return uring_flush(ring, 0);
+}
+
+/*
+ * Submits, then waits until wait_nr completions are available.
+ */
+int uring_submit_and_wait(uring_t *ring, uint32_t wait_nr) {
+	return uring_flush(ring, wait_nr);
+}
+
+/*
+ * Returns the oldest completion, or NULL if there is none. It stays in the
+ * ring until uring_cqe_seen is called.
+ */
+uring_cqe_t *uring_peek_cqe(uring_t *ring) {
+	uring_shared_t *shared = ring->shared;
+
+	if(shared->cq_head == shared->cq_tail) {
+		return NULL;
+	}
+
+	// The entry was written before the tail was advanced
+	__asm__ volatile("" : : : "memory");
+
+	return &shared->cqes[shared->cq_head & (URING_CQ_ENTRIES - 1)];
+}
+
+/*
+ * Waits for a completion.
+ */
+int uring_wait_cqe(uring_t *ring, uring_cqe_t **cqe) {
+	while(!(*cqe = uring_peek_cqe(ring))) {
+		int ret = uring_enter_syscall(1, URING_ENTER_GETEVENTS);
+
+		if(ret < 0) {
+			return -ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Gives the oldest completion back to the kernel.
+ */
+void uring_cqe_seen(uring_t *ring) {
+	__asm__ volatile("" : : : "memory");
+	ring->shared->cq_head++;
+}
+
+void uring_prep_console_write(uring_sqe_t *sqe, const void *buf, uint32_t len, uint32_t user_data) {
+	sqe->opcode = URING_OP_CONSOLE_WRITE;
+	sqe->user_data = user_data;
+	sqe->addr = (void *) buf;
+	sqe->len = len;
+}
+
+void uring_prep_read(uring_sqe_t *sqe, const char *mount, const char *path, void *buf, uint32_t len, uint32_t user_data) {
+	sqe->opcode = URING_OP_VFS_READ;
+	sqe->user_data = user_data;
+	sqe->addr = buf;
+	sqe->len = len;
+	sqe->mount = mount;
+	sqe->path = path;
+}
+
+void uring_prep_write(uring_sqe_t *sqe, const char *mount, const char *path, const void *buf, uint32_t len, uint32_t user_data) {
+	sqe->opcode = URING_OP_VFS_WRITE;
+	sqe->user_data = user_data;
+	sqe->addr = (void *) buf;
+	sqe->len = len;
+	sqe->mount = mount;
+	sqe->path = path;
+}
+
+void uring_prep_timeout(uring_sqe_t *sqe, uint64_t timeout_ns, uint32_t user_data) {
+	sqe->opcode = URING_OP_TIMEOUT;
+	sqe->user_data = user_data;
+	sqe->timeout_ns = timeout_ns;
+}
+
+void uring_prep_fd_write(uring_sqe_t *sqe, int fd, const void *buf, uint32_t len, uint32_t user_data) {
+	sqe->opcode = URING_OP_WRITE;
+	sqe->user_data = user_data;
+	sqe->fd = fd;
+	sqe->addr = (void *) buf;
+	sqe->len = len;
+}
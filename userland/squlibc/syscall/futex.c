@@ -0,0 +1,16 @@
+#include "syscalls_internal.h"
+
+/*
+ * Sleeps until futex_wake is called on addr, unless it no longer contains
+ * expected. Returns 0 when woken up, or a negative error code.
+ */
+int futex_wait(volatile uint32_t *addr, uint32_t expected, uint64_t timeout_ns) {
+	return do_syscall(SYSCALL_FUTEX_WAIT, (uint32_t) addr, expected, (uint32_t) timeout_ns, (uint32_t) (timeout_ns >> 32), 0);
+}
+
+/*
+ * Wakes up at most count threads sleeping on addr.
+ */
+int futex_wake(volatile uint32_t *addr, uint32_t count) {
+	return do_syscall(SYSCALL_FUTEX_WAKE, (uint32_t) addr, count, 0, 0, 0);
+}
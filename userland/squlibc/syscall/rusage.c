@@ -0,0 +1,17 @@
+#include "syscalls_internal.h"
+#include <resource.h>
+
+/*
+ * Gets the resource usage of the calling process, or of the calling thread
+ * alone. Returns 0, or -1 with errno set.
+ */
+int getrusage(int who, struct rusage *usage) {
+	int ret = do_syscall(SYSCALL_GETRUSAGE, who, (uint32_t) usage, 0, 0, 0);
+
+	if(ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
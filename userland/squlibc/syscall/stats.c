@@ -0,0 +1,10 @@
+#include "syscalls_internal.h"
+#include <syscall_stats.h>
+
+/*
+ * Gets the statistics of syscall number, either system-wide or for the
+ * calling thread. Returns 0, or a negative error code.
+ */
+int syscall_stats(unsigned int number, syscall_stats_t *stats, int scope) {
+	return do_syscall(SYSCALL_SYSCALL_STATS, number, (uint32_t) stats, scope, 0, 0);
+}
@@ -1,14 +1,24 @@
 #include "syscalls_internal.h"
 
-int do_syscall(int num, void* info) {
-	uint32_t syscall_return;
+/*
+ * Makes a syscall with up to five arguments, which go in EBX, ECX, EDX, ESI and
+ * EDI; the number goes in EAX, and the result comes back in it.
+ *
+ * SYSEXIT returns to the EIP and ESP in EDX and ECX, so those two arguments
+ * are saved on the stack along with EBP and the return address, and the stack
+ * pointer is passed to the kernel in EBP. It returns with ESP pointing at the
+ * return address.
+ */
+int do_syscall(int num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t arg5) {
+	int syscall_return;
 
-	// Use sysenter mechanism for syscall
-	__asm__ volatile("mov %%esp, %%ecx; mov %0, %%ebx; mov %1, %%eax; mov $.+7, %%edx; sysenter;"
+	__asm__ volatile("push %%ebp; push %%edx; push %%ecx; push $1f; mov %%esp, %%ebp; sysenter;"
+		"1: add $4, %%esp; pop %%ecx; pop %%edx; pop %%ebp;"
 		: "=a" (syscall_return)
-		: "r" (num), "r" (info));
+		: "0" (num), "b" (arg1), "c" (arg2), "d" (arg3), "S" (arg4), "D" (arg5)
+		: "memory", "cc");
 
 	// Set error number, return
 	errno = syscall_return;
 	return syscall_return;
-}
\ No newline at end of file
+}
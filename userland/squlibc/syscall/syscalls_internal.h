@@ -12,12 +12,17 @@
 #include "syscall_num.h"
 
 // Internal functions
-__attribute__((visibility("internal"))) int do_syscall(int num, void* info);
+__attribute__((visibility("internal"))) int do_syscall(int num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t arg5);
 
-// Syscall structures
-typedef struct {
-	void *data;
-	size_t count;
-	size_t size;
-	FILE* file;
-} syscall_write_struct;
\ No newline at end of file
+// Futexes; timeout_ns is relative, 0 waits forever
+__attribute__((visibility("internal"))) int futex_wait(volatile uint32_t *addr, uint32_t expected, uint64_t timeout_ns);
+__attribute__((visibility("internal"))) int futex_wake(volatile uint32_t *addr, uint32_t count);
+
+// Threads; see thread/pthread.c
+__attribute__((visibility("internal"))) int thread_create(void *entry, uint32_t arg0, uint32_t arg1);
+__attribute__((visibility("internal"))) void thread_exit(uint32_t value) __attribute__((noreturn));
+__attribute__((visibility("internal"))) int thread_join(uint32_t tid, uint32_t *value);
+
+// Submission and completion rings; see io/uring.c
+__attribute__((visibility("internal"))) int uring_setup_syscall(uint32_t flags);
+__attribute__((visibility("internal"))) int uring_enter_syscall(uint32_t min_complete, uint32_t flags);
@@ -0,0 +1,25 @@
+#include "syscalls_internal.h"
+
+/*
+ * Creates a thread in this process, which starts executing at entry with arg0
+ * and arg1 in EAX and EDX. Returns its ID, or a negative error code.
+ */
+int thread_create(void *entry, uint32_t arg0, uint32_t arg1) {
+	return do_syscall(SYSCALL_THREAD_CREATE, (uint32_t) entry, arg0, arg1, 0, 0);
+}
+
+/*
+ * Ends the calling thread; value is handed to whoever joins it.
+ */
+void thread_exit(uint32_t value) {
+	do_syscall(SYSCALL_THREAD_EXIT, value, 0, 0, 0, 0);
+
+	while(1);
+}
+
+/*
+ * Waits for a thread to exit, and gets the value it exited with.
+ */
+int thread_join(uint32_t tid, uint32_t *value) {
+	return do_syscall(SYSCALL_THREAD_JOIN, tid, (uint32_t) value, 0, 0, 0);
+}
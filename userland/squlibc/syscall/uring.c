@@ -0,0 +1,17 @@
+#include "syscalls_internal.h"
+
+/*
+ * Creates this process' rings. Returns the address they're mapped at, or a
+ * negative error code.
+ */
+int uring_setup_syscall(uint32_t flags) {
+	return do_syscall(SYSCALL_URING_SETUP, flags, 0, 0, 0, 0);
+}
+
+/*
+ * Has the kernel consume the submission ring, and, with URING_ENTER_GETEVENTS,
+ * waits for min_complete completions.
+ */
+int uring_enter_syscall(uint32_t min_complete, uint32_t flags) {
+	return do_syscall(SYSCALL_URING_ENTER, min_complete, flags, 0, 0, 0);
+}
@@ -0,0 +1,56 @@
+#include "thread_internal.h"
+#include <syscall/syscalls_internal.h>
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
+	cond->seq = 0;
+	cond->waiters = 0;
+
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond) {
+	return cond->waiters ? EBUSY : 0;
+}
+
+/*
+ * Releases the mutex and waits for the condition to be signalled, then takes
+ * the mutex again. The sequence number is read before the mutex is released,
+ * so if a signal comes in between, the kernel sees it changed and returns
+ * right away. Like with any condition variable, wakeups may be spurious.
+ */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+	__sync_fetch_and_add(&cond->waiters, 1);
+	uint32_t seq = cond->seq;
+
+	pthread_mutex_unlock(mutex);
+	futex_wait(&cond->seq, seq, 0);
+
+	__sync_fetch_and_sub(&cond->waiters, 1);
+
+	// Other waiters may have been woken too, so the mutex counts as contended
+	mutex_lock_contended(mutex);
+	return 0;
+}
+
+/*
+ * Wakes up one waiter. Without waiters, this doesn't enter the kernel.
+ */
+int pthread_cond_signal(pthread_cond_t *cond) {
+	__sync_fetch_and_add(&cond->seq, 1);
+
+	if(cond->waiters) {
+		futex_wake(&cond->seq, 1);
+	}
+
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+	__sync_fetch_and_add(&cond->seq, 1);
+
+	if(cond->waiters) {
+		futex_wake(&cond->seq, INT_MAX);
+	}
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "thread_internal.h"
+#include <syscall/syscalls_internal.h>
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr) {
+	mutex->state = MUTEX_UNLOCKED;
+	return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+	return (mutex->state == MUTEX_UNLOCKED) ? 0 : EBUSY;
+}
+
+/*
+ * Slow path: marks the mutex as contended, and sleeps until it's released.
+ * Whoever takes it this way leaves it marked, since other threads may still
+ * be waiting, so its unlock wakes one of them.
+ */
+void mutex_lock_contended(pthread_mutex_t *mutex) {
+	while(__sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED) != MUTEX_UNLOCKED) {
+		futex_wait(&mutex->state, MUTEX_CONTENDED, 0);
+	}
+}
+
+/*
+ * Takes the mutex. If it's free, this is a single compare-and-swap.
+ */
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+	if(__builtin_expect(__sync_bool_compare_and_swap(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED), 1)) {
+		return 0;
+	}
+
+	mutex_lock_contended(mutex);
+	return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+	if(__sync_bool_compare_and_swap(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED)) {
+		return 0;
+	}
+
+	return EBUSY;
+}
+
+/*
+ * Releases the mutex. The kernel is only asked to wake a waiter if the mutex
+ * was marked as contended.
+ */
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+	if(__builtin_expect(__sync_fetch_and_sub(&mutex->state, 1) == MUTEX_LOCKED, 1)) {
+		return 0;
+	}
+
+	mutex->state = MUTEX_UNLOCKED;
+	futex_wake(&mutex->state, 1);
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include "thread_internal.h"
+#include <syscall/syscalls_internal.h>
+
+// Thread-local block at the base of the TLS segment
+typedef struct {
+	// Address of this block, so it can be found with a single GS load
+	void *self;
+	pthread_t tid;
+} pthread_tcb_t;
+
+/*
+ * New threads start here, with the start routine in EAX, its argument in EDX,
+ * the thread's ID in ECX, and the address of its TLS block in EBX and ESP.
+ */
+void pthread_entry_trampoline(void);
+
+__asm__(".text\n"
+	".globl pthread_entry_trampoline\n"
+	"pthread_entry_trampoline:\n"
+	"	push %ebx\n"
+	"	push %ecx\n"
+	"	push %edx\n"
+	"	push %eax\n"
+	"	call pthread_start\n");
+
+/*
+ * Sets up the thread's TLS block and runs its start routine; returning from
+ * it is the same as calling pthread_exit.
+ */
+__attribute__((used, noreturn)) static void pthread_start(void *(*start_routine)(void *), void *arg, pthread_t tid, pthread_tcb_t *tcb) {
+	tcb->self = tcb;
+	tcb->tid = tid;
+
+	pthread_exit(start_routine(arg));
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg) {
+	int ret = thread_create(pthread_entry_trampoline, (uint32_t) start_routine, (uint32_t) arg);
+
+	if(ret < 0) {
+		return -ret;
+	}
+
+	*thread = ret;
+	return 0;
+}
+
+int pthread_join(pthread_t thread, void **value) {
+	uint32_t exit_value;
+	int ret = thread_join(thread, &exit_value);
+
+	if(ret < 0) {
+		return -ret;
+	}
+
+	if(value) {
+		*value = (void *) exit_value;
+	}
+
+	return 0;
+}
+
+void pthread_exit(void *value) {
+	thread_exit((uint32_t) value);
+}
+
+/*
+ * Returns the calling thread's ID. The main thread has no TLS block, and its
+ * ID isn't known, so it gets 0.
+ */
+pthread_t pthread_self(void) {
+	uint16_t gs;
+	__asm__("mov %%gs, %0" : "=r" (gs));
+
+	if((gs & ~3) != PTHREAD_TLS_SEG) {
+		return 0;
+	}
+
+	pthread_tcb_t *tcb;
+	__asm__("mov %%gs:0, %0" : "=r" (tcb));
+
+	return tcb->tid;
+}
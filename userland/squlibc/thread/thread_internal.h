@@ -0,0 +1,21 @@
+#if !defined(__cplusplus)
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdint-gcc.h>
+#include <limits.h>
+
+#include <pthread.h>
+
+#include "errno.h"
+
+// Mutex states
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+#define MUTEX_CONTENDED 2
+
+// Takes a mutex that may have waiters; used after waking up in cond_wait
+__attribute__((visibility("internal"))) void mutex_lock_contended(pthread_mutex_t *mutex);
+
+// Selector of the kernel's thread TLS segment (without the RPL)
+#define PTHREAD_TLS_SEG 0x38
@@ -0,0 +1,91 @@
+#include "time_internal.h"
+#include <syscall/syscalls_internal.h>
+
+static inline uint64_t rdtsc(void) {
+	uint64_t ret;
+	__asm__ volatile("rdtsc" : "=A" (ret));
+	return ret;
+}
+
+/*
+ * Multiplies a 64-bit value by a 32-bit value and shifts the 96-bit result
+ * right; same as the kernel's clock_mul_u64_u32_shr.
+ */
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mul, uint32_t shift) {
+	uint32_t high = a >> 32;
+	uint32_t low = a & 0xFFFFFFFF;
+
+	uint64_t ret = ((uint64_t) low * mul) >> shift;
+
+	if(high) {
+		ret += ((uint64_t) high * mul) << (32 - shift);
+	}
+
+	return ret;
+}
+
+/*
+ * Splits nanoseconds into seconds and nanoseconds, with a single DIVL; the
+ * quotient fits into 32 bits for the next 136 years.
+ */
+static inline void ns_to_timespec(uint64_t ns, struct timespec *ts) {
+	uint32_t sec, rem;
+
+	__asm__("divl %4" : "=a" (sec), "=d" (rem) : "a" ((uint32_t) ns), "d" ((uint32_t) (ns >> 32)), "rm" (NSEC_PER_SEC));
+
+	ts->tv_sec = sec;
+	ts->tv_nsec = rem;
+}
+
+/*
+ * Reads a clock from the kernel's time page, retrying while the kernel is
+ * updating it. If the kernel's clock isn't the TSC, the syscall is used.
+ */
+int clock_gettime(clockid_t clock, struct timespec *ts) {
+	vdso_time_t *vdso = (vdso_time_t *) VDSO_ADDR;
+	uint32_t seq;
+	uint64_t ns;
+
+	if(clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if(!vdso->is_tsc) {
+		int ret = do_syscall(SYSCALL_CLOCK_GETTIME, clock, (uint32_t) ts, 0, 0, 0);
+		return (ret < 0) ? -1 : 0;
+	}
+
+	do {
+		seq = vdso->seq;
+		__asm__ volatile("" : : : "memory");
+
+		ns = vdso->base_ns + mul_u64_u32_shr(rdtsc() - vdso->base_cycles, vdso->mult, vdso->shift);
+
+		if(clock == CLOCK_REALTIME) {
+			ns += vdso->realtime_offset_ns;
+		}
+
+		__asm__ volatile("" : : : "memory");
+	} while((seq & 1) || seq != vdso->seq);
+
+	ns_to_timespec(ns, ts);
+	return 0;
+}
+
+int gettimeofday(struct timeval *tv, struct timezone *tz) {
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_REALTIME, &ts) != 0) {
+		return -1;
+	}
+
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+
+	if(tz) {
+		tz->tz_minuteswest = tz->tz_dsttime = 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include "time_internal.h"
+#include <syscall/syscalls_internal.h>
+
+// Layout of the kernel's itimer_spec_t
+typedef struct {
+	uint64_t value_ns;
+	uint64_t interval_ns;
+	uint32_t user_data;
+} __attribute__((packed)) itimer_spec_t;
+
+static inline uint64_t timespec_to_ns(const struct timespec *ts) {
+	return ((uint64_t) ts->tv_sec * NSEC_PER_SEC) + ts->tv_nsec;
+}
+
+static inline int time_result(int ret) {
+	if(ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req, struct timespec *rem) {
+	if(req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= NSEC_PER_SEC) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	uint64_t ns = timespec_to_ns(req);
+
+	return time_result(do_syscall(SYSCALL_CLOCK_NANOSLEEP, clock, flags, (uint32_t) ns, (uint32_t) (ns >> 32), 0));
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+	return clock_nanosleep(CLOCK_MONOTONIC, 0, req, rem);
+}
+
+int itimer_create(clockid_t clock) {
+	return time_result(do_syscall(SYSCALL_ITIMER_CREATE, clock, 0, 0, 0, 0));
+}
+
+/*
+ * Arms a timer to expire at value->it_value, and then every
+ * value->it_interval, if that isn't zero. An it_value of zero disarms it.
+ */
+int itimer_settime(int fd, int flags, const struct itimerspec *value, uint32_t user_data) {
+	itimer_spec_t spec;
+
+	spec.value_ns = timespec_to_ns(&value->it_value);
+	spec.interval_ns = timespec_to_ns(&value->it_interval);
+	spec.user_data = user_data;
+
+	return time_result(do_syscall(SYSCALL_ITIMER_SETTIME, fd, flags, (uint32_t) &spec, 0, 0));
+}
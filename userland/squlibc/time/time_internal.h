@@ -0,0 +1,28 @@
+#if !defined(__cplusplus)
+#include <stdbool.h>
+#endif
+#include <stddef.h>
+#include <stdint-gcc.h>
+#include <limits.h>
+
+#include <time.h>
+
+#include "errno.h"
+
+// Where the kernel maps the time page, and its layout (the kernel's vdso.h)
+#define VDSO_ADDR 0xBFFFF000
+
+typedef struct {
+	volatile uint32_t seq;
+	uint32_t is_tsc;
+
+	uint32_t mult;
+	uint32_t shift;
+
+	uint64_t base_cycles;
+	uint64_t base_ns;
+
+	uint64_t realtime_offset_ns;
+} vdso_time_t;
+
+#define NSEC_PER_SEC 1000000000